@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <neural-graphics-primitives/batched_adam_optimizer.h>
 #include <neural-graphics-primitives/common.h>
 #include <neural-graphics-primitives/common_device.cuh>
 #include <neural-graphics-primitives/json_binding.h>
@@ -308,4 +309,46 @@ inline void from_json(const nlohmann::json& j, RotationAdamOptimizer& opt) {
 	opt.from_json(j);
 }
 
+// Device variant of BatchedAdamOptimizer::step() for items that step in lockstep and without L2 regularization. Keeps
+// the moments on the GPU and updates a device array of the variables in place, such that neither the gradients nor the
+// variables make a round trip through host memory. Rounds exactly like the host.
+class GpuBatchedAdamOptimizer {
+public:
+	bool active() const { return m_active; }
+
+	// Takes over the state of `opt`, whose variables must already be in the device array that step() updates. Returns
+	// false and stays inactive if the items of `opt` are not in lockstep.
+	bool upload(const BatchedAdamOptimizer& opt, cudaStream_t stream);
+	void step(const float* gradient_gpu, float gradient_scale, float learning_rate, float* variables_gpu, cudaStream_t stream);
+	// Hands the state back to `opt`, which is authoritative again afterwards.
+	void download(BatchedAdamOptimizer& opt, const float* variables_gpu, cudaStream_t stream);
+
+private:
+	bool m_active = false;
+	uint32_t m_iter = 0;
+	size_t m_n_params = 0;
+	float m_epsilon = 0.0f;
+	float m_beta1 = 0.0f;
+	float m_beta2 = 0.0f;
+	tcnn::GPUMemory<float> m_first_moment;
+	tcnn::GPUMemory<float> m_second_moment;
+};
+
+struct BatchedAdamBenchmark {
+	uint32_t n_items;
+	uint32_t dims;
+	uint32_t n_steps;
+	// Per step of all items: one VarAdamOptimizer per item as in the original training loop, BatchedAdamOptimizer on
+	// one thread and on a thread pool, and GpuBatchedAdamOptimizer.
+	double per_item_ms;
+	double batched_ms;
+	double batched_parallel_ms;
+	double gpu_ms;
+	// Largest difference of a variable from the per-item optimizers' after all steps
+	float max_abs_difference;
+	float max_abs_difference_gpu;
+};
+
+BatchedAdamBenchmark benchmark_batched_adam(uint32_t n_items, uint32_t dims, uint32_t n_steps, ThreadPool* pool);
+
 NGP_NAMESPACE_END
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   adaptive_sampling.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Convergence criterion and tile scheduling for adaptive sampling of offline renders.
+ *          The per-pixel criterion is shared between host and device; the host tile scheduler
+ *          is the reference implementation of what the render buffer does on the GPU.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <stdexcept>
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+struct AdaptiveSamplingSettings {
+	bool enabled = false;
+	// Convergence is decided per tile: a tile keeps sampling as long as any of its pixels has not converged.
+	uint32_t tile_size = 16;
+	uint32_t min_spp = 4;
+	uint32_t max_spp = 64;
+	// Threshold on the variance of the per-pixel mean estimate, relative to the squared mean.
+	float relative_variance_threshold = 1e-3f;
+};
+
+inline NGP_HOST_DEVICE float sample_luminance(const vec3& rgb) {
+	return dot(rgb, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Variance of the mean of `n` samples with running mean `mean` and running second moment `second_moment`,
+// relative to the squared mean. The small constant keeps (near-)black pixels from never converging.
+inline NGP_HOST_DEVICE float relative_variance_of_mean(float mean, float second_moment, uint32_t n) {
+	if (n < 2) {
+		return 1e30f;
+	}
+
+	float variance = fmaxf(second_moment - mean * mean, 0.0f) * (float)n / (float)(n - 1);
+	return variance / ((float)n * (mean * mean + 1e-4f));
+}
+
+inline NGP_HOST_DEVICE bool pixel_converged(float mean, float second_moment, uint32_t n, uint32_t min_spp, uint32_t max_spp, float threshold) {
+	if (n >= max_spp) {
+		return true;
+	}
+
+	return n >= min_spp && relative_variance_of_mean(mean, second_moment, n) <= threshold;
+}
+
+inline ivec2 adaptive_tile_resolution(const ivec2& resolution, uint32_t tile_size) {
+	if (tile_size == 0) {
+		throw std::runtime_error{"Adaptive sampling tile size must be positive."};
+	}
+
+	return (resolution + ivec2((int)tile_size - 1)) / (int)tile_size;
+}
+
+// Host reference of the tile scheduler. Marks each tile active if any of its pixels has not converged
+// and returns the number of active tiles. All per-pixel inputs are row-major with `resolution` entries.
+inline uint32_t compute_active_tiles(
+	const ivec2& resolution,
+	const float* luminance_mean,
+	const float* luminance_second_moment,
+	const uint32_t* sample_counts,
+	const AdaptiveSamplingSettings& settings,
+	std::vector<uint8_t>& tile_active
+) {
+	ivec2 tile_res = adaptive_tile_resolution(resolution, settings.tile_size);
+	tile_active.assign(compMul(tile_res), 0);
+
+	for (int y = 0; y < resolution.y; ++y) {
+		for (int x = 0; x < resolution.x; ++x) {
+			size_t idx = x + (size_t)y * resolution.x;
+			if (!pixel_converged(luminance_mean[idx], luminance_second_moment[idx], sample_counts[idx], settings.min_spp, settings.max_spp, settings.relative_variance_threshold)) {
+				tile_active[x / settings.tile_size + (y / settings.tile_size) * tile_res.x] = 1;
+			}
+		}
+	}
+
+	uint32_t n_active = 0;
+	for (uint8_t a : tile_active) {
+		n_active += a;
+	}
+
+	return n_active;
+}
+
+// Expands per-tile activity into the per-pixel mask that ray generation consumes.
+inline void expand_tile_mask(const ivec2& resolution, uint32_t tile_size, const std::vector<uint8_t>& tile_active, std::vector<uint8_t>& pixel_mask) {
+	ivec2 tile_res = adaptive_tile_resolution(resolution, tile_size);
+	pixel_mask.resize(compMul(resolution));
+
+	for (int y = 0; y < resolution.y; ++y) {
+		for (int x = 0; x < resolution.x; ++x) {
+			pixel_mask[x + (size_t)y * resolution.x] = tile_active[x / tile_size + (y / tile_size) * tile_res.x];
+		}
+	}
+}
+
+NGP_NAMESPACE_END
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   baked_nerf.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Sparse voxel bakes of trained NeRFs for lightweight viewers. Density and view-dependent color, as
+ *          low-order spherical harmonics, are stored for the voxels of those bricks that overlap occupied cells
+ *          of the density grid. An occupancy bitfield marks the allocated bricks, which are stored in the
+ *          order of their bits. BakedNerf renders the format on the CPU, without CUDA and without evaluating
+ *          the network.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/thread_pool.h>
+
+#include <string>
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+// File layout, little endian:
+//   BakedNerfHeader
+//   uint64_t occupancy[ceil(n_bricks.x * n_bricks.y * n_bricks.z / 64)]   one bit per brick, x-major; bit i of
+//            word w belongs to brick 64 * w + i
+//   uint16_t voxels[n_allocated_bricks][brick_size^3][1 + 3 * n_sh_coeffs]   allocated bricks in x-major order,
+//            voxels x-major within a brick; half precision density followed by the RGB coefficients of each
+//            spherical harmonic
+static constexpr uint32_t BAKED_NERF_VERSION = 2;
+static constexpr uint32_t BAKED_NERF_BRICK_SIZE = 8;
+static constexpr uint32_t BAKED_NERF_EMPTY_BRICK = 0xFFFFFFFF;
+static constexpr uint32_t BAKED_NERF_MAX_SH_DEGREE = 2;
+// Largest finite half precision value
+static constexpr float BAKED_NERF_MAX_HALF = 65504.0f;
+
+struct BakedNerfHeader {
+	char magic[8] = {'N', 'G', 'P', 'B', 'A', 'K', 'E', '\0'};
+	uint32_t version = BAKED_NERF_VERSION;
+	uint32_t brick_size = BAKED_NERF_BRICK_SIZE;
+	// Highest spherical harmonics band, such that each color channel has (sh_degree+1)^2 coefficients.
+	uint32_t sh_degree = 1;
+	uint32_t n_allocated_bricks = 0;
+	uint32_t n_bricks[3] = {};
+
+	// The voxels tile the box [aabb_min, aabb_min + n_bricks * brick_size * voxel_size] of the space that
+	// render_aabb_to_local (column major) maps world positions into.
+	float voxel_size = 0.0f;
+	float aabb_min[3] = {};
+	float render_aabb_to_local[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+
+	// View at the time of baking, in the testbed's camera space. See BakedNerf::focal_length().
+	float camera[12] = {};
+	float relative_focal_length[2] = {1.0f, 1.0f};
+	int32_t fov_axis = 1;
+	float zoom = 1.0f;
+	float screen_center[2] = {0.5f, 0.5f};
+};
+
+static_assert(sizeof(BakedNerfHeader) == 160, "BakedNerfHeader must not contain padding.");
+
+inline NGP_HOST_DEVICE size_t baked_nerf_n_occupancy_words(size_t n_bricks) {
+	return (n_bricks + 63) / 64;
+}
+
+inline NGP_HOST_DEVICE uint32_t baked_nerf_n_sh_coeffs(uint32_t sh_degree) {
+	return (sh_degree + 1) * (sh_degree + 1);
+}
+
+inline NGP_HOST_DEVICE uint32_t baked_nerf_values_per_voxel(uint32_t sh_degree) {
+	return 1 + 3 * baked_nerf_n_sh_coeffs(sh_degree);
+}
+
+// Real spherical harmonics basis of bands 0 to `sh_degree` (at most 2) in the direction `d`, which must be normalized.
+// Shared by the bake and the renderer, such that both agree on the basis.
+inline NGP_HOST_DEVICE void baked_nerf_sh_basis(uint32_t sh_degree, const vec3& d, float* out) {
+	out[0] = 0.28209479177387814f;
+	if (sh_degree < 1) {
+		return;
+	}
+
+	out[1] = -0.48860251190291987f * d.y;
+	out[2] = 0.48860251190291987f * d.z;
+	out[3] = -0.48860251190291987f * d.x;
+	if (sh_degree < 2) {
+		return;
+	}
+
+	out[4] = 1.0925484305920792f * d.x * d.y;
+	out[5] = -1.0925484305920792f * d.y * d.z;
+	out[6] = 0.94617469575756002f * d.z * d.z - 0.31539156525252005f;
+	out[7] = -1.0925484305920792f * d.x * d.z;
+	out[8] = 0.54627421529603959f * (d.x * d.x - d.y * d.y);
+}
+
+// Directions at which the bake evaluates the color of each voxel, evenly spread over the sphere (Fibonacci lattice).
+std::vector<vec3> baked_nerf_fit_directions(uint32_t n_directions);
+
+// Least-squares fit of spherical harmonics coefficients to colors at `directions`: coefficient c of a channel is
+// sum_k matrix[c * n_directions + k] * color_k. Throws if the directions do not determine the coefficients.
+std::vector<float> baked_nerf_sh_fit_matrix(uint32_t sh_degree, const std::vector<vec3>& directions);
+
+// `occupancy` and `voxels` are laid out as in the file. Throws if the number of set bits does not match the header.
+void save_baked_nerf(const fs::path& path, const BakedNerfHeader& header, const std::vector<uint64_t>& occupancy, const std::vector<uint16_t>& voxels);
+
+struct BakedNerfRenderStats {
+	uint32_t n_rays = 0;
+	size_t n_samples = 0;
+	float ms = 0.0f;
+
+	double fps() const { return ms > 0.0f ? 1000.0 / ms : 0.0; }
+};
+
+class BakedNerf {
+public:
+	BakedNerf(const fs::path& path);
+
+	// Renders linear, premultiplied RGBA of a pinhole camera, one sample per pixel through the pixel centers, like
+	// CpuNerf::render(). `camera` is in the testbed's camera space and `focal_length` is in pixels.
+	std::vector<vec4> render(const ivec2& resolution, const mat4x3& camera, const vec2& focal_length, const vec2& screen_center);
+
+	// View at the time of baking
+	mat4x3 camera() const;
+	vec2 focal_length(const ivec2& resolution) const;
+	vec2 screen_center() const;
+
+	uint32_t n_threads() const { return m_n_threads; }
+	void set_n_threads(uint32_t n_threads);
+
+	// Ray marching step in voxels
+	float step_size = 0.5f;
+	float min_transmittance = 0.01f;
+
+	const BakedNerfHeader& header() const { return m_header; }
+	uint32_t n_sh_coeffs() const { return baked_nerf_n_sh_coeffs(m_header.sh_degree); }
+	size_t n_bytes() const;
+
+	const BakedNerfRenderStats& render_stats() const { return m_render_stats; }
+
+private:
+	// Trilinearly interpolated density and SH coefficients at `pos` in voxel units, where voxel centers lie at
+	// half-integer coordinates. Returns false if none of the 8 surrounding voxels is allocated.
+	bool sample(const vec3& pos, float* values) const;
+
+	// Index of the allocated brick at brick coordinates `b`, or BAKED_NERF_EMPTY_BRICK
+	uint32_t brick(const ivec3& b) const;
+
+	// Values of the voxel at integer coordinates `v`, or nullptr if it lies in an empty brick or outside the grid.
+	const float* voxel(const ivec3& v) const;
+
+	BakedNerfHeader m_header;
+	ivec3 m_n_bricks = ivec3(0);
+	ivec3 m_n_voxels = ivec3(0);
+	mat3 m_render_aabb_to_local = mat3(1.0f);
+	vec3 m_aabb_min = vec3(0.0f);
+	uint32_t m_values_per_voxel = 0;
+
+	std::vector<uint64_t> m_occupancy;
+	// Number of allocated bricks before each occupancy word, such that a brick's index is the rank of its bit.
+	std::vector<uint32_t> m_occupancy_rank;
+	// Converted to single precision on load to keep half conversions out of the render loop.
+	std::vector<float> m_voxels;
+
+	uint32_t m_n_threads = 0;
+	ThreadPool m_pool;
+
+	BakedNerfRenderStats m_render_stats;
+};
+
+NGP_NAMESPACE_END
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   batched_adam_optimizer.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Adam over many small, independent parameter vectors (one per training camera) that are stored in
+ *          contiguous arrays and stepped together, vectorized and in parallel. Free of CUDA.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <json/json.hpp>
+
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+class ThreadPool;
+
+enum class EBatchedAdamUpdate : int {
+	// variable -= update, as AdamOptimizer
+	Subtract,
+	// Leaves the variables untouched and stores the updates for the caller to apply, e.g. as rotations
+	Deferred,
+};
+
+class BatchedAdamOptimizer {
+public:
+	BatchedAdamOptimizer(uint32_t dims = 0, float learning_rate = 1e-3f, float epsilon = 1e-08f, float beta1 = 0.9f, float beta2 = 0.99f)
+	: m_dims{dims}, m_default_learning_rate{learning_rate}, m_epsilon{epsilon}, m_beta1{beta1}, m_beta2{beta2} {}
+
+	size_t size() const { return m_iter.size(); }
+	uint32_t dims() const { return m_dims; }
+
+	// Appends items with zeroed state and the default learning rate, or drops trailing items.
+	void resize(size_t n_items);
+
+	// Item i's parameters are dims() consecutive floats.
+	float* variable(size_t i) { return m_variable.data() + i * m_dims; }
+	const float* variable(size_t i) const { return m_variable.data() + i * m_dims; }
+
+	// Item i's parameters as a vector type of dims() floats, e.g. vec3
+	template <typename T>
+	T& variable_as(size_t i) {
+		check_type_size(sizeof(T));
+		return *(T*)variable(i);
+	}
+
+	template <typename T>
+	const T& variable_as(size_t i) const {
+		check_type_size(sizeof(T));
+		return *(const T*)variable(i);
+	}
+
+	// Parameters of all items, item after item
+	std::vector<float>& variables() { return m_variable; }
+	const std::vector<float>& variables() const { return m_variable; }
+	std::vector<float>& first_moments() { return m_first_moment; }
+	const std::vector<float>& first_moments() const { return m_first_moment; }
+	std::vector<float>& second_moments() { return m_second_moment; }
+	const std::vector<float>& second_moments() const { return m_second_moment; }
+
+	// Updates of the most recent step with EBatchedAdamUpdate::Deferred
+	const float* update(size_t i) const { return m_update.data() + i * m_dims; }
+
+	uint32_t step(size_t i) const { return m_iter.at(i); }
+
+	void set_learning_rate(float lr);
+	void set_learning_rate(size_t i, float lr) { m_learning_rate.at(i) = lr; }
+	float learning_rate(size_t i) const { return m_learning_rate.at(i); }
+
+	float epsilon() const { return m_epsilon; }
+	float beta1() const { return m_beta1; }
+	float beta2() const { return m_beta2; }
+
+	// Zeroes the state, including the variables, like AdamOptimizer::reset_state()
+	void reset_state(size_t i);
+	void reset_state();
+
+	// One Adam step of the first `n_items` items. `gradient` holds n_items*dims() floats, item after item. The gradient
+	// that enters the moments is gradient*gradient_scale + variable*l2_reg, which matches AdamOptimizer's results
+	// exactly. Uses AVX2 if available and spreads the items over `pool` if given.
+	void step(size_t n_items, const float* gradient, float gradient_scale = 1.0f, float l2_reg = 0.0f, EBatchedAdamUpdate update = EBatchedAdamUpdate::Subtract, ThreadPool* pool = nullptr);
+
+	// Overrides the iteration count of all items, e.g. after they were stepped elsewhere in lockstep.
+	void set_steps(uint32_t iter);
+
+	// Same layout as a std::vector of per-item AdamOptimizer/VarAdamOptimizer/RotationAdamOptimizer, such that
+	// snapshots remain compatible.
+	void to_json(nlohmann::json& j) const;
+	void from_json(const nlohmann::json& j);
+
+private:
+	void check_type_size(size_t n_bytes) const;
+
+	uint32_t m_dims;
+	float m_default_learning_rate;
+	float m_epsilon;
+	float m_beta1;
+	float m_beta2;
+
+	// Per item
+	std::vector<uint32_t> m_iter;
+	std::vector<float> m_learning_rate;
+
+	// Per parameter
+	std::vector<float> m_variable;
+	std::vector<float> m_first_moment;
+	std::vector<float> m_second_moment;
+	std::vector<float> m_update;
+	// Bias-corrected learning rate of each parameter's item during a step, such that the update is elementwise
+	std::vector<float> m_step_size;
+};
+
+inline void to_json(nlohmann::json& j, const BatchedAdamOptimizer& opt) {
+	opt.to_json(j);
+}
+
+inline void from_json(const nlohmann::json& j, BatchedAdamOptimizer& opt) {
+	opt.from_json(j);
+}
+
+NGP_NAMESPACE_END
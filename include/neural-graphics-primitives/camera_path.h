@@ -76,6 +76,12 @@ struct CameraPath {
 	// with animation then returning back to the first frame, making a continuous loop.
 	// Note that the user does not have to (and should not normally) duplicate the first frame to be the last frame.
 	bool loop = false;
+	// If set, path time is reparameterized by path length, such that the camera moves at constant speed
+	// regardless of how the keyframes are spaced.
+	bool constant_speed = false;
+	// Path length is measured as translation plus this factor times rotation (in radians), so that
+	// segments that mostly rotate in place are not traversed instantaneously.
+	float angular_length_weight = 0.1f;
 
 	struct RenderSettings {
 		ivec2 resolution = {1920, 1080};
@@ -116,7 +122,7 @@ struct CameraPath {
 			return keyframes[tcnn::clamp(i, 0, (int)keyframes.size()-1)];
 		}
 	}
-	CameraKeyframe eval_camera_path(float t) {
+	CameraKeyframe eval_spline(float t) {
 		if (keyframes.empty())
 			return {};
 		// make room for last frame == first frame when looping
@@ -125,6 +131,24 @@ struct CameraPath {
 		return spline(t-floorf(t), get_keyframe(t1-1), get_keyframe(t1), get_keyframe(t1+1), get_keyframe(t1+2));
 	}
 
+	CameraKeyframe eval_camera_path(float t) {
+		return eval_spline(constant_speed ? spline_time(t) : t);
+	}
+
+	// Evaluates the path at many times at once, e.g. all frames of a render job. The length tables are
+	// built at most once for the whole batch.
+	std::vector<CameraKeyframe> eval_many(const std::vector<float>& ts);
+
+	// Maps path time in [0,1] to the spline parameter at which the path has covered the same fraction
+	// of its total length. O(1) lookup into a table that is rebuilt lazily after keyframe edits.
+	float spline_time(float t);
+	float arc_length();
+	float angular_length();
+
+	// Must be called after every edit of `keyframes`, such that the length tables are rebuilt on their next use.
+	// Changes of `loop` and `angular_length_weight` are detected automatically.
+	void keyframes_changed() { ++m_keyframes_generation; }
+
 	void save(const fs::path& path);
 	void load(const fs::path& path, const mat4x3 &first_xform);
 
@@ -134,6 +158,23 @@ struct CameraPath {
 	int imgui(char path_filename_buf[1024], float frame_milliseconds, mat4x3& camera, float slice_plane_z, float scale, float fov, float aperture_size, float bounding_radius, const mat4x3& first_xform, int glow_mode, float glow_y_cutoff);
 	bool imgui_viz(ImDrawList* list, mat4& view2proj, mat4& world2proj, mat4& world2view, vec2 focal, float aspect, float znear, float zfar);
 #endif
+
+private:
+	void update_length_tables();
+
+	static constexpr uint32_t N_LENGTH_SAMPLES_PER_SEGMENT = 64;
+
+	bool m_length_tables_valid = false;
+	bool m_length_tables_loop = false;
+	float m_length_tables_angular_weight = 0.0f;
+	uint64_t m_keyframes_generation = 0;
+	uint64_t m_length_tables_keyframes_generation = 0;
+
+	// Cumulative lengths at uniformly spaced spline parameters.
+	std::vector<float> m_arc_length_table;
+	std::vector<float> m_angular_length_table;
+	// Spline parameter at uniformly spaced fractions of the combined path length.
+	std::vector<float> m_spline_time_table;
 };
 
 #ifdef NGP_GUI
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   chebyshev_distance.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Chebyshev (L-infinity) distance transform of occupancy grids. A cell at distance d from the nearest
+ *          occupied cell is the center of an empty cube of (2d-1)^3 cells, which lets rays skip the whole cube.
+ *          The transform is separable into one pass per axis; the per-line pass is shared by the host and the GPU.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+class ThreadPool;
+
+// Distances saturate at this value, which also stands for "no occupied cell".
+static constexpr uint8_t CHEBYSHEV_DISTANCE_MAX = 255;
+
+// One pass of the separable transform along a line of `n` cells: out[x] = min_y max(|x - y|, in[y]), where `in` is
+// the result of the passes along the previous axes, or 0 for occupied and CHEBYSHEV_DISTANCE_MAX for empty cells in
+// the first pass. Cells just outside the line count as occupied, such that empty cubes never extend past the grid.
+//
+// Runs in O(n): each sweep keeps a queue of candidate cells, ordered by position, whose costs max(|x - y|, in[y])
+// increase along the queue. A candidate that becomes no better than a later one never becomes better again.
+// `queue` must hold n+1 entries.
+inline NGP_HOST_DEVICE void chebyshev_distance_transform_line(uint32_t n, const uint8_t* in, uint8_t* out, int16_t* queue) {
+	auto value = [&](int y) -> int {
+		return (y < 0 || y >= (int)n) ? 0 : (int)in[y];
+	};
+
+	auto cost = [&](int y, int x) -> int {
+		int d = x > y ? x - y : y - x;
+		int v = value(y);
+		return d > v ? d : v;
+	};
+
+	// Sources at or before x
+	int head = 0, tail = 0;
+	queue[tail++] = -1;
+	for (int x = 0; x < (int)n; ++x) {
+		int fx = in[x];
+		while (tail > head && fx <= cost(queue[tail-1], x)) {
+			--tail;
+		}
+		queue[tail++] = (int16_t)x;
+
+		while (tail - head > 1 && cost(queue[head+1], x) <= cost(queue[head], x)) {
+			++head;
+		}
+
+		int c = cost(queue[head], x);
+		out[x] = (uint8_t)(c < CHEBYSHEV_DISTANCE_MAX ? c : CHEBYSHEV_DISTANCE_MAX);
+	}
+
+	// Sources at or after x
+	head = tail = 0;
+	queue[tail++] = (int16_t)n;
+	for (int x = (int)n - 1; x >= 0; --x) {
+		int fx = in[x];
+		while (tail > head && fx <= cost(queue[tail-1], x)) {
+			--tail;
+		}
+		queue[tail++] = (int16_t)x;
+
+		while (tail - head > 1 && cost(queue[head+1], x) <= cost(queue[head], x)) {
+			++head;
+		}
+
+		int c = cost(queue[head], x);
+		if (c < out[x]) {
+			out[x] = (uint8_t)c;
+		}
+	}
+}
+
+// Host implementation over a cubic grid of `res`^3 cells in x-major order (x + res * (y + res * z)), one nonzero
+// byte per occupied cell. Lines are distributed over the threads of `pool`, or processed serially without one.
+std::vector<uint8_t> chebyshev_distance_transform(const std::vector<uint8_t>& occupied, uint32_t res, ThreadPool* pool = nullptr);
+
+// Reference for a single cell by exhaustive search over all occupied cells and the grid boundary.
+uint8_t chebyshev_distance_brute_force(const std::vector<uint8_t>& occupied, uint32_t res, const ivec3& cell);
+
+NGP_NAMESPACE_END
@@ -149,6 +149,12 @@ enum class ENerfActivation : int {
 };
 static constexpr const char* NerfActivationStr = "None\0ReLU\0Logistic\0Exponential\0\0";
 
+enum class EErrorMapSampler : int {
+	Cdf,
+	Alias,
+};
+static constexpr const char* ErrorMapSamplerStr = "CDF\0Alias\0\0";
+
 enum class EMeshSdfMode : int {
 	Watertight,
 	Raystab,
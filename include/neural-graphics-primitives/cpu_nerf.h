@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   cpu_nerf.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Evaluates and renders trained NeRF snapshots on the CPU, for machines without a GPU.
+ *          Mirrors the hash grid encoding, the spherical harmonics direction encoding and the density
+ *          and color MLPs of NerfNetwork, as well as the occupancy-grid ray marcher of NerfTracer.
+ *          Free of CUDA, such that it can be built and run on any host.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/thread_pool.h>
+
+#include <json/json.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+enum class ECpuIsa : int {
+	Scalar,
+	Avx2,
+	Avx512,
+};
+static constexpr const char* CpuIsaStr = "Scalar\0AVX2\0AVX-512\0\0";
+
+// The widest instruction set that both this build and the executing CPU support.
+ECpuIsa best_cpu_isa();
+bool cpu_supports(ECpuIsa isa);
+const char* isa_name(ECpuIsa isa);
+
+struct CpuNerfReferenceCheck {
+	uint32_t n_samples = 0;
+	// Over the raw (pre-activation) color and density outputs of the network.
+	float max_abs_error = 0.0f;
+	float mean_abs_error = 0.0f;
+	// Outputs whose error exceeds abs_tolerance + rel_tolerance * |reference|.
+	uint32_t n_failed = 0;
+
+	bool passed() const { return n_samples > 0 && n_failed == 0; }
+};
+
+struct CpuNerfBenchmarkResult {
+	uint32_t n_threads;
+	double msamples_per_second;
+	// Throughput relative to the first measured thread count, scaled to one thread, divided by the thread count.
+	// 1 means perfect scaling.
+	double parallel_efficiency;
+};
+
+struct CpuNerfRenderStats {
+	uint32_t n_rays = 0;
+	size_t n_samples = 0;
+	float ms = 0.0f;
+
+	double msamples_per_second() const { return ms > 0.0f ? (double)n_samples / (ms * 1e3) : 0.0; }
+};
+
+class CpuNerf {
+public:
+	// Loads a .ingp or .msgpack snapshot that was saved by the testbed in NeRF mode.
+	CpuNerf(const fs::path& snapshot_path);
+	~CpuNerf();
+
+	// Number of floats per network input. Inputs are laid out like NerfCoordinate: the position warped into the unit
+	// cube of the scene's aabb, the warped step size, and the direction warped into [0,1]^3.
+	uint32_t n_input_dims() const { return 7; }
+
+	// Raw network outputs, i.e. color and density before their activations, 4 floats per input.
+	// `inputs` holds `n` rows of n_input_dims() floats.
+	void inference(const float* inputs, float* outputs, size_t n);
+
+	// Renders linear RGBA of a pinhole camera, one sample per pixel through the pixel centers. `camera` is in the
+	// same space as the testbed's camera matrix and `focal_length` is in pixels.
+	std::vector<vec4> render(const ivec2& resolution, const mat4x3& camera, const vec2& focal_length, const vec2& screen_center);
+
+	// Compares inference() against the outputs that Testbed::save_nerf_reference_outputs() stored for the same snapshot.
+	// The GPU evaluates the network in half precision, so the tolerances need to account for its rounding.
+	CpuNerfReferenceCheck check_reference(const fs::path& reference_path, float abs_tolerance = 5e-2f, float rel_tolerance = 2e-2f);
+
+	// Network throughput on `n_samples` random inputs for each of the given thread counts.
+	std::vector<CpuNerfBenchmarkResult> benchmark(size_t n_samples, const std::vector<uint32_t>& thread_counts, uint32_t n_repetitions = 3);
+
+	uint32_t n_threads() const { return m_n_threads; }
+	void set_n_threads(uint32_t n_threads);
+
+	ECpuIsa isa() const { return m_isa; }
+	void set_isa(ECpuIsa isa);
+
+	// Camera of the snapshot and the conversion of NeRF-convention poses into the testbed's camera space.
+	const mat4x3& camera() const { return m_camera; }
+	vec2 focal_length(const ivec2& resolution) const;
+	vec2 screen_center() const;
+	mat4x3 nerf_matrix_to_ngp(const mat4x3& nerf_matrix) const;
+
+	float cone_angle_constant = 0.0f;
+	float min_transmittance = 0.01f;
+
+	const CpuNerfRenderStats& render_stats() const { return m_render_stats; }
+
+	std::string architecture() const;
+
+private:
+	struct GridLevel {
+		float scale;
+		uint32_t resolution;
+		// Offset into the grid and number of entries, each entry holding n_features_per_level floats
+		uint32_t offset;
+		uint32_t hashmap_size;
+	};
+
+	struct Layer;
+	struct Mlp;
+	struct Scratch;
+
+	void load_network(const nlohmann::json& config, const std::vector<float>& params);
+	void load_density_grid(const std::vector<float>& density_grid);
+
+	void encode_position(const float* inputs, size_t input_stride, size_t n, float* out, size_t out_stride) const;
+	void encode_direction(const float* inputs, size_t input_stride, size_t n, float* out, size_t out_stride) const;
+	void dense(const Layer& layer, const float* in, size_t in_stride, size_t n, float* out, size_t out_stride) const;
+	void run_mlp(const Mlp& mlp, Scratch& scratch, const float* in, size_t in_stride, size_t n, float* out, size_t out_stride) const;
+
+	// Evaluates a batch of at most BATCH_SIZE inputs on the calling thread.
+	void inference_batch(Scratch& scratch, const float* inputs, float* outputs, size_t n) const;
+
+	// Runs `fn(task_index)` on each of the n_threads() workers and waits for all of them.
+	template <typename F>
+	void run_on_all_threads(F&& fn);
+
+	bool density_grid_occupied_at(const vec3& pos, uint32_t mip) const;
+	float advance_to_next_occupied_voxel(float t, float cone_angle, const Ray& ray, const vec3& idir) const;
+
+	// Hash grid encoding
+	std::vector<GridLevel> m_levels;
+	uint32_t m_n_features_per_level = 0;
+	uint32_t m_base_resolution = 0;
+	float m_per_level_scale = 0.0f;
+	uint32_t m_log2_hashmap_size = 0;
+	bool m_hash = true;
+	std::vector<float> m_grid;
+	uint32_t m_pos_encoding_width = 0;
+
+	// Direction encoding: spherical harmonics of the direction, padded with ones
+	uint32_t m_sh_degree = 0;
+	uint32_t m_dir_encoding_width = 0;
+
+	std::unique_ptr<Mlp> m_density_network;
+	std::unique_ptr<Mlp> m_rgb_network;
+	// The density network writes its output into the first columns of the color network's input.
+	uint32_t m_density_output_width = 0;
+	uint32_t m_rgb_network_input_width = 0;
+
+	ENerfActivation m_rgb_activation = ENerfActivation::Logistic;
+	ENerfActivation m_density_activation = ENerfActivation::Exponential;
+
+	// Scene
+	vec3 m_aabb_min = vec3(0.0f);
+	vec3 m_aabb_max = vec3(1.0f);
+	vec3 m_render_aabb_min = vec3(0.0f);
+	vec3 m_render_aabb_max = vec3(1.0f);
+	mat3 m_render_aabb_to_local = mat3(1.0f);
+	float m_nerf_scale = 1.0f;
+	vec3 m_nerf_offset = vec3(0.0f);
+	bool m_from_mitsuba = false;
+
+	mat4x3 m_camera = mat4x3(1.0f);
+	vec2 m_relative_focal_length = vec2(1.0f);
+	int m_fov_axis = 1;
+	float m_zoom = 1.0f;
+	vec2 m_screen_center = vec2(0.5f);
+
+	// Occupancy bitfield of all cascades, laid out like Testbed::Nerf::density_grid_bitfield
+	uint32_t m_grid_size = 0;
+	uint32_t m_n_cascades = 0;
+	uint32_t m_max_cascade = 0;
+	std::vector<uint8_t> m_density_grid_bitfield;
+
+	ECpuIsa m_isa = ECpuIsa::Scalar;
+	uint32_t m_n_threads = 0;
+	ThreadPool m_pool;
+	std::vector<std::unique_ptr<Scratch>> m_scratch;
+
+	CpuNerfRenderStats m_render_stats;
+};
+
+NGP_NAMESPACE_END
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   density_grid_schedule.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Host-side policy that adapts the NeRF density grid updates to how much the occupancy still changes.
+ *          Once few occupancy bits flip per training step, updates become rarer and query fewer samples, and
+ *          cascades that stopped changing can be left out. The flip counts arrive from the device with a delay.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <algorithm>
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+inline uint32_t all_cascades_mask(uint32_t n_cascades) {
+	return n_cascades >= 32 ? 0xFFFFFFFFu : (1u << n_cascades) - 1;
+}
+
+struct DensityGridScheduleConfig {
+	bool enabled = false;
+
+	// Fraction of the occupancy bits of the updated cascades that flip per training step. Below half of it, the
+	// interval between updates doubles and the number of samples per update halves; above twice of it, both return
+	// to their defaults.
+	float target_flip_rate = 1e-5f;
+	uint32_t max_interval_multiplier = 8;
+	float min_sample_fraction = 0.25f;
+
+	// Leaves out cascades whose flip rate fell below half the target, but updates every cascade at least once every
+	// `max_skipped_updates` updates, such that it can pick up late changes.
+	bool restrict_to_changed_cascades = false;
+	uint32_t max_skipped_updates = 4;
+
+	// The first updates of training always cover all cells.
+	uint32_t warmup_steps = 256;
+};
+
+class DensityGridSchedule {
+public:
+	const DensityGridScheduleConfig& config() const { return m_config; }
+	void set_config(const DensityGridScheduleConfig& config) {
+		m_config = config;
+		reset();
+	}
+
+	bool enabled() const { return m_config.enabled; }
+
+	// Forgets the measurements and the query counts, e.g. when training restarts.
+	void reset() {
+		m_interval_multiplier = 1;
+		m_sample_fraction = 1.0f;
+		m_flip_rate = 0.0f;
+		m_cascade_flip_rate.clear();
+		m_cascade_last_update_step.clear();
+		m_cascade_n_skipped.clear();
+		m_measurement = {};
+		m_n_measurements = 0;
+		m_next_accounted_step = 0;
+		m_any_accounted = false;
+		m_n_updates = 0;
+		m_n_default_updates = 0;
+		m_n_queries = 0;
+		m_n_default_queries = 0;
+	}
+
+	bool active(uint32_t step) const {
+		return m_config.enabled && step >= m_config.warmup_steps;
+	}
+
+	// Factor by which the interval between updates exceeds the default one
+	uint32_t interval_multiplier(uint32_t step) const {
+		return active(step) ? m_interval_multiplier : 1;
+	}
+
+	// Fraction of the default number of samples per update
+	float sample_fraction(uint32_t step) const {
+		return active(step) ? m_sample_fraction : 1.0f;
+	}
+
+	// Cascades to update at `step`. May be empty, in which case the update can be skipped altogether.
+	uint32_t cascade_mask(uint32_t step, uint32_t n_cascades) const {
+		uint32_t all = all_cascades_mask(n_cascades);
+		if (!active(step) || !m_config.restrict_to_changed_cascades || m_interval_multiplier == 1) {
+			return all;
+		}
+
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < n_cascades; ++i) {
+			// Cascades without a measurement yet count as changing.
+			bool changing = i >= m_cascade_flip_rate.size() || m_cascade_flip_rate[i] >= m_config.target_flip_rate / 2;
+			bool overdue = i >= m_cascade_n_skipped.size() || m_cascade_n_skipped[i] >= m_config.max_skipped_updates;
+			if (changing || overdue) {
+				mask |= 1u << i;
+			}
+		}
+
+		return mask & all;
+	}
+
+	// Records an update of the cascades in `mask` at `step` that issued `n_queries` network queries. The default
+	// schedule would have issued `n_default_queries` since the previous call. If `measured`, the caller will report
+	// the number of bits that the update flipped via report().
+	void record_update(uint32_t step, uint32_t n_cascades, uint32_t mask, uint64_t n_queries, uint64_t n_default_queries, bool measured) {
+		m_cascade_last_update_step.resize(n_cascades, step);
+		m_cascade_n_skipped.resize(n_cascades, 0);
+
+		if (measured) {
+			m_measurement.mask = mask;
+			m_measurement.n_steps.assign(n_cascades, 0);
+		}
+
+		for (uint32_t i = 0; i < n_cascades; ++i) {
+			if (!(mask & (1u << i))) {
+				++m_cascade_n_skipped[i];
+				continue;
+			}
+
+			if (measured) {
+				m_measurement.n_steps[i] = std::max(step - m_cascade_last_update_step[i], 1u);
+			}
+
+			m_cascade_last_update_step[i] = step;
+			m_cascade_n_skipped[i] = 0;
+		}
+
+		if (mask != 0) {
+			++m_n_updates;
+		}
+
+		m_n_queries += n_queries;
+		m_n_default_queries += n_default_queries;
+	}
+
+	// Number of bits that the measured update flipped in each of its cascades of `n_cells` cells
+	void report(const uint32_t* n_flipped_bits, uint32_t n_cascades, uint32_t n_cells) {
+		double n_flipped = 0.0;
+		double n_bit_steps = 0.0;
+
+		m_cascade_flip_rate.resize(n_cascades, m_config.target_flip_rate);
+		for (uint32_t i = 0; i < n_cascades && i < m_measurement.n_steps.size(); ++i) {
+			if (!(m_measurement.mask & (1u << i))) {
+				continue;
+			}
+
+			double bit_steps = (double)n_cells * m_measurement.n_steps[i];
+			m_cascade_flip_rate[i] = (float)(n_flipped_bits[i] / bit_steps);
+			n_flipped += n_flipped_bits[i];
+			n_bit_steps += bit_steps;
+		}
+
+		m_measurement = {};
+		if (n_bit_steps == 0.0) {
+			return;
+		}
+
+		++m_n_measurements;
+		m_flip_rate = (float)(n_flipped / n_bit_steps);
+		if (m_flip_rate > 2 * m_config.target_flip_rate) {
+			m_interval_multiplier = 1;
+			m_sample_fraction = 1.0f;
+		} else if (m_flip_rate < m_config.target_flip_rate / 2) {
+			m_interval_multiplier = std::min(m_interval_multiplier * 2, std::max(m_config.max_interval_multiplier, 1u));
+			m_sample_fraction = std::max(m_sample_fraction / 2, std::min(m_config.min_sample_fraction, 1.0f));
+		}
+	}
+
+	// Counts the updates and network queries of the default schedule from the previous call up to and including
+	// `step`. `default_interval(s)` and `default_n_queries(s)` describe the default update at step s.
+	template <typename F, typename G>
+	uint64_t default_queries_until(uint32_t step, F&& default_interval, G&& default_n_queries) {
+		// Training may have started from a snapshot or have been restarted.
+		if (!m_any_accounted || step + 1 < m_next_accounted_step) {
+			m_next_accounted_step = step;
+		}
+
+		uint64_t result = 0;
+		for (uint32_t s = m_next_accounted_step; s <= step; ++s) {
+			if (s % default_interval(s) == 0) {
+				result += default_n_queries(s);
+				++m_n_default_updates;
+			}
+		}
+
+		m_next_accounted_step = step + 1;
+		m_any_accounted = true;
+		return result;
+	}
+
+	float flip_rate() const { return m_flip_rate; }
+	const std::vector<float>& cascade_flip_rates() const { return m_cascade_flip_rate; }
+	uint32_t n_measurements() const { return m_n_measurements; }
+
+	uint64_t n_updates() const { return m_n_updates; }
+	uint64_t n_default_updates() const { return m_n_default_updates; }
+	uint64_t n_queries() const { return m_n_queries; }
+	uint64_t n_default_queries() const { return m_n_default_queries; }
+	uint64_t n_queries_saved() const { return m_n_default_queries > m_n_queries ? m_n_default_queries - m_n_queries : 0; }
+
+private:
+	DensityGridScheduleConfig m_config;
+
+	uint32_t m_interval_multiplier = 1;
+	float m_sample_fraction = 1.0f;
+
+	float m_flip_rate = 0.0f;
+	std::vector<float> m_cascade_flip_rate;
+	std::vector<uint32_t> m_cascade_last_update_step;
+	std::vector<uint32_t> m_cascade_n_skipped;
+	uint32_t m_n_measurements = 0;
+
+	// The update whose flips are yet to be reported: its cascades and their steps since their previous update
+	struct Measurement {
+		uint32_t mask = 0;
+		std::vector<uint32_t> n_steps;
+	} m_measurement;
+
+	uint32_t m_next_accounted_step = 0;
+	bool m_any_accounted = false;
+	uint64_t m_n_updates = 0;
+	uint64_t m_n_default_updates = 0;
+	uint64_t m_n_queries = 0;
+	uint64_t m_n_default_queries = 0;
+};
+
+NGP_NAMESPACE_END
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   error_map_sampler.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Sampling of training images and pixels proportionally to the error map. Besides the inverse CDFs, the
+ *          error map can be turned into a hierarchy of alias tables (image -> row -> column), from which each level
+ *          samples with a single lookup instead of a binary search.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+class ThreadPool;
+
+// Fraction of the probability mass that is spread uniformly over the pixels of an image and over the images,
+// such that no part of the training data starves.
+static constexpr float ERROR_MAP_MIN_PDF = 0.01f;
+static constexpr float ERROR_MAP_MIN_PMF = 0.1f;
+// Added to every pixel's error, such that rows without any error remain valid distributions.
+static constexpr float ERROR_MAP_BIAS = 1e-10f;
+
+struct AliasEntry {
+	// Probability of keeping this bucket's own outcome rather than its alias
+	float prob;
+	uint32_t alias;
+};
+
+// Vose's construction of the alias table of `n` probabilities that sum to one. `scratch` holds n indices: buckets
+// with less than the average mass are stacked from its front, those with more from its back.
+inline NGP_HOST_DEVICE void build_alias_table(uint32_t n, const float* __restrict__ pmf, AliasEntry* __restrict__ table, uint32_t* __restrict__ scratch) {
+	uint32_t n_small = 0;
+	uint32_t n_large = 0;
+	for (uint32_t i = 0; i < n; ++i) {
+		float mass = pmf[i] * (float)n;
+		table[i] = {mass, i};
+		if (mass < 1.0f) {
+			scratch[n_small++] = i;
+		} else {
+			scratch[n - ++n_large] = i;
+		}
+	}
+
+	while (n_small > 0 && n_large > 0) {
+		uint32_t small = scratch[--n_small];
+		uint32_t large = scratch[n - n_large];
+
+		// The large bucket tops up the small one
+		table[small].alias = large;
+		float remaining = (table[large].prob + table[small].prob) - 1.0f;
+		table[large].prob = remaining;
+
+		if (remaining < 1.0f) {
+			--n_large;
+			scratch[n_small++] = large;
+		}
+	}
+
+	// Whatever is left over holds the average mass up to rounding
+	for (uint32_t i = 0; i < n_small; ++i) {
+		table[scratch[i]].prob = 1.0f;
+	}
+
+	for (uint32_t i = 0; i < n_large; ++i) {
+		table[scratch[n - 1 - i]].prob = 1.0f;
+	}
+}
+
+// Picks a bucket with one lookup. Like inverting a CDF, it then rescales `sample` from [0,1) to a fresh uniform
+// number in [0,1), which callers use to jitter within the picked bucket.
+inline NGP_HOST_DEVICE uint32_t sample_alias_table(float& sample, uint32_t n, const AliasEntry* __restrict__ table) {
+	float scaled = sample * (float)n;
+	uint32_t i = std::min((uint32_t)scaled, n - 1);
+	// The largest float below one, such that rounding can not push `u` past the last bucket's mass
+	float u = std::min(scaled - (float)i, 0.99999994f);
+
+	AliasEntry entry = table[i];
+	if (u < entry.prob) {
+		sample = u / entry.prob;
+		return i;
+	}
+
+	sample = (u - entry.prob) / (1.0f - entry.prob);
+	return entry.alias;
+}
+
+// Turns `n` non-negative weights, each plus `bias`, into probabilities with `min_pmf` of their mass spread uniformly,
+// as the CDF sampler does, and builds their alias table. Returns the sum of the biased weights.
+inline NGP_HOST_DEVICE float build_weighted_alias_table(uint32_t n, const float* __restrict__ weights, float bias, float min_pmf, float* __restrict__ pmf, AliasEntry* __restrict__ table, uint32_t* __restrict__ scratch) {
+	float cum = 0.0f;
+	for (uint32_t i = 0; i < n; ++i) {
+		cum += weights[i] + bias;
+	}
+
+	float norm = 1.0f / cum;
+	for (uint32_t i = 0; i < n; ++i) {
+		pmf[i] = (1.0f - min_pmf) * (weights[i] + bias) * norm + min_pmf / (float)n;
+	}
+
+	build_alias_table(n, pmf, table, scratch);
+	return cum;
+}
+
+// The error map tables that training kernels sample from. Null tables mean uniform sampling at that level.
+struct ErrorMapSampler {
+	EErrorMapSampler mode = EErrorMapSampler::Cdf;
+	ivec2 resolution = ivec2(0);
+	// Number of images in the image-level alias table
+	uint32_t n_images = 0;
+
+	// EErrorMapSampler::Cdf
+	const float* cdf_x_cond_y = nullptr;
+	const float* cdf_y = nullptr;
+	const float* cdf_img = nullptr;
+
+	// EErrorMapSampler::Alias, with the probabilities of the buckets for the sampling pdf
+	const AliasEntry* alias_x_cond_y = nullptr;
+	const AliasEntry* alias_y = nullptr;
+	const AliasEntry* alias_img = nullptr;
+	const float* pmf_x_cond_y = nullptr;
+	const float* pmf_y = nullptr;
+	const float* pmf_img = nullptr;
+
+	NGP_HOST_DEVICE bool samples_focal_plane() const {
+		return mode == EErrorMapSampler::Alias ? alias_x_cond_y != nullptr : cdf_x_cond_y != nullptr;
+	}
+
+	NGP_HOST_DEVICE bool samples_images() const {
+		return mode == EErrorMapSampler::Alias ? alias_img != nullptr : cdf_img != nullptr;
+	}
+};
+
+// Host construction of the alias table hierarchy of an error map with `n_images` images of `resolution` cells,
+// parallel over images. The testbed builds the same tables on the GPU; this serves as their reference and
+// benchmark.
+struct ErrorMapAliasTables {
+	ivec2 resolution = ivec2(0);
+	uint32_t n_images = 0;
+
+	std::vector<float> pmf_x_cond_y;
+	std::vector<float> pmf_y;
+	std::vector<float> pmf_img;
+	std::vector<AliasEntry> alias_x_cond_y;
+	std::vector<AliasEntry> alias_y;
+	std::vector<AliasEntry> alias_img;
+
+	// Sum of the (biased) error per row and per image
+	std::vector<float> row_weight;
+	std::vector<float> image_weight;
+
+	// Rebuilds the rows of the images whose `dirty` flag is set, or of all images if it is null or the shape changed,
+	// and then the image-level table.
+	void build(const float* data, uint32_t n_images, const ivec2& resolution, const uint8_t* dirty = nullptr, ThreadPool* pool = nullptr);
+
+	// Largest deviation of the distribution that an alias table represents from its probabilities. Zero up to
+	// rounding for correctly built tables.
+	static float max_alias_error(uint32_t n, const float* pmf, const AliasEntry* table);
+};
+
+// Image-level table from the error of each image, mixing in ERROR_MAP_MIN_PMF
+void build_image_alias_table(const std::vector<float>& image_weight, std::vector<float>& pmf, std::vector<AliasEntry>& table);
+
+NGP_NAMESPACE_END
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   hash_grid_analysis.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Offline analysis of how well the hash tables of a NeRF snapshot's grid encoding fit its scene. Simulates
+ *          the encoding's indexing of the grid vertices in occupied space per level to measure hash collisions for a
+ *          range of table sizes, and distributes a memory budget among the levels. Free of CUDA.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <json/json.hpp>
+
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+struct HashGridLevelAnalysis {
+	uint32_t resolution = 0;
+	// Entries that the level needs to be dense, i.e. free of collisions
+	uint32_t dense_size = 0;
+	// Entries in the snapshot
+	uint32_t hashmap_size = 0;
+
+	// Grid vertices that lie in occupied cells of the density grid
+	size_t n_occupied_vertices = 0;
+	// Whether the collision rates were simulated on a subset of the occupied cells, with the tables shrunk by the same
+	// factor, because the level has too many occupied vertices to enumerate.
+	bool subsampled = false;
+
+	// Fractions of occupied vertices that share their table entry with another occupied vertex, for tables of
+	// 2^HashGridAnalysis::min_log2_size to 2^HashGridAnalysis::max_log2_size entries (capped at the dense size)
+	std::vector<float> collision_rates;
+
+	// Entries and collision rate in the snapshot and in the distribution of the memory budget among levels
+	float collision_rate = 0.0f;
+	uint32_t suggested_size = 0;
+	float suggested_collision_rate = 0.0f;
+
+	float load_factor() const { return hashmap_size > 0 ? (float)((double)n_occupied_vertices / hashmap_size) : 0.0f; }
+};
+
+struct HashGridAnalysis {
+	// Range of simulated table sizes, extended to include the snapshot's
+	uint32_t min_log2_size = 10;
+	uint32_t max_log2_size = 24;
+
+	uint32_t n_features_per_level = 0;
+	uint32_t log2_hashmap_size = 0;
+	size_t n_occupied_cells = 0;
+	std::vector<HashGridLevelAnalysis> levels;
+
+	// Bytes of the grid's half precision parameters. The budget defaults to the snapshot's size.
+	size_t n_bytes = 0;
+	size_t budget_bytes = 0;
+
+	// Table sizes per level, as distributed by greedily growing the level whose collision rate drops the most per byte
+	size_t suggested_n_bytes = 0;
+
+	// The grid encoding uses one table size for all levels: the largest that fits the budget.
+	uint32_t suggested_log2_hashmap_size = 0;
+	size_t suggested_uniform_n_bytes = 0;
+
+	// Means of the levels' collision rates
+	float collision_rate = 0.0f;
+	float suggested_collision_rate = 0.0f;
+	float suggested_uniform_collision_rate = 0.0f;
+
+	// Network configuration of the snapshot, and the same with the suggested uniform table size
+	nlohmann::json network_config;
+	nlohmann::json tuned_network_config() const;
+
+	float ms = 0.0f;
+};
+
+// Analyzes the hash grid of a NeRF snapshot (.ingp/.msgpack) that contains a density grid. Levels with more occupied
+// vertices than `max_vertices_per_level` are subsampled. `budget_bytes == 0` keeps the snapshot's memory footprint.
+HashGridAnalysis analyze_hash_grid(const fs::path& snapshot_path, size_t budget_bytes = 0, size_t max_vertices_per_level = (size_t)1 << 24);
+
+NGP_NAMESPACE_END
@@ -16,6 +16,7 @@
 #pragma once
 
 #include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/nerf.h>
 #include <neural-graphics-primitives/nerf_loader.h>
 
 #include <json/json.hpp>
@@ -159,6 +160,16 @@ inline void from_json(const nlohmann::json& j, BoundingBox& box) {
 	box.max = j.at("max");
 }
 
+inline void to_json(nlohmann::json& j, const DensityGridShape& shape) {
+	j["size"] = shape.size;
+	j["n_cascades"] = shape.n_cascades;
+}
+
+inline void from_json(const nlohmann::json& j, DensityGridShape& shape) {
+	shape.size = j.value("size", shape.size);
+	shape.n_cascades = j.value("n_cascades", shape.n_cascades);
+}
+
 inline void to_json(nlohmann::json& j, const Lens& lens) {
 	if (lens.mode == ELensMode::OpenCV) {
 		j["is_fisheye"] = false;
@@ -18,9 +18,14 @@
 
 #include <tiny-cuda-nn/gpu_memory.h>
 
+#include <fmt/core.h>
+
+#include <type_traits>
+
 NGP_NAMESPACE_BEGIN
 
-// size of the density/occupancy grid in number of cells along an axis.
+// Default size of the density/occupancy grid in number of cells along an axis. Models can choose any size that
+// dispatch_density_grid_size() supports. Ray marching step sizes remain derived from the default.
 inline constexpr __device__ uint32_t NERF_GRIDSIZE() {
 	return 128;
 }
@@ -29,14 +34,105 @@ inline constexpr __device__ uint32_t NERF_GRID_N_CELLS() {
 	return NERF_GRIDSIZE() * NERF_GRIDSIZE() * NERF_GRIDSIZE();
 }
 
-struct NerfPayload {
-	vec3 origin;
-	vec3 dir;
-	float t;
-	float max_weight;
-	uint32_t idx;
-	uint16_t n_steps;
-	bool alive;
+// Default number of density grid cascades, each of which covers twice the extent of the previous one.
+inline constexpr __device__ uint32_t NERF_CASCADES() {
+	return 8;
+}
+
+// Limits the density grid buffers to 32 bit indices at the largest supported size.
+inline constexpr __device__ uint32_t NERF_MAX_CASCADES() {
+	return 16;
+}
+
+// Shape of a model's density grid: `n_cascades` nested grids of `size`^3 cells each.
+struct DensityGridShape {
+	uint32_t size = NERF_GRIDSIZE();
+	uint32_t n_cascades = NERF_CASCADES();
+
+	NGP_HOST_DEVICE uint32_t n_cells() const {
+		return size * size * size;
+	}
+
+	NGP_HOST_DEVICE uint32_t mip_offset(uint32_t mip) const {
+		return n_cells() * mip;
+	}
+
+	// The occupancy bitfield of all cascades is followed by their Chebyshev distance fields, one byte per cell,
+	// in the same buffer, such that the distance fields travel along wherever the bitfield is copied.
+	NGP_HOST_DEVICE uint32_t bitfield_bytes() const {
+		return mip_offset(n_cascades) / 8;
+	}
+
+	NGP_HOST_DEVICE uint32_t distance_field_offset() const {
+		return bitfield_bytes();
+	}
+
+	NGP_HOST_DEVICE uint32_t buffer_bytes() const {
+		return bitfield_bytes() + mip_offset(n_cascades);
+	}
+
+	bool operator==(const DensityGridShape& other) const {
+		return size == other.size && n_cascades == other.n_cascades;
+	}
+
+	bool operator!=(const DensityGridShape& other) const {
+		return !(*this == other);
+	}
+};
+
+// Density grid kernels are compiled for these sizes. Invokes `f` with the size as an std::integral_constant, such that
+// it can instantiate kernels for it.
+template <typename F>
+auto dispatch_density_grid_size(uint32_t size, F&& f) -> decltype(f(std::integral_constant<uint32_t, 128>{})) {
+	switch (size) {
+		case 64: return f(std::integral_constant<uint32_t, 64>{});
+		case 128: return f(std::integral_constant<uint32_t, 128>{});
+		case 256: return f(std::integral_constant<uint32_t, 256>{});
+		default: throw std::runtime_error{fmt::format("Density grid size must be 64, 128, or 256, but is {}.", size)};
+	}
+}
+
+// Marching state of a ray, packed into one word: the number of steps in the low 16 bits, the index of the ray's
+// NerfTraceView in the next 8 bits, and whether the ray is alive in the top bit.
+struct NerfRayState {
+	uint32_t bits;
+
+	NGP_HOST_DEVICE static NerfRayState make(uint32_t n_steps, uint32_t view, bool alive) {
+		return {(n_steps & 0xFFFF) | ((view & 0xFF) << 16) | (alive ? 0x80000000u : 0u)};
+	}
+
+	NGP_HOST_DEVICE uint32_t n_steps() const { return bits & 0xFFFF; }
+	NGP_HOST_DEVICE uint32_t view() const { return (bits >> 16) & 0xFF; }
+	NGP_HOST_DEVICE bool alive() const { return bits & 0x80000000u; }
+
+	NGP_HOST_DEVICE void set_n_steps(uint32_t n_steps) { bits = (bits & ~0xFFFFu) | (n_steps & 0xFFFF); }
+	NGP_HOST_DEVICE void set_alive(bool alive) { bits = alive ? (bits | 0x80000000u) : (bits & ~0x80000000u); }
+};
+
+// Per-ray state of the NeRF tracer as a structure of arrays. These are the fields that change while marching and
+// that compaction moves. The origin and direction of a ray never change after initialization, so they stay in the
+// per-pixel arrays of the ray's view (see NerfTraceView), where the pixel index `idx` finds them.
+struct NerfPayloads {
+	NGP_HOST_DEVICE NerfPayloads operator+(size_t offset) const {
+		return {t + offset, max_weight + offset, idx + offset, state + offset};
+	}
+
+	float* t;
+	float* max_weight;
+	uint32_t* idx;
+	NerfRayState* state;
+};
+
+// Per-view state of a NeRF trace. Rays of several views can share one ray pool and thereby one set of network
+// inference batches; each ray then looks up its view's camera and buffers via NerfRayState::view().
+struct NerfTraceView {
+	mat4x3 camera; // the camera at the end of the frame, relative to which cone angles and depths are computed
+	vec2 focal_length;
+	uint32_t sample_index;
+	vec4* frame_buffer;
+	float* depth_buffer;
+	vec3* origin; // per pixel, like frame_buffer
+	vec3* dir;
 };
 
 struct RaysNerfSoa {
@@ -44,11 +140,14 @@ struct RaysNerfSoa {
 	void copy_from_other_async(const RaysNerfSoa& other, cudaStream_t stream) {
 		CUDA_CHECK_THROW(cudaMemcpyAsync(rgba, other.rgba, size * sizeof(vec4), cudaMemcpyDeviceToDevice, stream));
 		CUDA_CHECK_THROW(cudaMemcpyAsync(depth, other.depth, size * sizeof(float), cudaMemcpyDeviceToDevice, stream));
-		CUDA_CHECK_THROW(cudaMemcpyAsync(payload, other.payload, size * sizeof(NerfPayload), cudaMemcpyDeviceToDevice, stream));
+		CUDA_CHECK_THROW(cudaMemcpyAsync(payload.t, other.payload.t, size * sizeof(float), cudaMemcpyDeviceToDevice, stream));
+		CUDA_CHECK_THROW(cudaMemcpyAsync(payload.max_weight, other.payload.max_weight, size * sizeof(float), cudaMemcpyDeviceToDevice, stream));
+		CUDA_CHECK_THROW(cudaMemcpyAsync(payload.idx, other.payload.idx, size * sizeof(uint32_t), cudaMemcpyDeviceToDevice, stream));
+		CUDA_CHECK_THROW(cudaMemcpyAsync(payload.state, other.payload.state, size * sizeof(NerfRayState), cudaMemcpyDeviceToDevice, stream));
 	}
 #endif
 
-	void set(vec4* rgba, float* depth, NerfPayload* payload, size_t size) {
+	void set(vec4* rgba, float* depth, const NerfPayloads& payload, size_t size) {
 		this->rgba = rgba;
 		this->depth = depth;
 		this->payload = payload;
@@ -57,10 +156,56 @@ struct RaysNerfSoa {
 
 	vec4* rgba;
 	float* depth;
-	NerfPayload* payload;
+	NerfPayloads payload;
 	size_t size;
 };
 
+// Level of detail of a multiresolution hash encoding. A sample only evaluates the levels whose cells are no finer than
+// its pixel footprint, so samples far from the camera skip the hash lookups of fine levels. The network copes with the
+// truncated encoding when trained with randomized max levels (Testbed::m_max_level_rand_training).
+struct NerfLevelOfDetail {
+	// Fraction of the levels, in the convention of GridEncoding::set_max_level_gpu(), that resolve a footprint of
+	// the given size relative to the unit cube of the encoding: level l is evaluated if l <= max_level * n_levels.
+	NGP_HOST_DEVICE float max_level(float footprint) const {
+		if (n_levels <= 1) {
+			return 1.0f;
+		}
+
+		float level = -logf(footprint * base_resolution) / log_per_level_scale + bias;
+		return fminf(fmaxf(level / n_levels, 0.0f), 1.0f);
+	}
+
+	// Number of levels that max_level() lets through
+	NGP_HOST_DEVICE uint32_t n_evaluated_levels(float max_level) const {
+		uint32_t n = (uint32_t)(max_level * n_levels + 1e-3f) + 1;
+		return n < n_levels ? n : n_levels;
+	}
+
+	NGP_HOST_DEVICE explicit operator bool() const {
+		return n_levels > 0;
+	}
+
+	uint32_t n_levels = 0; // zero disables level of detail
+	float base_resolution = 16.0f;
+	float log_per_level_scale = 0.0f;
+	// Levels evaluated beyond those that the footprint resolves. Negative values trade detail for speed.
+	float bias = 0.0f;
+};
+
+// Optional per-pixel auxiliary outputs that the NeRF tracer accumulates alongside the color.
+// Indexed by NerfPayloads::idx, so they are unaffected by ray compaction.
+struct NerfAovBuffers {
+	float* alpha = nullptr; // sum of compositing weights
+	float* expected_depth = nullptr; // weighted sum of depths; divide by alpha
+	float* median_depth = nullptr; // depth at which the accumulated alpha crosses 0.5
+	vec3* normal = nullptr; // weighted sum of density-gradient normals; requires an additional input-gradient pass
+	uint32_t* n_steps = nullptr; // number of network samples composited
+
+	NGP_HOST_DEVICE operator bool() const {
+		return alpha;
+	}
+};
+
 //#define TRIPLANAR_COMPATIBLE_POSITIONS   // if this is defined, then positions are stored as [x,y,z,x] so that it can be split as [x,y] [y,z] [z,x] by the input encoding
 
 struct NerfPosition {
@@ -84,30 +229,87 @@ struct NerfDirection {
 
 struct NerfCoordinate {
 	NGP_HOST_DEVICE NerfCoordinate(const vec3& pos, const vec3& dir, float dt) : pos{pos, dt}, dt{dt}, dir{dir, dt} {}
-	NGP_HOST_DEVICE void set_with_optional_extra_dims(const vec3& pos, const vec3& dir, float dt, const float* extra_dims, uint32_t stride_in_bytes) {
-		this->dt = dt;
-		this->pos = NerfPosition(pos, dt);
-		this->dir = NerfDirection(dir, dt);
-		copy_extra_dims(extra_dims, stride_in_bytes);
-	}
 	inline NGP_HOST_DEVICE const float* get_extra_dims() const { return (const float*)(this + 1); }
 	inline NGP_HOST_DEVICE float* get_extra_dims() { return (float*)(this + 1); }
 
-	NGP_HOST_DEVICE void copy(const NerfCoordinate& inp, uint32_t stride_in_bytes) {
-		*this = inp;
-		copy_extra_dims(inp.get_extra_dims(), stride_in_bytes);
+	NerfPosition pos;
+	float dt;
+	NerfDirection dir;
+};
+
+// Number of extra network input dimensions that is only known at run time.
+static constexpr uint32_t NERF_DYNAMIC_EXTRA_DIMS = 0xFFFFFFFF;
+
+// Network inputs laid out as consecutive NerfCoordinates, each followed by its extra dimensions (light directions and
+// latent codes). With a compile-time number of extra dims, indexing uses a constant stride and copying the extra dims
+// unrolls, such that inputs without extra dims involve no stride arithmetic at all.
+template <uint32_t N_EXTRA_DIMS>
+struct NerfCoordinates {
+	NGP_HOST_DEVICE NerfCoordinates(NerfCoordinate* ptr = nullptr, uint32_t n_extra_dims = 0) : ptr{ptr}, dynamic_n_extra_dims{n_extra_dims} {}
+
+	NGP_HOST_DEVICE uint32_t n_extra_dims() const {
+		return N_EXTRA_DIMS == NERF_DYNAMIC_EXTRA_DIMS ? dynamic_n_extra_dims : N_EXTRA_DIMS;
 	}
-	NGP_HOST_DEVICE inline void copy_extra_dims(const float *extra_dims, uint32_t stride_in_bytes) {
-		if (stride_in_bytes >= sizeof(NerfCoordinate)) {
-			float* dst = get_extra_dims();
-			const uint32_t n_extra = (stride_in_bytes - sizeof(NerfCoordinate)) / sizeof(float);
-			for (uint32_t i = 0; i < n_extra; ++i) dst[i] = extra_dims[i];
+
+	NGP_HOST_DEVICE uint32_t stride_in_floats() const {
+		return sizeof(NerfCoordinate) / sizeof(float) + n_extra_dims();
+	}
+
+	NGP_HOST_DEVICE NerfCoordinate* operator()(uint32_t i) const {
+		return (NerfCoordinate*)((float*)ptr + (size_t)i * stride_in_floats());
+	}
+
+	NGP_HOST_DEVICE NerfCoordinates& operator+=(uint32_t i) {
+		ptr = (*this)(i);
+		return *this;
+	}
+
+	NGP_HOST_DEVICE NerfCoordinates& operator-=(uint32_t i) {
+		ptr = (NerfCoordinate*)((float*)ptr - (size_t)i * stride_in_floats());
+		return *this;
+	}
+
+	NGP_HOST_DEVICE void set(uint32_t i, const vec3& pos, const vec3& dir, float dt, const float* extra_dims) const {
+		NerfCoordinate* coord = (*this)(i);
+		*coord = NerfCoordinate{pos, dir, dt};
+		copy_extra_dims(coord->get_extra_dims(), extra_dims);
+	}
+
+	// Copies `src`, which is laid out like the coordinates of this pointer, to coordinate `i`.
+	NGP_HOST_DEVICE void copy(uint32_t i, const NerfCoordinate& src) const {
+		NerfCoordinate* coord = (*this)(i);
+		*coord = src;
+		copy_extra_dims(coord->get_extra_dims(), src.get_extra_dims());
+	}
+
+	NGP_HOST_DEVICE void copy_extra_dims(float* dst, const float* src) const {
+		if (N_EXTRA_DIMS == NERF_DYNAMIC_EXTRA_DIMS) {
+			for (uint32_t j = 0; j < dynamic_n_extra_dims; ++j) {
+				dst[j] = src[j];
+			}
+		} else {
+			NGP_PRAGMA_UNROLL
+			for (uint32_t j = 0; j < (N_EXTRA_DIMS == NERF_DYNAMIC_EXTRA_DIMS ? 0 : N_EXTRA_DIMS); ++j) {
+				dst[j] = src[j];
+			}
 		}
 	}
 
-	NerfPosition pos;
-	float dt;
-	NerfDirection dir;
+	NerfCoordinate* ptr;
+	uint32_t dynamic_n_extra_dims;
 };
 
+// Kernels that generate network inputs are compiled for no extra dims, for light directions, and for light directions
+// or latent codes of the default size. Invokes `f` with the number of extra dims as an std::integral_constant, which
+// is NERF_DYNAMIC_EXTRA_DIMS for any other number.
+template <typename F>
+auto dispatch_nerf_extra_dims(uint32_t n_extra_dims, F&& f) -> decltype(f(std::integral_constant<uint32_t, 0>{})) {
+	switch (n_extra_dims) {
+		case 0: return f(std::integral_constant<uint32_t, 0>{});
+		case 3: return f(std::integral_constant<uint32_t, 3>{});
+		case 16: return f(std::integral_constant<uint32_t, 16>{});
+		default: return f(std::integral_constant<uint32_t, NERF_DYNAMIC_EXTRA_DIMS>{});
+	}
+}
+
 NGP_NAMESPACE_END
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   nerf_march_schedule.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Host-side step policy of the NeRF ray marching loop. Decides how many rays to launch and how many
+ *          steps to march between compactions from alive counts that arrive from the device with a delay,
+ *          such that the loop does not need to synchronize after every compaction.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <algorithm>
+
+NGP_NAMESPACE_BEGIN
+
+class NerfMarchSchedule {
+public:
+	// `max_staleness` is the number of compactions by which the alive count that the schedule is based on
+	// may lag behind the compaction that was just enqueued. 0 synchronizes after every compaction.
+	NerfMarchSchedule(uint32_t n_rays, uint32_t min_steps, uint32_t max_steps, uint32_t target_n_queries, uint32_t max_staleness)
+	: m_alive_bound{n_rays}, m_min_steps{min_steps}, m_max_steps{std::max(min_steps, max_steps)}, m_target_n_queries{target_n_queries}, m_max_staleness{max_staleness} {}
+
+	// Alive count after the compaction of `iteration`. Counts must be reported in order of iteration.
+	void report(uint32_t iteration, uint32_t n_alive) {
+		if (iteration != m_n_known) {
+			return;
+		}
+
+		// Rays never come back to life, so a count is an upper bound for all later compactions.
+		m_alive_bound = std::min(m_alive_bound, n_alive);
+		++m_n_known;
+	}
+
+	// Number of compactions, starting from the first, whose alive count has been reported.
+	uint32_t n_known() const {
+		return m_n_known;
+	}
+
+	// Whether the host must wait for the count of compaction n_known() before launching the marching
+	// step that follows the compaction of `iteration`.
+	bool must_wait(uint32_t iteration) const {
+		return iteration + 1 > m_n_known + m_max_staleness;
+	}
+
+	// Number of rays to launch the marching kernels for. Never less than the actual number of alive rays;
+	// the kernels skip the excess by reading the actual count on the device.
+	uint32_t alive_bound() const {
+		return m_alive_bound;
+	}
+
+	// Want a large number of queries to saturate the GPU and to ensure compaction doesn't happen too frequently.
+	uint32_t n_steps() const {
+		if (m_alive_bound == 0) {
+			return m_max_steps;
+		}
+
+		return std::min(std::max(m_target_n_queries / m_alive_bound, m_min_steps), m_max_steps);
+	}
+
+	bool finished() const {
+		return m_alive_bound == 0;
+	}
+
+private:
+	uint32_t m_alive_bound;
+	uint32_t m_n_known = 0;
+	uint32_t m_min_steps;
+	uint32_t m_max_steps;
+	uint32_t m_target_n_queries;
+	uint32_t m_max_staleness;
+};
+
+NGP_NAMESPACE_END
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   nerf_scene.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Renders scenes that are too large for a single NeRF from the blocks of a NerfScenePartition. Every
+ *          block is a snapshot with its own network, density grid, and coordinate system, loaded into its own
+ *          testbed when it becomes visible and evicted under a memory budget.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/nerf_scene_partition.h>
+
+#include <tiny-cuda-nn/gpu_memory.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+class Testbed;
+
+struct NerfSceneRenderStats {
+	uint32_t n_visible_blocks = 0;
+	uint32_t n_rendered_blocks = 0;
+	uint32_t n_loaded_blocks = 0;
+	uint32_t n_evicted_blocks = 0;
+	uint32_t n_skipped_blocks = 0;
+	float load_ms = 0.0f;
+	float render_ms = 0.0f;
+};
+
+class NerfScene {
+public:
+	NerfScene(const fs::path& index_path, size_t memory_budget_bytes);
+	NerfScene(NerfScenePartition partition, size_t memory_budget_bytes);
+	~NerfScene();
+
+	// Renders linear, premultiplied RGBA with one sample per pixel through the pixel centers. The visible blocks
+	// are traced one after another from front to back, each one behind what the blocks in front of it left, such
+	// that transmittance carries across block boundaries. Visible blocks are loaded first, as far as the memory
+	// budget allows; the others are left out of the image.
+	std::vector<vec4> render(const NerfSceneCamera& camera);
+
+	const NerfScenePartition& partition() const { return m_partition; }
+	const NerfBlockResidency& residency() const { return m_residency; }
+	void set_memory_budget(size_t memory_budget_bytes) { m_residency.set_budget(memory_budget_bytes); }
+
+	// Applies to every block. The transmittance below which rays terminate also decides which pixels the blocks
+	// behind the first one still trace.
+	float min_transmittance = 0.01f;
+
+	const NerfSceneRenderStats& render_stats() const { return m_render_stats; }
+
+private:
+	void load_block(uint32_t block);
+
+	NerfScenePartition m_partition;
+	NerfBlockResidency m_residency;
+	std::unordered_map<uint32_t, std::unique_ptr<Testbed>> m_testbeds;
+
+	tcnn::GPUMemory<vec4> m_frame_buffer;
+	tcnn::GPUMemory<float> m_depth_buffer;
+
+	// Blocks are rendered one after another on the scene's own stream, since they composite into the same buffers.
+	cudaStream_t m_stream = nullptr;
+
+	NerfSceneRenderStats m_render_stats;
+};
+
+NGP_NAMESPACE_END
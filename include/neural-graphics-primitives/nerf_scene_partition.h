@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   nerf_scene_partition.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Partition of a large scene into an axis-aligned grid of blocks, each of which is a separately trained
+ *          NeRF snapshot. Decides which blocks a view sees, in which order rays pass through them, and which
+ *          blocks stay loaded under a memory budget; free of CUDA, such that these policies can be exercised on
+ *          the host.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+// Pinhole camera in the world coordinates of a scene partition. The camera-to-world matrix follows the NeRF
+// convention of transforms.json (x right, y up, looking along -z); the focal length is in pixels.
+struct NerfSceneCamera {
+	mat4x3 camera = mat4x3(1.0f);
+	ivec2 resolution = ivec2(0);
+	vec2 focal_length = vec2(0.0f);
+	vec2 screen_center = vec2(0.5f);
+	float near_distance = 0.0f;
+	float far_distance = std::numeric_limits<float>::infinity();
+
+	vec3 position() const { return camera[3]; }
+	vec3 forward() const { return -camera[2]; }
+
+	// Normalized world direction of the ray through the given pixel coordinates, where (0,0) is the top left corner.
+	vec3 pixel_dir(const vec2& pixel) const;
+};
+
+struct NerfSceneBlock {
+	ivec3 cell;
+	fs::path snapshot;
+	// Memory that the block occupies while loaded. Defaults to the size of the snapshot.
+	size_t n_bytes = 0;
+};
+
+class NerfScenePartition {
+public:
+	NerfScenePartition(const vec3& origin, const vec3& block_size, const ivec3& n_blocks);
+
+	// Index file, in world coordinates:
+	// {"origin": [x,y,z], "block_size": [x,y,z], "n_blocks": [x,y,z],
+	//  "blocks": [{"cell": [i,j,k], "snapshot": "relative/to/index.ingp", "n_bytes": optional}, ...]}
+	static NerfScenePartition load(const fs::path& path);
+
+	// Cells without a block are empty space. Returns the index of the block.
+	uint32_t add_block(const ivec3& cell, const fs::path& snapshot, size_t n_bytes);
+
+	const std::vector<NerfSceneBlock>& blocks() const { return m_blocks; }
+	std::vector<size_t> block_n_bytes() const;
+	vec3 block_min(uint32_t block) const { return m_origin + vec3(m_blocks.at(block).cell) * m_block_size; }
+	vec3 block_max(uint32_t block) const { return block_min(block) + m_block_size; }
+
+	const vec3& origin() const { return m_origin; }
+	const vec3& block_size() const { return m_block_size; }
+	const ivec3& n_blocks() const { return m_n_blocks; }
+
+	// Blocks whose boxes intersect the view frustum (conservatively), front to back.
+	std::vector<uint32_t> visible_blocks(const NerfSceneCamera& camera) const;
+
+	// Orders blocks such that every ray from `pos` passes through them in that order. Rays move monotonically
+	// through the cells along each axis, so sorting by the L1 cell distance from the camera's (clamped) cell is
+	// consistent with the order along every ray.
+	void sort_front_to_back(const vec3& pos, std::vector<uint32_t>& blocks) const;
+
+	// Blocks that the ray o + t * d with t > t_min passes through, in order of entry. Brute force; for reference.
+	std::vector<uint32_t> blocks_along_ray(const vec3& o, const vec3& d, float t_min = 0.0f) const;
+
+private:
+	vec3 m_origin;
+	vec3 m_block_size;
+	ivec3 m_n_blocks;
+
+	std::vector<NerfSceneBlock> m_blocks;
+	std::vector<int32_t> m_block_of_cell;
+};
+
+// Decides which blocks are resident on the GPU. The visible blocks are loaded in order of importance, as many as fit
+// into the budget; loaded blocks that are not visible stay as a cache until their memory is needed, least recently
+// used first.
+class NerfBlockResidency {
+public:
+	explicit NerfBlockResidency(size_t budget_bytes = 0) : m_budget(budget_bytes) {}
+
+	struct Update {
+		std::vector<uint32_t> load;
+		std::vector<uint32_t> evict;
+		// Visible blocks that remain unloaded, because more important blocks take up the budget
+		std::vector<uint32_t> skip;
+	};
+
+	// Starts a frame that sees the `visible` blocks, most important (e.g. closest) first. `n_bytes` holds the cost
+	// of every block of the partition. Evictions must be carried out before the loads.
+	Update update(const std::vector<uint32_t>& visible, const std::vector<size_t>& n_bytes);
+
+	// Evicts every block, e.g. before the owner of the loaded blocks goes away.
+	std::vector<uint32_t> clear();
+
+	bool resident(uint32_t block) const { return m_last_used.count(block) > 0; }
+	size_t n_resident() const { return m_last_used.size(); }
+	size_t n_resident_bytes() const { return m_n_resident_bytes; }
+
+	// A smaller budget takes effect with the next update.
+	size_t budget() const { return m_budget; }
+	void set_budget(size_t budget_bytes) { m_budget = budget_bytes; }
+
+private:
+	size_t m_budget;
+	size_t m_n_resident_bytes = 0;
+	uint64_t m_frame = 0;
+	// Resident blocks and the frame in which they were last visible
+	std::unordered_map<uint32_t, uint64_t> m_last_used;
+	std::unordered_map<uint32_t, size_t> m_resident_n_bytes;
+};
+
+struct NerfScenePartitionCheck {
+	uint32_t n_rays = 0;
+	// Blocks on a ray that frustum culling removed
+	uint32_t n_culling_errors = 0;
+	// Pairs of consecutive blocks on a ray that the front-to-back order swaps
+	uint32_t n_order_errors = 0;
+	uint32_t n_residency_frames = 0;
+	// Frames after which the residency exceeded its budget, missed a visible block that would have fit, or evicted
+	// a block that was visible
+	uint32_t n_residency_errors = 0;
+};
+
+// Compares visibility and ordering against brute-force ray traversals of random views, and exercises the residency
+// of the partition's blocks with half their total size as the budget.
+NerfScenePartitionCheck check_nerf_scene_partition(const NerfScenePartition& partition, uint32_t n_views, uint32_t n_rays_per_view);
+
+NGP_NAMESPACE_END
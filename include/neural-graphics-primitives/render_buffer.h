@@ -14,13 +14,16 @@
 
 #pragma once
 
+#include <neural-graphics-primitives/adaptive_sampling.h>
 #include <neural-graphics-primitives/common.h>
 #include <neural-graphics-primitives/common_device.cuh>
 #include <neural-graphics-primitives/dlss.h>
 
 #include <tiny-cuda-nn/gpu_memory.h>
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 NGP_NAMESPACE_BEGIN
@@ -195,6 +198,10 @@ public:
 
 	void reset_accumulation() {
 		m_spp = 0;
+		m_accumulation_seeded = false;
+
+		// A fresh accumulation has to trace every pixel again, apart from those that the external mask hides.
+		m_sample_mask_installed = false;
 	}
 
 	uint32_t spp() const {
@@ -217,6 +224,43 @@ public:
 		return m_accumulate_buffer.data();
 	}
 
+	// Running mean of the squared sample luminance. Only allocated with adaptive sampling.
+	float* second_moment_buffer() const {
+		return m_second_moment_buffer.data();
+	}
+
+	// Number of samples accumulated into each pixel. Only allocated with adaptive sampling.
+	uint32_t* sample_count_buffer() const {
+		return m_sample_count_buffer.data();
+	}
+
+	bool adaptive_sampling() const {
+		return m_adaptive_sampling;
+	}
+
+	void enable_adaptive_sampling(bool enabled);
+
+	// Decides per tile whether sampling has converged and restricts subsequent frames to the pixels of
+	// the remaining active tiles. Returns the number of active tiles; zero means the image has converged.
+	uint32_t update_adaptive_sampling_mask(const AdaptiveSamplingSettings& settings, cudaStream_t stream);
+
+	// Restricts subsequent frames to the pixels of the given tiles (row-major, nonzero for active tiles of
+	// `tile_size`^2 pixels), e.g. as chosen by a ProgressiveTileScheduler. Requires adaptive sampling, which
+	// provides the per-pixel sample counts that let tiles accumulate independently.
+	void set_active_tiles(const std::vector<uint8_t>& tile_active, uint32_t tile_size, cudaStream_t stream);
+
+	// Per-pixel mask of the pixels that subsequent frames trace and accumulate. Shared with the adaptive
+	// sampling and tile masks and only effective once installed, which also masks out the pixels that the
+	// external hidden area mask hides. Requires adaptive sampling.
+	uint8_t* sample_mask();
+	void install_sample_mask(cudaStream_t stream);
+
+	// Marks the accumulation, sample count, and second moment buffers as pre-filled (e.g. with reprojected
+	// samples of a previous frame), such that the first accumulated frame does not clear them.
+	void seed_accumulation() {
+		m_accumulation_seeded = true;
+	}
+
 	CudaRenderBufferView view() const {
 		return {
 			frame_buffer(),
@@ -288,12 +332,19 @@ public:
 		return m_dlss;
 	}
 
+	// External mask of pixels that are never traced, e.g. the parts of a VR display that are not visible.
 	void set_hidden_area_mask(const std::shared_ptr<Buffer2D<uint8_t>>& hidden_area_mask) {
+		// An installed sample mask was combined with the previous external mask.
+		if (hidden_area_mask != m_hidden_area_mask) {
+			m_sample_mask_installed = false;
+		}
+
 		m_hidden_area_mask = hidden_area_mask;
 	}
 
+	// The mask that ray generators respect: the installed sample mask, or else the external hidden area mask.
 	const std::shared_ptr<Buffer2D<uint8_t>>& hidden_area_mask() const {
-		return m_hidden_area_mask;
+		return m_sample_mask_installed ? m_adaptive_mask : m_hidden_area_mask;
 	}
 
 private:
@@ -310,10 +361,122 @@ private:
 	tcnn::GPUMemory<float> m_depth_buffer;
 	tcnn::GPUMemory<vec4> m_accumulate_buffer;
 
+	bool m_adaptive_sampling = false;
+	bool m_accumulation_seeded = false;
+	// Resolution of the image in the accumulation buffer, which may outlive a reset of the accumulation.
+	ivec2 m_accumulated_resolution = ivec2(0);
+	tcnn::GPUMemory<float> m_second_moment_buffer;
+	tcnn::GPUMemory<uint32_t> m_sample_count_buffer;
+	tcnn::GPUMemory<uint8_t> m_tile_active;
+	std::shared_ptr<Buffer2D<uint8_t>> m_adaptive_mask = nullptr;
+	bool m_sample_mask_installed = false;
+
+	void install_tile_mask(uint32_t tile_size, cudaStream_t stream);
+
 	std::shared_ptr<Buffer2D<uint8_t>> m_hidden_area_mask = nullptr;
 
 	std::shared_ptr<SurfaceProvider> m_rgba_target;
 	std::shared_ptr<SurfaceProvider> m_depth_target;
 };
 
+enum class EReadbackFormat {
+	RGB8,
+	RGBA8,
+	RGBA16F,
+	RGBA32F,
+};
+
+inline size_t readback_bytes_per_pixel(EReadbackFormat format) {
+	switch (format) {
+		case EReadbackFormat::RGB8: return 3;
+		case EReadbackFormat::RGBA8: return 4;
+		case EReadbackFormat::RGBA16F: return 8;
+		case EReadbackFormat::RGBA32F: return 16;
+		default: throw std::runtime_error{"Invalid readback format."};
+	}
+}
+
+class ReadbackRing;
+
+// Handle to a frame that is being (or has been) read back into pinned host memory. The memory stays valid
+// until the handle is released or destroyed, after which the ring reuses it for another frame.
+class ReadbackFrame {
+public:
+	ReadbackFrame() = default;
+	ReadbackFrame(ReadbackFrame&& other) { *this = std::move(other); }
+	ReadbackFrame& operator=(ReadbackFrame&& other);
+	ReadbackFrame(const ReadbackFrame&) = delete;
+	ReadbackFrame& operator=(const ReadbackFrame&) = delete;
+
+	~ReadbackFrame() {
+		release();
+	}
+
+	// Blocks until the frame has arrived in host memory.
+	const void* data() const;
+	void release();
+
+	ivec2 resolution() const { return m_resolution; }
+	EReadbackFormat format() const { return m_format; }
+	size_t bytes() const { return compMul(m_resolution) * readback_bytes_per_pixel(m_format); }
+	explicit operator bool() const { return m_ring; }
+
+private:
+	friend class ReadbackRing;
+
+	ReadbackRing* m_ring = nullptr;
+	uint32_t m_slot = 0;
+	ivec2 m_resolution = ivec2(0);
+	EReadbackFormat m_format = EReadbackFormat::RGBA32F;
+};
+
+// A ring of pinned host buffers, each with its own events. Frames are converted to their output format on the
+// device, such that only the final bytes cross the bus, and copied asynchronously. The copy therefore overlaps
+// with whatever is submitted to the stream afterwards, e.g. the next frame.
+class ReadbackRing {
+public:
+	ReadbackRing(uint32_t n_slots = 3) : m_slots(n_slots) {}
+	~ReadbackRing();
+
+	ReadbackRing(const ReadbackRing&) = delete;
+	ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+	// Enqueues the conversion of `surface` (whose contents are in `surface_color_space`) to `format` in
+	// `output_color_space` and the copy to host memory. Blocks only if all slots are held by unreleased frames.
+	ReadbackFrame enqueue(
+		cudaSurfaceObject_t surface,
+		const ivec2& resolution,
+		EColorSpace surface_color_space,
+		EColorSpace output_color_space,
+		EReadbackFormat format,
+		cudaStream_t stream
+	);
+
+	// Device time from the start of the conversion until the arrival in host memory of all frames that
+	// have been waited for since the last call.
+	std::vector<float> pop_readback_timings();
+
+private:
+	friend class ReadbackFrame;
+
+	struct Slot {
+		tcnn::GPUMemory<uint8_t> device_buffer;
+		uint8_t* host_buffer = nullptr;
+		size_t host_buffer_bytes = 0;
+		cudaEvent_t start = nullptr;
+		cudaEvent_t done = nullptr;
+		bool in_use = false;
+		bool timing_reported = false;
+	};
+
+	const void* wait(uint32_t slot);
+	void release(uint32_t slot);
+
+	std::vector<Slot> m_slots;
+	uint32_t m_next_slot = 0;
+	std::vector<float> m_timings;
+	std::mutex m_mutex;
+	std::condition_variable m_slot_released;
+};
+
 NGP_NAMESPACE_END
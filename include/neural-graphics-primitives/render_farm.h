@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   render_farm.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Splits a camera-path render into leased frame chunks that several worker processes render in parallel.
+ *
+ *  The coordination logic (FrameRangeCoordinator) is free of I/O and takes the current time as an argument, so
+ *  that it can be driven by stand-in workers and a fake clock. The spool-directory classes implement the
+ *  transport between one coordinator process and any number of worker processes on top of it:
+ *
+ *    <spool>/workers/<id>  heartbeat counter, rewritten periodically by each worker
+ *    <spool>/leases/<id>   "<chunk> <begin_frame> <end_frame>", written by the coordinator
+ *    <spool>/done/<chunk>  id of the worker that finished the chunk, written by the worker
+ *    <spool>/frames/       rendered frames, named by frame index
+ *    <spool>/finished      written by the coordinator once every chunk is done
+ *
+ *  All files are written to a temporary name that is unique to the writer first and then renamed, so readers never
+ *  observe partial writes and concurrent writers of the same file do not collide.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+struct FrameChunk {
+	uint32_t id;
+	uint32_t begin_frame;
+	uint32_t end_frame; // exclusive
+};
+
+class FrameRangeCoordinator {
+public:
+	FrameRangeCoordinator(uint32_t n_frames, uint32_t chunk_size, double lease_timeout_seconds);
+
+	// Hands the lowest pending chunk to `worker`. Returns false if nothing is left to lease.
+	bool lease(const std::string& worker, double now, FrameChunk& chunk);
+
+	// Any sign of life of a worker. Leasing and completing also count as heartbeats.
+	void heartbeat(const std::string& worker, double now);
+
+	// Marks a chunk as done. Completion is accepted from any worker, including one whose lease already
+	// expired, as long as the chunk has not been completed before. Returns whether the chunk was newly completed.
+	bool complete(const std::string& worker, uint32_t chunk_id, double now);
+
+	// Returns the chunks of workers that have not been heard of for longer than the lease timeout to the pending
+	// queue and returns the ids of those workers.
+	std::vector<std::string> expire(double now);
+
+	// Frames that became available for in-order assembly since the last call, i.e. the frames of completed chunks
+	// that are not preceded by any incomplete chunk.
+	std::vector<uint32_t> pop_assemblable_frames();
+
+	bool is_alive(const std::string& worker) const;
+	bool holds_lease(const std::string& worker) const;
+	bool finished() const { return m_n_completed == m_chunks.size(); }
+
+	uint32_t n_frames() const { return m_n_frames; }
+	uint32_t n_chunks() const { return (uint32_t)m_chunks.size(); }
+	uint32_t n_completed() const { return m_n_completed; }
+
+private:
+	enum class EChunkState {
+		Pending,
+		Leased,
+		Done,
+	};
+
+	struct ChunkState {
+		FrameChunk chunk;
+		EChunkState state = EChunkState::Pending;
+		std::string worker;
+	};
+
+	uint32_t m_n_frames;
+	double m_lease_timeout;
+	std::vector<ChunkState> m_chunks;
+	std::map<std::string, double> m_last_seen;
+	uint32_t m_n_completed = 0;
+	uint32_t m_next_chunk_to_assemble = 0;
+};
+
+class SpoolDirectoryCoordinator {
+public:
+	SpoolDirectoryCoordinator(const fs::path& spool_dir, uint32_t n_frames, uint32_t chunk_size, double lease_timeout_seconds);
+
+	// Performs one round of coordination: picks up heartbeats and finished chunks, re-leases the chunks of dead
+	// workers and hands chunks to idle workers. Returns true once all frames are done.
+	bool poll();
+
+	std::vector<uint32_t> pop_assemblable_frames() { return m_coordinator.pop_assemblable_frames(); }
+	fs::path frame_dir() const { return m_spool_dir / "frames"; }
+	const FrameRangeCoordinator& coordinator() const { return m_coordinator; }
+
+private:
+	double now() const;
+
+	fs::path m_spool_dir;
+	FrameRangeCoordinator m_coordinator;
+	std::map<std::string, std::string> m_heartbeats;
+	std::chrono::time_point<std::chrono::steady_clock> m_start_time;
+};
+
+class SpoolDirectoryWorker {
+public:
+	SpoolDirectoryWorker(const fs::path& spool_dir, const std::string& id);
+	~SpoolDirectoryWorker();
+
+	// Must be called more often than the coordinator's lease timeout, including while rendering.
+	void heartbeat();
+	// Heartbeats every `interval_seconds` from a background thread until destruction, such that frames that take
+	// longer than the lease timeout do not get their chunk re-leased.
+	void start_heartbeat_thread(double interval_seconds);
+
+	// Returns true and the chunk if the coordinator leased a chunk to this worker that it has not completed yet.
+	bool next_chunk(FrameChunk& chunk);
+	void complete(const FrameChunk& chunk);
+	bool finished() const;
+
+	fs::path frame_dir() const { return m_spool_dir / "frames"; }
+	const std::string& id() const { return m_id; }
+
+private:
+	fs::path m_spool_dir;
+	std::string m_id;
+	uint64_t m_heartbeat_counter = 0;
+	int64_t m_last_completed_chunk = -1;
+
+	std::mutex m_heartbeat_mutex;
+	std::condition_variable m_heartbeat_cv;
+	bool m_stop_heartbeat_thread = false;
+	std::thread m_heartbeat_thread;
+};
+
+// Atomically replaces the contents of `path`.
+void write_file_atomic(const fs::path& path, const std::string& content);
+
+NGP_NAMESPACE_END
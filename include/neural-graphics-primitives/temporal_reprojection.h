@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   temporal_reprojection.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Reuses the accumulated samples of the previous camera-path frame by warping them into the
+ *          current view, such that only disoccluded or unreliable pixels need to be traced again.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/render_buffer.h>
+
+#include <tiny-cuda-nn/gpu_memory.h>
+
+NGP_NAMESPACE_BEGIN
+
+struct TemporalReprojectionSettings {
+	bool enabled = false;
+	// Maximum difference between the reprojected and the stored view depth, relative to the depth.
+	float depth_tolerance = 0.02f;
+	// Minimum cosine between the depth-derived normals of the previous and the current frame.
+	float min_normal_cos = 0.9f;
+	// Resampling blurs slightly, so pixels are traced from scratch after being reused this many frames in a row.
+	uint32_t max_age = 8;
+	// Additionally renders every frame without reprojection and reports the PSNR of the reprojected frame
+	// against it. Doubles the cost; meant for tuning the settings above.
+	bool measure_quality = false;
+};
+
+struct TemporalReprojectionStats {
+	uint32_t n_frames = 0;
+	float reused_fraction = 0.0f;
+	float mean_reused_fraction = 0.0f;
+	// Only measured with TemporalReprojectionSettings::measure_quality. Infinite if the frames are identical,
+	// in which case the frame does not count towards the mean.
+	uint32_t n_measured_frames = 0;
+	float psnr = 0.0f;
+	float mean_psnr = 0.0f;
+};
+
+class TemporalReprojection {
+public:
+	// Forgets the previous frame, e.g. at a cut or when the render settings change.
+	void invalidate() {
+		m_history_valid = false;
+	}
+
+	bool has_history() const {
+		return m_history_valid;
+	}
+
+	// Warps the previous frame into the view of `camera` and seeds the accumulation of `render_buffer` with it.
+	// Disoccluded pixels, pixels that fail the depth or normal test, and pixels that have been reused for too long
+	// start without samples; all others keep their previous sample count, scaled down by the test's confidence.
+	// Returns the number of reused pixels. Requires adaptive sampling on `render_buffer` for per-pixel sample counts.
+	uint32_t reproject(
+		CudaRenderBuffer& render_buffer,
+		const mat4x3& camera,
+		const vec2& focal_length,
+		const vec2& screen_center,
+		const vec3& parallax_shift,
+		uint32_t target_spp,
+		const TemporalReprojectionSettings& settings,
+		cudaStream_t stream
+	);
+
+	// Restricts the next sample to pixels with fewer than `target_spp` samples and records the depth of the
+	// pixels that the previous sample traced. Returns the number of pixels that still need samples.
+	uint32_t update_mask(CudaRenderBuffer& render_buffer, uint32_t target_spp, cudaStream_t stream);
+
+	// Keeps the finished frame around to be reprojected into the next one.
+	void store(CudaRenderBuffer& render_buffer, const mat4x3& camera, const vec2& focal_length, const vec2& screen_center, cudaStream_t stream);
+
+private:
+	uint32_t update_mask(CudaRenderBuffer& render_buffer, uint32_t target_spp, bool capture_depth, cudaStream_t stream);
+
+	bool m_history_valid = false;
+	ivec2 m_resolution = ivec2(0);
+	mat4x3 m_camera = mat4x3(1.0f);
+	vec2 m_focal_length = vec2(0.0f);
+	vec2 m_screen_center = vec2(0.5f);
+
+	tcnn::GPUMemory<vec4> m_history_color;
+	tcnn::GPUMemory<float> m_history_depth;
+	tcnn::GPUMemory<uint32_t> m_history_sample_count;
+	tcnn::GPUMemory<uint8_t> m_history_age;
+
+	// View depth of every pixel of the frame in progress: reprojected for reused pixels, traced for all others.
+	tcnn::GPUMemory<float> m_depth;
+	tcnn::GPUMemory<uint8_t> m_age;
+	tcnn::GPUMemory<float> m_splat_depth;
+	tcnn::GPUMemory<uint32_t> m_counter;
+};
+
+NGP_NAMESPACE_END
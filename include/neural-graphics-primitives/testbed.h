@@ -17,13 +17,19 @@
 #include <neural-graphics-primitives/adam_optimizer.h>
 #include <neural-graphics-primitives/camera_path.h>
 #include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/density_grid_schedule.h>
 #include <neural-graphics-primitives/discrete_distribution.h>
+#include <neural-graphics-primitives/error_map_sampler.h>
 #include <neural-graphics-primitives/nerf.h>
 #include <neural-graphics-primitives/nerf_loader.h>
 #include <neural-graphics-primitives/render_buffer.h>
 #include <neural-graphics-primitives/sdf.h>
 #include <neural-graphics-primitives/shared_queue.h>
+#include <neural-graphics-primitives/temporal_reprojection.h>
 #include <neural-graphics-primitives/thread_pool.h>
+#include <neural-graphics-primitives/tile_scheduler.h>
+#include <neural-graphics-primitives/training_profiler.h>
+#include <neural-graphics-primitives/training_scheduler.h>
 #include <neural-graphics-primitives/trainable_buffer.cuh>
 
 #ifdef NGP_GUI
@@ -144,6 +150,42 @@ public:
 	public:
 		NerfTracer() {}
 
+		// One view of a multi-view trace. Its rays share the ray pool and network inference batches with all other views.
+		struct View {
+			uint32_t sample_index;
+			ivec2 resolution;
+			vec2 focal_length;
+			mat4x3 camera_matrix0;
+			mat4x3 camera_matrix1;
+			vec4 rolling_shutter;
+			vec2 screen_center;
+			Foveation foveation;
+			vec4* frame_buffer;
+			float* depth_buffer;
+			Buffer2DView<const uint8_t> hidden_area_mask;
+		};
+
+		struct Stats {
+			uint32_t n_views = 0;
+			uint32_t n_rays = 0;
+			uint32_t n_inference_batches = 0;
+			// Network evaluations, including the batch padding and the steps past the end of rays
+			uint64_t n_queries = 0;
+			// Network evaluations that contribute to a ray. Only counted if enabled via count_useful_queries().
+			uint64_t n_useful_queries = 0;
+			// Iterations of empty-space skipping until the rays reach occupied cells. Also only counted if enabled via
+			// count_useful_queries().
+			uint64_t n_empty_space_steps = 0;
+			// Hash encoding levels evaluated by the network queries of rays. Only counted with level of detail and if
+			// enabled via count_useful_queries().
+			uint64_t n_level_evaluations = 0;
+			uint32_t n_iterations = 0;
+			// Times the host waited for an alive count of the marching loop while the device kept working on
+			// steps that were already enqueued, and times it drained the stream.
+			uint32_t n_host_waits = 0;
+			uint32_t n_stream_syncs = 0;
+		};
+
 		void init_rays_from_camera(
 			uint32_t spp,
 			uint32_t padded_output_width,
@@ -176,16 +218,36 @@ public:
 			cudaStream_t stream
 		);
 
+		void init_rays_from_views(
+			uint32_t padded_output_width,
+			uint32_t n_extra_dims,
+			const std::vector<View>& views,
+			const vec3& parallax_shift,
+			bool snap_to_pixel_centers,
+			const BoundingBox& render_aabb,
+			const mat3& render_aabb_to_local,
+			float near_distance,
+			float plane_z,
+			float aperture_size,
+			const Lens& lens,
+			const Buffer2DView<const vec4>& envmap,
+			const Buffer2DView<const vec2>& distortion,
+			const uint8_t* grid,
+			int show_accel,
+			uint32_t max_mip,
+			float cone_angle_constant,
+			ERenderMode render_mode,
+			cudaStream_t stream
+		);
+
 		uint32_t trace(
 			NerfNetwork<precision_t>& network,
 			const BoundingBox& render_aabb,
 			const mat3& render_aabb_to_local,
 			const BoundingBox& train_aabb,
-			const vec2& focal_length,
 			float cone_angle_constant,
 			const uint8_t* grid,
 			ERenderMode render_mode,
-			const mat4x3 &camera_matrix,
 			float depth_scale,
 			int visualized_layer,
 			int visualized_dim,
@@ -197,23 +259,74 @@ public:
 			float glow_y_cutoff,
 			int glow_mode,
 			const float* extra_dims_gpu,
-			cudaStream_t stream
+			cudaStream_t stream,
+			const NerfAovBuffers& aovs = {}
 		);
 
 		void enlarge(size_t n_elements, uint32_t padded_output_width, uint32_t n_extra_dims, cudaStream_t stream);
 		RaysNerfSoa& rays_hit() { return m_rays_hit; }
 		RaysNerfSoa& rays_init() { return m_rays[0]; }
 		uint32_t n_rays_initialized() const { return m_n_rays_initialized; }
+		const NerfTraceView* views() const { return m_views; }
+
+		// Costs one atomic per ray and inference batch, so it is off by default.
+		void count_useful_queries(bool enabled) { m_count_useful_queries = enabled; }
+		// Skips runs of empty cells in one step using the distance field that follows the density grid bitfield.
+		void skip_empty_space_with_distance_field(bool enabled) { m_skip_empty_space_with_distance_field = enabled; }
+		// Shape of the density grid that is passed to the tracing functions.
+		void set_density_grid_shape(const DensityGridShape& shape) { m_density_grid_shape = shape; }
+		// Must be set before the rays are initialized, which allocates the per-sample levels.
+		void set_level_of_detail(const NerfLevelOfDetail& lod) { m_lod = lod; }
+		// Rays start behind what the frame buffers already hold, i.e. with the transmittance that it leaves, and
+		// pixels with less than `min_transmittance` spawn no rays. Shading then composites behind the frame buffers'
+		// content. Several traces of disjoint regions can thereby render a scene front to back. Must be set before
+		// the rays are initialized.
+		void composite_behind(bool enabled, float min_transmittance) {
+			m_composite_behind = enabled;
+			m_composite_behind_min_transmittance = min_transmittance;
+		}
+		bool composite_behind() const { return m_composite_behind; }
+		const Stats& stats() const { return m_stats; }
 
 	private:
+		const uint8_t* distance_field(const uint8_t* grid) const;
+
 		RaysNerfSoa m_rays[2];
 		RaysNerfSoa m_rays_hit;
+		// Origin and direction of every initialized ray, indexed like the pixels of its view. See NerfTraceView.
+		vec3* m_ray_origin;
+		vec3* m_ray_dir;
 		precision_t* m_network_output;
 		float* m_network_input;
+		float* m_max_level; // per network query; only allocated with level of detail
 		uint32_t* m_hit_counter;
-		uint32_t* m_alive_counter;
+
+		// Slots of m_counters. Consecutive compactions alternate between the two alive counts, such that each
+		// compaction can read the count of its predecessor. The others are statistics, see count_useful_queries().
+		enum ECounter : uint32_t {
+			AliveCount0,
+			AliveCount1,
+			UsefulQueries,
+			EmptySpaceSteps,
+			LevelEvaluations,
+			NumCounters,
+		};
+
+		uint32_t* m_counters;
 		uint32_t m_n_rays_initialized = 0;
 		tcnn::GPUMemoryArena::Allocation m_scratch_alloc;
+
+		NerfTraceView* m_views = nullptr;
+		uint32_t m_n_views = 0;
+		tcnn::GPUMemoryArena::Allocation m_views_alloc;
+
+		bool m_count_useful_queries = false;
+		bool m_skip_empty_space_with_distance_field = true;
+		DensityGridShape m_density_grid_shape;
+		NerfLevelOfDetail m_lod;
+		bool m_composite_behind = false;
+		float m_composite_behind_min_transmittance = 0.0f;
+		Stats m_stats;
 	};
 
 	class FiniteDifferenceNormalsApproximator {
@@ -292,6 +405,30 @@ public:
 		const Foveation& foveation,
 		int visualized_dimension
 	);
+	// Clears `render_buffer` and describes it as one view of a multi-view trace.
+	NerfTracer::View nerf_tracer_view(
+		cudaStream_t stream,
+		CudaRenderBuffer& render_buffer,
+		const mat4x3& camera_matrix0,
+		const mat4x3& camera_matrix1,
+		const vec2& orig_screen_center,
+		const vec2& relative_focal_length,
+		const Foveation& foveation
+	);
+	// Level of detail of the NeRF's hash encoding for rendering, or a disabled one. See Nerf::render_lod.
+	NerfLevelOfDetail nerf_level_of_detail() const;
+	bool can_render_nerf_views_batched() const;
+	// With `composite_behind`, the NeRF is composited behind the current content of the views' frame buffers instead
+	// of in front of it. See NerfTracer::composite_behind().
+	NerfTracer::Stats render_nerf_views(
+		cudaStream_t stream,
+		const std::vector<NerfTracer::View>& views,
+		NerfNetwork<precision_t>& nerf_network,
+		const uint8_t* density_grid_bitfield,
+		int visualized_dimension,
+		bool count_useful_queries = false,
+		bool composite_behind = false
+	);
 	void render_sdf(
 		cudaStream_t stream,
 		const distance_fun_t& distance_function,
@@ -401,9 +538,14 @@ public:
 	void reset_camera();
 	bool keyboard_event();
 	void generate_training_samples_sdf(vec3* positions, float* distances, uint32_t n_to_generate, cudaStream_t stream, bool uniform_only);
-	void update_density_grid_nerf(float decay, uint32_t n_uniform_density_grid_samples, uint32_t n_nonuniform_density_grid_samples, cudaStream_t stream);
+	// Only the cascades in `cascade_mask` are sampled and decayed.
+	void update_density_grid_nerf(float decay, uint32_t n_uniform_density_grid_samples, uint32_t n_nonuniform_density_grid_samples, cudaStream_t stream, uint32_t cascade_mask = 0xFFFFFFFF);
 	void update_density_grid_mean_and_bitfield(cudaStream_t stream);
 	void mark_density_grid_in_sphere_empty(const vec3& pos, float radius, cudaStream_t stream);
+	// Resamples the density grid, whose cascades consist of `src_size`^3 cells, into the current density grid shape.
+	void resample_density_grid_nerf(uint32_t src_size, cudaStream_t stream);
+	// Changes the size and cascade count of the density grid, resampling its current estimate.
+	void set_density_grid_shape(const DensityGridShape& shape);
 
 	struct NerfCounters {
 		tcnn::GPUMemory<uint32_t> numsteps_counter; // number of steps each ray took
@@ -417,9 +559,27 @@ public:
 
 		void prepare_for_training_steps(cudaStream_t stream);
 		float update_after_training(uint32_t target_batch_size, bool get_loss_scalar, cudaStream_t stream);
+
+		// Counters (and loss) of a training step whose readback completed
+		struct Readback {
+			uint32_t measured_batch_size = 0;
+			uint32_t measured_batch_size_before_compaction = 0;
+			bool has_loss = false;
+			float loss = 0.0f;
+		};
+
+		// Alternative to update_after_training() that does not wait for the step to finish: the counters and loss
+		// are copied into a ring of pinned host memory, and the batch size adapts to the measurements of earlier
+		// steps as they arrive. Blocks only if the ring is full.
+		void enqueue_readback(uint32_t target_batch_size, bool get_loss_scalar, cudaStream_t stream);
+		// Returns the completed readbacks in step order. With `wait`, waits for all enqueued readbacks.
+		std::vector<Readback> poll_readbacks(bool wait);
+
+		struct PendingReadbacks;
+		std::shared_ptr<PendingReadbacks> pending_readbacks;
 	};
 
-	void train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaStream_t stream);
+	void train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaStream_t stream, bool async_readback = false);
 	void train_nerf_step(uint32_t target_batch_size, NerfCounters& counters, cudaStream_t stream);
 	void train_sdf(size_t target_batch_size, bool get_loss_scalar, cudaStream_t stream);
 	void train_image(size_t target_batch_size, bool get_loss_scalar, cudaStream_t stream);
@@ -434,6 +594,25 @@ public:
 	void training_prep_sdf(uint32_t batch_size, cudaStream_t stream);
 	void training_prep_image(uint32_t batch_size, cudaStream_t stream) {}
 	void train(uint32_t batch_size);
+	// Enqueues `n_steps` training steps back to back without waiting for each to finish. The loss is read back
+	// asynchronously every `loss_readback_interval` steps (NeRF), or synchronously at that interval (other modes).
+	void train_n_steps(uint32_t n_steps, uint32_t batch_size, uint32_t loss_readback_interval = 16);
+	// Trains until `config`'s time or step budget runs out or the loss returned by `evaluate`, e.g. of held-out views,
+	// plateaus, with the batch size and density grid cadence chosen by a TrainingScheduler. Without `evaluate`, the
+	// training loss decides. With `replay`, repeats the decisions of an earlier run instead.
+	TrainingScheduler train_with_schedule(const TrainingScheduleConfig& config, const std::function<float()>& evaluate = {}, const std::vector<TrainingDecision>& replay = {});
+	// Shared by train() and train_n_steps(). Returns false if there is nothing to train.
+	bool prepare_training();
+	// Steps between training_prep() calls, i.e. density grid updates in NeRF mode
+	uint32_t training_prep_interval() const;
+	void training_prep(uint32_t batch_size, cudaStream_t stream);
+	// Applies the GUI's optimizer settings to the leaf optimizer, if they or the optimizer changed since the last call.
+	void update_optimizer_hyperparams();
+	// Times the remainder of the enclosing scope as `phase` of the current training step, on the host and with a pair of
+	// device events on `stream`. A no-op unless the training profiler is enabled.
+	tcnn::ScopeGuard profile_training_phase(ETrainingPhase phase, cudaStream_t stream);
+	// Hands the durations of completed device event pairs to the training profiler. Does not block unless `wait`.
+	void poll_training_profiler(bool wait);
 	vec2 calc_focal_length(const ivec2& resolution, const vec2& relative_focal_length, int fov_axis, float zoom) const;
 	vec2 render_screen_center(const vec2& screen_center) const;
 	void optimise_mesh_step(uint32_t N_STEPS);
@@ -443,6 +622,22 @@ public:
 	tcnn::GPUMemory<vec4> get_rgba_on_grid(ivec3 res3d, vec3 ray_dir, bool voxel_centers, float depth, bool density_as_alpha = false);
 	int marching_cubes(ivec3 res3d, const BoundingBox& render_aabb, const mat3& render_aabb_to_local, float thresh);
 
+	// Color and auxiliary outputs of a NeRF, all produced by a single trace of the current camera.
+	// Depths are distances along the view axis in the units of the training data; a median depth of 0 means that the
+	// accumulated alpha never reached 0.5.
+	struct AovImages {
+		ivec2 resolution = ivec2(0);
+		std::vector<vec4> rgba; // linear
+		std::vector<float> alpha;
+		std::vector<float> expected_depth;
+		std::vector<float> median_depth;
+		std::vector<vec3> normal;
+		std::vector<uint32_t> n_steps;
+	};
+
+	AovImages render_aovs(const ivec2& resolution, bool normals = true);
+	void save_aovs_exr(const AovImages& aovs, const fs::path& path);
+
 	float get_depth_from_renderbuffer(const CudaRenderBuffer& render_buffer, const vec2& uv);
 	vec3 get_3d_pos_from_pixel(const CudaRenderBuffer& render_buffer, const ivec2& focus_pixel);
 	void autofocus();
@@ -450,10 +645,58 @@ public:
 	size_t first_encoder_param();
 	size_t n_encoding_params();
 
+	// Rendering throughput at one camera distance with and without Nerf::render_lod
+	struct LevelOfDetailBenchmark {
+		float distance = 0.0f;
+		float full_ms = 0.0f;
+		float full_msamples_per_second = 0.0f;
+		float lod_ms = 0.0f;
+		float lod_msamples_per_second = 0.0f;
+		// Hash encoding levels evaluated per sample with level of detail, out of all levels without
+		float lod_mean_levels = 0.0f;
+		uint32_t n_levels = 0;
+		float speedup = 0.0f;
+	};
+
+	// Training throughput of one train() per step, as in the frame loop, against train_n_steps()
+	struct TrainingLoopBenchmark {
+		uint32_t n_steps = 0;
+		float per_step_steps_per_second = 0.0f;
+		float batched_steps_per_second = 0.0f;
+		float speedup = 0.0f;
+	};
+
+	// Construction and sampling cost of the error map samplers on synthetic error
+	struct ErrorMapSamplerBenchmark {
+		uint32_t n_images = 0;
+		ivec2 resolution = ivec2(0);
+		float touched_fraction = 0.0f;
+		float cdf_build_ms = 0.0f;
+		float alias_build_ms = 0.0f;
+		// Rebuild after error was deposited into `touched_fraction` of the images
+		float alias_incremental_build_ms = 0.0f;
+		float host_build_ms = 0.0f;
+		float host_incremental_build_ms = 0.0f;
+		float cdf_msamples_per_second = 0.0f;
+		float alias_msamples_per_second = 0.0f;
+		// Largest difference of the GPU's alias table probabilities from the host's
+		float max_pmf_difference = 0.0f;
+		// Largest deviation of any of the alias tables from the probabilities it represents
+		float max_alias_error = 0.0f;
+	};
+
+	ErrorMapSamplerBenchmark benchmark_error_map_sampler(uint32_t n_images, ivec2 resolution, float touched_fraction, uint32_t n_samples);
+
 #ifdef NGP_PYTHON
 	pybind11::dict compute_marching_cubes_mesh(ivec3 res3d = ivec3(128), BoundingBox aabb = BoundingBox{vec3(0.0f), vec3(1.0f)}, float thresh=2.5f);
 	pybind11::array_t<float> render_to_cpu(int width, int height, int spp, bool linear, float start_t, float end_t, float fps, float shutter_fraction);
-	pybind11::array_t<float> view(bool linear, size_t view) const;
+	pybind11::array_t<float> render_batch(pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> poses, pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> focal_lengths, int width, int height, int spp, bool linear, pybind11::object out, std::function<void(int, pybind11::array_t<float>)> sink);
+	pybind11::array_t<uint32_t> render_sample_counts() const;
+	pybind11::array_t<float> render_views(pybind11::array_t<float> poses, int width, int height, int spp, bool linear, bool compare_to_per_view);
+	std::vector<LevelOfDetailBenchmark> benchmark_level_of_detail(const std::vector<float>& distances, int width, int height, int n_frames);
+	TrainingLoopBenchmark benchmark_training_loop(uint32_t n_steps, uint32_t loss_readback_interval);
+	pybind11::dict render_aovs_to_cpu(int width, int height, bool normals, const fs::path& exr_path);
+	pybind11::array view(bool linear, size_t view, const std::string& dtype) const;
 	pybind11::array_t<float> screenshot(bool linear, bool front_buffer) const;
 	void override_sdf_training_data(pybind11::array_t<float> points, pybind11::array_t<float> distances);
 #endif
@@ -487,13 +730,54 @@ public:
 	void set_fov_xy(const vec2& val);
 	void save_snapshot(const fs::path& path, bool include_optimizer_state, bool compress);
 	void load_snapshot(const fs::path& path);
+	// Evaluates the NeRF network on random inputs and stores inputs and raw outputs, such that CPU inference of the
+	// snapshot can be checked against the GPU. See CpuNerf::check_reference().
+	void save_nerf_reference_outputs(const fs::path& path, uint32_t n_samples);
+	// Bakes density and spherical harmonics color into the sparse voxel format of baked_nerf.h. `resolution` voxels
+	// span the longest axis of the render aabb; colors are fitted to `n_directions` network evaluations per voxel.
+	void bake_nerf(const fs::path& path, uint32_t resolution, uint32_t sh_degree, uint32_t n_directions);
+
+	struct DensityGridDistanceFieldCheck {
+		uint32_t n_cells = 0;
+		// Cells in which the distance field on the GPU differs from the multithreaded host transform
+		uint32_t n_mismatches = 0;
+		float host_ms = 0.0f;
+		// Random cells in which the host transform differs from an exhaustive search
+		uint32_t n_brute_force_samples = 0;
+		uint32_t n_brute_force_mismatches = 0;
+		float mean_distance = 0.0f;
+	};
+
+	// Compares the distance field that update_density_grid_mean_and_bitfield() builds on the GPU against the host
+	// implementation of the transform, and the latter against a brute-force reference on random cells.
+	DensityGridDistanceFieldCheck check_density_grid_distance_field(uint32_t n_brute_force_samples);
+
+	struct NerfRayCompactionCheck {
+		uint32_t n_rays = 0;
+		uint32_t n_alive = 0;
+		uint32_t n_hit = 0;
+		// Compacted rays whose state on the GPU differs from a compaction of the former array-of-structures payload
+		uint32_t n_mismatches = 0;
+		// Bytes of ray state that compaction moves per ray, with and without the origin and direction
+		uint32_t aos_bytes_per_ray = 0;
+		uint32_t soa_bytes_per_ray = 0;
+	};
+
+	// Compacts random rays with compact_kernel_nerf and compares the result, including the origins and directions
+	// that rays look up by pixel index, against a host compaction of the former array-of-structures layout.
+	NerfRayCompactionCheck check_nerf_ray_compaction(uint32_t n_rays);
 	CameraKeyframe copy_camera_to_keyframe() const;
 	void set_camera_from_keyframe(const CameraKeyframe& k);
 	void set_camera_from_time(float t);
+	// Advances the camera state exactly like rendering the camera-path frame [start_time,end_time] would, but without
+	// rendering. Allows starting a path render in the middle with the same camera smoothing and motion blur.
+	void skip_camera_path_frame(float start_time, float end_time, float fps);
 	void update_loss_graph();
 	void load_camera_path(const fs::path& path);
 	bool loop_animation();
 	void set_loop_animation(bool value);
+	// Camera poses at the given path times, e.g. of all frames of a render job. In NeRF convention if `nerf_space`.
+	std::vector<mat4x3> camera_path_poses(const std::vector<float>& ts, bool nerf_space = true);
 
 	float compute_image_mse(bool quantize_to_byte);
 
@@ -577,6 +861,35 @@ public:
 
 	CameraPath m_camera_path = {};
 
+	struct MultiViewRenderStats {
+		uint32_t n_views = 0;
+		float ms = 0.0f;
+		uint32_t n_inference_batches = 0;
+		// Fraction of network evaluations that contribute to a ray; the remainder is batch padding and steps past the end of rays.
+		float occupancy = 0.0f;
+		// Empty-space skipping iterations per ray. Compare renders with and without Nerf::skip_empty_space_with_distance_field.
+		float empty_space_steps_per_ray = 0.0f;
+
+		// Only measured with `compare_to_per_view`: the same views rendered one trace at a time.
+		float per_view_ms = 0.0f;
+		uint32_t per_view_inference_batches = 0;
+		float per_view_occupancy = 0.0f;
+		float per_view_empty_space_steps_per_ray = 0.0f;
+		float speedup = 0.0f;
+	};
+
+	MultiViewRenderStats m_multi_view_render_stats = {};
+	std::vector<CudaRenderBuffer> m_multi_view_render_buffers;
+
+	// Adaptive sampling for offline (windowless) renders. When enabled, the `spp` passed to `render_to_cpu` is the per-pixel maximum.
+	AdaptiveSamplingSettings m_adaptive_sampling = {};
+	// Interactive views render a time-budgeted subset of screen tiles per frame, from the screen center outwards.
+	ProgressiveTileSettings m_progressive_tiles = {};
+	// Camera-path renders through `render_to_cpu` reuse the previous frame's samples where they reproject reliably.
+	TemporalReprojectionSettings m_temporal_reprojection = {};
+	TemporalReprojectionStats m_temporal_reprojection_stats = {};
+	TemporalReprojection m_temporal_reprojection_history;
+
 	vec3 m_up_dir = {0.0f, 1.0f, 0.0f};
 	vec3 m_sun_dir = normalize(vec3(1.0f));
 	float m_bounding_radius = 1;
@@ -647,6 +960,34 @@ public:
 				ivec2 resolution = {16, 16};
 				ivec2 cdf_resolution = {16, 16};
 				bool is_cdf_valid = false;
+
+				// Alias table hierarchy of EErrorMapSampler::Alias, see error_map_sampler.h
+				tcnn::GPUMemory<float> pmf_x_cond_y;
+				tcnn::GPUMemory<float> pmf_y;
+				tcnn::GPUMemory<float> pmf_img;
+				tcnn::GPUMemory<AliasEntry> alias_x_cond_y;
+				tcnn::GPUMemory<AliasEntry> alias_y;
+				tcnn::GPUMemory<AliasEntry> alias_img;
+				tcnn::GPUMemory<float> row_weight;
+				tcnn::GPUMemory<float> image_weight;
+				tcnn::GPUMemory<uint32_t> alias_scratch;
+				std::vector<AliasEntry> alias_img_cpu;
+				// Shape of the alias tables, or zero if they need to be rebuilt entirely
+				ivec2 alias_resolution = {0, 0};
+				uint32_t alias_n_images = 0;
+
+				// Per image. Bit 0 is set when error is deposited into the image, bit 1 holds bit 0 of the previous
+				// update. The tables of images with neither are built from an all-zero error and remain valid.
+				tcnn::GPUMemory<uint8_t> touched;
+				tcnn::GPUMemory<uint8_t> dirty;
+				uint32_t n_rebuilt_images = 0;
+
+				// Builds the sampling tables of the first `n_images` images from `data`.
+				void build_cdf(uint32_t n_images, cudaStream_t stream);
+				// Only rebuilds the row and column tables of images whose error changed.
+				void build_alias_tables(uint32_t n_images, cudaStream_t stream);
+
+				ErrorMapSampler sampler(EErrorMapSampler mode, bool sample_focal_plane, bool sample_image) const;
 			} error_map;
 
 			std::vector<TrainingXForm> transforms;
@@ -665,16 +1006,24 @@ public:
 			vec2 cam_focal_length_gradient = vec2(0.0f);
 			tcnn::GPUMemory<vec2> cam_focal_length_gradient_gpu;
 
-			std::vector<AdamOptimizer<vec3>> cam_exposure;
-			std::vector<AdamOptimizer<vec3>> cam_pos_offset;
-			std::vector<RotationAdamOptimizer> cam_rot_offset;
+			// One item per training image, stepped together
+			BatchedAdamOptimizer cam_exposure = BatchedAdamOptimizer(3, 1e-3f);
+			BatchedAdamOptimizer cam_pos_offset = BatchedAdamOptimizer(3, 1e-4f);
+			BatchedAdamOptimizer cam_rot_offset = BatchedAdamOptimizer(3, 1e-4f); // rotation vectors; updates are composed as rotations
 			AdamOptimizer<vec2> cam_focal_length_offset = AdamOptimizer<vec2>(0.0f);
 
 			tcnn::GPUMemory<float> extra_dims_gpu; // if the model demands a latent code per training image, we put them in here.
 			tcnn::GPUMemory<float> extra_dims_gradient_gpu;
-			std::vector<VarAdamOptimizer> extra_dims_opt;
+			BatchedAdamOptimizer extra_dims_opt;
+
+			// Steps the latent codes on the GPU, such that their gradients are not read back every step. While active,
+			// extra_dims_gpu holds the authoritative latent codes and extra_dims_opt is stale until synced.
+			bool optimize_extra_dims_on_gpu = false;
+			GpuBatchedAdamOptimizer extra_dims_opt_gpu;
 
 			void reset_extra_dims(default_rng_t &rng);
+			// Hands the latent codes and their optimizer state back to extra_dims_opt if they live on the GPU.
+			void sync_extra_dims_to_host(cudaStream_t stream);
 
 			float extrinsic_l2_reg = 1e-4f;
 			float extrinsic_learning_rate = 1e-3f;
@@ -703,6 +1052,7 @@ public:
 
 			bool sample_focal_plane_proportional_to_error = false;
 			bool sample_image_proportional_to_error = false;
+			EErrorMapSampler error_map_sampler = EErrorMapSampler::Alias;
 			bool include_sharpness_in_error = false;
 			uint32_t n_steps_between_error_map_updates = 128;
 			uint32_t n_steps_since_error_map_update = 0;
@@ -711,6 +1061,14 @@ public:
 			float near_distance = 0.1f;
 			float density_grid_decay = 0.95f;
 			default_rng_t density_grid_rng;
+
+			// Adapts the cadence and size of the density grid updates to the number of occupancy bits that they flip.
+			// The flips are counted against a copy of the bitfield from before the update and read back asynchronously.
+			DensityGridSchedule density_grid_schedule;
+			tcnn::GPUMemory<uint8_t> density_grid_bitfield_prev;
+			tcnn::GPUMemory<uint32_t> density_grid_flips;
+			struct DensityGridFlipReadback;
+			std::shared_ptr<DensityGridFlipReadback> density_grid_flip_readback;
 			int view = 0;
 
 			float depth_supervision_lambda = 0.f;
@@ -732,9 +1090,11 @@ public:
 			void export_camera_extrinsics(const fs::path& path, bool export_extrinsics_in_quat_format = true);
 		} training = {};
 
-		tcnn::GPUMemory<float> density_grid; // NERF_GRIDSIZE()^3 grid of EMA smoothed densities from the network
+		DensityGridShape density_grid_shape; // model parameter, see Testbed::set_density_grid_shape
+		tcnn::GPUMemory<float> density_grid; // density_grid_shape.size^3 grid of EMA smoothed densities per cascade
 		tcnn::GPUMemory<uint8_t> density_grid_bitfield;
 		uint8_t* get_density_grid_bitfield_mip(uint32_t mip);
+		uint8_t* get_density_grid_distance_field(uint32_t mip);
 		tcnn::GPUMemory<float> density_grid_mean;
 		uint32_t density_grid_ema_step = 0;
 
@@ -752,15 +1112,30 @@ public:
 
 		float cone_angle_constant = 1.f/256.f;
 
+		// Lets rendered rays leave runs of empty density grid cells in one step, using the Chebyshev distance field
+		// that update_density_grid_mean_and_bitfield() builds next to the bitfield.
+		bool skip_empty_space_with_distance_field = true;
+
 		bool visualize_cameras = false;
 		bool render_with_lens_distortion = false;
 		Lens render_lens = {};
 
 		float render_min_transmittance = 0.01f;
 
+		// Skips the fine hash encoding levels of samples whose pixel footprint is too coarse to resolve them. Train
+		// with randomized max levels to keep the truncated encoding accurate. See NerfLevelOfDetail.
+		bool render_lod = false;
+		float render_lod_bias = 0.0f;
+
+		// Renders all views (e.g. both eyes in VR) with a single trace, such that they share ray marching and
+		// network inference batches. Only applies while all views are rendered by the primary GPU.
+		bool render_views_in_one_trace = false;
+
 		float glow_y_cutoff = 0.f;
 		int glow_mode = 0;
 
+		// Only set for the duration of render_aovs().
+		NerfAovBuffers render_aovs = {};
 	} m_nerf;
 
 	struct Sdf {
@@ -895,7 +1270,12 @@ public:
 	// Rendering/UI bookkeeping
 	Ema m_training_prep_ms = {EEmaType::Time, 100};
 	Ema m_training_ms = {EEmaType::Time, 100};
+	TrainingProfiler m_training_profiler;
+	struct TrainingProfilerEvents;
+	std::shared_ptr<TrainingProfilerEvents> m_training_profiler_events;
 	Ema m_render_ms = {EEmaType::Time, 100};
+	// Device time of converting and copying a finished frame to host memory
+	Ema m_readback_ms = {EEmaType::Time, 100};
 	// The frame contains everything, i.e. training + rendering + GUI and buffer swapping
 	Ema m_frame_ms = {EEmaType::Time, 100};
 	std::chrono::time_point<std::chrono::steady_clock> m_last_frame_time_point;
@@ -925,6 +1305,8 @@ public:
 		vec2 relative_focal_length;
 		vec2 screen_center;
 
+		ProgressiveTileScheduler tile_scheduler;
+
 		CudaDevice* device = nullptr;
 	};
 
@@ -973,6 +1355,8 @@ public:
 
 	uint32_t m_training_step = 0;
 	uint32_t m_training_batch_size = 1 << 18;
+	// Overrides the density grid update cadence if nonzero, see train_with_schedule()
+	uint32_t m_training_prep_interval = 0;
 	Ema m_loss_scalar = {EEmaType::Time, 100};
 	std::vector<float> m_loss_graph = std::vector<float>(256, 0.0f);
 	size_t m_loss_graph_samples = 0;
@@ -1139,6 +1523,8 @@ public:
 		return m_devices.front();
 	}
 
+	// Declared before the thread pool, such that pending frame writers finish before the ring is destroyed.
+	mutable ReadbackRing m_readback_ring;
 	ThreadPool m_thread_pool;
 	std::vector<std::future<void>> m_render_futures;
 
@@ -1154,6 +1540,9 @@ public:
 	fs::path m_network_config_path = "base.json";
 
 	nlohmann::json m_network_config;
+	// Optimizer config as last applied by update_optimizer_hyperparams(), and to which optimizer
+	nlohmann::json m_applied_optimizer_config;
+	const void* m_applied_optimizer = nullptr;
 
 
 	default_rng_t m_rng;
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   tile_scheduler.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Host-side scheduling of screen-space tiles for progressive interactive rendering.
+ *          Decides which tiles get a sample in each frame; free of CUDA, such that the
+ *          ordering and budget policy can be exercised on the host.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+struct ProgressiveTileSettings {
+	bool enabled = false;
+	uint32_t tile_size = 64;
+	// Wall time that the rendering part of a frame should take. At least one tile is rendered per frame.
+	float frame_budget_ms = 16.0f;
+};
+
+class ProgressiveTileScheduler {
+public:
+	// Starts a new accumulation and thereby cancels every tile that was scheduled for the previous one.
+	// Tiles are handed out in passes: each pass gives every tile one more sample, starting at the tile
+	// closest to `fovea` (in [0,1]^2 screen coordinates) and working outwards.
+	void reset(const ivec2& resolution, uint32_t tile_size, const vec2& fovea, uint32_t target_spp);
+
+	// Wall time of rendering the tiles of the most recent call to next_tiles(). Refines the cost model
+	// (fixed overhead plus cost per pixel) that decides how many tiles fit into a frame. Ignored if no
+	// tiles are in flight, e.g. after a reset.
+	void report_frame_time(float ms);
+
+	// Tiles (indices into the row-major tile grid) to render in the next frame, as many as fit into
+	// `budget_ms` according to the cost estimate and never more than one pass. Empty once finished.
+	const std::vector<uint32_t>& next_tiles(float budget_ms);
+
+	// Expands a list of tiles into the per-tile activity mask that the render buffer consumes.
+	std::vector<uint8_t> tile_mask(const std::vector<uint32_t>& tiles) const;
+
+	bool finished() const { return m_pass >= m_target_spp; }
+
+	const ivec2& resolution() const { return m_resolution; }
+	uint32_t tile_size() const { return m_tile_size; }
+	ivec2 tile_resolution() const { return m_tile_resolution; }
+	uint32_t n_tiles() const { return (uint32_t)m_order.size(); }
+	uint32_t tile_spp(uint32_t tile) const { return m_tile_spp.at(tile); }
+	uint32_t tile_n_pixels(uint32_t tile) const;
+
+	// Incremented by every reset. Work tagged with an older generation is stale.
+	uint64_t generation() const { return m_generation; }
+
+	float ms_per_pixel() const { return m_ms_per_pixel; }
+	float overhead_ms() const { return m_overhead_ms; }
+
+private:
+	ivec2 m_resolution = ivec2(0);
+	ivec2 m_tile_resolution = ivec2(0);
+	uint32_t m_tile_size = 0;
+	uint32_t m_target_spp = 0;
+	uint64_t m_generation = 0;
+
+	// Tiles sorted by distance from the fovea. A pass walks this order from front to back.
+	std::vector<uint32_t> m_order;
+	std::vector<uint32_t> m_tile_spp;
+	uint32_t m_cursor = 0;
+	uint32_t m_pass = 0;
+
+	std::vector<uint32_t> m_next_tiles;
+	size_t m_n_pixels_in_flight = 0;
+
+	// The cost model persists across resets: the cost of a pixel does not change much when the camera moves.
+	float m_ms_per_pixel = 0.0f;
+	float m_overhead_ms = 0.0f;
+	double m_mean_pixels = 0.0;
+	double m_mean_ms = 0.0;
+	double m_mean_pixels_sq = 0.0;
+	double m_mean_pixels_ms = 0.0;
+	uint32_t m_n_measurements = 0;
+	size_t m_n_pixels_last_frame = 0;
+};
+
+NGP_NAMESPACE_END
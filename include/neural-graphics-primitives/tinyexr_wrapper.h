@@ -18,9 +18,15 @@
 
 #include <neural-graphics-primitives/common.h>
 
+#include <string>
+#include <utility>
+#include <vector>
+
 NGP_NAMESPACE_BEGIN
 
 void save_exr(const float* data, int width, int height, int nChannels, int channelStride, const fs::path& path);
+// Writes named single-channel planes of width*height floats (e.g. "R", "G", "B", "A", "Z") at full precision.
+void save_exr(std::vector<std::pair<std::string, const float*>> channels, int width, int height, const fs::path& path);
 void load_exr(float** data, int* width, int* height, const fs::path& path);
 __half* load_exr_to_gpu(int* width, int* height, const fs::path& path, bool fix_premult);
 
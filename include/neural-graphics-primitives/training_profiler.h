@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   training_profiler.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Aggregation of per-phase training timings into histograms and their export as a Chrome trace
+ *          (chrome://tracing, Perfetto). Free of CUDA: the testbed measures the phases on the host and with
+ *          device event pairs and hands the durations to this class.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <json/json.hpp>
+
+#include <array>
+#include <string>
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+enum class ETrainingPhase : uint32_t {
+	// A whole training step, including the phases below
+	Step,
+	// Density grid update (NeRF) or training data generation (other modes)
+	Prep,
+	GenerateSamples,
+	Inference,
+	Loss,
+	ForwardBackward,
+	// Extra-dims and camera gradient kernels
+	InputGradients,
+	OptimizerStep,
+	CounterReadback,
+	ErrorMapCdf,
+	// Host-side optimization of extra dims and cameras
+	ExtraDimsUpdate,
+	CameraUpdate,
+	NumPhases,
+};
+
+static constexpr uint32_t N_TRAINING_PHASES = (uint32_t)ETrainingPhase::NumPhases;
+
+std::string to_string(ETrainingPhase phase);
+
+enum class ETrainingTrack : uint32_t {
+	// Wall time of issuing a phase on the host thread
+	Host,
+	// Time between device events recorded around a phase on the training stream
+	Device,
+};
+
+static constexpr uint32_t N_TRAINING_TRACKS = 2;
+
+// Histogram of durations with 4 logarithmic buckets per octave, starting at 1/16µs.
+class TrainingPhaseHistogram {
+public:
+	static constexpr uint32_t N_BUCKETS_PER_OCTAVE = 4;
+	static constexpr uint32_t N_BUCKETS = 32 * N_BUCKETS_PER_OCTAVE;
+	static constexpr double MIN_US = 1.0 / 16.0;
+
+	void add(double us);
+
+	uint64_t count() const { return m_count; }
+	double total_us() const { return m_total_us; }
+	double mean_us() const { return m_count > 0 ? m_total_us / m_count : 0.0; }
+	double min_us() const { return m_count > 0 ? m_min_us : 0.0; }
+	double max_us() const { return m_count > 0 ? m_max_us : 0.0; }
+
+	// Interpolates geometrically within the bucket that contains the `p`-th quantile (p in [0,1]).
+	// Exact to within a bucket width, i.e. about 19%, and clamped to the observed range.
+	double percentile_us(double p) const;
+
+	static uint32_t bucket(double us);
+	static double bucket_lower_us(uint32_t bucket);
+
+	const std::array<uint64_t, N_BUCKETS>& buckets() const { return m_buckets; }
+
+private:
+	std::array<uint64_t, N_BUCKETS> m_buckets = {};
+	uint64_t m_count = 0;
+	double m_total_us = 0.0;
+	double m_min_us = 0.0;
+	double m_max_us = 0.0;
+};
+
+struct TrainingProfileEvent {
+	ETrainingPhase phase;
+	ETrainingTrack track;
+	uint32_t step;
+	// Relative to the start of profiling on the respective track. Host and device clocks are not aligned.
+	double start_us;
+	double duration_us;
+};
+
+struct TrainingPhaseStats {
+	ETrainingPhase phase;
+	ETrainingTrack track;
+	uint64_t count;
+	double total_ms;
+	double mean_ms;
+	double min_ms;
+	double p50_ms;
+	double p90_ms;
+	double p99_ms;
+	double max_ms;
+};
+
+class TrainingProfiler {
+public:
+	bool enabled() const { return m_enabled; }
+	void set_enabled(bool enabled) { m_enabled = enabled; }
+
+	// Steps in [begin_step, end_step) keep their individual events for the trace. The histograms cover every
+	// recorded step regardless.
+	void set_trace_range(uint32_t begin_step, uint32_t end_step);
+	uint32_t trace_begin_step() const { return m_trace_begin_step; }
+	uint32_t trace_end_step() const { return m_trace_end_step; }
+
+	// Caps the memory of the trace. Events beyond the cap still enter the histograms.
+	size_t max_trace_events = (size_t)1 << 20;
+
+	void record(ETrainingPhase phase, ETrainingTrack track, uint32_t step, double start_us, double duration_us);
+
+	const TrainingPhaseHistogram& histogram(ETrainingPhase phase, ETrainingTrack track) const {
+		return m_histograms.at((size_t)track * N_TRAINING_PHASES + (size_t)phase);
+	}
+
+	const std::vector<TrainingProfileEvent>& events() const { return m_events; }
+	size_t n_dropped_events() const { return m_n_dropped_events; }
+
+	// One entry per phase and track with at least one recorded duration
+	std::vector<TrainingPhaseStats> stats() const;
+	std::string summary() const;
+
+	// Trace event format with one process per track, complete ("X") events and the step as an argument
+	nlohmann::json chrome_trace() const;
+	void save_chrome_trace(const fs::path& path) const;
+
+	void reset();
+
+private:
+	bool m_enabled = false;
+	uint32_t m_trace_begin_step = 0;
+	uint32_t m_trace_end_step = 0;
+
+	std::array<TrainingPhaseHistogram, N_TRAINING_PHASES * N_TRAINING_TRACKS> m_histograms;
+	std::vector<TrainingProfileEvent> m_events;
+	size_t m_n_dropped_events = 0;
+};
+
+NGP_NAMESPACE_END
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   training_scheduler.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Policy that trains within a time or step budget: it picks the batch size and the density grid update
+ *          cadence from measured throughput and stops once an evaluation loss plateaus. Free of CUDA: it only sees
+ *          the durations and losses that the caller reports, such that it can be driven by synthetic ones.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <json/json.hpp>
+
+#include <string>
+#include <vector>
+
+NGP_NAMESPACE_BEGIN
+
+enum class ETrainingDecision : int {
+	// Starts measuring the throughput of a candidate batch size
+	ProbeBatchSize,
+	BatchSize,
+	// Overrides the density grid update cadence, or restores the default cadence if 0
+	DensityGridInterval,
+	Stop,
+};
+
+enum class ETrainingStopReason : int {
+	None,
+	StepBudget,
+	TimeBudget,
+	// The evaluation loss stopped improving
+	Converged,
+	// Training failed, e.g. because a batch generated no samples
+	Aborted,
+};
+
+std::string to_string(ETrainingDecision decision);
+std::string to_string(ETrainingStopReason reason);
+
+struct TrainingDecision {
+	ETrainingDecision type = ETrainingDecision::BatchSize;
+	// Training step from which on the decision applies
+	uint32_t step = 0;
+	double elapsed_seconds = 0.0;
+	uint32_t batch_size = 0;
+	uint32_t density_grid_interval = 0;
+	ETrainingStopReason stop_reason = ETrainingStopReason::None;
+	// The measurements that led to the decision
+	std::string reason;
+};
+
+void to_json(nlohmann::json& j, const TrainingDecision& decision);
+void from_json(const nlohmann::json& j, TrainingDecision& decision);
+
+struct TrainingScheduleConfig {
+	// Budgets. Zero means unlimited, but at least one of them must be set.
+	double time_budget_seconds = 0.0;
+	uint32_t step_budget = 0;
+
+	// Steps between decisions, i.e. the longest stretch of training between two reports to the scheduler
+	uint32_t decision_interval = 256;
+
+	// Each power of two times min_batch_size up to max_batch_size is trained for n_probe_warmup_steps and then measured
+	// over n_probe_steps. The smallest batch size with at least `throughput_tolerance` times the best throughput (samples
+	// per second) wins, because it takes the most optimizer steps in the same time.
+	bool tune_batch_size = true;
+	uint32_t min_batch_size = 1 << 16;
+	uint32_t max_batch_size = 1 << 20;
+	uint32_t n_probe_warmup_steps = 16;
+	uint32_t n_probe_steps = 64;
+	float throughput_tolerance = 0.9f;
+
+	// Updates the density grid less often than by default if its updates would take more than
+	// `max_density_grid_overhead` of the training time. Intervals are powers of two.
+	bool tune_density_grid_interval = true;
+	float max_density_grid_overhead = 0.05f;
+	uint32_t max_density_grid_interval = 64;
+
+	// Evaluates every `eval_interval` steps (0 disables early stopping) and stops once `patience` evaluations in a row
+	// failed to lower the best loss by `min_relative_improvement`, but not before `min_steps` steps.
+	uint32_t eval_interval = 1024;
+	uint32_t patience = 4;
+	float min_relative_improvement = 0.01f;
+	uint32_t min_steps = 2048;
+};
+
+struct TrainingEvaluation {
+	uint32_t step;
+	double elapsed_seconds;
+	float loss;
+};
+
+class TrainingScheduler {
+public:
+	// Schedules training that continues from `start_step` with `batch_size` unless the batch size is tuned.
+	TrainingScheduler(const TrainingScheduleConfig& config, uint32_t start_step, uint32_t batch_size);
+	// Applies the decisions of an earlier run at the same steps instead of measuring, such that training proceeds
+	// identically. Budgets and evaluations do not stop a replay; its Stop decision does.
+	TrainingScheduler(const TrainingScheduleConfig& config, uint32_t start_step, const std::vector<TrainingDecision>& replay);
+
+	const TrainingScheduleConfig& config() const { return m_config; }
+	bool replaying() const { return !m_replay.empty(); }
+
+	uint32_t step() const { return m_step; }
+	uint32_t n_steps_done() const { return m_step - m_start_step; }
+	double elapsed_seconds() const { return m_elapsed_seconds; }
+
+	uint32_t batch_size() const { return m_batch_size; }
+	// Steps between density grid updates at the current step
+	uint32_t density_grid_interval() const;
+	// 0 while the default cadence applies
+	uint32_t tuned_density_grid_interval() const { return m_density_grid_interval; }
+	// The testbed's cadence: every step at first, then up to every 16th
+	static uint32_t default_density_grid_interval(uint32_t step);
+
+	bool done() const { return m_stop_reason != ETrainingStopReason::None; }
+	ETrainingStopReason stop_reason() const { return m_stop_reason; }
+
+	// Whether the caller should evaluate before training further
+	bool wants_evaluation() const;
+	// Steps to train before reporting to observe_steps()
+	uint32_t next_chunk_steps() const;
+
+	// Reports `n_steps` steps that took `seconds`, of which `prep_seconds` went into `n_preps` density grid updates.
+	void observe_steps(uint32_t n_steps, double seconds, double prep_seconds = 0.0, uint32_t n_preps = 0);
+	// Reports an evaluation loss, e.g. of held-out views, that took `seconds` to compute.
+	void observe_evaluation(float loss, double seconds = 0.0);
+	void abort(const std::string& reason);
+
+	const std::vector<TrainingDecision>& decisions() const { return m_decisions; }
+	const std::vector<TrainingEvaluation>& evaluations() const { return m_evaluations; }
+	float best_loss() const { return m_best_loss; }
+
+	// Samples per second of each probed batch size, in probing order
+	const std::vector<std::pair<uint32_t, float>>& measured_throughput() const { return m_throughput; }
+	float step_ms() const { return (float)(m_step_seconds * 1000.0); }
+	float density_grid_update_ms() const { return (float)(m_prep_seconds_per_update * 1000.0); }
+
+private:
+	void decide(TrainingDecision decision);
+	void stop(ETrainingStopReason reason, const std::string& why);
+	void start_probe(size_t candidate);
+	void finish_probing();
+	void tune_density_grid_interval();
+	void apply_replay();
+	void check_budgets();
+
+	TrainingScheduleConfig m_config;
+	uint32_t m_start_step;
+	uint32_t m_step;
+	double m_elapsed_seconds = 0.0;
+
+	uint32_t m_batch_size = 0;
+	// 0 if the default cadence applies
+	uint32_t m_density_grid_interval = 0;
+	ETrainingStopReason m_stop_reason = ETrainingStopReason::None;
+
+	// Batch size candidates and the probing progress: warmup, then measurement of the current candidate
+	std::vector<uint32_t> m_candidates;
+	size_t m_probe = 0;
+	bool m_probe_warmup = false;
+	uint32_t m_probe_steps_left = 0;
+	double m_probe_seconds = 0.0;
+	uint32_t m_probe_n_steps = 0;
+	bool m_probing = false;
+	std::vector<std::pair<uint32_t, float>> m_throughput;
+
+	// Seconds per step without density grid updates, and per update, of the most recent measurements
+	double m_step_seconds = 0.0;
+	double m_prep_seconds_per_update = 0.0;
+
+	uint32_t m_last_evaluation_step;
+	float m_best_loss;
+	uint32_t m_n_evaluations_without_improvement = 0;
+	std::vector<TrainingEvaluation> m_evaluations;
+
+	std::vector<TrainingDecision> m_replay;
+	size_t m_replay_pos = 0;
+	std::vector<TrainingDecision> m_decisions;
+};
+
+NGP_NAMESPACE_END
@@ -0,0 +1,36 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+#
+# NVIDIA CORPORATION and its licensors retain all intellectual property
+# and proprietary rights in and to this software, related documentation
+# and any modifications thereto.  Any use, reproduction, disclosure or
+# distribution of this software and related documentation without an express
+# license agreement from NVIDIA CORPORATION is strictly prohibited.
+
+import argparse
+import json
+
+from common import *
+
+import pyngp as ngp # noqa
+
+def parse_args():
+	parser = argparse.ArgumentParser(description="Measure hash collisions of a NeRF snapshot's grid encoding in occupied space and suggest hash table sizes for a memory budget. Runs on the CPU.")
+
+	parser.add_argument("snapshot", help="NeRF snapshot (.ingp/.msgpack) with a density grid.")
+	parser.add_argument("--budget_mb", type=float, default=0.0, help="Memory budget of the grid's half precision parameters in MB. Defaults to the snapshot's.")
+	parser.add_argument("--max_vertices_per_level", type=int, default=1 << 24, help="Levels with more occupied vertices are simulated on a random subset of the occupied cells.")
+	parser.add_argument("--save_network", default="", help="Write the snapshot's network config with the suggested hash table size to this file.")
+
+	return parser.parse_args()
+
+if __name__ == "__main__":
+	args = parse_args()
+
+	analysis = ngp.analyze_hash_grid(args.snapshot, int(args.budget_mb * 1024 * 1024), args.max_vertices_per_level)
+
+	if args.save_network:
+		with open(args.save_network, "w") as f:
+			json.dump(analysis.tuned_network_config(), f, indent=2)
+		print(f"Saved network config with log2_hashmap_size={analysis.suggested_log2_hashmap_size} to {args.save_network}")
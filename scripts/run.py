@@ -9,12 +9,14 @@
 # license agreement from NVIDIA CORPORATION is strictly prohibited.
 
 import argparse
+import copy
 import os
 import commentjson as json
 
 import numpy as np
 
 import shutil
+import subprocess
 import time
 
 from common import *
@@ -35,6 +37,10 @@ def parse_args():
 
 	parser.add_argument("--load_snapshot", "--snapshot", default="", help="Load this snapshot before training. recommended extension: .ingp/.msgpack")
 	parser.add_argument("--save_snapshot", default="", help="Save this snapshot after training. recommended extension: .ingp/.msgpack")
+	parser.add_argument("--save_nerf_reference", default="", help="Save raw network outputs of random inputs after training, against which CPU inference of the snapshot can be checked. NeRF only.")
+	parser.add_argument("--save_baked", default="", help="Bake the trained NeRF into a sparse voxel file for lightweight viewers and compare a CPU rendering of it against the full model. NeRF only.")
+	parser.add_argument("--bake_resolution", type=int, default=512, help="Number of voxels along the longest axis of the render aabb when baking.")
+	parser.add_argument("--bake_sh_degree", type=int, default=1, help="Spherical harmonics degree (0 to 2) of the baked view-dependent color.")
 
 	parser.add_argument("--nerf_compatibility", action="store_true", help="Matches parameters with original NeRF. Can cause slowness and worse results on some scenes, but helps with high PSNR on synthetic scenes.")
 	parser.add_argument("--test_transforms", default="", help="Path to a nerf style transforms json from which we will compute PSNR.")
@@ -47,12 +53,19 @@ def parse_args():
 	parser.add_argument("--screenshot_spp", type=int, default=16, help="Number of samples per pixel in screenshots.")
 
 	parser.add_argument("--video_camera_path", default="", help="The camera path to render, e.g., base_cam.json.")
+	parser.add_argument("--video_constant_speed", action="store_true", help="Moves the camera at constant speed along the camera path, regardless of keyframe spacing.")
 	parser.add_argument("--video_camera_smoothing", action="store_true", help="Applies additional smoothing to the camera trajectory with the caveat that the endpoint of the camera path may not be reached.")
 	parser.add_argument("--video_fps", type=int, default=60, help="Number of frames per second.")
 	parser.add_argument("--video_n_seconds", type=int, default=1, help="Number of seconds the rendered video should be long.")
 	parser.add_argument("--video_render_range", type=int, nargs=2, default=(-1, -1), metavar=("START_FRAME", "END_FRAME"), help="Limit output to frames between START_FRAME and END_FRAME (inclusive)")
 	parser.add_argument("--video_spp", type=int, default=8, help="Number of samples per pixel. A larger number means less noise, but slower rendering.")
+	parser.add_argument("--video_temporal_reprojection", action="store_true", help="Reuses the samples of the previous frame where they reproject reliably, such that mostly disoccluded pixels are traced.")
 	parser.add_argument("--video_output", type=str, default="video.mp4", help="Filename of the output video (video.mp4) or video frames (video_%%04d.png).")
+	parser.add_argument("--video_spool_dir", default="", help="Shared directory through which several processes render one camera path. Requires --video_farm_role.")
+	parser.add_argument("--video_farm_role", default="", choices=["", "coordinator", "worker"], help="Whether this process hands out frame chunks (coordinator) or renders them (worker). All workers must load the same snapshot.")
+	parser.add_argument("--video_worker_id", default=f"{os.uname().nodename if hasattr(os, 'uname') else 'worker'}-{os.getpid()}", help="Unique name of this worker within the spool directory.")
+	parser.add_argument("--video_chunk_size", type=int, default=16, help="Number of consecutive frames leased to a worker at once.")
+	parser.add_argument("--video_lease_timeout", type=float, default=120.0, help="Seconds without a heartbeat after which a worker's chunk is leased to another worker.")
 
 	parser.add_argument("--save_mesh", default="", help="Output a marching-cubes based mesh from the NeRF or SDF model. Supports OBJ and PLY format.")
 	parser.add_argument("--marching_cubes_res", default=256, type=int, help="Sets the resolution for the marching cubes grid.")
@@ -63,6 +76,16 @@ def parse_args():
 	parser.add_argument("--gui", action="store_true", help="Run the testbed GUI interactively.")
 	parser.add_argument("--train", action="store_true", help="If the GUI is enabled, controls whether training starts immediately.")
 	parser.add_argument("--n_steps", type=int, default=-1, help="Number of steps to train for before quitting.")
+	parser.add_argument("--training_trace", default="", help="Profile the phases of each training step and save a Chrome trace (chrome://tracing) of the steps in --training_trace_steps to this path.")
+	parser.add_argument("--training_trace_steps", type=int, nargs=2, default=[100, 110], metavar=("BEGIN", "END"), help="Range of training steps whose phases go into the trace.")
+	parser.add_argument("--time_budget", type=float, default=0, help="Without a GUI, train for at most this many seconds (and at most --n_steps steps if given), tuning the batch size and density grid updates from the measured throughput and stopping early once the loss plateaus.")
+	parser.add_argument("--holdout_views", type=int, default=0, help="Exclude the last N training views from training and stop a --time_budget run once their loss plateaus instead of the training loss.")
+	parser.add_argument("--schedule_log", default="", help="Save the decisions of a --time_budget run to this JSON file.")
+	parser.add_argument("--schedule_replay", default="", help="Repeat the decisions of an earlier --time_budget run from its --schedule_log instead of measuring.")
+	parser.add_argument("--adaptive_density_grid", action="store_true", help="Update the NeRF density grid less often and with fewer samples once its occupancy stops changing. Prints the network queries saved after training; compare PSNR with --test_transforms.")
+	parser.add_argument("--density_grid_flip_rate", type=float, default=1e-5, help="Fraction of occupancy bits flipping per training step below which --adaptive_density_grid backs off.")
+	parser.add_argument("--density_grid_restrict_cascades", action="store_true", help="With --adaptive_density_grid, also leave out cascades whose occupancy stopped changing.")
+	parser.add_argument("--train_steps_per_call", type=int, default=0, help="Without a GUI, train this many steps per call without synchronizing after each step instead of one step per frame. 0 trains one step per frame.")
 	parser.add_argument("--second_window", action="store_true", help="Open a second window containing a copy of the main output.")
 	parser.add_argument("--vr", action="store_true", help="Render to a VR headset.")
 
@@ -71,6 +94,46 @@ def parse_args():
 
 	return parser.parse_args()
 
+def holdout_loss(testbed, views, downscale=4):
+	# Mean squared error of the given training views against their images, rendered at reduced resolution.
+	# Moving to a training view changes the camera's intrinsics and lens, so all of it is restored afterwards.
+	camera_matrix = testbed.camera_matrix
+	scale = testbed.scale
+	relative_focal_length = testbed.relative_focal_length
+	screen_center = testbed.screen_center
+	render_lens = copy.copy(testbed.nerf.render_lens)
+	render_with_lens_distortion = testbed.nerf.render_with_lens_distortion
+	training_view = testbed.nerf.training.view
+	dlss = testbed.dlss
+	background_color = testbed.background_color
+	snap_to_pixel_centers = testbed.snap_to_pixel_centers
+	testbed.background_color = [0.0, 0.0, 0.0, 1.0]
+	testbed.snap_to_pixel_centers = True
+
+	total = 0.0
+	for i in views:
+		resolution = testbed.nerf.training.dataset.metadata[i].resolution
+		width, height = max(resolution[0] // downscale, 1), max(resolution[1] // downscale, 1)
+		testbed.set_camera_to_training_view(i)
+		testbed.render_ground_truth = True
+		ref_image = testbed.render(width, height, 1, True)
+		testbed.render_ground_truth = False
+		image = testbed.render(width, height, 1, True)
+		total += float(compute_error("MSE", image[...,:3], ref_image[...,:3]))
+
+	# The scale moves the camera, so it is restored before the camera matrix.
+	testbed.scale = scale
+	testbed.camera_matrix = camera_matrix
+	testbed.relative_focal_length = relative_focal_length
+	testbed.screen_center = screen_center
+	testbed.nerf.render_lens = render_lens
+	testbed.nerf.render_with_lens_distortion = render_with_lens_distortion
+	testbed.nerf.training.view = training_view
+	testbed.dlss = dlss
+	testbed.background_color = background_color
+	testbed.snap_to_pixel_centers = snap_to_pixel_centers
+	return total / max(len(views), 1)
+
 def get_scene(scene):
 	for scenes in [scenes_sdf, scenes_nerf, scenes_image, scenes_volume]:
 		if scene in scenes:
@@ -168,6 +231,17 @@ if __name__ == "__main__":
 		# Match nerf paper behaviour and train on a fixed bg.
 		testbed.nerf.training.random_bg_color = False
 
+	if args.training_trace:
+		testbed.training_profiler.set_trace_range(*args.training_trace_steps)
+		testbed.training_profiler.enabled = True
+
+	if args.adaptive_density_grid:
+		config = ngp.DensityGridScheduleConfig()
+		config.enabled = True
+		config.target_flip_rate = args.density_grid_flip_rate
+		config.restrict_to_changed_cascades = args.density_grid_restrict_cascades
+		testbed.nerf.training.density_grid_schedule_config = config
+
 	old_training_step = 0
 	n_steps = args.n_steps
 
@@ -178,7 +252,40 @@ if __name__ == "__main__":
 		n_steps = 35000
 
 	tqdm_last_update = 0
-	if n_steps > 0:
+	if args.time_budget > 0 and not args.gui:
+		config = ngp.TrainingScheduleConfig()
+		config.time_budget_seconds = args.time_budget
+		config.step_budget = max(args.n_steps, 0)
+
+		evaluate = None
+		if args.holdout_views > 0:
+			n_images = testbed.nerf.training.dataset.n_images
+			if args.holdout_views >= n_images:
+				raise ValueError(f"Can not hold out {args.holdout_views} of {n_images} training views.")
+			testbed.nerf.training.n_images_for_training = n_images - args.holdout_views
+			evaluate = lambda: holdout_loss(testbed, range(n_images - args.holdout_views, n_images))
+
+		replay = None
+		if args.schedule_replay:
+			with open(args.schedule_replay) as f:
+				replay = json.load(f)
+
+		scheduler = testbed.train_with_schedule(config, evaluate, replay)
+		print(f"Trained {scheduler.n_steps_done} steps in {scheduler.elapsed_seconds:.1f}s at batch size {scheduler.batch_size}: {scheduler.stop_reason.name}")
+
+		if args.schedule_log:
+			with open(args.schedule_log, "w") as f:
+				json.dump(scheduler.decisions_json, f, indent=2)
+	elif n_steps > 0 and args.train_steps_per_call > 0 and not args.gui:
+		with tqdm(desc="Training", total=n_steps, unit="step") as t:
+			while testbed.training_step < n_steps:
+				old_training_step = testbed.training_step
+				testbed.train_n_steps(min(args.train_steps_per_call, n_steps - testbed.training_step), testbed.training_batch_size, 16)
+				if testbed.training_step == old_training_step:
+					break
+				t.update(testbed.training_step - old_training_step)
+				t.set_postfix(loss=testbed.loss)
+	elif n_steps > 0:
 		with tqdm(desc="Training", total=n_steps, unit="step") as t:
 			while testbed.frame():
 				if testbed.want_repl():
@@ -202,9 +309,42 @@ if __name__ == "__main__":
 					old_training_step = testbed.training_step
 					tqdm_last_update = now
 
+	if args.adaptive_density_grid:
+		schedule = testbed.nerf.training.density_grid_schedule
+		saved = schedule.n_queries_saved / max(schedule.n_default_queries, 1)
+		print(f"Density grid: {schedule.n_updates}/{schedule.n_default_updates} updates, {schedule.n_queries / 1e6:.1f}M/{schedule.n_default_queries / 1e6:.1f}M network queries ({saved * 100:.1f}% saved), last flip rate {schedule.flip_rate:.2e} per step")
+
+	if args.training_trace:
+		print(testbed.training_profiler.summary())
+		testbed.training_profiler.save_chrome_trace(args.training_trace)
+
 	if args.save_snapshot:
 		testbed.save_snapshot(args.save_snapshot, False)
 
+	if args.save_nerf_reference:
+		testbed.save_nerf_reference_outputs(args.save_nerf_reference)
+
+	if args.save_baked:
+		testbed.bake_nerf(args.save_baked, args.bake_resolution, args.bake_sh_degree)
+
+		# Compare against the full model from the current view, one sample through each pixel center on black
+		prev_background_color = testbed.background_color
+		prev_snap_to_pixel_centers = testbed.snap_to_pixel_centers
+		testbed.background_color = [0.0, 0.0, 0.0, 1.0]
+		testbed.snap_to_pixel_centers = True
+		width, height = args.width or 800, args.height or 800
+		ref_image = testbed.render(width, height, 1, True)
+		testbed.background_color = prev_background_color
+		testbed.snap_to_pixel_centers = prev_snap_to_pixel_centers
+
+		baked = ngp.BakedNerf(args.save_baked)
+		image = baked.render(width, height)
+
+		A = np.clip(linear_to_srgb(image[...,:3]), 0.0, 1.0)
+		R = np.clip(linear_to_srgb(ref_image[...,:3]), 0.0, 1.0)
+		psnr = mse2psnr(float(compute_error("MSE", A, R)))
+		print(f"Baked NeRF: PSNR={psnr:.2f} vs. full model, {baked.render_stats.fps:.1f} FPS on {baked.n_threads} CPU threads, {baked.n_bytes / (1024 * 1024):.1f} MB")
+
 	if args.test_transforms:
 		print("Evaluating test transforms from ", args.test_transforms)
 		with open(args.test_transforms) as f:
@@ -298,8 +438,81 @@ if __name__ == "__main__":
 			os.makedirs(os.path.dirname(outname), exist_ok=True)
 		write_image(outname + ".png", image)
 
-	if args.video_camera_path:
+	if args.video_camera_path and args.video_farm_role:
+		if not args.video_spool_dir:
+			raise ValueError("--video_farm_role requires --video_spool_dir")
+
 		testbed.load_camera_path(args.video_camera_path)
+		if args.video_constant_speed:
+			testbed.camera_path_constant_speed = True
+		testbed.temporal_reprojection.enabled = args.video_temporal_reprojection
+		testbed.camera_smoothing = args.video_camera_smoothing
+
+		resolution = [args.width or 1920, args.height or 1080]
+		n_frames = args.video_n_seconds * args.video_fps
+		save_frames = "%" in args.video_output
+
+		if args.video_farm_role == "coordinator":
+			coordinator = ngp.SpoolDirectoryCoordinator(args.video_spool_dir, n_frames, args.video_chunk_size, args.video_lease_timeout)
+			frame_dir = coordinator.frame_dir
+
+			# Frames are released strictly in order, so the video is encoded as its prefix grows rather than at the end.
+			encoder = None
+			if not save_frames:
+				encoder = subprocess.Popen(["ffmpeg", "-y", "-framerate", str(args.video_fps), "-f", "image2pipe", "-c:v", "png", "-i", "-", "-c:v", "libx264", "-pix_fmt", "yuv420p", args.video_output], stdin=subprocess.PIPE)
+
+			with tqdm(total=n_frames, unit="frames", desc="Assembling video") as progress:
+				while True:
+					done = coordinator.poll()
+					for i in coordinator.pop_assemblable_frames():
+						frame_path = os.path.join(frame_dir, f"{i:04d}.png")
+						if save_frames:
+							shutil.copyfile(frame_path, args.video_output % i)
+						else:
+							with open(frame_path, "rb") as f:
+								encoder.stdin.write(f.read())
+						progress.update(1)
+					if done:
+						break
+					time.sleep(0.5)
+
+			if encoder:
+				encoder.stdin.close()
+				encoder.wait()
+		else:
+			worker = ngp.SpoolDirectoryWorker(args.video_spool_dir, args.video_worker_id)
+			# Rendering a single frame may take longer than the lease timeout and holds the GIL.
+			worker.start_heartbeat_thread(args.video_lease_timeout / 4)
+			next_frame = 0
+			while not worker.finished():
+				chunk = worker.next_chunk()
+				if chunk is None:
+					worker.heartbeat()
+					time.sleep(0.5)
+					continue
+
+				# Camera smoothing and motion blur depend on all preceding frames. When the leased chunk does not continue
+				# where this worker left off, replay the camera state from the start of the path without rendering.
+				if chunk.begin_frame < next_frame:
+					next_frame = 0
+				for i in range(next_frame, chunk.begin_frame):
+					testbed.skip_camera_path_frame(float(i)/n_frames, float(i + 1)/n_frames, args.video_fps)
+
+				for i in tqdm(range(chunk.begin_frame, chunk.end_frame), unit="frames", desc=f"Rendering chunk #{chunk.id}"):
+					frame = testbed.render(resolution[0], resolution[1], args.video_spp, True, float(i)/n_frames, float(i + 1)/n_frames, args.video_fps, shutter_fraction=0.5)
+					outname = os.path.join(worker.frame_dir, f"{i:04d}.png")
+					write_image(outname + ".tmp.png", np.clip(frame * 2**args.exposure, 0.0, 1.0))
+					os.replace(outname + ".tmp.png", outname)
+					worker.heartbeat()
+
+				next_frame = chunk.end_frame
+				worker.complete(chunk)
+
+	elif args.video_camera_path:
+		testbed.load_camera_path(args.video_camera_path)
+		if args.video_constant_speed:
+			testbed.camera_path_constant_speed = True
+		testbed.temporal_reprojection.enabled = args.video_temporal_reprojection
 
 		resolution = [args.width or 1920, args.height or 1080]
 		n_frames = args.video_n_seconds * args.video_fps
@@ -315,10 +528,8 @@ if __name__ == "__main__":
 
 			if start_frame >= 0 and i < start_frame:
 				# For camera smoothing and motion blur to work, we cannot just start rendering
-				# from middle of the sequence. Instead we render a very small image and discard it
-				# for these initial frames.
-				# TODO Replace this with a no-op render method once it's available
-				frame = testbed.render(32, 32, 1, True, float(i)/n_frames, float(i + 1)/n_frames, args.video_fps, shutter_fraction=0.5)
+				# from middle of the sequence. Instead we advance the camera state without rendering.
+				testbed.skip_camera_path_frame(float(i)/n_frames, float(i + 1)/n_frames, args.video_fps)
 				continue
 			elif end_frame >= 0 and i > end_frame:
 				continue
@@ -329,6 +540,9 @@ if __name__ == "__main__":
 			else:
 				write_image(f"tmp/{i:04d}.jpg", np.clip(frame * 2**args.exposure, 0.0, 1.0), quality=100)
 
+		if args.video_temporal_reprojection:
+			print(f"Temporal reprojection reused {testbed.temporal_reprojection_stats.mean_reused_fraction * 100:.1f}% of pixels on average.")
+
 		if not save_frames:
 			os.system(f"ffmpeg -y -framerate {args.video_fps} -i tmp/%04d.jpg -c:v libx264 -pix_fmt yuv420p {args.video_output}")
 
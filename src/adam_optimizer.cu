@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   adam_optimizer.cu
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/adam_optimizer.h>
+#include <neural-graphics-primitives/common_device.cuh>
+#include <neural-graphics-primitives/thread_pool.h>
+
+#include <chrono>
+#include <random>
+
+using namespace tcnn;
+
+NGP_NAMESPACE_BEGIN
+
+// Explicitly rounded intrinsics, such that the compiler neither fuses multiplies and adds nor approximates the
+// division and square root. The results then equal BatchedAdamOptimizer::step() on the host.
+__global__ void batched_adam_step_kernel(
+	const uint32_t n_elements,
+	const float step_size,
+	const float gradient_scale,
+	const float beta1,
+	const float beta2,
+	const float epsilon,
+	const float* __restrict__ gradient,
+	float* __restrict__ variable,
+	float* __restrict__ first_moment,
+	float* __restrict__ second_moment
+) {
+	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
+	if (i >= n_elements) return;
+
+	float g = __fmul_rn(gradient[i], gradient_scale);
+	float m = __fadd_rn(__fmul_rn(beta1, first_moment[i]), __fmul_rn(1.0f - beta1, g));
+	float v = __fadd_rn(__fmul_rn(beta2, second_moment[i]), __fmul_rn(__fmul_rn(1.0f - beta2, g), g));
+	first_moment[i] = m;
+	second_moment[i] = v;
+	variable[i] = __fsub_rn(variable[i], __fdiv_rn(__fmul_rn(step_size, m), __fadd_rn(__fsqrt_rn(v), epsilon)));
+}
+
+bool GpuBatchedAdamOptimizer::upload(const BatchedAdamOptimizer& opt, cudaStream_t stream) {
+	for (size_t i = 1; i < opt.size(); ++i) {
+		if (opt.step(i) != opt.step(0)) {
+			return false;
+		}
+	}
+
+	m_iter = opt.size() > 0 ? opt.step(0) : 0;
+	m_n_params = opt.variables().size();
+	m_epsilon = opt.epsilon();
+	m_beta1 = opt.beta1();
+	m_beta2 = opt.beta2();
+
+	m_first_moment.resize(m_n_params);
+	m_second_moment.resize(m_n_params);
+	CUDA_CHECK_THROW(cudaMemcpyAsync(m_first_moment.data(), opt.first_moments().data(), m_n_params * sizeof(float), cudaMemcpyHostToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(m_second_moment.data(), opt.second_moments().data(), m_n_params * sizeof(float), cudaMemcpyHostToDevice, stream));
+	// The host arrays may change once this returns.
+	CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+
+	m_active = true;
+	return true;
+}
+
+void GpuBatchedAdamOptimizer::step(const float* gradient_gpu, float gradient_scale, float learning_rate, float* variables_gpu, cudaStream_t stream) {
+	if (!m_active) {
+		throw std::runtime_error{"GpuBatchedAdamOptimizer must be uploaded before stepping."};
+	}
+
+	++m_iter;
+
+	// Same bias correction as on the host
+	float step_size = learning_rate * std::sqrt(1.0f - std::pow(m_beta2, (float)m_iter)) / (1.0f - std::pow(m_beta1, (float)m_iter));
+	linear_kernel(batched_adam_step_kernel, 0, stream,
+		(uint32_t)m_n_params,
+		step_size,
+		gradient_scale,
+		m_beta1,
+		m_beta2,
+		m_epsilon,
+		gradient_gpu,
+		variables_gpu,
+		m_first_moment.data(),
+		m_second_moment.data()
+	);
+}
+
+void GpuBatchedAdamOptimizer::download(BatchedAdamOptimizer& opt, const float* variables_gpu, cudaStream_t stream) {
+	if (!m_active) {
+		return;
+	}
+
+	if (opt.variables().size() != m_n_params) {
+		throw std::runtime_error{fmt::format("Can not download {} parameters into a batched Adam optimizer with {}.", m_n_params, opt.variables().size())};
+	}
+
+	CUDA_CHECK_THROW(cudaMemcpyAsync(opt.first_moments().data(), m_first_moment.data(), m_n_params * sizeof(float), cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(opt.second_moments().data(), m_second_moment.data(), m_n_params * sizeof(float), cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(opt.variables().data(), variables_gpu, m_n_params * sizeof(float), cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+	opt.set_steps(m_iter);
+
+	m_active = false;
+}
+
+BatchedAdamBenchmark benchmark_batched_adam(uint32_t n_items, uint32_t dims, uint32_t n_steps, ThreadPool* pool) {
+	if (n_items == 0 || dims == 0 || n_steps == 0) {
+		throw std::runtime_error{"Benchmarking the batched Adam optimizer requires at least one item, dimension and step."};
+	}
+
+	// Gradients as scaled by the loss scale of the training loop, and a learning rate as in train_nerf()
+	constexpr float GRADIENT_DIVISOR = 128.0f;
+	constexpr float LEARNING_RATE = 1e-2f;
+
+	size_t n_params = (size_t)n_items * dims;
+	std::mt19937 rng{1337};
+	std::normal_distribution<float> normal{0.0f, GRADIENT_DIVISOR};
+	std::vector<float> gradient(n_params);
+	std::vector<float> initial(n_params);
+	for (size_t i = 0; i < n_params; ++i) {
+		gradient[i] = normal(rng);
+		initial[i] = normal(rng) / GRADIENT_DIVISOR;
+	}
+
+	auto time_ms = [&](auto&& fun) {
+		auto start = std::chrono::steady_clock::now();
+		fun();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / n_steps;
+	};
+
+	BatchedAdamBenchmark result = {};
+	result.n_items = n_items;
+	result.dims = dims;
+	result.n_steps = n_steps;
+
+	// One optimizer per item and a temporary gradient per item and step, as train_nerf() used to do
+	std::vector<VarAdamOptimizer> per_item(n_items, VarAdamOptimizer(dims, 1e-4f));
+	for (uint32_t i = 0; i < n_items; ++i) {
+		std::copy_n(initial.begin() + (size_t)i * dims, dims, per_item[i].variable().begin());
+	}
+
+	result.per_item_ms = time_ms([&]() {
+		for (uint32_t s = 0; s < n_steps; ++s) {
+			for (uint32_t i = 0; i < n_items; ++i) {
+				std::vector<float> g(dims);
+				for (uint32_t j = 0; j < dims; ++j) {
+					g[j] = gradient[(size_t)i * dims + j] / GRADIENT_DIVISOR;
+				}
+
+				per_item[i].set_learning_rate(LEARNING_RATE);
+				per_item[i].step(g);
+			}
+		}
+	});
+
+	auto make_batched = [&]() {
+		BatchedAdamOptimizer opt{dims, 1e-4f};
+		opt.resize(n_items);
+		opt.variables() = initial;
+		return opt;
+	};
+
+	auto max_abs_difference = [&](const std::vector<float>& variables) {
+		float result = 0.0f;
+		for (uint32_t i = 0; i < n_items; ++i) {
+			for (uint32_t j = 0; j < dims; ++j) {
+				result = std::max(result, std::abs(variables[(size_t)i * dims + j] - per_item[i].variable()[j]));
+			}
+		}
+
+		return result;
+	};
+
+	BatchedAdamOptimizer batched = make_batched();
+	result.batched_ms = time_ms([&]() {
+		for (uint32_t s = 0; s < n_steps; ++s) {
+			batched.set_learning_rate(LEARNING_RATE);
+			batched.step(n_items, gradient.data(), 1.0f / GRADIENT_DIVISOR);
+		}
+	});
+
+	result.max_abs_difference = max_abs_difference(batched.variables());
+
+	BatchedAdamOptimizer batched_parallel = make_batched();
+	result.batched_parallel_ms = time_ms([&]() {
+		for (uint32_t s = 0; s < n_steps; ++s) {
+			batched_parallel.set_learning_rate(LEARNING_RATE);
+			batched_parallel.step(n_items, gradient.data(), 1.0f / GRADIENT_DIVISOR, 0.0f, EBatchedAdamUpdate::Subtract, pool);
+		}
+	});
+
+	result.max_abs_difference = std::max(result.max_abs_difference, max_abs_difference(batched_parallel.variables()));
+
+	cudaStream_t stream;
+	CUDA_CHECK_THROW(cudaStreamCreate(&stream));
+	ScopeGuard stream_guard{[&]() {
+		cudaStreamSynchronize(stream);
+		cudaStreamDestroy(stream);
+	}};
+
+	BatchedAdamOptimizer batched_gpu = make_batched();
+	GPUMemory<float> gradient_gpu(n_params);
+	GPUMemory<float> variables_gpu(n_params);
+	gradient_gpu.copy_from_host(gradient);
+	variables_gpu.copy_from_host(initial);
+
+	GpuBatchedAdamOptimizer gpu;
+	gpu.upload(batched_gpu, stream);
+	result.gpu_ms = time_ms([&]() {
+		for (uint32_t s = 0; s < n_steps; ++s) {
+			gpu.step(gradient_gpu.data(), 1.0f / GRADIENT_DIVISOR, LEARNING_RATE, variables_gpu.data(), stream);
+		}
+
+		CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+	});
+
+	gpu.download(batched_gpu, variables_gpu.data(), stream);
+	result.max_abs_difference_gpu = max_abs_difference(batched_gpu.variables());
+
+	tlog::info() << fmt::format(
+		"Adam over {} items of {} parameters: {:.3f}ms per item, {:.3f}ms batched, {:.3f}ms batched in parallel, {:.3f}ms on the GPU per step. Max difference: {} (host), {} (GPU)",
+		n_items, dims, result.per_item_ms, result.batched_ms, result.batched_parallel_ms, result.gpu_ms, result.max_abs_difference, result.max_abs_difference_gpu
+	);
+
+	return result;
+}
+
+NGP_NAMESPACE_END
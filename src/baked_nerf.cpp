@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   baked_nerf.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/baked_nerf.h>
+#include <neural-graphics-primitives/common.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <limits>
+
+NGP_NAMESPACE_BEGIN
+
+namespace {
+
+constexpr uint32_t RENDER_TILE_SIZE = 16;
+
+float half_to_float(uint16_t h) {
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+
+	uint32_t bits;
+	if (exponent == 0x1f) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	} else if (exponent != 0) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	} else if (mantissa != 0) {
+		// Subnormal: renormalize
+		exponent = 113;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	} else {
+		bits = sign;
+	}
+
+	float result;
+	std::memcpy(&result, &bits, sizeof(float));
+	return result;
+}
+
+uint32_t popcount(uint64_t x) {
+	x = x - ((x >> 1) & 0x5555555555555555ull);
+	x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (uint32_t)((x * 0x0101010101010101ull) >> 56);
+}
+
+vec2 ray_intersect(const vec3& min, const vec3& max, const vec3& pos, const vec3& dir) {
+	float tmin = -std::numeric_limits<float>::infinity();
+	float tmax = std::numeric_limits<float>::infinity();
+	for (int i = 0; i < 3; ++i) {
+		float t0 = (min[i] - pos[i]) / dir[i];
+		float t1 = (max[i] - pos[i]) / dir[i];
+		if (t0 > t1) {
+			std::swap(t0, t1);
+		}
+
+		tmin = std::max(tmin, t0);
+		tmax = std::min(tmax, t1);
+	}
+
+	return {tmin, tmax};
+}
+
+}
+
+std::vector<vec3> baked_nerf_fit_directions(uint32_t n_directions) {
+	const float golden_angle = 3.14159265358979f * (3.0f - std::sqrt(5.0f));
+
+	std::vector<vec3> result(n_directions);
+	for (uint32_t k = 0; k < n_directions; ++k) {
+		float z = 1.0f - (2.0f * k + 1.0f) / n_directions;
+		float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+		float phi = golden_angle * k;
+		result[k] = {r * std::cos(phi), r * std::sin(phi), z};
+	}
+
+	return result;
+}
+
+std::vector<float> baked_nerf_sh_fit_matrix(uint32_t sh_degree, const std::vector<vec3>& directions) {
+	if (sh_degree > BAKED_NERF_MAX_SH_DEGREE) {
+		throw std::runtime_error{fmt::format("Baked NeRFs support spherical harmonics up to degree {}, but {} was requested.", BAKED_NERF_MAX_SH_DEGREE, sh_degree)};
+	}
+
+	const uint32_t n_coeffs = baked_nerf_n_sh_coeffs(sh_degree);
+	const uint32_t n_directions = (uint32_t)directions.size();
+	if (n_directions < n_coeffs) {
+		throw std::runtime_error{fmt::format("Fitting {} spherical harmonics requires at least as many directions, but got {}.", n_coeffs, n_directions)};
+	}
+
+	// Basis functions at each direction, one row per direction
+	std::vector<double> basis((size_t)n_directions * n_coeffs);
+	for (uint32_t k = 0; k < n_directions; ++k) {
+		float values[9];
+		baked_nerf_sh_basis(sh_degree, directions[k], values);
+		for (uint32_t c = 0; c < n_coeffs; ++c) {
+			basis[k * n_coeffs + c] = values[c];
+		}
+	}
+
+	// Solve the normal equations (B^T B) X = B^T by Gauss-Jordan elimination with partial pivoting. The system is
+	// tiny, but left unchecked, a degenerate set of directions would silently yield garbage.
+	const uint32_t n_cols = n_coeffs + n_directions;
+	std::vector<double> system((size_t)n_coeffs * n_cols, 0.0);
+	for (uint32_t i = 0; i < n_coeffs; ++i) {
+		for (uint32_t k = 0; k < n_directions; ++k) {
+			for (uint32_t j = 0; j < n_coeffs; ++j) {
+				system[i * n_cols + j] += basis[k * n_coeffs + i] * basis[k * n_coeffs + j];
+			}
+			system[i * n_cols + n_coeffs + k] = basis[k * n_coeffs + i];
+		}
+	}
+
+	for (uint32_t col = 0; col < n_coeffs; ++col) {
+		uint32_t pivot = col;
+		for (uint32_t row = col + 1; row < n_coeffs; ++row) {
+			if (std::abs(system[row * n_cols + col]) > std::abs(system[pivot * n_cols + col])) {
+				pivot = row;
+			}
+		}
+
+		if (std::abs(system[pivot * n_cols + col]) < 1e-9) {
+			throw std::runtime_error{fmt::format("{} directions do not determine {} spherical harmonics coefficients.", n_directions, n_coeffs)};
+		}
+
+		if (pivot != col) {
+			for (uint32_t j = 0; j < n_cols; ++j) {
+				std::swap(system[pivot * n_cols + j], system[col * n_cols + j]);
+			}
+		}
+
+		double inv = 1.0 / system[col * n_cols + col];
+		for (uint32_t j = 0; j < n_cols; ++j) {
+			system[col * n_cols + j] *= inv;
+		}
+
+		for (uint32_t row = 0; row < n_coeffs; ++row) {
+			if (row == col) {
+				continue;
+			}
+
+			double factor = system[row * n_cols + col];
+			for (uint32_t j = 0; j < n_cols; ++j) {
+				system[row * n_cols + j] -= factor * system[col * n_cols + j];
+			}
+		}
+	}
+
+	std::vector<float> result((size_t)n_coeffs * n_directions);
+	for (uint32_t c = 0; c < n_coeffs; ++c) {
+		for (uint32_t k = 0; k < n_directions; ++k) {
+			result[c * n_directions + k] = (float)system[c * n_cols + n_coeffs + k];
+		}
+	}
+
+	return result;
+}
+
+void save_baked_nerf(const fs::path& path, const BakedNerfHeader& header, const std::vector<uint64_t>& occupancy, const std::vector<uint16_t>& voxels) {
+	size_t n_words = baked_nerf_n_occupancy_words((size_t)header.n_bricks[0] * header.n_bricks[1] * header.n_bricks[2]);
+	size_t n_values = (size_t)header.n_allocated_bricks * header.brick_size * header.brick_size * header.brick_size * baked_nerf_values_per_voxel(header.sh_degree);
+	if (occupancy.size() != n_words || voxels.size() != n_values) {
+		throw std::runtime_error{fmt::format("Baked NeRF has {} occupancy words and {} values, but its header requires {} and {}.", occupancy.size(), voxels.size(), n_words, n_values)};
+	}
+
+	size_t n_occupied = 0;
+	for (uint64_t word : occupancy) {
+		n_occupied += popcount(word);
+	}
+
+	if (n_occupied != header.n_allocated_bricks) {
+		throw std::runtime_error{fmt::format("Baked NeRF marks {} bricks as occupied, but its header allocates {}.", n_occupied, header.n_allocated_bricks)};
+	}
+
+	std::ofstream f{native_string(path), std::ios::out | std::ios::binary};
+	f.write((const char*)&header, sizeof(header));
+	f.write((const char*)occupancy.data(), occupancy.size() * sizeof(uint64_t));
+	f.write((const char*)voxels.data(), voxels.size() * sizeof(uint16_t));
+	if (!f) {
+		throw std::runtime_error{fmt::format("Failed to write baked NeRF '{}'.", path.str())};
+	}
+}
+
+BakedNerf::BakedNerf(const fs::path& path) {
+	if (!path.exists()) {
+		throw std::runtime_error{fmt::format("Baked NeRF '{}' does not exist.", path.str())};
+	}
+
+	std::ifstream f{native_string(path), std::ios::in | std::ios::binary};
+	f.read((char*)&m_header, sizeof(m_header));
+	if (!f || std::memcmp(m_header.magic, BakedNerfHeader{}.magic, sizeof(m_header.magic)) != 0) {
+		throw std::runtime_error{fmt::format("'{}' is not a baked NeRF.", path.str())};
+	}
+
+	if (m_header.version != BAKED_NERF_VERSION) {
+		throw std::runtime_error{fmt::format("Baked NeRF '{}' has version {}, but only version {} is supported.", path.str(), m_header.version, BAKED_NERF_VERSION)};
+	}
+
+	if (m_header.brick_size == 0 || m_header.sh_degree > BAKED_NERF_MAX_SH_DEGREE || m_header.voxel_size <= 0.0f || (m_header.fov_axis != 0 && m_header.fov_axis != 1)) {
+		throw std::runtime_error{fmt::format("Baked NeRF '{}' has an invalid header.", path.str())};
+	}
+
+	m_n_bricks = {(int)m_header.n_bricks[0], (int)m_header.n_bricks[1], (int)m_header.n_bricks[2]};
+	m_n_voxels = m_n_bricks * (int)m_header.brick_size;
+	m_aabb_min = {m_header.aabb_min[0], m_header.aabb_min[1], m_header.aabb_min[2]};
+	for (uint32_t i = 0; i < 9; ++i) {
+		m_render_aabb_to_local[i / 3][i % 3] = m_header.render_aabb_to_local[i];
+	}
+
+	m_values_per_voxel = baked_nerf_values_per_voxel(m_header.sh_degree);
+
+	const size_t n_pages = (size_t)compMul(m_n_bricks);
+	m_occupancy.resize(baked_nerf_n_occupancy_words(n_pages));
+	f.read((char*)m_occupancy.data(), m_occupancy.size() * sizeof(uint64_t));
+
+	size_t voxels_per_brick = (size_t)m_header.brick_size * m_header.brick_size * m_header.brick_size;
+	std::vector<uint16_t> voxels(m_header.n_allocated_bricks * voxels_per_brick * m_values_per_voxel);
+	f.read((char*)voxels.data(), voxels.size() * sizeof(uint16_t));
+	if (!f) {
+		throw std::runtime_error{fmt::format("Baked NeRF '{}' is truncated.", path.str())};
+	}
+
+	// Bits past the last brick must be clear, such that the ranks count exactly the allocated bricks.
+	if (n_pages % 64 != 0 && (m_occupancy.back() >> (n_pages % 64)) != 0) {
+		throw std::runtime_error{fmt::format("Baked NeRF '{}' marks bricks outside of its grid as occupied.", path.str())};
+	}
+
+	m_occupancy_rank.resize(m_occupancy.size());
+	size_t n_occupied = 0;
+	for (size_t i = 0; i < m_occupancy.size(); ++i) {
+		m_occupancy_rank[i] = (uint32_t)n_occupied;
+		n_occupied += popcount(m_occupancy[i]);
+	}
+
+	if (n_occupied != m_header.n_allocated_bricks) {
+		throw std::runtime_error{fmt::format("Baked NeRF '{}' marks {} bricks as occupied, but allocates {}.", path.str(), n_occupied, m_header.n_allocated_bricks)};
+	}
+
+	m_voxels.resize(voxels.size());
+	std::transform(voxels.begin(), voxels.end(), m_voxels.begin(), half_to_float);
+
+	set_n_threads(std::thread::hardware_concurrency());
+
+	tlog::success() << fmt::format(
+		"Loaded baked NeRF '{}': {}/{} bricks of {}^3 voxels, SH degree {}, {:.1f} MB",
+		path.str(), m_header.n_allocated_bricks, n_pages, m_header.brick_size, m_header.sh_degree, n_bytes() / (1024.0 * 1024.0)
+	);
+}
+
+size_t BakedNerf::n_bytes() const {
+	return sizeof(BakedNerfHeader) + m_occupancy.size() * sizeof(uint64_t) + m_voxels.size() * sizeof(uint16_t);
+}
+
+void BakedNerf::set_n_threads(uint32_t n_threads) {
+	n_threads = std::max(n_threads, 1u);
+	m_pool.set_n_threads(n_threads);
+	m_n_threads = n_threads;
+}
+
+uint32_t BakedNerf::brick(const ivec3& b) const {
+	size_t i = b.x + m_n_bricks.x * (b.y + (size_t)m_n_bricks.y * b.z);
+	uint64_t word = m_occupancy[i / 64];
+	uint64_t bit = 1ull << (i % 64);
+	if (!(word & bit)) {
+		return BAKED_NERF_EMPTY_BRICK;
+	}
+
+	return m_occupancy_rank[i / 64] + popcount(word & (bit - 1));
+}
+
+const float* BakedNerf::voxel(const ivec3& v) const {
+	if (v.x < 0 || v.y < 0 || v.z < 0 || v.x >= m_n_voxels.x || v.y >= m_n_voxels.y || v.z >= m_n_voxels.z) {
+		return nullptr;
+	}
+
+	const int brick_size = (int)m_header.brick_size;
+	ivec3 b = v / brick_size;
+	uint32_t page = brick(b);
+	if (page == BAKED_NERF_EMPTY_BRICK) {
+		return nullptr;
+	}
+
+	ivec3 l = v - b * brick_size;
+	size_t idx = (size_t)page * brick_size * brick_size * brick_size + l.x + brick_size * (l.y + brick_size * l.z);
+	return m_voxels.data() + idx * m_values_per_voxel;
+}
+
+bool BakedNerf::sample(const vec3& pos, float* values) const {
+	vec3 u = pos - vec3(0.5f);
+	vec3 base = floor(u);
+	vec3 w = u - base;
+	ivec3 i0 = ivec3(base);
+
+	std::fill(values, values + m_values_per_voxel, 0.0f);
+
+	bool any = false;
+	for (uint32_t corner = 0; corner < 8; ++corner) {
+		ivec3 offset = {(int)(corner & 1), (int)((corner >> 1) & 1), (int)((corner >> 2) & 1)};
+		const float* v = voxel(i0 + offset);
+		if (!v) {
+			continue;
+		}
+
+		float weight =
+			(offset.x ? w.x : 1.0f - w.x) *
+			(offset.y ? w.y : 1.0f - w.y) *
+			(offset.z ? w.z : 1.0f - w.z);
+
+		for (uint32_t j = 0; j < m_values_per_voxel; ++j) {
+			values[j] += weight * v[j];
+		}
+
+		any = true;
+	}
+
+	return any;
+}
+
+std::vector<vec4> BakedNerf::render(const ivec2& resolution, const mat4x3& camera, const vec2& focal_length, const vec2& screen_center) {
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<vec4> frame((size_t)compMul(resolution), vec4(0.0f));
+	if (compMin(resolution) <= 0) {
+		return frame;
+	}
+
+	const ivec2 n_tiles = (resolution + ivec2((int)RENDER_TILE_SIZE - 1)) / (int)RENDER_TILE_SIZE;
+	const uint32_t n_total_tiles = (uint32_t)compMul(n_tiles);
+
+	const float voxel_size = m_header.voxel_size;
+	const float brick_extent = voxel_size * m_header.brick_size;
+	const float dt = step_size * voxel_size;
+	const vec3 aabb_max = m_aabb_min + vec3(m_n_voxels) * voxel_size;
+	const uint32_t n_coeffs = n_sh_coeffs();
+
+	std::atomic<uint32_t> next_tile{0};
+	std::atomic<size_t> n_samples{0};
+	std::atomic<uint32_t> n_rays{0};
+
+	auto render_tiles = [&]() {
+		float values[1 + 3 * 9];
+		float basis[9];
+		size_t local_n_samples = 0;
+		uint32_t local_n_rays = 0;
+
+		for (uint32_t tile = next_tile++; tile < n_total_tiles; tile = next_tile++) {
+			ivec2 tile_min = ivec2{(int)(tile % n_tiles.x), (int)(tile / n_tiles.x)} * (int)RENDER_TILE_SIZE;
+			ivec2 tile_max = min(tile_min + ivec2((int)RENDER_TILE_SIZE), resolution);
+
+			for (int y = tile_min.y; y < tile_max.y; ++y) {
+				for (int x = tile_min.x; x < tile_max.x; ++x) {
+					// Same rays as CpuNerf::render()
+					vec2 uv = (vec2{(float)x, (float)y} + vec2(0.5f)) / vec2(resolution);
+					vec3 dir = {
+						(uv.x - screen_center.x) * (float)resolution.x / focal_length.x,
+						(uv.y - screen_center.y) * (float)resolution.y / focal_length.y,
+						1.0f
+					};
+
+					vec3 world_dir = normalize(mat3(camera) * dir);
+					vec3 origin = m_render_aabb_to_local * camera[3];
+					vec3 local_dir = m_render_aabb_to_local * world_dir;
+					vec3 idir = vec3(1.0f) / local_dir;
+
+					vec2 tminmax = ray_intersect(m_aabb_min, aabb_max, origin, local_dir);
+					if (tminmax.y <= std::max(tminmax.x, 0.0f)) {
+						continue;
+					}
+
+					++local_n_rays;
+
+					// Color is view dependent only through the direction, which is constant along the ray.
+					baked_nerf_sh_basis(m_header.sh_degree, world_dir, basis);
+
+					vec4 rgba = vec4(0.0f);
+					float t = std::max(tminmax.x, 0.0f) + 0.5f * dt;
+					while (t < tminmax.y) {
+						vec3 local_pos = origin + t * local_dir;
+						vec3 voxel_pos = (local_pos - m_aabb_min) / voxel_size;
+						ivec3 b = ivec3(floor(voxel_pos / (float)m_header.brick_size));
+						b = clamp(b, ivec3(0), m_n_bricks - ivec3(1));
+
+						size_t page = b.x + m_n_bricks.x * (b.y + (size_t)m_n_bricks.y * b.z);
+						if (!(m_occupancy[page / 64] & (1ull << (page % 64)))) {
+							// Skip the empty brick in whole steps, such that samples stay on the same lattice.
+							vec3 brick_min = m_aabb_min + vec3(b) * brick_extent;
+							float t_exit = std::numeric_limits<float>::infinity();
+							for (uint32_t axis = 0; axis < 3; ++axis) {
+								if (local_dir[axis] != 0.0f) {
+									float boundary = brick_min[axis] + (local_dir[axis] > 0.0f ? brick_extent : 0.0f);
+									t_exit = std::min(t_exit, (boundary - origin[axis]) * idir[axis]);
+								}
+							}
+
+							float n_steps = std::ceil((t_exit - t) / dt);
+							t += std::max(n_steps, 1.0f) * dt;
+							continue;
+						}
+
+						++local_n_samples;
+						if (sample(voxel_pos, values)) {
+							float alpha = 1.0f - std::exp(-std::max(values[0], 0.0f) * dt);
+							float weight = alpha * (1.0f - rgba.a);
+
+							vec3 rgb = vec3(0.0f);
+							for (uint32_t c = 0; c < n_coeffs; ++c) {
+								rgb += basis[c] * vec3{values[1 + 3 * c], values[2 + 3 * c], values[3 + 3 * c]};
+							}
+
+							rgba += vec4(max(rgb, vec3(0.0f)) * weight, weight);
+							if (rgba.a > (1.0f - min_transmittance)) {
+								rgba /= rgba.a;
+								break;
+							}
+						}
+
+						t += dt;
+					}
+
+					frame[x + y * resolution.x] = rgba;
+				}
+			}
+		}
+
+		n_samples += local_n_samples;
+		n_rays += local_n_rays;
+	};
+
+	std::vector<std::future<void>> futures;
+	for (uint32_t i = 0; i < m_n_threads; ++i) {
+		futures.emplace_back(m_pool.enqueue_task(render_tiles));
+	}
+
+	wait_all(futures);
+
+	m_render_stats.n_rays = n_rays;
+	m_render_stats.n_samples = n_samples;
+	m_render_stats.ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	return frame;
+}
+
+mat4x3 BakedNerf::camera() const {
+	mat4x3 result;
+	for (uint32_t i = 0; i < 12; ++i) {
+		result[i / 3][i % 3] = m_header.camera[i];
+	}
+	return result;
+}
+
+vec2 BakedNerf::focal_length(const ivec2& resolution) const {
+	// Same as Testbed::calc_focal_length()
+	vec2 relative_focal_length = {m_header.relative_focal_length[0], m_header.relative_focal_length[1]};
+	return relative_focal_length * (float)resolution[m_header.fov_axis] * m_header.zoom;
+}
+
+vec2 BakedNerf::screen_center() const {
+	// Same as Testbed::render_screen_center()
+	vec2 screen_center = {m_header.screen_center[0], m_header.screen_center[1]};
+	return (vec2(0.5f) - screen_center) * m_header.zoom + vec2(0.5f);
+}
+
+NGP_NAMESPACE_END
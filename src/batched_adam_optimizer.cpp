@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   batched_adam_optimizer.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/batched_adam_optimizer.h>
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/cpu_nerf.h>
+#include <neural-graphics-primitives/thread_pool.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#  define NGP_CPU_X86
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    define NGP_CPU_TARGET(isa)
+#  else
+#    define NGP_CPU_TARGET(isa) __attribute__((target(isa)))
+#  endif
+#endif
+
+using namespace nlohmann;
+
+NGP_NAMESPACE_BEGIN
+
+namespace {
+
+// Steps are split into chunks of this many items, which threads take in turn. Smaller steps stay on the calling thread.
+constexpr size_t ITEMS_PER_CHUNK = 4096;
+
+struct AdamStepParams {
+	float gradient_scale;
+	float l2_reg;
+	float beta1, one_minus_beta1;
+	float beta2, one_minus_beta2;
+	float epsilon;
+};
+
+// The same sequence of float operations as AdamOptimizer::step(), such that the results are identical. No FMA: the
+// fused roundings would differ.
+template <bool L2, bool DEFERRED>
+void adam_scalar(size_t begin, size_t end, const AdamStepParams& p, const float* gradient, const float* step_size, float* variable, float* first_moment, float* second_moment, float* update) {
+	for (size_t j = begin; j < end; ++j) {
+		float g = gradient[j] * p.gradient_scale;
+		if (L2) {
+			g += variable[j] * p.l2_reg;
+		}
+
+		first_moment[j] = p.beta1 * first_moment[j] + p.one_minus_beta1 * g;
+		second_moment[j] = p.beta2 * second_moment[j] + p.one_minus_beta2 * g * g;
+		float u = step_size[j] * first_moment[j] / (std::sqrt(second_moment[j]) + p.epsilon);
+
+		if (DEFERRED) {
+			update[j] = u;
+		} else {
+			variable[j] -= u;
+		}
+	}
+}
+
+#ifdef NGP_CPU_X86
+template <bool L2, bool DEFERRED>
+NGP_CPU_TARGET("avx2") void adam_avx2(size_t begin, size_t end, const AdamStepParams& p, const float* gradient, const float* step_size, float* variable, float* first_moment, float* second_moment, float* update) {
+	const __m256 gradient_scale = _mm256_set1_ps(p.gradient_scale);
+	const __m256 l2_reg = _mm256_set1_ps(p.l2_reg);
+	const __m256 beta1 = _mm256_set1_ps(p.beta1);
+	const __m256 one_minus_beta1 = _mm256_set1_ps(p.one_minus_beta1);
+	const __m256 beta2 = _mm256_set1_ps(p.beta2);
+	const __m256 one_minus_beta2 = _mm256_set1_ps(p.one_minus_beta2);
+	const __m256 epsilon = _mm256_set1_ps(p.epsilon);
+
+	size_t j = begin;
+	for (; j + 8 <= end; j += 8) {
+		__m256 var = _mm256_loadu_ps(variable + j);
+		__m256 g = _mm256_mul_ps(_mm256_loadu_ps(gradient + j), gradient_scale);
+		if (L2) {
+			g = _mm256_add_ps(g, _mm256_mul_ps(var, l2_reg));
+		}
+
+		__m256 m = _mm256_add_ps(_mm256_mul_ps(beta1, _mm256_loadu_ps(first_moment + j)), _mm256_mul_ps(one_minus_beta1, g));
+		__m256 v = _mm256_add_ps(_mm256_mul_ps(beta2, _mm256_loadu_ps(second_moment + j)), _mm256_mul_ps(_mm256_mul_ps(one_minus_beta2, g), g));
+		_mm256_storeu_ps(first_moment + j, m);
+		_mm256_storeu_ps(second_moment + j, v);
+
+		__m256 u = _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(step_size + j), m), _mm256_add_ps(_mm256_sqrt_ps(v), epsilon));
+		if (DEFERRED) {
+			_mm256_storeu_ps(update + j, u);
+		} else {
+			_mm256_storeu_ps(variable + j, _mm256_sub_ps(var, u));
+		}
+	}
+
+	adam_scalar<L2, DEFERRED>(j, end, p, gradient, step_size, variable, first_moment, second_moment, update);
+}
+#endif
+
+using AdamKernel = void (*)(size_t, size_t, const AdamStepParams&, const float*, const float*, float*, float*, float*, float*);
+
+template <bool L2, bool DEFERRED>
+AdamKernel select_adam_kernel() {
+#ifdef NGP_CPU_X86
+	static const bool avx2 = cpu_supports(ECpuIsa::Avx2);
+	if (avx2) {
+		return adam_avx2<L2, DEFERRED>;
+	}
+#endif
+	return adam_scalar<L2, DEFERRED>;
+}
+
+}
+
+void BatchedAdamOptimizer::resize(size_t n_items) {
+	m_iter.resize(n_items, 0);
+	m_learning_rate.resize(n_items, m_default_learning_rate);
+	m_variable.resize(n_items * m_dims, 0.0f);
+	m_first_moment.resize(n_items * m_dims, 0.0f);
+	m_second_moment.resize(n_items * m_dims, 0.0f);
+}
+
+void BatchedAdamOptimizer::set_learning_rate(float lr) {
+	m_default_learning_rate = lr;
+	std::fill(m_learning_rate.begin(), m_learning_rate.end(), lr);
+}
+
+void BatchedAdamOptimizer::reset_state(size_t i) {
+	m_iter.at(i) = 0;
+	std::fill_n(m_variable.begin() + i * m_dims, m_dims, 0.0f);
+	std::fill_n(m_first_moment.begin() + i * m_dims, m_dims, 0.0f);
+	std::fill_n(m_second_moment.begin() + i * m_dims, m_dims, 0.0f);
+}
+
+void BatchedAdamOptimizer::reset_state() {
+	std::fill(m_iter.begin(), m_iter.end(), 0);
+	std::fill(m_variable.begin(), m_variable.end(), 0.0f);
+	std::fill(m_first_moment.begin(), m_first_moment.end(), 0.0f);
+	std::fill(m_second_moment.begin(), m_second_moment.end(), 0.0f);
+}
+
+void BatchedAdamOptimizer::set_steps(uint32_t iter) {
+	std::fill(m_iter.begin(), m_iter.end(), iter);
+}
+
+void BatchedAdamOptimizer::check_type_size(size_t n_bytes) const {
+	if (n_bytes != m_dims * sizeof(float)) {
+		throw std::runtime_error{fmt::format("Can not view {} parameters per item as a type of {} bytes.", m_dims, n_bytes)};
+	}
+}
+
+void BatchedAdamOptimizer::step(size_t n_items, const float* gradient, float gradient_scale, float l2_reg, EBatchedAdamUpdate update, ThreadPool* pool) {
+	if (n_items > size()) {
+		throw std::runtime_error{fmt::format("Can not step {} items of a batched Adam optimizer with {}.", n_items, size())};
+	}
+
+	if (n_items == 0 || m_dims == 0) {
+		return;
+	}
+
+	m_step_size.resize(n_items * m_dims);
+	if (update == EBatchedAdamUpdate::Deferred) {
+		m_update.resize(n_items * m_dims);
+	}
+
+	AdamStepParams params = {gradient_scale, l2_reg, m_beta1, 1.0f - m_beta1, m_beta2, 1.0f - m_beta2, m_epsilon};
+
+	bool l2 = l2_reg != 0.0f;
+	bool deferred = update == EBatchedAdamUpdate::Deferred;
+	AdamKernel kernel = l2 ?
+		(deferred ? select_adam_kernel<true, true>() : select_adam_kernel<true, false>()) :
+		(deferred ? select_adam_kernel<false, true>() : select_adam_kernel<false, false>());
+
+	auto step_chunk = [&](size_t chunk) {
+		size_t begin = chunk * ITEMS_PER_CHUNK;
+		size_t end = std::min(begin + ITEMS_PER_CHUNK, n_items);
+
+		// The bias correction only depends on the iteration, which all items usually share, so only evaluate
+		// std::pow when it changes.
+		uint32_t cached_iter = 0;
+		float sqrt_beta2_correction = 0.0f;
+		float beta1_correction = 1.0f;
+
+		for (size_t i = begin; i < end; ++i) {
+			uint32_t iter = ++m_iter[i];
+			if (iter != cached_iter) {
+				cached_iter = iter;
+				sqrt_beta2_correction = std::sqrt(1.0f - std::pow(m_beta2, (float)iter));
+				beta1_correction = 1.0f - std::pow(m_beta1, (float)iter);
+			}
+
+			std::fill_n(m_step_size.begin() + i * m_dims, m_dims, m_learning_rate[i] * sqrt_beta2_correction / beta1_correction);
+		}
+
+		kernel(begin * m_dims, end * m_dims, params, gradient, m_step_size.data(), m_variable.data(), m_first_moment.data(), m_second_moment.data(), m_update.data());
+	};
+
+	size_t n_chunks = (n_items + ITEMS_PER_CHUNK - 1) / ITEMS_PER_CHUNK;
+	if (pool && n_chunks > 1) {
+		pool->parallel_for<size_t>(0, n_chunks, step_chunk);
+	} else {
+		for (size_t chunk = 0; chunk < n_chunks; ++chunk) {
+			step_chunk(chunk);
+		}
+	}
+}
+
+void BatchedAdamOptimizer::to_json(json& j) const {
+	j = json::array();
+	for (size_t i = 0; i < size(); ++i) {
+		j.push_back({
+			{"iter", m_iter[i]},
+			{"first_moment", std::vector<float>(m_first_moment.begin() + i * m_dims, m_first_moment.begin() + (i + 1) * m_dims)},
+			{"second_moment", std::vector<float>(m_second_moment.begin() + i * m_dims, m_second_moment.begin() + (i + 1) * m_dims)},
+			{"variable", std::vector<float>(m_variable.begin() + i * m_dims, m_variable.begin() + (i + 1) * m_dims)},
+			{"learning_rate", m_learning_rate[i]},
+			{"epsilon", m_epsilon},
+			{"beta1", m_beta1},
+			{"beta2", m_beta2},
+		});
+	}
+}
+
+void BatchedAdamOptimizer::from_json(const json& j) {
+	if (!j.is_array()) {
+		throw std::runtime_error{"Batched Adam state must be an array of per-item states."};
+	}
+
+	if (!j.empty()) {
+		uint32_t dims = (uint32_t)j.at(0).at("variable").size();
+		if (m_dims != 0 && dims != m_dims) {
+			throw std::runtime_error{fmt::format("Batched Adam state has {} parameters per item, but {} are expected.", dims, m_dims)};
+		}
+
+		m_dims = dims;
+		m_epsilon = j.at(0).at("epsilon");
+		m_beta1 = j.at(0).at("beta1");
+		m_beta2 = j.at(0).at("beta2");
+	}
+
+	resize(0);
+	resize(j.size());
+
+	for (size_t i = 0; i < j.size(); ++i) {
+		const auto& item = j.at(i);
+		m_iter[i] = item.at("iter");
+		m_learning_rate[i] = item.at("learning_rate");
+
+		auto copy = [&](const char* key, std::vector<float>& dst) {
+			auto values = item.at(key).get<std::vector<float>>();
+			if (values.size() != m_dims) {
+				throw std::runtime_error{fmt::format("Item {} of a batched Adam state has {} {} values, but {} are expected.", i, values.size(), key, m_dims)};
+			}
+
+			std::copy(values.begin(), values.end(), dst.begin() + i * m_dims);
+		};
+
+		copy("first_moment", m_first_moment);
+		copy("second_moment", m_second_moment);
+		copy("variable", m_variable);
+	}
+}
+
+NGP_NAMESPACE_END
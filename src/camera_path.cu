@@ -22,6 +22,7 @@
 #endif
 
 #include <json/json.hpp>
+
 #include <fstream>
 
 using namespace nlohmann;
@@ -71,6 +72,111 @@ CameraKeyframe spline(float t, const CameraKeyframe& p0, const CameraKeyframe& p
 	}
 }
 
+void CameraPath::update_length_tables() {
+	if (keyframes.empty()) {
+		m_length_tables_valid = false;
+		return;
+	}
+
+	if (m_length_tables_valid && m_length_tables_loop == loop && m_length_tables_angular_weight == angular_length_weight && m_length_tables_keyframes_generation == m_keyframes_generation) {
+		return;
+	}
+
+	m_length_tables_valid = true;
+	m_length_tables_loop = loop;
+	m_length_tables_angular_weight = angular_length_weight;
+	m_length_tables_keyframes_generation = m_keyframes_generation;
+
+	size_t n_segments = std::max(loop ? keyframes.size() : keyframes.size() - 1, (size_t)1);
+	size_t n = n_segments * N_LENGTH_SAMPLES_PER_SEGMENT + 1;
+
+	m_arc_length_table.resize(n);
+	m_angular_length_table.resize(n);
+	std::vector<float> length(n);
+
+	m_arc_length_table[0] = m_angular_length_table[0] = length[0] = 0.0f;
+
+	CameraKeyframe prev = eval_spline(0.0f);
+	for (size_t i = 1; i < n; ++i) {
+		CameraKeyframe cur = eval_spline((float)i / (float)(n - 1));
+		float cos_half_angle = std::min(fabsf(dot(normalize(prev.R), normalize(cur.R))), 1.0f);
+
+		m_arc_length_table[i] = m_arc_length_table[i-1] + distance(prev.T, cur.T);
+		m_angular_length_table[i] = m_angular_length_table[i-1] + 2.0f * acosf(cos_half_angle);
+		length[i] = m_arc_length_table[i] + angular_length_weight * m_angular_length_table[i];
+		prev = cur;
+	}
+
+	// Invert the cumulative length into a table that is uniformly spaced in length,
+	// such that looking up the spline parameter of a given path time is O(1).
+	m_spline_time_table.resize(n);
+	float total_length = length.back();
+	size_t j = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (total_length <= 0.0f) {
+			m_spline_time_table[i] = (float)i / (float)(n - 1);
+			continue;
+		}
+
+		float target = total_length * (float)i / (float)(n - 1);
+		while (j < n - 2 && length[j+1] < target) {
+			++j;
+		}
+
+		float segment_length = length[j+1] - length[j];
+		float frac = segment_length > 0.0f ? tcnn::clamp((target - length[j]) / segment_length, 0.0f, 1.0f) : 0.0f;
+		m_spline_time_table[i] = ((float)j + frac) / (float)(n - 1);
+	}
+}
+
+float CameraPath::spline_time(float t) {
+	if (keyframes.empty()) {
+		return t;
+	}
+
+	update_length_tables();
+
+	size_t n = m_spline_time_table.size();
+	float x = tcnn::clamp(t, 0.0f, 1.0f) * (float)(n - 1);
+	size_t i = std::min((size_t)x, n - 2);
+	return m_spline_time_table[i] + (m_spline_time_table[i+1] - m_spline_time_table[i]) * (x - (float)i);
+}
+
+float CameraPath::arc_length() {
+	if (keyframes.empty()) {
+		return 0.0f;
+	}
+
+	update_length_tables();
+	return m_arc_length_table.back();
+}
+
+float CameraPath::angular_length() {
+	if (keyframes.empty()) {
+		return 0.0f;
+	}
+
+	update_length_tables();
+	return m_angular_length_table.back();
+}
+
+std::vector<CameraKeyframe> CameraPath::eval_many(const std::vector<float>& ts) {
+	std::vector<CameraKeyframe> result(ts.size());
+	if (keyframes.empty()) {
+		return result;
+	}
+
+	if (constant_speed) {
+		update_length_tables();
+	}
+
+	for (size_t i = 0; i < ts.size(); ++i) {
+		result[i] = eval_camera_path(ts[i]);
+	}
+
+	return result;
+}
+
 void to_json(json& j, const CameraKeyframe& p) {
 	j = json{
 		{"R", p.R},
@@ -112,6 +218,8 @@ void CameraPath::save(const fs::path& path) {
 	json j = {
 		{"loop", loop},
 		{"time", play_time},
+		{"constant_speed", constant_speed},
+		{"angular_length_weight", angular_length_weight},
 		{"path", keyframes},
 	};
 	std::ofstream f(native_string(path));
@@ -132,6 +240,8 @@ void CameraPath::load(const fs::path& path, const mat4x3& first_xform) {
 	keyframes.clear();
 	if (j.contains("loop")) loop = j["loop"];
 	if (j.contains("time")) play_time = j["time"];
+	if (j.contains("constant_speed")) constant_speed = j["constant_speed"];
+	if (j.contains("angular_length_weight")) angular_length_weight = j["angular_length_weight"];
 	if (j.contains("path")) for (auto& el : j["path"]) {
 		CameraKeyframe p;
 		bool is_first = keyframes.empty();
@@ -141,6 +251,8 @@ void CameraPath::load(const fs::path& path, const mat4x3& first_xform) {
 		}
 		keyframes.push_back(p);
 	}
+
+	keyframes_changed();
 }
 
 #ifdef NGP_GUI
@@ -197,7 +309,8 @@ int CameraPath::imgui(char path_filename_buf[1024], float frame_milliseconds, ma
 		ImGui::SameLine();
 		if (ImGui::Button("Split")) {
 			update_cam_from_path = false;
-			int i = (int)ceil(play_time * (float)n + 0.001f);
+			float u = constant_speed ? spline_time(play_time) : play_time;
+			int i = (int)ceil(u * (float)n + 0.001f);
 			if (i > keyframes.size()) { i = (int)keyframes.size(); }
 			if (i < 0) { i = 0; }
 			keyframes.insert(keyframes.begin() + i, eval_camera_path(play_time));
@@ -231,6 +344,8 @@ int CameraPath::imgui(char path_filename_buf[1024], float frame_milliseconds, ma
 		if (ImGui::RadioButton("World", m_gizmo_mode == ImGuizmo::WORLD)) { m_gizmo_mode = ImGuizmo::WORLD; }
 		ImGui::SameLine();
 		ImGui::Checkbox("Loop path", &loop);
+		ImGui::SameLine();
+		if (ImGui::Checkbox("Constant speed", &constant_speed)) { read = 1; }
 
 		if (ImGui::SliderFloat("Camera path time", &play_time, 0.0f, 1.0f)) { read = 1; }
 
@@ -255,6 +370,11 @@ int CameraPath::imgui(char path_filename_buf[1024], float frame_milliseconds, ma
 
 	if (rendering) { ImGui::EndDisabled(); }
 
+	// All keyframe edits above request a hard camera update.
+	if (read == 2) {
+		keyframes_changed();
+	}
+
 	return keyframes.empty() ? 0 : read;
 }
 
@@ -353,6 +473,7 @@ bool CameraPath::imgui_viz(ImDrawList* list, mat4 &view2proj, mat4 &world2proj,
 					keyframes[i].T = matrix[3].xyz;
 					keyframes[i].R = quat(mat3(matrix));
 				}
+				keyframes_changed();
 				changed=true;
 			}
 
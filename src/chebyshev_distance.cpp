@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   chebyshev_distance.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/chebyshev_distance.h>
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/thread_pool.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+NGP_NAMESPACE_BEGIN
+
+std::vector<uint8_t> chebyshev_distance_transform(const std::vector<uint8_t>& occupied, uint32_t res, ThreadPool* pool) {
+	size_t n_cells = (size_t)res * res * res;
+	if (occupied.size() != n_cells) {
+		throw std::runtime_error{fmt::format("Occupancy grid has {} cells but resolution {} requires {}.", occupied.size(), res, n_cells)};
+	}
+
+	if (res > (uint32_t)std::numeric_limits<int16_t>::max()) {
+		throw std::runtime_error{fmt::format("Resolution {} is too large for the distance transform.", res)};
+	}
+
+	std::vector<uint8_t> dist(n_cells), tmp(n_cells);
+
+	auto for_each = [&](uint32_t n, const std::function<void(uint32_t)>& body) {
+		if (pool) {
+			pool->parallel_for<uint32_t>(0, n, body);
+		} else {
+			for (uint32_t i = 0; i < n; ++i) {
+				body(i);
+			}
+		}
+	};
+
+	auto idx = [res](uint32_t x, uint32_t y, uint32_t z) {
+		return x + (size_t)res * (y + (size_t)res * z);
+	};
+
+	// One pass along `axis` from `src` into `dst`. Lines are gathered into contiguous scratch memory that is
+	// allocated once per slice of lines rather than once per line.
+	auto pass = [&](uint32_t axis, const std::vector<uint8_t>& src, std::vector<uint8_t>& dst, bool from_occupancy) {
+		for_each(res, [&](uint32_t slice) {
+			std::vector<uint8_t> in(res), out(res);
+			std::vector<int16_t> queue(res + 1);
+
+			for (uint32_t line = 0; line < res; ++line) {
+				auto cell = [&](uint32_t i) {
+					switch (axis) {
+						case 0: return idx(i, line, slice);
+						case 1: return idx(line, i, slice);
+						default: return idx(line, slice, i);
+					}
+				};
+
+				for (uint32_t i = 0; i < res; ++i) {
+					uint8_t v = src[cell(i)];
+					in[i] = from_occupancy ? (v ? 0 : CHEBYSHEV_DISTANCE_MAX) : v;
+				}
+
+				chebyshev_distance_transform_line(res, in.data(), out.data(), queue.data());
+
+				for (uint32_t i = 0; i < res; ++i) {
+					dst[cell(i)] = out[i];
+				}
+			}
+		});
+	};
+
+	pass(0, occupied, dist, true);
+	pass(1, dist, tmp, false);
+	pass(2, tmp, dist, false);
+
+	return dist;
+}
+
+uint8_t chebyshev_distance_brute_force(const std::vector<uint8_t>& occupied, uint32_t res, const ivec3& cell) {
+	// The nearest cell outside the grid
+	int best = std::min(compMin(cell), (int)res - 1 - compMax(cell)) + 1;
+
+	for (uint32_t z = 0; z < res; ++z) {
+		for (uint32_t y = 0; y < res; ++y) {
+			for (uint32_t x = 0; x < res; ++x) {
+				if (!occupied[x + (size_t)res * (y + (size_t)res * z)]) {
+					continue;
+				}
+
+				ivec3 d = abs(ivec3{(int)x, (int)y, (int)z} - cell);
+				best = std::min(best, compMax(d));
+			}
+		}
+	}
+
+	return (uint8_t)std::min(best, (int)CHEBYSHEV_DISTANCE_MAX);
+}
+
+NGP_NAMESPACE_END
@@ -0,0 +1,1445 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   cpu_nerf.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/cpu_nerf.h>
+
+#include <fmt/core.h>
+
+#include <zstr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#  define NGP_CPU_X86
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#    define NGP_CPU_TARGET(isa)
+#  else
+#    define NGP_CPU_TARGET(isa) __attribute__((target(isa)))
+#  endif
+#endif
+
+using namespace nlohmann;
+
+NGP_NAMESPACE_BEGIN
+
+namespace {
+
+// Mirrors of the ray marching constants in testbed_nerf.cu
+constexpr uint32_t NERF_STEPS = 1024;
+constexpr uint32_t NERF_GRIDSIZE = 128;
+constexpr uint32_t NERF_CASCADES = 8;
+constexpr float SQRT3 = 1.73205080757f;
+constexpr float MIN_CONE_STEPSIZE = SQRT3 / NERF_STEPS;
+constexpr float NERF_MIN_OPTICAL_THICKNESS = 0.01f;
+constexpr float MAX_DEPTH = 16384.0f;
+
+// Inputs are evaluated in batches of this many rows. All activations of a batch stay in the L2 cache
+// while it passes through both networks, and the weights of a layer stay in L1 while a batch passes it.
+constexpr uint32_t BATCH_SIZE = 128;
+// The GEMM kernels compute tiles of ROW_TILE inputs times 16 (AVX2) or 32 (AVX-512) outputs in registers.
+constexpr uint32_t ROW_TILE = 4;
+constexpr uint32_t COLUMN_ALIGNMENT = 16;
+
+constexpr uint32_t RENDER_TILE_SIZE = 16;
+constexpr uint32_t MAX_STEPS_PER_MARCH = 8;
+
+enum class EActivation {
+	None,
+	ReLU,
+	LeakyReLU,
+	Exponential,
+	Sine,
+	Sigmoid,
+	Squareplus,
+	Softplus,
+	Tanh,
+};
+
+std::string lower(std::string str) {
+	std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	return str;
+}
+
+bool equals_lower(const std::string& a, const std::string& b) {
+	return lower(a) == lower(b);
+}
+
+uint32_t next_multiple(uint32_t val, uint32_t divisor) {
+	return (val + divisor - 1) / divisor * divisor;
+}
+
+EActivation activation_from_string(const std::string& str) {
+	static const std::pair<const char*, EActivation> activations[] = {
+		{"None", EActivation::None},
+		{"ReLU", EActivation::ReLU},
+		{"LeakyReLU", EActivation::LeakyReLU},
+		{"Exponential", EActivation::Exponential},
+		{"Sine", EActivation::Sine},
+		{"Sigmoid", EActivation::Sigmoid},
+		{"Squareplus", EActivation::Squareplus},
+		{"Softplus", EActivation::Softplus},
+		{"Tanh", EActivation::Tanh},
+	};
+
+	for (const auto& a : activations) {
+		if (equals_lower(str, a.first)) {
+			return a.second;
+		}
+	}
+
+	throw std::runtime_error{fmt::format("Unsupported activation '{}'.", str)};
+}
+
+float activate(float x, EActivation activation) {
+	// Same scaling of Squareplus and Softplus as tiny-cuda-nn
+	static constexpr float K_ACT = 10.0f;
+
+	switch (activation) {
+		case EActivation::None: return x;
+		case EActivation::ReLU: return x > 0.0f ? x : 0.0f;
+		case EActivation::LeakyReLU: return x > 0.0f ? x : 0.01f * x;
+		case EActivation::Exponential: return std::exp(x);
+		case EActivation::Sine: return std::sin(x);
+		case EActivation::Sigmoid: return 1.0f / (1.0f + std::exp(-x));
+		case EActivation::Squareplus: { float y = x * K_ACT; return 0.5f * (y + std::sqrt(y * y + 4.0f)) / K_ACT; }
+		case EActivation::Softplus: return std::log(std::exp(x * K_ACT) + 1.0f) / K_ACT;
+		case EActivation::Tanh: return std::tanh(x);
+		default: return x;
+	}
+}
+
+float network_to_rgb(float val, ENerfActivation activation) {
+	switch (activation) {
+		case ENerfActivation::None: return val;
+		case ENerfActivation::ReLU: return val > 0.0f ? val : 0.0f;
+		case ENerfActivation::Logistic: return 1.0f / (1.0f + std::exp(-val));
+		case ENerfActivation::Exponential: return std::exp(std::min(std::max(val, -10.0f), 10.0f));
+		default: return val;
+	}
+}
+
+float network_to_density(float val, ENerfActivation activation) {
+	switch (activation) {
+		case ENerfActivation::None: return val;
+		case ENerfActivation::ReLU: return val > 0.0f ? val : 0.0f;
+		case ENerfActivation::Logistic: return 1.0f / (1.0f + std::exp(-val));
+		case ENerfActivation::Exponential: return std::exp(val);
+		default: return val;
+	}
+}
+
+float half_to_float(uint16_t h) {
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+
+	uint32_t bits;
+	if (exponent == 0x1f) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	} else if (exponent != 0) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	} else if (mantissa != 0) {
+		// Subnormal: renormalize
+		exponent = 113;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	} else {
+		bits = sign;
+	}
+
+	float result;
+	std::memcpy(&result, &bits, sizeof(float));
+	return result;
+}
+
+std::vector<uint8_t> json_binary(const json& j) {
+	if (j.is_binary()) {
+		return j.get_binary();
+	} else if (j.is_object() && j.contains("bytes")) {
+		// Binary data that went through a conversion to plain json
+		return j["bytes"].get<std::vector<uint8_t>>();
+	}
+
+	throw std::runtime_error{"Expected binary data."};
+}
+
+std::vector<float> floats_from_binary(const json& j, const std::string& type) {
+	std::vector<uint8_t> bytes = json_binary(j);
+	std::vector<float> result;
+
+	if (type == "__half") {
+		result.resize(bytes.size() / sizeof(uint16_t));
+		for (size_t i = 0; i < result.size(); ++i) {
+			uint16_t h;
+			std::memcpy(&h, bytes.data() + i * sizeof(uint16_t), sizeof(uint16_t));
+			result[i] = half_to_float(h);
+		}
+	} else if (type == "float") {
+		result.resize(bytes.size() / sizeof(float));
+		std::memcpy(result.data(), bytes.data(), result.size() * sizeof(float));
+	} else {
+		throw std::runtime_error{fmt::format("Unsupported parameter type '{}'.", type)};
+	}
+
+	return result;
+}
+
+vec3 read_vec3(const json& j) {
+	return {j.at(0).get<float>(), j.at(1).get<float>(), j.at(2).get<float>()};
+}
+
+vec2 read_vec2(const json& j) {
+	return {j.at(0).get<float>(), j.at(1).get<float>()};
+}
+
+// Matrices are stored as rows, see json_binding.h
+template <int N_COLS, typename M>
+M read_matrix(const json& j) {
+	M result;
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < N_COLS; ++col) {
+			result[col][row] = j.at(row).at(col).get<float>();
+		}
+	}
+	return result;
+}
+
+uint32_t expand_bits(uint32_t v) {
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+uint32_t morton3D(uint32_t x, uint32_t y, uint32_t z) {
+	return expand_bits(x) | (expand_bits(y) << 1) | (expand_bits(z) << 2);
+}
+
+uint32_t morton3D_invert(uint32_t x) {
+	x = x & 0x49249249;
+	x = (x | (x >> 2)) & 0xc30c30c3;
+	x = (x | (x >> 4)) & 0x0f00f00f;
+	x = (x | (x >> 8)) & 0xff0000ff;
+	x = (x | (x >> 16)) & 0x0000ffff;
+	return x;
+}
+
+// Host mirrors of the exponential stepping in testbed_nerf.cu. The maximum step size depends on the density grid size.
+float to_stepping_space(float t, float cone_angle, float max_stepsize) {
+	if (cone_angle <= 1e-5f) {
+		return t / MIN_CONE_STEPSIZE;
+	}
+
+	float log1p_c = std::log(1.0f + cone_angle);
+
+	float a = (std::log(MIN_CONE_STEPSIZE) - std::log(log1p_c)) / log1p_c;
+	float b = (std::log(max_stepsize) - std::log(log1p_c)) / log1p_c;
+
+	float at = std::exp(a * log1p_c);
+	float bt = std::exp(b * log1p_c);
+
+	if (t <= at) {
+		return (t - at) / MIN_CONE_STEPSIZE + a;
+	} else if (t <= bt) {
+		return std::log(t) / log1p_c;
+	} else {
+		return (t - bt) / max_stepsize + b;
+	}
+}
+
+float from_stepping_space(float n, float cone_angle, float max_stepsize) {
+	if (cone_angle <= 1e-5f) {
+		return n * MIN_CONE_STEPSIZE;
+	}
+
+	float log1p_c = std::log(1.0f + cone_angle);
+
+	float a = (std::log(MIN_CONE_STEPSIZE) - std::log(log1p_c)) / log1p_c;
+	float b = (std::log(max_stepsize) - std::log(log1p_c)) / log1p_c;
+
+	float at = std::exp(a * log1p_c);
+	float bt = std::exp(b * log1p_c);
+
+	if (n <= a) {
+		return (n - a) * MIN_CONE_STEPSIZE + at;
+	} else if (n <= b) {
+		return std::exp(n * log1p_c);
+	} else {
+		return (n - b) * max_stepsize + bt;
+	}
+}
+
+float advance_n_steps(float t, float cone_angle, float n, float max_stepsize) {
+	return from_stepping_space(to_stepping_space(t, cone_angle, max_stepsize) + n, cone_angle, max_stepsize);
+}
+
+float calc_dt(float t, float cone_angle, float max_stepsize) {
+	return advance_n_steps(t, cone_angle, 1.0f, max_stepsize) - t;
+}
+
+float warp_dt(float dt) {
+	float max_stepsize = MIN_CONE_STEPSIZE * (1 << (NERF_CASCADES - 1));
+	return (dt - MIN_CONE_STEPSIZE) / (max_stepsize - MIN_CONE_STEPSIZE);
+}
+
+uint32_t mip_from_pos(const vec3& pos, uint32_t max_cascade) {
+	int exponent;
+	float maxval = compMax(abs(pos - vec3(0.5f)));
+	std::frexp(maxval, &exponent);
+	return (uint32_t)std::min(std::max(exponent + 1, 0), (int)max_cascade);
+}
+
+float distance_to_next_voxel(const vec3& pos, const vec3& dir, const vec3& idir, float res) {
+	vec3 p = res * (pos - vec3(0.5f));
+	float tx = (std::floor(p.x + 0.5f + 0.5f * sign(dir.x)) - p.x) * idir.x;
+	float ty = (std::floor(p.y + 0.5f + 0.5f * sign(dir.y)) - p.y) * idir.y;
+	float tz = (std::floor(p.z + 0.5f + 0.5f * sign(dir.z)) - p.z) * idir.z;
+	float t = std::min(std::min(tx, ty), tz);
+
+	return std::max(t / res, 0.0f);
+}
+
+vec2 ray_intersect(const vec3& min, const vec3& max, const vec3& pos, const vec3& dir) {
+	float tmin = -std::numeric_limits<float>::infinity();
+	float tmax = std::numeric_limits<float>::infinity();
+	for (int i = 0; i < 3; ++i) {
+		float t0 = (min[i] - pos[i]) / dir[i];
+		float t1 = (max[i] - pos[i]) / dir[i];
+		if (t0 > t1) {
+			std::swap(t0, t1);
+		}
+
+		tmin = std::max(tmin, t0);
+		tmax = std::min(tmax, t1);
+	}
+
+	return {tmin, tmax};
+}
+
+bool contains(const vec3& min, const vec3& max, const vec3& p) {
+	return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y && p.z >= min.z && p.z <= max.z;
+}
+
+// Same hash as tiny-cuda-nn's grid encoding
+uint32_t grid_index(bool hash, uint32_t hashmap_size, uint32_t resolution, const uint32_t pos_grid[3]) {
+	uint32_t stride = 1;
+	uint32_t index = 0;
+
+	for (uint32_t dim = 0; dim < 3 && stride <= hashmap_size; ++dim) {
+		index += pos_grid[dim] * stride;
+		stride *= resolution;
+	}
+
+	if (hash && hashmap_size < stride) {
+		index = pos_grid[0] ^ (pos_grid[1] * 2654435761u) ^ (pos_grid[2] * 805459861u);
+	}
+
+	return index % hashmap_size;
+}
+
+void sh_enc(uint32_t degree, vec3 dir, float* out) {
+	float x = dir.x * 2.0f - 1.0f;
+	float y = dir.y * 2.0f - 1.0f;
+	float z = dir.z * 2.0f - 1.0f;
+
+	float xy = x * y, xz = x * z, yz = y * z, x2 = x * x, y2 = y * y, z2 = z * z;
+
+	out[0] = 0.28209479177387814f;
+	if (degree <= 1) { return; }
+	out[1] = -0.48860251190291987f * y;
+	out[2] = 0.48860251190291987f * z;
+	out[3] = -0.48860251190291987f * x;
+	if (degree <= 2) { return; }
+	out[4] = 1.0925484305920792f * xy;
+	out[5] = -1.0925484305920792f * yz;
+	out[6] = 0.94617469575755997f * z2 - 0.31539156525251999f;
+	out[7] = -1.0925484305920792f * xz;
+	out[8] = 0.54627421529603959f * x2 - 0.54627421529603959f * y2;
+	if (degree <= 3) { return; }
+	out[9] = 0.59004358992664352f * y * (-3.0f * x2 + y2);
+	out[10] = 2.8906114426405538f * xy * z;
+	out[11] = 0.45704579946446572f * y * (1.0f - 5.0f * z2);
+	out[12] = 0.3731763325901154f * z * (5.0f * z2 - 3.0f);
+	out[13] = 0.45704579946446572f * x * (1.0f - 5.0f * z2);
+	out[14] = 1.4453057213202769f * z * (x2 - y2);
+	out[15] = 0.59004358992664352f * x * (-x2 + 3.0f * y2);
+}
+
+// Out = In * W for `n` rows, where W is stored transposed (n_inputs rows of `stride` floats) such that every input
+// broadcasts against contiguous output columns. `n` must be a multiple of ROW_TILE and `stride` of COLUMN_ALIGNMENT.
+void dense_scalar(const float* in, size_t in_stride, size_t n, const float* w, uint32_t n_inputs, uint32_t stride, bool relu, float* out, size_t out_stride) {
+	for (size_t r = 0; r < n; ++r) {
+		const float* x = in + r * in_stride;
+		float* y = out + r * out_stride;
+		std::fill(y, y + stride, 0.0f);
+
+		for (uint32_t k = 0; k < n_inputs; ++k) {
+			const float xk = x[k];
+			const float* wk = w + (size_t)k * stride;
+			for (uint32_t o = 0; o < stride; ++o) {
+				y[o] += xk * wk[o];
+			}
+		}
+
+		if (relu) {
+			for (uint32_t o = 0; o < stride; ++o) {
+				y[o] = std::max(y[o], 0.0f);
+			}
+		}
+	}
+}
+
+#ifdef NGP_CPU_X86
+template <uint32_t N_VECS>
+NGP_CPU_TARGET("avx2,fma") void dense_tile_avx2(const float* in, size_t in_stride, const float* w, uint32_t n_inputs, uint32_t stride, bool relu, float* out, size_t out_stride) {
+	__m256 acc[ROW_TILE][N_VECS];
+	for (uint32_t r = 0; r < ROW_TILE; ++r) {
+		for (uint32_t v = 0; v < N_VECS; ++v) {
+			acc[r][v] = _mm256_setzero_ps();
+		}
+	}
+
+	for (uint32_t k = 0; k < n_inputs; ++k) {
+		__m256 wk[N_VECS];
+		for (uint32_t v = 0; v < N_VECS; ++v) {
+			wk[v] = _mm256_loadu_ps(w + (size_t)k * stride + 8 * v);
+		}
+
+		for (uint32_t r = 0; r < ROW_TILE; ++r) {
+			__m256 x = _mm256_broadcast_ss(in + r * in_stride + k);
+			for (uint32_t v = 0; v < N_VECS; ++v) {
+				acc[r][v] = _mm256_fmadd_ps(x, wk[v], acc[r][v]);
+			}
+		}
+	}
+
+	const __m256 zero = _mm256_setzero_ps();
+	for (uint32_t r = 0; r < ROW_TILE; ++r) {
+		for (uint32_t v = 0; v < N_VECS; ++v) {
+			_mm256_storeu_ps(out + r * out_stride + 8 * v, relu ? _mm256_max_ps(acc[r][v], zero) : acc[r][v]);
+		}
+	}
+}
+
+NGP_CPU_TARGET("avx2,fma") void dense_avx2(const float* in, size_t in_stride, size_t n, const float* w, uint32_t n_inputs, uint32_t stride, bool relu, float* out, size_t out_stride) {
+	for (size_t r = 0; r < n; r += ROW_TILE) {
+		for (uint32_t c = 0; c < stride; c += 16) {
+			dense_tile_avx2<2>(in + r * in_stride, in_stride, w + c, n_inputs, stride, relu, out + r * out_stride + c, out_stride);
+		}
+	}
+}
+
+template <uint32_t N_VECS>
+NGP_CPU_TARGET("avx512f") void dense_tile_avx512(const float* in, size_t in_stride, const float* w, uint32_t n_inputs, uint32_t stride, bool relu, float* out, size_t out_stride) {
+	__m512 acc[ROW_TILE][N_VECS];
+	for (uint32_t r = 0; r < ROW_TILE; ++r) {
+		for (uint32_t v = 0; v < N_VECS; ++v) {
+			acc[r][v] = _mm512_setzero_ps();
+		}
+	}
+
+	for (uint32_t k = 0; k < n_inputs; ++k) {
+		__m512 wk[N_VECS];
+		for (uint32_t v = 0; v < N_VECS; ++v) {
+			wk[v] = _mm512_loadu_ps(w + (size_t)k * stride + 16 * v);
+		}
+
+		for (uint32_t r = 0; r < ROW_TILE; ++r) {
+			__m512 x = _mm512_set1_ps(in[r * in_stride + k]);
+			for (uint32_t v = 0; v < N_VECS; ++v) {
+				acc[r][v] = _mm512_fmadd_ps(x, wk[v], acc[r][v]);
+			}
+		}
+	}
+
+	const __m512 zero = _mm512_setzero_ps();
+	for (uint32_t r = 0; r < ROW_TILE; ++r) {
+		for (uint32_t v = 0; v < N_VECS; ++v) {
+			_mm512_storeu_ps(out + r * out_stride + 16 * v, relu ? _mm512_max_ps(acc[r][v], zero) : acc[r][v]);
+		}
+	}
+}
+
+NGP_CPU_TARGET("avx512f") void dense_avx512(const float* in, size_t in_stride, size_t n, const float* w, uint32_t n_inputs, uint32_t stride, bool relu, float* out, size_t out_stride) {
+	for (size_t r = 0; r < n; r += ROW_TILE) {
+		uint32_t c = 0;
+		for (; c + 32 <= stride; c += 32) {
+			dense_tile_avx512<2>(in + r * in_stride, in_stride, w + c, n_inputs, stride, relu, out + r * out_stride + c, out_stride);
+		}
+
+		if (c < stride) {
+			dense_tile_avx512<1>(in + r * in_stride, in_stride, w + c, n_inputs, stride, relu, out + r * out_stride + c, out_stride);
+		}
+	}
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+bool msvc_cpu_supports(ECpuIsa isa) {
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+
+	__cpuid(info, 1);
+	bool fma = info[2] & (1 << 12);
+	bool osxsave = info[2] & (1 << 27);
+	if (!osxsave) {
+		return false;
+	}
+
+	// The OS must save the AVX (and AVX-512) register state across context switches.
+	unsigned long long xcr0 = _xgetbv(0);
+
+	__cpuidex(info, 7, 0);
+	if (isa == ECpuIsa::Avx2) {
+		return fma && (info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+	}
+
+	return (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+}
+#endif
+#endif
+
+}
+
+const char* isa_name(ECpuIsa isa) {
+	switch (isa) {
+		case ECpuIsa::Avx2: return "AVX2";
+		case ECpuIsa::Avx512: return "AVX-512";
+		default: return "Scalar";
+	}
+}
+
+bool cpu_supports(ECpuIsa isa) {
+	switch (isa) {
+		case ECpuIsa::Scalar: return true;
+#ifdef NGP_CPU_X86
+#  if defined(_MSC_VER) && !defined(__clang__)
+		case ECpuIsa::Avx2: return msvc_cpu_supports(ECpuIsa::Avx2);
+		case ECpuIsa::Avx512: return msvc_cpu_supports(ECpuIsa::Avx512);
+#  else
+		case ECpuIsa::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		case ECpuIsa::Avx512: return __builtin_cpu_supports("avx512f");
+#  endif
+#endif
+		default: return false;
+	}
+}
+
+ECpuIsa best_cpu_isa() {
+	if (cpu_supports(ECpuIsa::Avx512)) {
+		return ECpuIsa::Avx512;
+	} else if (cpu_supports(ECpuIsa::Avx2)) {
+		return ECpuIsa::Avx2;
+	}
+
+	return ECpuIsa::Scalar;
+}
+
+struct CpuNerf::Layer {
+	uint32_t n_inputs;
+	uint32_t n_outputs;
+	// n_outputs rounded up to COLUMN_ALIGNMENT. Row stride of the transposed weights and width of the output.
+	uint32_t stride;
+	EActivation activation;
+	// Transposed weights: n_inputs rows of `stride` floats, zero beyond n_outputs
+	std::vector<float> weights;
+};
+
+struct CpuNerf::Mlp {
+	std::vector<Layer> layers;
+	uint32_t max_hidden_stride = 0;
+
+	uint32_t output_stride() const { return layers.back().stride; }
+};
+
+struct CpuNerf::Scratch {
+	// Network activations of one batch
+	std::vector<float> pos_encoding;
+	std::vector<float> hidden[2];
+	std::vector<float> rgb_input;
+	std::vector<float> rgb_output;
+	size_t hidden_stride;
+	size_t rgb_input_stride;
+
+	// Ray marching state of one render tile
+	struct RayState {
+		vec3 origin;
+		vec3 dir;
+		float t;
+		vec4 rgba;
+		uint32_t pixel;
+		uint32_t n_samples;
+		bool alive;
+	};
+
+	std::vector<RayState> rays;
+	std::vector<float> sample_inputs;
+	std::vector<float> sample_dt;
+	std::vector<float> sample_outputs;
+};
+
+CpuNerf::CpuNerf(const fs::path& snapshot_path) {
+	if (!snapshot_path.exists()) {
+		throw std::runtime_error{fmt::format("Snapshot '{}' does not exist.", snapshot_path.str())};
+	}
+
+	json config;
+	{
+		std::ifstream f{native_string(snapshot_path), std::ios::in | std::ios::binary};
+		if (ends_with_case_insensitive(snapshot_path.str(), ".ingp")) {
+			zstr::istream zf{f};
+			config = json::from_msgpack(zf);
+		} else {
+			config = json::from_msgpack(f);
+		}
+	}
+
+	if (!config.contains("snapshot")) {
+		throw std::runtime_error{fmt::format("File '{}' does not contain a snapshot.", snapshot_path.str())};
+	}
+
+	const json& snapshot = config["snapshot"];
+	if (snapshot.contains("mode") && !equals_lower(snapshot["mode"].get<std::string>(), "nerf")) {
+		throw std::runtime_error{fmt::format("CPU inference supports NeRF snapshots only, not '{}'.", snapshot["mode"].get<std::string>())};
+	}
+
+	if (!snapshot.contains("nerf")) {
+		throw std::runtime_error{"Snapshot does not contain a NeRF."};
+	}
+
+	const json& nerf = snapshot["nerf"];
+	float aabb_scale = nerf.value("aabb_scale", 1.0f);
+
+	if (nerf.contains("dataset")) {
+		const json& dataset = nerf["dataset"];
+		if (dataset.value("n_extra_learnable_dims", 0u) > 0) {
+			throw std::runtime_error{"CPU inference does not support extra learnable dimensions."};
+		}
+
+		m_rgb_activation = dataset.value("is_hdr", false) ? ENerfActivation::Exponential : ENerfActivation::Logistic;
+		m_nerf_scale = dataset.value("scale", m_nerf_scale);
+		if (dataset.contains("offset")) m_nerf_offset = read_vec3(dataset["offset"]);
+		m_from_mitsuba = dataset.value("from_mitsuba", m_from_mitsuba);
+	}
+
+	if (snapshot.contains("aabb")) {
+		m_aabb_min = read_vec3(snapshot["aabb"]["min"]);
+		m_aabb_max = read_vec3(snapshot["aabb"]["max"]);
+	}
+
+	m_render_aabb_min = m_aabb_min;
+	m_render_aabb_max = m_aabb_max;
+	if (snapshot.contains("render_aabb")) {
+		m_render_aabb_min = read_vec3(snapshot["render_aabb"]["min"]);
+		m_render_aabb_max = read_vec3(snapshot["render_aabb"]["max"]);
+	}
+
+	if (snapshot.contains("render_aabb_to_local")) {
+		m_render_aabb_to_local = read_matrix<3, mat3>(snapshot["render_aabb_to_local"]);
+	}
+
+	if (snapshot.contains("camera")) {
+		const json& camera = snapshot["camera"];
+		if (camera.contains("matrix")) m_camera = read_matrix<4, mat4x3>(camera["matrix"]);
+		if (camera.contains("relative_focal_length")) m_relative_focal_length = read_vec2(camera["relative_focal_length"]);
+		if (camera.contains("screen_center")) m_screen_center = read_vec2(camera["screen_center"]);
+		m_fov_axis = camera.value("fov_axis", m_fov_axis);
+		m_zoom = camera.value("zoom", m_zoom);
+	}
+
+	// Same default as the testbed
+	cone_angle_constant = aabb_scale <= 1 ? 0.0f : (1.0f / 256.0f);
+
+	std::vector<float> params = floats_from_binary(snapshot["params_binary"], snapshot.value("params_type", std::string{"__half"}));
+	if (snapshot.contains("n_params") && params.size() != snapshot["n_params"].get<size_t>()) {
+		throw std::runtime_error{fmt::format("Snapshot has {} parameters but claims to have {}.", params.size(), snapshot["n_params"].get<size_t>())};
+	}
+
+	config["aabb_scale"] = aabb_scale;
+	load_network(config, params);
+
+	m_grid_size = snapshot.value("density_grid_size", NERF_GRIDSIZE);
+	m_n_cascades = config.contains("density_grid") ? config["density_grid"].value("n_cascades", NERF_CASCADES) : NERF_CASCADES;
+	if (snapshot.contains("density_grid_binary")) {
+		load_density_grid(floats_from_binary(snapshot["density_grid_binary"], "__half"));
+	}
+
+	set_isa(best_cpu_isa());
+	set_n_threads(std::thread::hardware_concurrency());
+
+	tlog::success() << "Loaded snapshot '" << snapshot_path.str() << "' for CPU inference: " << architecture();
+}
+
+CpuNerf::~CpuNerf() {}
+
+void CpuNerf::load_network(const json& config, const std::vector<float>& params) {
+	const json& encoding = config.at("encoding");
+	const json& density_network = config.at("network");
+	const json& dir_encoding = config.at("dir_encoding");
+	const json& rgb_network = config.at("rgb_network");
+
+	auto network_alignment = [](const json& network) -> uint32_t {
+		std::string otype = network.value("otype", "FullyFusedMLP");
+		if (equals_lower(otype, "FullyFusedMLP") || equals_lower(otype, "MegakernelMLP")) {
+			return 16;
+		} else if (equals_lower(otype, "CutlassMLP")) {
+			return 8;
+		}
+
+		throw std::runtime_error{fmt::format("CPU inference does not support networks of type '{}'.", otype)};
+	};
+
+	// Hash grid, configured the same way as Testbed::reset_network() and tiny-cuda-nn's create_grid_encoding()
+	std::string encoding_type = encoding.value("otype", "HashGrid");
+	if (lower(encoding_type).find("grid") == std::string::npos) {
+		throw std::runtime_error{fmt::format("CPU inference supports grid encodings only, not '{}'.", encoding_type)};
+	}
+
+	std::string grid_type = encoding.value("type", equals_lower(encoding_type, "TiledGrid") ? "Tiled" : (equals_lower(encoding_type, "DenseGrid") ? "Dense" : "Hash"));
+	if (!equals_lower(grid_type, "Hash") && !equals_lower(grid_type, "Dense")) {
+		throw std::runtime_error{fmt::format("CPU inference does not support grids of type '{}'.", grid_type)};
+	}
+
+	if (!equals_lower(encoding.value("interpolation", "Linear"), "Linear") || !equals_lower(encoding.value("hash", "CoherentPrime"), "CoherentPrime")) {
+		throw std::runtime_error{"CPU inference supports linearly interpolated grids with the default hash only."};
+	}
+
+	m_hash = equals_lower(grid_type, "Hash");
+	m_n_features_per_level = encoding.value("n_features_per_level", 2u);
+
+	uint32_t n_levels = encoding.value("n_levels", 16u);
+	if (encoding.contains("n_features") && encoding["n_features"] > 0) {
+		n_levels = encoding["n_features"].get<uint32_t>() / m_n_features_per_level;
+	}
+
+	m_log2_hashmap_size = encoding.value("log2_hashmap_size", 19u);
+
+	m_base_resolution = encoding.value("base_resolution", 0u);
+	if (!m_base_resolution) {
+		m_base_resolution = 1u << (encoding.value("log2_hashmap_size", 15u) / 3);
+	}
+
+	m_per_level_scale = encoding.value("per_level_scale", 0.0f);
+	if (m_per_level_scale <= 0.0f) {
+		m_per_level_scale = n_levels > 1 ? std::exp(std::log(2048.0f * config.value("aabb_scale", 1.0f) / (float)m_base_resolution) / (n_levels - 1)) : 2.0f;
+	}
+
+	m_levels.clear();
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < n_levels; ++i) {
+		GridLevel level;
+		level.scale = std::exp2(i * std::log2(m_per_level_scale)) * m_base_resolution - 1.0f;
+		level.resolution = (uint32_t)std::ceil(level.scale) + 1;
+		level.offset = offset;
+
+		uint32_t max_params = std::numeric_limits<uint32_t>::max() / 2;
+		uint32_t params_in_level = std::pow((float)level.resolution, 3.0f) > (float)max_params ? max_params : level.resolution * level.resolution * level.resolution;
+		params_in_level = next_multiple(params_in_level, 8u);
+		if (m_hash) {
+			params_in_level = std::min(params_in_level, 1u << m_log2_hashmap_size);
+		}
+
+		level.hashmap_size = params_in_level;
+		offset += params_in_level;
+		m_levels.emplace_back(level);
+	}
+
+	m_pos_encoding_width = next_multiple(n_levels * m_n_features_per_level, network_alignment(density_network) == 16 ? 16u : 8u);
+
+	// Direction encoding: spherical harmonics, optionally inside a composite whose other parts encode the (absent) extra dims.
+	const json* sh = &dir_encoding;
+	if (equals_lower(dir_encoding.value("otype", ""), "Composite")) {
+		const json& nested = dir_encoding.at("nested");
+		sh = nested.size() > 0 ? &nested[0] : nullptr;
+		for (size_t i = 1; i < nested.size(); ++i) {
+			if (!equals_lower(nested[i].value("otype", ""), "Identity") || nested[i].value("n_dims_to_encode", 0u) > 0) {
+				throw std::runtime_error{"CPU inference supports a composite direction encoding of spherical harmonics and identity only."};
+			}
+		}
+	}
+
+	if (!sh || !equals_lower(sh->value("otype", ""), "SphericalHarmonics") || sh->value("n_dims_to_encode", 3u) != 3) {
+		throw std::runtime_error{"CPU inference supports spherical harmonics direction encodings only."};
+	}
+
+	m_sh_degree = sh->value("degree", 4u);
+	if (m_sh_degree < 1 || m_sh_degree > 4) {
+		throw std::runtime_error{fmt::format("CPU inference supports spherical harmonics up to degree 4, not {}.", m_sh_degree)};
+	}
+
+	uint32_t rgb_alignment = network_alignment(rgb_network);
+	m_dir_encoding_width = next_multiple(m_sh_degree * m_sh_degree, rgb_alignment);
+
+	// Weights are stored per layer as row-major (outputs x inputs) matrices: density network, color network, encodings.
+	size_t param_offset = 0;
+	auto load_mlp = [&](const json& network, uint32_t n_inputs, uint32_t n_outputs) {
+		auto mlp = std::make_unique<Mlp>();
+
+		uint32_t width = network.value("n_neurons", 128u);
+		uint32_t n_hidden_layers = network.value("n_hidden_layers", 5u);
+		uint32_t padded_outputs = next_multiple(n_outputs, 16u);
+		EActivation activation = activation_from_string(network.value("activation", "ReLU"));
+		EActivation output_activation = activation_from_string(network.value("output_activation", "None"));
+
+		std::vector<uint32_t> widths = {n_inputs};
+		for (uint32_t i = 0; i < n_hidden_layers; ++i) {
+			widths.emplace_back(width);
+		}
+		widths.emplace_back(padded_outputs);
+
+		for (size_t i = 0; i + 1 < widths.size(); ++i) {
+			Layer layer;
+			layer.n_inputs = widths[i];
+			layer.n_outputs = widths[i+1];
+			layer.stride = next_multiple(layer.n_outputs, COLUMN_ALIGNMENT);
+			layer.activation = i + 2 == widths.size() ? output_activation : activation;
+			layer.weights.assign((size_t)layer.n_inputs * layer.stride, 0.0f);
+
+			size_t n_layer_params = (size_t)layer.n_inputs * layer.n_outputs;
+			if (param_offset + n_layer_params > params.size()) {
+				throw std::runtime_error{"Snapshot has fewer parameters than its network configuration requires."};
+			}
+
+			for (uint32_t o = 0; o < layer.n_outputs; ++o) {
+				for (uint32_t k = 0; k < layer.n_inputs; ++k) {
+					layer.weights[(size_t)k * layer.stride + o] = params[param_offset + (size_t)o * layer.n_inputs + k];
+				}
+			}
+
+			param_offset += n_layer_params;
+			if (i + 2 < widths.size()) {
+				mlp->max_hidden_stride = std::max(mlp->max_hidden_stride, layer.stride);
+			}
+
+			mlp->layers.emplace_back(std::move(layer));
+		}
+
+		return mlp;
+	};
+
+	m_density_network = load_mlp(density_network, m_pos_encoding_width, density_network.value("n_output_dims", 16u));
+	m_density_output_width = m_density_network->layers.back().n_outputs;
+	m_rgb_network_input_width = next_multiple(m_dir_encoding_width + m_density_output_width, rgb_alignment);
+	m_rgb_network = load_mlp(rgb_network, m_rgb_network_input_width, 3);
+
+	size_t n_grid_params = (size_t)offset * m_n_features_per_level;
+	if (param_offset + n_grid_params != params.size()) {
+		throw std::runtime_error{fmt::format(
+			"Network configuration requires {} parameters, but the snapshot has {}.",
+			param_offset + n_grid_params, params.size()
+		)};
+	}
+
+	m_grid.assign(params.begin() + param_offset, params.end());
+}
+
+void CpuNerf::load_density_grid(const std::vector<float>& density_grid) {
+	const uint32_t n_cells = m_grid_size * m_grid_size * m_grid_size;
+	if (density_grid.empty()) {
+		// Never populated. Leave the bitfield empty, which disables empty-space skipping.
+		return;
+	}
+
+	if (density_grid.size() % n_cells != 0 || density_grid.size() / n_cells > m_n_cascades) {
+		throw std::runtime_error{"Incompatible number of grid cascades."};
+	}
+
+	m_max_cascade = (uint32_t)(density_grid.size() / n_cells) - 1;
+
+	// Same thresholding and max pooling as Testbed::update_density_grid_mean_and_bitfield()
+	double mean = 0.0;
+	for (uint32_t i = 0; i < n_cells; ++i) {
+		mean += std::max(density_grid[i], 0.0f);
+	}
+	float thresh = std::min(NERF_MIN_OPTICAL_THICKNESS, (float)(mean / n_cells));
+
+	m_density_grid_bitfield.assign((size_t)n_cells / 8 * m_n_cascades, 0);
+	for (size_t i = 0; i < (size_t)n_cells / 8 * (m_max_cascade + 1); ++i) {
+		uint8_t bits = 0;
+		for (uint8_t j = 0; j < 8; ++j) {
+			bits |= density_grid[i*8+j] > thresh ? ((uint8_t)1 << j) : 0;
+		}
+		m_density_grid_bitfield[i] = bits;
+	}
+
+	for (uint32_t level = 1; level < m_n_cascades; ++level) {
+		const uint8_t* prev_level = m_density_grid_bitfield.data() + (size_t)n_cells / 8 * (level - 1);
+		uint8_t* next_level = m_density_grid_bitfield.data() + (size_t)n_cells / 8 * level;
+
+		for (uint32_t i = 0; i < n_cells / 64; ++i) {
+			uint8_t bits = 0;
+			for (uint8_t j = 0; j < 8; ++j) {
+				bits |= prev_level[i*8+j] > 0 ? ((uint8_t)1 << j) : 0;
+			}
+
+			uint32_t x = morton3D_invert(i>>0) + m_grid_size/8;
+			uint32_t y = morton3D_invert(i>>1) + m_grid_size/8;
+			uint32_t z = morton3D_invert(i>>2) + m_grid_size/8;
+
+			next_level[morton3D(x, y, z)] |= bits;
+		}
+	}
+}
+
+std::string CpuNerf::architecture() const {
+	auto mlp_widths = [](const Mlp& mlp) {
+		std::string result = std::to_string(mlp.layers.front().n_inputs);
+		for (const auto& layer : mlp.layers) {
+			result += "-" + std::to_string(layer.n_outputs);
+		}
+		return result;
+	};
+
+	return fmt::format(
+		"{}Grid(L={},F={},T=2^{},Nmin={},b={:.3f}) -> MLP({}) | SH(degree={}) -> MLP({}), {}, {} threads",
+		m_hash ? "Hash" : "Dense", m_levels.size(), m_n_features_per_level, m_log2_hashmap_size, m_base_resolution, m_per_level_scale,
+		mlp_widths(*m_density_network), m_sh_degree, mlp_widths(*m_rgb_network),
+		isa_name(m_isa),
+		m_n_threads
+	);
+}
+
+void CpuNerf::set_isa(ECpuIsa isa) {
+	if (!cpu_supports(isa)) {
+		throw std::runtime_error{"The CPU does not support the requested instruction set."};
+	}
+
+	m_isa = isa;
+}
+
+void CpuNerf::set_n_threads(uint32_t n_threads) {
+	n_threads = std::max(n_threads, 1u);
+	m_pool.set_n_threads(n_threads);
+	m_n_threads = n_threads;
+
+	// Per-thread scratch arenas, allocated once such that neither inference nor rendering allocates.
+	size_t hidden_stride = std::max(m_density_network->max_hidden_stride, m_rgb_network->max_hidden_stride);
+	size_t rgb_input_stride = next_multiple(std::max(m_rgb_network_input_width, m_density_network->output_stride()), COLUMN_ALIGNMENT);
+	size_t max_samples = RENDER_TILE_SIZE * RENDER_TILE_SIZE * MAX_STEPS_PER_MARCH;
+
+	while (m_scratch.size() < n_threads) {
+		auto scratch = std::make_unique<Scratch>();
+		scratch->hidden_stride = hidden_stride;
+		scratch->rgb_input_stride = rgb_input_stride;
+		scratch->pos_encoding.resize(BATCH_SIZE * m_pos_encoding_width);
+		scratch->hidden[0].resize(BATCH_SIZE * hidden_stride);
+		scratch->hidden[1].resize(BATCH_SIZE * hidden_stride);
+		scratch->rgb_input.resize(BATCH_SIZE * rgb_input_stride);
+		scratch->rgb_output.resize(BATCH_SIZE * m_rgb_network->output_stride());
+		scratch->rays.resize(RENDER_TILE_SIZE * RENDER_TILE_SIZE);
+		scratch->sample_inputs.resize(max_samples * n_input_dims());
+		scratch->sample_dt.resize(max_samples);
+		scratch->sample_outputs.resize(max_samples * 4);
+		m_scratch.emplace_back(std::move(scratch));
+	}
+
+	m_scratch.resize(n_threads);
+}
+
+template <typename F>
+void CpuNerf::run_on_all_threads(F&& fn) {
+	std::vector<std::future<void>> futures;
+	for (uint32_t i = 0; i < m_n_threads; ++i) {
+		futures.emplace_back(m_pool.enqueue_task([&fn, i]() { fn(i); }));
+	}
+
+	wait_all(futures);
+}
+
+void CpuNerf::encode_position(const float* inputs, size_t input_stride, size_t n, float* out, size_t out_stride) const {
+	const uint32_t n_features = m_n_features_per_level;
+	const uint32_t n_levels = (uint32_t)m_levels.size();
+
+	for (size_t i = 0; i < n; ++i) {
+		const float* x = inputs + i * input_stride;
+		float* y = out + i * out_stride;
+
+		for (uint32_t l = 0; l < n_levels; ++l) {
+			const GridLevel& level = m_levels[l];
+			const float* grid = m_grid.data() + (size_t)level.offset * n_features;
+
+			float pos[3];
+			uint32_t pos_grid[3];
+			for (uint32_t dim = 0; dim < 3; ++dim) {
+				float p = level.scale * x[dim] + 0.5f;
+				float tmp = std::floor(p);
+				pos_grid[dim] = (uint32_t)(int)tmp;
+				pos[dim] = p - tmp;
+			}
+
+			float* features = y + l * n_features;
+			std::fill(features, features + n_features, 0.0f);
+
+			// Trilinear interpolation of the 8 surrounding grid vertices
+			for (uint32_t idx = 0; idx < 8; ++idx) {
+				float weight = 1.0f;
+				uint32_t corner[3];
+				for (uint32_t dim = 0; dim < 3; ++dim) {
+					if (idx & (1 << dim)) {
+						weight *= pos[dim];
+						corner[dim] = pos_grid[dim] + 1;
+					} else {
+						weight *= 1.0f - pos[dim];
+						corner[dim] = pos_grid[dim];
+					}
+				}
+
+				const float* val = grid + (size_t)grid_index(m_hash, level.hashmap_size, level.resolution, corner) * n_features;
+				for (uint32_t f = 0; f < n_features; ++f) {
+					features[f] += weight * val[f];
+				}
+			}
+		}
+
+		// Like tiny-cuda-nn, pad with ones
+		std::fill(y + n_levels * n_features, y + m_pos_encoding_width, 1.0f);
+	}
+}
+
+void CpuNerf::encode_direction(const float* inputs, size_t input_stride, size_t n, float* out, size_t out_stride) const {
+	const uint32_t n_sh = m_sh_degree * m_sh_degree;
+
+	for (size_t i = 0; i < n; ++i) {
+		const float* x = inputs + i * input_stride;
+		float* y = out + i * out_stride;
+		sh_enc(m_sh_degree, {x[0], x[1], x[2]}, y);
+		std::fill(y + n_sh, y + m_dir_encoding_width, 1.0f);
+	}
+}
+
+void CpuNerf::dense(const Layer& layer, const float* in, size_t in_stride, size_t n, float* out, size_t out_stride) const {
+	bool relu = layer.activation == EActivation::ReLU;
+
+	switch (m_isa) {
+#ifdef NGP_CPU_X86
+		case ECpuIsa::Avx512: dense_avx512(in, in_stride, n, layer.weights.data(), layer.n_inputs, layer.stride, relu, out, out_stride); break;
+		case ECpuIsa::Avx2: dense_avx2(in, in_stride, n, layer.weights.data(), layer.n_inputs, layer.stride, relu, out, out_stride); break;
+#endif
+		default: dense_scalar(in, in_stride, n, layer.weights.data(), layer.n_inputs, layer.stride, relu, out, out_stride); break;
+	}
+
+	if (layer.activation != EActivation::ReLU && layer.activation != EActivation::None) {
+		for (size_t r = 0; r < n; ++r) {
+			for (uint32_t o = 0; o < layer.n_outputs; ++o) {
+				out[r * out_stride + o] = activate(out[r * out_stride + o], layer.activation);
+			}
+		}
+	}
+}
+
+void CpuNerf::run_mlp(const Mlp& mlp, Scratch& scratch, const float* in, size_t in_stride, size_t n, float* out, size_t out_stride) const {
+	const float* x = in;
+	size_t x_stride = in_stride;
+
+	for (size_t i = 0; i < mlp.layers.size(); ++i) {
+		bool last = i + 1 == mlp.layers.size();
+		float* y = last ? out : scratch.hidden[i % 2].data();
+		size_t y_stride = last ? out_stride : scratch.hidden_stride;
+
+		dense(mlp.layers[i], x, x_stride, n, y, y_stride);
+
+		x = y;
+		x_stride = y_stride;
+	}
+}
+
+void CpuNerf::inference_batch(Scratch& scratch, const float* inputs, float* outputs, size_t n) const {
+	// The GEMMs process whole row tiles. Rows past `n` hold stale but finite scratch values and are never read back.
+	size_t n_rows = next_multiple((uint32_t)n, ROW_TILE);
+
+	encode_position(inputs, n_input_dims(), n, scratch.pos_encoding.data(), m_pos_encoding_width);
+	run_mlp(*m_density_network, scratch, scratch.pos_encoding.data(), m_pos_encoding_width, n_rows, scratch.rgb_input.data(), scratch.rgb_input_stride);
+
+	// Written after the density network, whose output tile may extend past its padded width.
+	encode_direction(inputs + 4, n_input_dims(), n, scratch.rgb_input.data() + m_density_output_width, scratch.rgb_input_stride);
+	run_mlp(*m_rgb_network, scratch, scratch.rgb_input.data(), scratch.rgb_input_stride, n_rows, scratch.rgb_output.data(), m_rgb_network->output_stride());
+
+	const size_t rgb_output_stride = m_rgb_network->output_stride();
+	for (size_t i = 0; i < n; ++i) {
+		outputs[i*4+0] = scratch.rgb_output[i * rgb_output_stride + 0];
+		outputs[i*4+1] = scratch.rgb_output[i * rgb_output_stride + 1];
+		outputs[i*4+2] = scratch.rgb_output[i * rgb_output_stride + 2];
+		outputs[i*4+3] = scratch.rgb_input[i * scratch.rgb_input_stride];
+	}
+}
+
+void CpuNerf::inference(const float* inputs, float* outputs, size_t n) {
+	const size_t n_batches = (n + BATCH_SIZE - 1) / BATCH_SIZE;
+	std::atomic<size_t> next_batch{0};
+
+	run_on_all_threads([&](uint32_t thread) {
+		Scratch& scratch = *m_scratch[thread];
+		for (size_t batch = next_batch++; batch < n_batches; batch = next_batch++) {
+			size_t offset = batch * BATCH_SIZE;
+			inference_batch(scratch, inputs + offset * n_input_dims(), outputs + offset * 4, std::min((size_t)BATCH_SIZE, n - offset));
+		}
+	});
+}
+
+bool CpuNerf::density_grid_occupied_at(const vec3& pos, uint32_t mip) const {
+	if (m_density_grid_bitfield.empty()) {
+		return true;
+	}
+
+	vec3 p = (pos - vec3(0.5f)) * std::ldexp(1.0f, -(int)mip) + vec3(0.5f);
+	ivec3 i = ivec3(p * (float)m_grid_size);
+	if (i.x < 0 || i.x >= (int)m_grid_size || i.y < 0 || i.y >= (int)m_grid_size || i.z < 0 || i.z >= (int)m_grid_size) {
+		return false;
+	}
+
+	uint32_t idx = morton3D(i.x, i.y, i.z);
+	size_t mip_offset = (size_t)m_grid_size * m_grid_size * m_grid_size * mip / 8;
+	return m_density_grid_bitfield[idx/8 + mip_offset] & (1 << (idx%8));
+}
+
+float CpuNerf::advance_to_next_occupied_voxel(float t, float cone_angle, const Ray& ray, const vec3& idir) const {
+	const float max_stepsize = MIN_CONE_STEPSIZE * (1 << (NERF_CASCADES - 1)) * NERF_STEPS / NERF_GRIDSIZE;
+
+	while (true) {
+		vec3 pos = ray(t);
+		if (t >= MAX_DEPTH || !contains(m_render_aabb_min, m_render_aabb_max, m_render_aabb_to_local * pos)) {
+			return MAX_DEPTH;
+		}
+
+		uint32_t mip = mip_from_pos(pos, m_max_cascade);
+		if (density_grid_occupied_at(pos, mip)) {
+			return t;
+		}
+
+		// Skip the largest empty voxel around the current position
+		while (mip < m_max_cascade && !density_grid_occupied_at(pos, mip + 1)) {
+			++mip;
+		}
+
+		float res = std::ldexp((float)m_grid_size, -(int)mip);
+		float t_target = t + distance_to_next_voxel(pos, ray.d, idir, res);
+
+		float n = to_stepping_space(t, cone_angle, max_stepsize);
+		float n_target = to_stepping_space(t_target, cone_angle, max_stepsize);
+		t = from_stepping_space(n + std::ceil(std::max(n_target - n, 0.5f)), cone_angle, max_stepsize);
+	}
+}
+
+std::vector<vec4> CpuNerf::render(const ivec2& resolution, const mat4x3& camera, const vec2& focal_length, const vec2& screen_center) {
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<vec4> frame((size_t)compMul(resolution), vec4(0.0f));
+	if (compMin(resolution) <= 0) {
+		return frame;
+	}
+
+	const ivec2 n_tiles = (resolution + ivec2((int)RENDER_TILE_SIZE - 1)) / (int)RENDER_TILE_SIZE;
+	const uint32_t n_total_tiles = (uint32_t)compMul(n_tiles);
+	const float max_stepsize = MIN_CONE_STEPSIZE * (1 << (NERF_CASCADES - 1)) * NERF_STEPS / NERF_GRIDSIZE;
+	const vec3 aabb_diag = m_aabb_max - m_aabb_min;
+
+	std::atomic<uint32_t> next_tile{0};
+	std::atomic<size_t> n_samples{0};
+	std::atomic<uint32_t> n_rays{0};
+
+	run_on_all_threads([&](uint32_t thread) {
+		Scratch& scratch = *m_scratch[thread];
+		size_t local_n_samples = 0;
+		uint32_t local_n_rays = 0;
+
+		for (uint32_t tile = next_tile++; tile < n_total_tiles; tile = next_tile++) {
+			ivec2 tile_min = ivec2{(int)(tile % n_tiles.x), (int)(tile / n_tiles.x)} * (int)RENDER_TILE_SIZE;
+			ivec2 tile_max = min(tile_min + ivec2((int)RENDER_TILE_SIZE), resolution);
+
+			// Generate rays through the pixel centers, like NerfTracer::init_rays_from_camera with pixel snapping
+			uint32_t n_tile_rays = 0;
+			for (int y = tile_min.y; y < tile_max.y; ++y) {
+				for (int x = tile_min.x; x < tile_max.x; ++x) {
+					vec2 uv = (vec2{(float)x, (float)y} + vec2(0.5f)) / vec2(resolution);
+					vec3 dir = {
+						(uv.x - screen_center.x) * (float)resolution.x / focal_length.x,
+						(uv.y - screen_center.y) * (float)resolution.y / focal_length.y,
+						1.0f
+					};
+
+					Ray ray = {camera[3], normalize(mat3(camera) * dir)};
+					float t = std::max(ray_intersect(m_render_aabb_min, m_render_aabb_max, m_render_aabb_to_local * ray.o, m_render_aabb_to_local * ray.d).x, 0.0f) + 1e-6f;
+					if (!contains(m_render_aabb_min, m_render_aabb_max, m_render_aabb_to_local * ray(t))) {
+						continue;
+					}
+
+					// The GPU jitters the first step per sample; a single deterministic sample starts half a step in.
+					float cone_angle = cone_angle_constant;
+					t = advance_n_steps(t, cone_angle, 0.5f, max_stepsize);
+
+					scratch.rays[n_tile_rays++] = {ray.o, ray.d, t, vec4(0.0f), (uint32_t)(x + y * resolution.x), 0, true};
+				}
+			}
+
+			local_n_rays += n_tile_rays;
+
+			uint32_t n_alive = n_tile_rays;
+			while (n_alive > 0) {
+				// Same trade-off as NerfTracer::trace(): march more steps per ray as fewer rays remain alive.
+				uint32_t n_steps = std::min(std::max(n_tile_rays / n_alive, 1u), MAX_STEPS_PER_MARCH);
+
+				size_t n_tile_samples = 0;
+				for (uint32_t i = 0; i < n_tile_rays; ++i) {
+					auto& r = scratch.rays[i];
+					r.n_samples = 0;
+					if (!r.alive) {
+						continue;
+					}
+
+					Ray ray = {r.origin, r.dir};
+					vec3 idir = vec3(1.0f) / r.dir;
+					float t = r.t;
+
+					for (uint32_t j = 0; j < n_steps; ++j) {
+						t = advance_to_next_occupied_voxel(t, cone_angle_constant, ray, idir);
+						if (t >= MAX_DEPTH) {
+							break;
+						}
+
+						float dt = calc_dt(t, cone_angle_constant, max_stepsize);
+						vec3 warped_pos = (ray(t) - m_aabb_min) / aabb_diag;
+						vec3 warped_dir = (r.dir + vec3(1.0f)) * 0.5f;
+
+						float* input = scratch.sample_inputs.data() + n_tile_samples * n_input_dims();
+						input[0] = warped_pos.x; input[1] = warped_pos.y; input[2] = warped_pos.z;
+						input[3] = warp_dt(dt);
+						input[4] = warped_dir.x; input[5] = warped_dir.y; input[6] = warped_dir.z;
+						scratch.sample_dt[n_tile_samples] = dt;
+
+						++n_tile_samples;
+						++r.n_samples;
+						t += dt;
+					}
+
+					r.t = t;
+					if (r.n_samples < n_steps) {
+						// Left the render aabb: composite what was gathered, then retire.
+						r.alive = false;
+					}
+				}
+
+				for (size_t offset = 0; offset < n_tile_samples; offset += BATCH_SIZE) {
+					inference_batch(
+						scratch,
+						scratch.sample_inputs.data() + offset * n_input_dims(),
+						scratch.sample_outputs.data() + offset * 4,
+						std::min((size_t)BATCH_SIZE, n_tile_samples - offset)
+					);
+				}
+
+				local_n_samples += n_tile_samples;
+
+				// Front-to-back compositing, like composite_kernel_nerf in Shade mode
+				size_t sample = 0;
+				n_alive = 0;
+				for (uint32_t i = 0; i < n_tile_rays; ++i) {
+					auto& r = scratch.rays[i];
+					bool opaque = false;
+
+					for (uint32_t j = 0; j < r.n_samples; ++j, ++sample) {
+						if (opaque) {
+							continue;
+						}
+
+						const float* out = scratch.sample_outputs.data() + sample * 4;
+						float T = 1.0f - r.rgba.a;
+						float alpha = 1.0f - std::exp(-network_to_density(out[3], m_density_activation) * scratch.sample_dt[sample]);
+						float weight = alpha * T;
+
+						vec3 rgb = {
+							network_to_rgb(out[0], m_rgb_activation),
+							network_to_rgb(out[1], m_rgb_activation),
+							network_to_rgb(out[2], m_rgb_activation),
+						};
+
+						r.rgba += vec4(rgb * weight, weight);
+						if (r.rgba.a > (1.0f - min_transmittance)) {
+							r.rgba /= r.rgba.a;
+							opaque = true;
+						}
+					}
+
+					if (opaque) {
+						r.alive = false;
+					}
+
+					if (r.alive) {
+						++n_alive;
+					}
+				}
+			}
+
+			for (uint32_t i = 0; i < n_tile_rays; ++i) {
+				frame[scratch.rays[i].pixel] = scratch.rays[i].rgba;
+			}
+		}
+
+		n_samples += local_n_samples;
+		n_rays += local_n_rays;
+	});
+
+	m_render_stats.n_rays = n_rays;
+	m_render_stats.n_samples = n_samples;
+	m_render_stats.ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	return frame;
+}
+
+CpuNerfReferenceCheck CpuNerf::check_reference(const fs::path& reference_path, float abs_tolerance, float rel_tolerance) {
+	if (!reference_path.exists()) {
+		throw std::runtime_error{fmt::format("Reference '{}' does not exist.", reference_path.str())};
+	}
+
+	json reference;
+	{
+		std::ifstream f{native_string(reference_path), std::ios::in | std::ios::binary};
+		reference = json::from_msgpack(f);
+	}
+
+	if (reference.value("n_input_dims", 0u) != n_input_dims() || reference.value("n_output_dims", 0u) != 4) {
+		throw std::runtime_error{"Reference has incompatible input or output dimensions."};
+	}
+
+	std::vector<float> inputs = floats_from_binary(reference["inputs"], "float");
+	std::vector<float> expected = floats_from_binary(reference["outputs"], "float");
+
+	size_t n = inputs.size() / n_input_dims();
+	if (expected.size() != n * 4) {
+		throw std::runtime_error{"Reference has a different number of inputs and outputs."};
+	}
+
+	std::vector<float> outputs(n * 4);
+	inference(inputs.data(), outputs.data(), n);
+
+	CpuNerfReferenceCheck result;
+	result.n_samples = (uint32_t)n;
+
+	double sum_abs_error = 0.0;
+	for (size_t i = 0; i < outputs.size(); ++i) {
+		float error = std::abs(outputs[i] - expected[i]);
+		// NaN errors count as failures
+		if (!(error <= abs_tolerance + rel_tolerance * std::abs(expected[i]))) {
+			++result.n_failed;
+		}
+
+		result.max_abs_error = std::max(result.max_abs_error, error);
+		sum_abs_error += error;
+	}
+
+	result.mean_abs_error = outputs.empty() ? 0.0f : (float)(sum_abs_error / outputs.size());
+
+	if (result.passed()) {
+		tlog::success() << fmt::format("CPU inference matches {} reference samples: max abs error {:.2e}, mean {:.2e}", result.n_samples, result.max_abs_error, result.mean_abs_error);
+	} else {
+		tlog::error() << fmt::format("CPU inference deviates from the reference in {}/{} outputs: max abs error {:.2e}, mean {:.2e}", result.n_failed, outputs.size(), result.max_abs_error, result.mean_abs_error);
+	}
+
+	return result;
+}
+
+std::vector<CpuNerfBenchmarkResult> CpuNerf::benchmark(size_t n_samples, const std::vector<uint32_t>& thread_counts, uint32_t n_repetitions) {
+	std::mt19937 rng{1337};
+	std::uniform_real_distribution<float> uniform{0.0f, 1.0f};
+	std::normal_distribution<float> normal;
+
+	std::vector<float> inputs(n_samples * n_input_dims());
+	for (size_t i = 0; i < n_samples; ++i) {
+		float* input = inputs.data() + i * n_input_dims();
+		vec3 dir = normalize(vec3{normal(rng), normal(rng), normal(rng)});
+		input[0] = uniform(rng); input[1] = uniform(rng); input[2] = uniform(rng);
+		input[3] = 0.0f;
+		input[4] = (dir.x + 1.0f) * 0.5f; input[5] = (dir.y + 1.0f) * 0.5f; input[6] = (dir.z + 1.0f) * 0.5f;
+	}
+
+	std::vector<float> outputs(n_samples * 4);
+
+	uint32_t prev_n_threads = m_n_threads;
+	std::vector<CpuNerfBenchmarkResult> results;
+
+	for (uint32_t n_threads : thread_counts) {
+		set_n_threads(n_threads);
+
+		// Warm up caches and the thread pool
+		inference(inputs.data(), outputs.data(), std::min(n_samples, (size_t)BATCH_SIZE * m_n_threads));
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < std::max(n_repetitions, 1u); ++i) {
+			inference(inputs.data(), outputs.data(), n_samples);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		CpuNerfBenchmarkResult result;
+		result.n_threads = m_n_threads;
+		result.msamples_per_second = (double)n_samples * std::max(n_repetitions, 1u) / seconds / 1e6;
+		result.parallel_efficiency = results.empty() ? 1.0 :
+			(result.msamples_per_second / result.n_threads) / (results.front().msamples_per_second / results.front().n_threads);
+
+		tlog::info() << fmt::format("CPU inference: {:>3} threads {:8.3f} Msamples/s, {:6.3f} Msamples/s per thread, efficiency {:.2f}",
+			result.n_threads, result.msamples_per_second, result.msamples_per_second / result.n_threads, result.parallel_efficiency);
+
+		results.emplace_back(result);
+	}
+
+	set_n_threads(prev_n_threads);
+	return results;
+}
+
+vec2 CpuNerf::focal_length(const ivec2& resolution) const {
+	// Same as Testbed::calc_focal_length()
+	return m_relative_focal_length * (float)resolution[m_fov_axis] * m_zoom;
+}
+
+vec2 CpuNerf::screen_center() const {
+	// Same as Testbed::render_screen_center()
+	return (vec2(0.5f) - m_screen_center) * m_zoom + vec2(0.5f);
+}
+
+mat4x3 CpuNerf::nerf_matrix_to_ngp(const mat4x3& nerf_matrix) const {
+	// Same as NerfDataset::nerf_matrix_to_ngp()
+	mat4x3 result = nerf_matrix;
+	result[1] *= -1.f;
+	result[2] *= -1.f;
+	result[3] = result[3] * m_nerf_scale + m_nerf_offset;
+
+	if (m_from_mitsuba) {
+		result[0] *= -1;
+		result[2] *= -1;
+	} else {
+		// Cycle axes xyz<-yzx
+		vec4 tmp = row(result, 0);
+		result = row(result, 0, row(result, 1));
+		result = row(result, 1, row(result, 2));
+		result = row(result, 2, tmp);
+	}
+
+	return result;
+}
+
+NGP_NAMESPACE_END
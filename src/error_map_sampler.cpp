@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   error_map_sampler.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/error_map_sampler.h>
+#include <neural-graphics-primitives/thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+
+NGP_NAMESPACE_BEGIN
+
+void build_image_alias_table(const std::vector<float>& image_weight, std::vector<float>& pmf, std::vector<AliasEntry>& table) {
+	uint32_t n = (uint32_t)image_weight.size();
+	pmf.resize(n);
+	table.resize(n);
+
+	std::vector<uint32_t> scratch(n);
+	build_weighted_alias_table(n, image_weight.data(), 0.0f, ERROR_MAP_MIN_PMF, pmf.data(), table.data(), scratch.data());
+}
+
+void ErrorMapAliasTables::build(const float* data, uint32_t n_images, const ivec2& resolution, const uint8_t* dirty, ThreadPool* pool) {
+	uint32_t width = resolution.x;
+	uint32_t height = resolution.y;
+
+	if (n_images != this->n_images || resolution != this->resolution) {
+		this->n_images = n_images;
+		this->resolution = resolution;
+
+		pmf_x_cond_y.assign((size_t)n_images * height * width, 0.0f);
+		alias_x_cond_y.assign((size_t)n_images * height * width, {});
+		row_weight.assign((size_t)n_images * height, 0.0f);
+		pmf_y.assign((size_t)n_images * height, 0.0f);
+		alias_y.assign((size_t)n_images * height, {});
+		image_weight.assign(n_images, 0.0f);
+
+		// Nothing to keep
+		dirty = nullptr;
+	}
+
+	auto build_image = [&](uint32_t img) {
+		if (dirty && !dirty[img]) {
+			return;
+		}
+
+		std::vector<uint32_t> scratch(std::max(width, height));
+		for (uint32_t y = 0; y < height; ++y) {
+			size_t offset = ((size_t)img * height + y) * width;
+			row_weight[(size_t)img * height + y] = build_weighted_alias_table(
+				width, data + offset, ERROR_MAP_BIAS, ERROR_MAP_MIN_PDF, pmf_x_cond_y.data() + offset, alias_x_cond_y.data() + offset, scratch.data()
+			);
+		}
+
+		size_t offset = (size_t)img * height;
+		image_weight[img] = build_weighted_alias_table(
+			height, row_weight.data() + offset, 0.0f, ERROR_MAP_MIN_PDF, pmf_y.data() + offset, alias_y.data() + offset, scratch.data()
+		);
+	};
+
+	if (pool) {
+		pool->parallel_for<uint32_t>(0, n_images, build_image);
+	} else {
+		for (uint32_t img = 0; img < n_images; ++img) {
+			build_image(img);
+		}
+	}
+
+	build_image_alias_table(image_weight, pmf_img, alias_img);
+}
+
+float ErrorMapAliasTables::max_alias_error(uint32_t n, const float* pmf, const AliasEntry* table) {
+	// Each bucket holds 1/n of the mass, split between its own outcome and its alias
+	std::vector<double> mass(n, 0.0);
+	for (uint32_t i = 0; i < n; ++i) {
+		mass[i] += table[i].prob;
+		mass[table[i].alias] += 1.0 - table[i].prob;
+	}
+
+	double result = 0.0;
+	for (uint32_t i = 0; i < n; ++i) {
+		result = std::max(result, std::abs(mass[i] / n - pmf[i]));
+	}
+
+	return (float)result;
+}
+
+NGP_NAMESPACE_END
@@ -0,0 +1,522 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   hash_grid_analysis.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/hash_grid_analysis.h>
+
+#include <fmt/core.h>
+
+#include <zstr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+using namespace nlohmann;
+
+NGP_NAMESPACE_BEGIN
+
+namespace {
+
+// Mirrors of the defaults in testbed_nerf.cu
+constexpr uint32_t NERF_GRIDSIZE = 128;
+constexpr float NERF_MIN_OPTICAL_THICKNESS = 0.01f;
+
+std::string lower(std::string str) {
+	std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	return str;
+}
+
+bool equals_lower(const std::string& a, const std::string& b) {
+	return lower(a) == lower(b);
+}
+
+uint32_t next_multiple(uint32_t val, uint32_t divisor) {
+	return (val + divisor - 1) / divisor * divisor;
+}
+
+float half_to_float(uint16_t h) {
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+
+	uint32_t bits;
+	if (exponent == 0x1f) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	} else if (exponent != 0) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	} else if (mantissa != 0) {
+		// Subnormal: renormalize
+		exponent = 113;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	} else {
+		bits = sign;
+	}
+
+	float result;
+	std::memcpy(&result, &bits, sizeof(float));
+	return result;
+}
+
+std::vector<float> halfs_from_binary(const json& j) {
+	std::vector<uint8_t> bytes;
+	if (j.is_binary()) {
+		bytes = j.get_binary();
+	} else if (j.is_object() && j.contains("bytes")) {
+		bytes = j["bytes"].get<std::vector<uint8_t>>();
+	} else {
+		throw std::runtime_error{"Expected binary data."};
+	}
+
+	std::vector<float> result(bytes.size() / sizeof(uint16_t));
+	for (size_t i = 0; i < result.size(); ++i) {
+		uint16_t h;
+		std::memcpy(&h, bytes.data() + i * sizeof(uint16_t), sizeof(uint16_t));
+		result[i] = half_to_float(h);
+	}
+
+	return result;
+}
+
+vec3 read_vec3(const json& j) {
+	return {j.at(0).get<float>(), j.at(1).get<float>(), j.at(2).get<float>()};
+}
+
+uint32_t morton3D_invert(uint32_t x) {
+	x = x & 0x49249249;
+	x = (x | (x >> 2)) & 0xc30c30c3;
+	x = (x | (x >> 4)) & 0x0f00f00f;
+	x = (x | (x >> 8)) & 0xff0000ff;
+	x = (x | (x >> 16)) & 0x0000ffff;
+	return x;
+}
+
+// How tiny-cuda-nn's grid encoding indexes a level with `hashmap_size` entries. Its strides are 32 bit, so the
+// linear index of fine dense-looking levels can wrap around instead of being hashed.
+enum class EIndexing {
+	Dense,
+	Hash,
+	Wrapped,
+};
+
+EIndexing indexing(uint32_t hashmap_size, uint32_t resolution) {
+	uint32_t stride = 1;
+	for (uint32_t dim = 0; dim < 3 && stride <= hashmap_size; ++dim) {
+		stride *= resolution;
+	}
+
+	if (hashmap_size < stride) {
+		return EIndexing::Hash;
+	}
+
+	return (uint64_t)resolution * resolution * resolution <= hashmap_size ? EIndexing::Dense : EIndexing::Wrapped;
+}
+
+uint32_t coherent_prime_hash(uint32_t x, uint32_t y, uint32_t z) {
+	return x ^ (y * 2654435761u) ^ (z * 805459861u);
+}
+
+uint32_t linear_index(uint32_t hashmap_size, uint32_t resolution, uint32_t x, uint32_t y, uint32_t z) {
+	const uint32_t pos_grid[3] = {x, y, z};
+	uint32_t stride = 1;
+	uint32_t index = 0;
+	for (uint32_t dim = 0; dim < 3 && stride <= hashmap_size; ++dim) {
+		index += pos_grid[dim] * stride;
+		stride *= resolution;
+	}
+	return index % hashmap_size;
+}
+
+uint32_t cell_hash(uint32_t cell, uint32_t level) {
+	uint32_t h = cell * 0x9e3779b9u ^ (level + 1) * 0x85ebca6bu;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	return h;
+}
+
+// Fraction of N keys that share their slot with another key when hashed uniformly into T slots
+double random_collision_rate(double n, double t) {
+	return n > 1 ? 1.0 - std::exp((n - 1) * std::log1p(-1.0 / t)) : 0.0;
+}
+
+size_t n_colliding(const std::vector<uint32_t>& counts, size_t n) {
+	size_t result = 0;
+	for (size_t i = 0; i < n; ++i) {
+		result += counts[i] >= 2 ? counts[i] : 0;
+	}
+	return result;
+}
+
+// Box of an occupied density grid cell in the unit cube that the grid encoding sees
+struct Cell {
+	uint32_t index;
+	vec3 min;
+	vec3 max;
+};
+
+}
+
+json HashGridAnalysis::tuned_network_config() const {
+	json config = network_config;
+	config["encoding"]["log2_hashmap_size"] = suggested_log2_hashmap_size;
+	return config;
+}
+
+HashGridAnalysis analyze_hash_grid(const fs::path& snapshot_path, size_t budget_bytes, size_t max_vertices_per_level) {
+	auto start = std::chrono::steady_clock::now();
+
+	if (!snapshot_path.exists()) {
+		throw std::runtime_error{fmt::format("Snapshot '{}' does not exist.", snapshot_path.str())};
+	}
+
+	json config;
+	{
+		std::ifstream f{native_string(snapshot_path), std::ios::in | std::ios::binary};
+		if (ends_with_case_insensitive(snapshot_path.str(), ".ingp")) {
+			zstr::istream zf{f};
+			config = json::from_msgpack(zf);
+		} else {
+			config = json::from_msgpack(f);
+		}
+	}
+
+	if (!config.contains("snapshot")) {
+		throw std::runtime_error{fmt::format("File '{}' does not contain a snapshot.", snapshot_path.str())};
+	}
+
+	const json& snapshot = config["snapshot"];
+	if (!snapshot.contains("nerf") || !snapshot.contains("density_grid_binary")) {
+		throw std::runtime_error{"Hash grid analysis requires a NeRF snapshot with a density grid."};
+	}
+
+	HashGridAnalysis result;
+	result.network_config = config;
+	result.network_config.erase("snapshot");
+
+	// Grid levels, configured like CpuNerf::load_network()
+	const json& encoding = config.at("encoding");
+	if (!equals_lower(encoding.value("type", equals_lower(encoding.value("otype", "HashGrid"), "HashGrid") ? "Hash" : ""), "Hash")) {
+		throw std::runtime_error{"Hash grid analysis requires a hash grid encoding."};
+	}
+
+	float aabb_scale = snapshot["nerf"].value("aabb_scale", 1.0f);
+
+	result.n_features_per_level = encoding.value("n_features_per_level", 2u);
+	uint32_t n_levels = encoding.value("n_levels", 16u);
+	if (encoding.contains("n_features") && encoding["n_features"] > 0) {
+		n_levels = encoding["n_features"].get<uint32_t>() / result.n_features_per_level;
+	}
+
+	result.log2_hashmap_size = encoding.value("log2_hashmap_size", 19u);
+	result.min_log2_size = std::min(result.min_log2_size, result.log2_hashmap_size);
+	result.max_log2_size = std::max(result.max_log2_size, result.log2_hashmap_size);
+
+	uint32_t base_resolution = encoding.value("base_resolution", 0u);
+	if (!base_resolution) {
+		base_resolution = 1u << (encoding.value("log2_hashmap_size", 15u) / 3);
+	}
+
+	float per_level_scale = encoding.value("per_level_scale", 0.0f);
+	if (per_level_scale <= 0.0f) {
+		per_level_scale = n_levels > 1 ? std::exp(std::log(2048.0f * aabb_scale / (float)base_resolution) / (n_levels - 1)) : 2.0f;
+	}
+
+	// Occupied cells of all cascades, each covered by exactly one cascade, thresholded like the testbed's bitfield
+	uint32_t grid_size = snapshot.value("density_grid_size", NERF_GRIDSIZE);
+	uint32_t n_cells = grid_size * grid_size * grid_size;
+	std::vector<float> density_grid = halfs_from_binary(snapshot["density_grid_binary"]);
+	if (density_grid.empty() || density_grid.size() % n_cells != 0) {
+		throw std::runtime_error{"Snapshot has an empty or incompatible density grid."};
+	}
+
+	uint32_t n_cascades = (uint32_t)(density_grid.size() / n_cells);
+
+	double mean = 0.0;
+	for (uint32_t i = 0; i < n_cells; ++i) {
+		mean += std::max(density_grid[i], 0.0f);
+	}
+	float thresh = std::min(NERF_MIN_OPTICAL_THICKNESS, (float)(mean / n_cells));
+
+	vec3 aabb_min = vec3(0.5f - 0.5f * aabb_scale);
+	vec3 aabb_max = vec3(0.5f + 0.5f * aabb_scale);
+	if (snapshot.contains("aabb")) {
+		aabb_min = read_vec3(snapshot["aabb"]["min"]);
+		aabb_max = read_vec3(snapshot["aabb"]["max"]);
+	}
+
+	std::vector<Cell> cells;
+	for (uint32_t cascade = 0; cascade < n_cascades; ++cascade) {
+		float cell_size = std::ldexp(1.0f, (int)cascade) / grid_size;
+		for (uint32_t i = 0; i < n_cells; ++i) {
+			if (!(density_grid[cascade * n_cells + i] > thresh)) {
+				continue;
+			}
+
+			uvec3 pos = {morton3D_invert(i>>0), morton3D_invert(i>>1), morton3D_invert(i>>2)};
+			if (cascade > 0 && all(greaterThanEqual(pos, uvec3(grid_size/4))) && all(lessThan(pos, uvec3(grid_size*3/4)))) {
+				// Covered by the next finer cascade
+				continue;
+			}
+
+			vec3 min = (vec3(pos) * cell_size - 0.5f * std::ldexp(1.0f, (int)cascade)) + 0.5f;
+			Cell cell = {
+				cascade * n_cells + i,
+				clamp((min - aabb_min) / (aabb_max - aabb_min), 0.0f, 1.0f),
+				clamp((min + cell_size - aabb_min) / (aabb_max - aabb_min), 0.0f, 1.0f),
+			};
+
+			if (all(lessThan(cell.min, cell.max))) {
+				cells.emplace_back(cell);
+			}
+		}
+	}
+
+	result.n_occupied_cells = cells.size();
+
+	const uint32_t n_sizes = result.max_log2_size - result.min_log2_size + 1;
+	auto table_size = [&](const HashGridLevelAnalysis& level, uint32_t log2_size) {
+		return std::min(1u << log2_size, level.dense_size);
+	};
+
+	std::vector<uint32_t> counts;
+	for (uint32_t l = 0; l < n_levels; ++l) {
+		HashGridLevelAnalysis level;
+
+		float scale = std::exp2(l * std::log2(per_level_scale)) * base_resolution - 1.0f;
+		level.resolution = (uint32_t)std::ceil(scale) + 1;
+
+		uint32_t max_params = std::numeric_limits<uint32_t>::max() / 2;
+		level.dense_size = std::pow((float)level.resolution, 3.0f) > (float)max_params ? max_params : level.resolution * level.resolution * level.resolution;
+		level.dense_size = next_multiple(level.dense_size, 8u);
+		level.hashmap_size = std::min(level.dense_size, 1u << result.log2_hashmap_size);
+
+		// The vertex at grid position i lies at x = (i - 0.5) / scale, see the encoding's pos_fract().
+		auto vertex_range = [&](const Cell& cell, uvec3& begin, uvec3& end) {
+			for (uint32_t dim = 0; dim < 3; ++dim) {
+				begin[dim] = (uint32_t)std::ceil((double)cell.min[dim] * scale + 0.5);
+				end[dim] = std::min((uint32_t)std::ceil((double)cell.max[dim] * scale + 0.5), level.resolution + 1);
+			}
+		};
+
+		for (const auto& cell : cells) {
+			uvec3 begin, end;
+			vertex_range(cell, begin, end);
+			if (all(lessThan(begin, end))) {
+				level.n_occupied_vertices += (size_t)(end.x - begin.x) * (end.y - begin.y) * (end.z - begin.z);
+			}
+		}
+
+		// Levels with too many vertices are simulated on a 2^-k subset of the cells with 2^-k times smaller tables,
+		// which keeps the load factors and thereby the collision rates of the hash.
+		uint32_t k = 0;
+		while ((level.n_occupied_vertices >> k) > max_vertices_per_level) {
+			++k;
+		}
+		level.subsampled = k > 0;
+
+		std::vector<EIndexing> modes(n_sizes);
+		bool needs_simulation = false;
+		for (uint32_t s = 0; s < n_sizes; ++s) {
+			modes[s] = indexing(table_size(level, result.min_log2_size + s), level.resolution);
+			needs_simulation |= modes[s] != EIndexing::Dense;
+		}
+
+		level.collision_rates.assign(n_sizes, 0.0f);
+		if (needs_simulation && level.n_occupied_vertices > 0) {
+			auto for_each_vertex = [&](auto&& fn) {
+				uint32_t mask = (1u << k) - 1;
+				for (const auto& cell : cells) {
+					if ((cell_hash(cell.index, l) & mask) != 0) {
+						continue;
+					}
+
+					uvec3 begin, end;
+					vertex_range(cell, begin, end);
+					for (uint32_t z = begin.z; z < end.z; ++z) {
+						for (uint32_t y = begin.y; y < end.y; ++y) {
+							for (uint32_t x = begin.x; x < end.x; ++x) {
+								fn(x, y, z);
+							}
+						}
+					}
+				}
+			};
+
+			// Hashed table sizes are powers of two, so one simulation at the largest size yields all smaller ones by
+			// folding the upper half of the table onto the lower half.
+			uint32_t max_bits = result.max_log2_size > k ? result.max_log2_size - k : 0;
+			counts.assign((size_t)1 << max_bits, 0);
+			size_t n_simulated = 0;
+			for_each_vertex([&](uint32_t x, uint32_t y, uint32_t z) {
+				++counts[coherent_prime_hash(x, y, z) & (uint32_t)(counts.size() - 1)];
+				++n_simulated;
+			});
+
+			size_t n = counts.size();
+			for (uint32_t s = n_sizes; s-- > 0;) {
+				uint32_t log2_size = result.min_log2_size + s;
+				if (log2_size < max_bits + k) {
+					for (size_t i = 0; i < n / 2; ++i) {
+						counts[i] += counts[i + n / 2];
+					}
+					n /= 2;
+				}
+
+				if (modes[s] != EIndexing::Hash) {
+					continue;
+				}
+
+				if (log2_size < k) {
+					level.collision_rates[s] = (float)random_collision_rate((double)level.n_occupied_vertices, (double)(1u << log2_size));
+				} else {
+					level.collision_rates[s] = n_simulated > 0 ? (float)((double)n_colliding(counts, n) / n_simulated) : 0.0f;
+				}
+			}
+
+			// Wrapped linear indexing is not random, so it is simulated at the full table size.
+			for (uint32_t s = 0; s < n_sizes; ++s) {
+				if (modes[s] != EIndexing::Wrapped) {
+					continue;
+				}
+
+				uint32_t size = table_size(level, result.min_log2_size + s);
+				std::vector<uint32_t> wrapped_counts(size, 0);
+				for_each_vertex([&](uint32_t x, uint32_t y, uint32_t z) {
+					++wrapped_counts[linear_index(size, level.resolution, x, y, z)];
+				});
+				level.collision_rates[s] = n_simulated > 0 ? (float)((double)n_colliding(wrapped_counts, size) / n_simulated) : 0.0f;
+			}
+		}
+
+		level.collision_rate = level.collision_rates[result.log2_hashmap_size - result.min_log2_size];
+		result.levels.emplace_back(std::move(level));
+	}
+
+	// Budget in bytes of half precision parameters. Every level contributes equally many features to the encoding, so
+	// collisions are weighed by the mean of the levels' collision rates rather than by vertex counts, which the finest
+	// levels would dominate.
+	const size_t bytes_per_entry = result.n_features_per_level * sizeof(uint16_t);
+	auto mean_collision_rate = [&](const std::vector<uint32_t>& sizes) {
+		double sum = 0.0;
+		for (uint32_t l = 0; l < n_levels; ++l) {
+			sum += result.levels[l].collision_rates[sizes[l]];
+		}
+		return n_levels > 0 ? (float)(sum / n_levels) : 0.0f;
+	};
+
+	for (const auto& level : result.levels) {
+		result.n_bytes += (size_t)level.hashmap_size * bytes_per_entry;
+	}
+
+	result.collision_rate = mean_collision_rate(std::vector<uint32_t>(n_levels, result.log2_hashmap_size - result.min_log2_size));
+	result.budget_bytes = budget_bytes > 0 ? budget_bytes : result.n_bytes;
+
+	// Per-level sizes: start every level at the smallest size and repeatedly grow the level whose collision rate drops
+	// the most per added byte, as long as the budget allows. Growing by several doublings at once steps over sizes at
+	// which a saturated level does not improve yet.
+	std::vector<uint32_t> sizes(n_levels, 0);
+	size_t n_bytes = 0;
+	for (uint32_t l = 0; l < n_levels; ++l) {
+		n_bytes += (size_t)table_size(result.levels[l], result.min_log2_size) * bytes_per_entry;
+	}
+
+	while (true) {
+		int best_level = -1;
+		uint32_t best_size = 0;
+		double best_gain = 0.0;
+		size_t best_bytes = 0;
+
+		for (uint32_t l = 0; l < n_levels; ++l) {
+			const auto& level = result.levels[l];
+			uint32_t s = sizes[l];
+			for (uint32_t t = s + 1; t < n_sizes && table_size(level, result.min_log2_size + t - 1) < level.dense_size; ++t) {
+				size_t added_bytes = (size_t)(table_size(level, result.min_log2_size + t) - table_size(level, result.min_log2_size + s)) * bytes_per_entry;
+				if (n_bytes + added_bytes > result.budget_bytes) {
+					break;
+				}
+
+				double gain = ((double)level.collision_rates[s] - level.collision_rates[t]) / (double)added_bytes;
+				if (gain > best_gain) {
+					best_level = (int)l;
+					best_size = t;
+					best_gain = gain;
+					best_bytes = added_bytes;
+				}
+			}
+		}
+
+		if (best_level < 0) {
+			break;
+		}
+
+		sizes[best_level] = best_size;
+		n_bytes += best_bytes;
+	}
+
+	for (uint32_t l = 0; l < n_levels; ++l) {
+		auto& level = result.levels[l];
+		level.suggested_size = table_size(level, result.min_log2_size + sizes[l]);
+		level.suggested_collision_rate = level.collision_rates[sizes[l]];
+	}
+
+	result.suggested_n_bytes = n_bytes;
+	result.suggested_collision_rate = mean_collision_rate(sizes);
+
+	// Uniform size: the largest that fits into the budget
+	for (uint32_t s = 0; s < n_sizes; ++s) {
+		size_t uniform_bytes = 0;
+		for (const auto& level : result.levels) {
+			uniform_bytes += (size_t)table_size(level, result.min_log2_size + s) * bytes_per_entry;
+		}
+
+		if (s == 0 || uniform_bytes <= result.budget_bytes) {
+			result.suggested_log2_hashmap_size = result.min_log2_size + s;
+			result.suggested_uniform_n_bytes = uniform_bytes;
+			result.suggested_uniform_collision_rate = mean_collision_rate(std::vector<uint32_t>(n_levels, s));
+		}
+	}
+
+	result.ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	tlog::info() << fmt::format("Hash grid of '{}': {} occupied cells, T=2^{}, {:.1f} MB", snapshot_path.str(), result.n_occupied_cells, result.log2_hashmap_size, result.n_bytes / (1024.0 * 1024.0));
+	for (uint32_t l = 0; l < n_levels; ++l) {
+		const auto& level = result.levels[l];
+		tlog::info() << fmt::format(
+			"  level {:2}: N={:5} vertices={:10} load={:8.2f} collisions={:5.1f}% suggested T={:8} collisions={:5.1f}%{}",
+			l, level.resolution, level.n_occupied_vertices, level.load_factor(), level.collision_rate * 100.0f,
+			level.suggested_size, level.suggested_collision_rate * 100.0f, level.subsampled ? " (subsampled)" : ""
+		);
+	}
+
+	tlog::success() << fmt::format(
+		"Budget {:.1f} MB: collisions {:.1f}% -> {:.1f}% with per-level sizes ({:.1f} MB), {:.1f}% with T=2^{} ({:.1f} MB). Took {:.0f}ms",
+		result.budget_bytes / (1024.0 * 1024.0),
+		result.collision_rate * 100.0f,
+		result.suggested_collision_rate * 100.0f, result.suggested_n_bytes / (1024.0 * 1024.0),
+		result.suggested_uniform_collision_rate * 100.0f, result.suggested_log2_hashmap_size, result.suggested_uniform_n_bytes / (1024.0 * 1024.0),
+		result.ms
+	);
+
+	return result;
+}
+
+NGP_NAMESPACE_END
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   nerf_scene.cu
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Renders scenes that are too large for a single NeRF from the blocks of a NerfScenePartition.
+ */
+
+#include <neural-graphics-primitives/common_device.cuh>
+#include <neural-graphics-primitives/nerf_loader.h>
+#include <neural-graphics-primitives/nerf_scene.h>
+#include <neural-graphics-primitives/testbed.h>
+
+#include <chrono>
+#include <unordered_set>
+
+NGP_NAMESPACE_BEGIN
+
+NerfScene::NerfScene(const fs::path& index_path, size_t memory_budget_bytes)
+: NerfScene{NerfScenePartition::load(index_path), memory_budget_bytes} {}
+
+NerfScene::NerfScene(NerfScenePartition partition, size_t memory_budget_bytes)
+: m_partition{std::move(partition)}, m_residency{memory_budget_bytes} {
+	CUDA_CHECK_THROW(cudaStreamCreate(&m_stream));
+}
+
+NerfScene::~NerfScene() {
+	m_testbeds.clear();
+	m_residency.clear();
+
+	if (m_stream) {
+		cudaStreamSynchronize(m_stream);
+		cudaStreamDestroy(m_stream);
+	}
+}
+
+void NerfScene::load_block(uint32_t block) {
+	const auto& info = m_partition.blocks().at(block);
+
+	auto testbed = std::make_unique<Testbed>(ETestbedMode::Nerf);
+	testbed->load_snapshot(info.snapshot);
+	if (testbed->m_testbed_mode != ETestbedMode::Nerf) {
+		throw std::runtime_error{fmt::format("Block {} of the scene is not a NeRF: {}", block, info.snapshot.str())};
+	}
+
+	testbed->m_render_mode = ERenderMode::Shade;
+	testbed->m_snap_to_pixel_centers = true;
+	CUDA_CHECK_THROW(cudaStreamSynchronize(testbed->m_stream.get()));
+
+	m_testbeds[block] = std::move(testbed);
+}
+
+std::vector<vec4> NerfScene::render(const NerfSceneCamera& camera) {
+	if (any(lessThanEqual(camera.resolution, ivec2(0)))) {
+		throw std::runtime_error{fmt::format("Invalid resolution {}x{}", camera.resolution.x, camera.resolution.y)};
+	}
+
+	m_render_stats = {};
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<uint32_t> visible = m_partition.visible_blocks(camera);
+	auto update = m_residency.update(visible, m_partition.block_n_bytes());
+
+	for (uint32_t block : update.evict) {
+		m_testbeds.erase(block);
+		tlog::info() << fmt::format("Evicted scene block {}", block);
+	}
+
+	for (uint32_t block : update.load) {
+		load_block(block);
+		tlog::info() << fmt::format("Loaded scene block {} from {}", block, m_partition.blocks()[block].snapshot.str());
+	}
+
+	auto loaded = std::chrono::steady_clock::now();
+
+	m_render_stats.n_visible_blocks = (uint32_t)visible.size();
+	m_render_stats.n_loaded_blocks = (uint32_t)update.load.size();
+	m_render_stats.n_evicted_blocks = (uint32_t)update.evict.size();
+	m_render_stats.n_skipped_blocks = (uint32_t)update.skip.size();
+	m_render_stats.load_ms = std::chrono::duration<float, std::milli>(loaded - start).count();
+
+	size_t n_pixels = (size_t)compMul(camera.resolution);
+	m_frame_buffer.enlarge(n_pixels);
+	m_depth_buffer.enlarge(n_pixels);
+
+	CUDA_CHECK_THROW(cudaMemsetAsync(m_frame_buffer.data(), 0, n_pixels * sizeof(vec4), m_stream));
+	parallel_for_gpu(m_stream, n_pixels, [depth_buffer=m_depth_buffer.data()] __device__ (size_t i) {
+		depth_buffer[i] = MAX_DEPTH();
+	});
+
+	std::unordered_set<uint32_t> skipped(update.skip.begin(), update.skip.end());
+
+	for (uint32_t block : visible) {
+		auto it = m_testbeds.find(block);
+		if (skipped.count(block) || it == m_testbeds.end()) {
+			continue;
+		}
+
+		Testbed& testbed = *it->second;
+		const auto& dataset = testbed.m_nerf.training.dataset;
+
+		// Each block only contributes the part of its NeRF within its own box, such that the overlap between the
+		// training volumes of neighboring blocks is not composited twice.
+		vec3 a = dataset.nerf_position_to_ngp(m_partition.block_min(block));
+		vec3 b = dataset.nerf_position_to_ngp(m_partition.block_max(block));
+		testbed.m_render_aabb = BoundingBox{min(a, b), max(a, b)}.intersection(testbed.m_aabb);
+		testbed.m_render_aabb_to_local = mat3(1.0f);
+		if (testbed.m_render_aabb.is_empty()) {
+			continue;
+		}
+
+		testbed.m_render_near_distance = camera.near_distance * dataset.scale;
+		testbed.m_nerf.render_min_transmittance = min_transmittance;
+
+		mat4x3 camera_ngp = dataset.nerf_matrix_to_ngp(camera.camera);
+		NerfTracer::View view = {
+			0,
+			camera.resolution,
+			camera.focal_length,
+			camera_ngp,
+			camera_ngp,
+			{0.0f, 0.0f, 0.0f, 1.0f},
+			camera.screen_center,
+			{},
+			m_frame_buffer.data(),
+			m_depth_buffer.data(),
+			{},
+		};
+
+		testbed.render_nerf_views(m_stream, {view}, *testbed.m_nerf_network, testbed.m_nerf.density_grid_bitfield.data(), -1, false, true);
+		++m_render_stats.n_rendered_blocks;
+	}
+
+	std::vector<vec4> frame(n_pixels);
+	CUDA_CHECK_THROW(cudaMemcpyAsync(frame.data(), m_frame_buffer.data(), n_pixels * sizeof(vec4), cudaMemcpyDeviceToHost, m_stream));
+	CUDA_CHECK_THROW(cudaStreamSynchronize(m_stream));
+
+	m_render_stats.render_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - loaded).count();
+	return frame;
+}
+
+NGP_NAMESPACE_END
@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   nerf_scene_partition.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/nerf_scene_partition.h>
+
+#include <json/json.hpp>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+
+NGP_NAMESPACE_BEGIN
+
+using namespace nlohmann;
+
+vec3 NerfSceneCamera::pixel_dir(const vec2& pixel) const {
+	vec2 p = (pixel - screen_center * vec2(resolution)) / focal_length;
+	return normalize(camera[0] * p.x - camera[1] * p.y - camera[2]);
+}
+
+NerfScenePartition::NerfScenePartition(const vec3& origin, const vec3& block_size, const ivec3& n_blocks)
+: m_origin{origin}, m_block_size{block_size}, m_n_blocks{n_blocks} {
+	if (any(lessThanEqual(block_size, vec3(0.0f))) || any(lessThanEqual(n_blocks, ivec3(0)))) {
+		throw std::runtime_error{"A scene partition needs a positive block size and block count."};
+	}
+
+	m_block_of_cell.assign((size_t)n_blocks.x * n_blocks.y * n_blocks.z, -1);
+}
+
+NerfScenePartition NerfScenePartition::load(const fs::path& path) {
+	std::ifstream f{native_string(path), std::ios::in | std::ios::binary};
+	if (!f) {
+		throw std::runtime_error{fmt::format("Failed to open scene partition {}.", path.str())};
+	}
+
+	json index = json::parse(f, nullptr, true, true);
+
+	auto read_vec3 = [&](const char* name) {
+		const auto& v = index.at(name);
+		return vec3{v.at(0).get<float>(), v.at(1).get<float>(), v.at(2).get<float>()};
+	};
+
+	vec3 n_blocks = read_vec3("n_blocks");
+	NerfScenePartition partition{read_vec3("origin"), read_vec3("block_size"), ivec3(n_blocks)};
+
+	fs::path base = path.parent_path();
+	for (const auto& block : index.at("blocks")) {
+		const auto& c = block.at("cell");
+		ivec3 cell = {c.at(0).get<int>(), c.at(1).get<int>(), c.at(2).get<int>()};
+
+		fs::path snapshot = block.at("snapshot").get<std::string>();
+		if (!snapshot.is_absolute()) {
+			snapshot = base / snapshot;
+		}
+
+		size_t n_bytes = block.value("n_bytes", (size_t)0);
+		if (n_bytes == 0) {
+			n_bytes = snapshot.file_size();
+		}
+
+		partition.add_block(cell, snapshot, n_bytes);
+	}
+
+	tlog::info() << fmt::format(
+		"Loaded scene partition {} with {} blocks in a {}x{}x{} grid",
+		path.str(), partition.blocks().size(), partition.n_blocks().x, partition.n_blocks().y, partition.n_blocks().z
+	);
+
+	return partition;
+}
+
+uint32_t NerfScenePartition::add_block(const ivec3& cell, const fs::path& snapshot, size_t n_bytes) {
+	if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, m_n_blocks))) {
+		throw std::runtime_error{fmt::format("Block cell [{},{},{}] lies outside the partition.", cell.x, cell.y, cell.z)};
+	}
+
+	int32_t& block = m_block_of_cell[cell.x + m_n_blocks.x * (cell.y + m_n_blocks.y * cell.z)];
+	if (block >= 0) {
+		throw std::runtime_error{fmt::format("Block cell [{},{},{}] has more than one snapshot.", cell.x, cell.y, cell.z)};
+	}
+
+	block = (int32_t)m_blocks.size();
+	m_blocks.push_back({cell, snapshot, n_bytes});
+	return (uint32_t)block;
+}
+
+std::vector<size_t> NerfScenePartition::block_n_bytes() const {
+	std::vector<size_t> result;
+	for (const auto& block : m_blocks) {
+		result.emplace_back(block.n_bytes);
+	}
+	return result;
+}
+
+std::vector<uint32_t> NerfScenePartition::visible_blocks(const NerfSceneCamera& camera) const {
+	vec3 pos = camera.position();
+	vec3 forward = camera.forward();
+
+	// Inward normals of the four side planes of the frustum, which all pass through the camera position
+	vec2 res = vec2(camera.resolution);
+	vec3 corners[4] = {
+		camera.pixel_dir({0.0f, 0.0f}),
+		camera.pixel_dir({res.x, 0.0f}),
+		camera.pixel_dir({res.x, res.y}),
+		camera.pixel_dir({0.0f, res.y}),
+	};
+
+	vec3 normals[4];
+	for (uint32_t i = 0; i < 4; ++i) {
+		normals[i] = cross(corners[i], corners[(i + 1) % 4]);
+		if (dot(normals[i], forward) < 0.0f) {
+			normals[i] = -normals[i];
+		}
+	}
+
+	std::vector<uint32_t> result;
+	for (uint32_t b = 0; b < m_blocks.size(); ++b) {
+		vec3 lo = block_min(b), hi = block_max(b);
+
+		// A box is outside if all of its corners lie outside one of the planes. Conservative near the edges.
+		bool outside_near = true, outside_far = true;
+		bool outside_side[4] = {true, true, true, true};
+		for (uint32_t c = 0; c < 8; ++c) {
+			vec3 corner = {(c & 1) ? hi.x : lo.x, (c & 2) ? hi.y : lo.y, (c & 4) ? hi.z : lo.z};
+			vec3 d = corner - pos;
+			float z = dot(d, forward);
+			outside_near &= z < camera.near_distance;
+			outside_far &= z > camera.far_distance;
+			for (uint32_t i = 0; i < 4; ++i) {
+				outside_side[i] &= dot(d, normals[i]) < 0.0f;
+			}
+		}
+
+		if (!outside_near && !outside_far && !outside_side[0] && !outside_side[1] && !outside_side[2] && !outside_side[3]) {
+			result.emplace_back(b);
+		}
+	}
+
+	sort_front_to_back(pos, result);
+	return result;
+}
+
+void NerfScenePartition::sort_front_to_back(const vec3& pos, std::vector<uint32_t>& blocks) const {
+	ivec3 camera_cell = clamp(ivec3(floor((pos - m_origin) / m_block_size)), ivec3(0), m_n_blocks - 1);
+
+	auto distance = [&](uint32_t block) {
+		ivec3 d = abs(m_blocks.at(block).cell - camera_cell);
+		return d.x + d.y + d.z;
+	};
+
+	// Stable, such that blocks that no ray passes through both keep a deterministic order
+	std::stable_sort(blocks.begin(), blocks.end(), [&](uint32_t a, uint32_t b) {
+		return distance(a) < distance(b);
+	});
+}
+
+std::vector<uint32_t> NerfScenePartition::blocks_along_ray(const vec3& o, const vec3& d, float t_min) const {
+	std::vector<std::pair<float, uint32_t>> hits;
+	for (uint32_t b = 0; b < m_blocks.size(); ++b) {
+		vec3 lo = block_min(b), hi = block_max(b);
+
+		float t0 = t_min, t1 = std::numeric_limits<float>::infinity();
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (d[i] == 0.0f) {
+				if (o[i] < lo[i] || o[i] > hi[i]) {
+					t1 = -1.0f;
+				}
+				continue;
+			}
+
+			float ta = (lo[i] - o[i]) / d[i];
+			float tb = (hi[i] - o[i]) / d[i];
+			t0 = std::max(t0, std::min(ta, tb));
+			t1 = std::min(t1, std::max(ta, tb));
+		}
+
+		// Grazing hits of edges and faces have no extent and no defined order.
+		if (t1 > t0 + 1e-5f * std::max(1.0f, t0)) {
+			hits.emplace_back(t0, b);
+		}
+	}
+
+	std::sort(hits.begin(), hits.end());
+
+	std::vector<uint32_t> result;
+	for (const auto& hit : hits) {
+		result.emplace_back(hit.second);
+	}
+	return result;
+}
+
+NerfBlockResidency::Update NerfBlockResidency::update(const std::vector<uint32_t>& visible, const std::vector<size_t>& n_bytes) {
+	++m_frame;
+
+	// Visible blocks in order of importance, as many as fit into the budget on their own
+	std::vector<uint32_t> target;
+	Update update;
+	size_t target_n_bytes = 0;
+	for (uint32_t block : visible) {
+		size_t size = n_bytes.at(block);
+		if (target_n_bytes + size <= m_budget) {
+			target.emplace_back(block);
+			target_n_bytes += size;
+		} else {
+			update.skip.emplace_back(block);
+		}
+	}
+
+	std::vector<uint32_t> candidates;
+	for (const auto& entry : m_last_used) {
+		if (std::find(target.begin(), target.end(), entry.first) == target.end()) {
+			candidates.emplace_back(entry.first);
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+		uint64_t last_a = m_last_used.at(a), last_b = m_last_used.at(b);
+		return last_a != last_b ? last_a < last_b : a < b;
+	});
+
+	size_t n_missing_bytes = 0;
+	for (uint32_t block : target) {
+		if (!resident(block)) {
+			n_missing_bytes += n_bytes.at(block);
+		}
+	}
+
+	// The target fits into the budget on its own, so evicting all other blocks always makes room.
+	for (uint32_t block : candidates) {
+		if (m_n_resident_bytes + n_missing_bytes <= m_budget) {
+			break;
+		}
+
+		m_n_resident_bytes -= m_resident_n_bytes.at(block);
+		m_resident_n_bytes.erase(block);
+		m_last_used.erase(block);
+		update.evict.emplace_back(block);
+	}
+
+	for (uint32_t block : target) {
+		if (!resident(block)) {
+			m_resident_n_bytes[block] = n_bytes.at(block);
+			m_n_resident_bytes += n_bytes.at(block);
+			update.load.emplace_back(block);
+		}
+		m_last_used[block] = m_frame;
+	}
+
+	return update;
+}
+
+std::vector<uint32_t> NerfBlockResidency::clear() {
+	std::vector<uint32_t> evicted;
+	for (const auto& entry : m_last_used) {
+		evicted.emplace_back(entry.first);
+	}
+
+	std::sort(evicted.begin(), evicted.end());
+	m_last_used.clear();
+	m_resident_n_bytes.clear();
+	m_n_resident_bytes = 0;
+	return evicted;
+}
+
+NerfScenePartitionCheck check_nerf_scene_partition(const NerfScenePartition& partition, uint32_t n_views, uint32_t n_rays_per_view) {
+	NerfScenePartitionCheck result;
+
+	std::mt19937 rng{1337};
+	std::uniform_real_distribution<float> uniform{0.0f, 1.0f};
+
+	vec3 extent = vec3(partition.n_blocks()) * partition.block_size();
+	vec3 center = partition.origin() + 0.5f * extent;
+
+	std::vector<NerfSceneCamera> cameras;
+	for (uint32_t v = 0; v < n_views; ++v) {
+		// Cameras inside and around the partition, looking at random points in it
+		vec3 pos = partition.origin() + (vec3{uniform(rng), uniform(rng), uniform(rng)} * 2.0f - 0.5f) * extent;
+		vec3 target = partition.origin() + vec3{uniform(rng), uniform(rng), uniform(rng)} * extent;
+		if (distance(pos, target) < 1e-3f * length(extent)) {
+			target = center + extent;
+		}
+
+		vec3 forward = normalize(target - pos);
+		vec3 up = std::abs(forward.z) < 0.9f ? vec3{0.0f, 0.0f, 1.0f} : vec3{1.0f, 0.0f, 0.0f};
+		vec3 right = normalize(cross(forward, up));
+		up = cross(right, forward);
+
+		NerfSceneCamera camera;
+		camera.camera = mat4x3(right, up, -forward, pos);
+		camera.resolution = {64 + (int)(uniform(rng) * 64), 64 + (int)(uniform(rng) * 64)};
+		camera.focal_length = vec2(compMax(camera.resolution) * (0.5f + uniform(rng)));
+		cameras.emplace_back(camera);
+
+		std::vector<uint32_t> visible = partition.visible_blocks(camera);
+		std::vector<int> position(partition.blocks().size(), -1);
+		for (uint32_t i = 0; i < visible.size(); ++i) {
+			position[visible[i]] = (int)i;
+		}
+
+		for (uint32_t r = 0; r < n_rays_per_view; ++r) {
+			vec2 pixel = vec2{uniform(rng), uniform(rng)} * vec2(camera.resolution);
+			std::vector<uint32_t> along = partition.blocks_along_ray(pos, camera.pixel_dir(pixel));
+			++result.n_rays;
+
+			int prev = -1;
+			for (uint32_t block : along) {
+				if (position[block] < 0) {
+					++result.n_culling_errors;
+					continue;
+				}
+
+				result.n_order_errors += position[block] < prev ? 1 : 0;
+				prev = position[block];
+			}
+		}
+	}
+
+	std::vector<size_t> n_bytes = partition.block_n_bytes();
+	size_t total_n_bytes = 0;
+	for (size_t size : n_bytes) {
+		total_n_bytes += size;
+	}
+
+	NerfBlockResidency residency{total_n_bytes / 2};
+	for (const auto& camera : cameras) {
+		std::vector<uint32_t> visible = partition.visible_blocks(camera);
+		auto update = residency.update(visible, n_bytes);
+		++result.n_residency_frames;
+
+		bool ok = residency.n_resident_bytes() <= residency.budget();
+
+		// Skipped blocks may linger as long as their memory is not needed, but are not rendered.
+		size_t n_target_bytes = 0;
+		for (uint32_t block : visible) {
+			bool fits = n_target_bytes + n_bytes[block] <= residency.budget();
+			bool skipped = std::find(update.skip.begin(), update.skip.end(), block) != update.skip.end();
+			ok &= fits ? residency.resident(block) && !skipped : skipped;
+			n_target_bytes += fits ? n_bytes[block] : 0;
+		}
+
+		for (uint32_t block : update.evict) {
+			ok &= !residency.resident(block);
+			ok &= std::find(visible.begin(), visible.end(), block) == visible.end() || std::find(update.skip.begin(), update.skip.end(), block) != update.skip.end();
+		}
+
+		result.n_residency_errors += ok ? 0 : 1;
+	}
+
+	std::string message = fmt::format(
+		"Scene partition: {} blocks culled and {} blocks out of order on {} rays; {}/{} residency frames with errors",
+		result.n_culling_errors, result.n_order_errors, result.n_rays, result.n_residency_errors, result.n_residency_frames
+	);
+
+	if (result.n_culling_errors == 0 && result.n_order_errors == 0 && result.n_residency_errors == 0) {
+		tlog::success() << message;
+	} else {
+		tlog::error() << message;
+	}
+
+	return result;
+}
+
+NGP_NAMESPACE_END
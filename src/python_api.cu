@@ -12,9 +12,16 @@
  *  @author Thomas Müller & Alex Evans, NVIDIA
  */
 
+#include <neural-graphics-primitives/baked_nerf.h>
 #include <neural-graphics-primitives/common_device.cuh>
+#include <neural-graphics-primitives/cpu_nerf.h>
+#include <neural-graphics-primitives/hash_grid_analysis.h>
+#include <neural-graphics-primitives/nerf_scene.h>
+#include <neural-graphics-primitives/render_farm.h>
 #include <neural-graphics-primitives/testbed.h>
 #include <neural-graphics-primitives/thread_pool.h>
+#include <neural-graphics-primitives/training_profiler.h>
+#include <neural-graphics-primitives/training_scheduler.h>
 
 #include <json/json.hpp>
 
@@ -158,80 +165,591 @@ py::array_t<float> Testbed::render_to_cpu(int width, int height, int spp, bool l
 	auto end_cam_matrix = m_smoothed_camera;
 	auto prev_camera_matrix = m_smoothed_camera;
 
-	for (int i = 0; i < spp; ++i) {
-		float start_alpha = ((float)i)/(float)spp * shutter_fraction;
-		float end_alpha = ((float)i + 1.0f)/(float)spp * shutter_fraction;
+	AdaptiveSamplingSettings adaptive_settings = m_adaptive_sampling;
+	adaptive_settings.max_spp = spp;
 
-		auto sample_start_cam_matrix = start_cam_matrix;
-		auto sample_end_cam_matrix = camera_log_lerp(start_cam_matrix, end_cam_matrix, shutter_fraction);
-		if (i == 0) {
+	// Reprojection warps pixels with a pinhole model, so it is restricted to NeRF renders without lens distortion.
+	bool temporal_reprojection = m_temporal_reprojection.enabled && path_animation_enabled && m_testbed_mode == ETestbedMode::Nerf && !m_nerf.render_with_lens_distortion;
+	if (!temporal_reprojection || start_time == 0.f) {
+		m_temporal_reprojection_history.invalidate();
+		m_temporal_reprojection_stats = {};
+	}
+
+	auto render_samples = [&](bool reproject) {
+		m_windowless_render_surface.enable_adaptive_sampling(adaptive_settings.enabled || reproject);
+		m_windowless_render_surface.reset_accumulation();
+
+		if (reproject) {
+			vec2 focal_length = calc_focal_length(m_windowless_render_surface.in_resolution(), m_relative_focal_length, m_fov_axis, m_zoom);
+			uint32_t n_reused = m_temporal_reprojection_history.reproject(
+				m_windowless_render_surface,
+				start_cam_matrix,
+				focal_length,
+				render_screen_center(m_screen_center),
+				m_parallax_shift,
+				(uint32_t)spp,
+				m_temporal_reprojection,
+				m_stream.get()
+			);
+
+			auto& stats = m_temporal_reprojection_stats;
+			++stats.n_frames;
+			stats.reused_fraction = (float)n_reused / (float)compMul(m_windowless_render_surface.in_resolution());
+			stats.mean_reused_fraction += (stats.reused_fraction - stats.mean_reused_fraction) / (float)stats.n_frames;
+		}
+
+		for (int i = 0; i < spp; ++i) {
+			float start_alpha = ((float)i)/(float)spp * shutter_fraction;
+			float end_alpha = ((float)i + 1.0f)/(float)spp * shutter_fraction;
+
+			auto sample_start_cam_matrix = start_cam_matrix;
+			auto sample_end_cam_matrix = camera_log_lerp(start_cam_matrix, end_cam_matrix, shutter_fraction);
+			if (i == 0) {
+				prev_camera_matrix = sample_start_cam_matrix;
+			}
+
+			if (path_animation_enabled) {
+				set_camera_from_time(start_time + (end_time-start_time) * (start_alpha + end_alpha) / 2.0f);
+				m_smoothed_camera = m_camera;
+			}
+
+			if (m_autofocus) {
+				autofocus();
+			}
+
+			render_frame(
+				m_stream.get(),
+				sample_start_cam_matrix,
+				sample_end_cam_matrix,
+				prev_camera_matrix,
+				m_screen_center,
+				m_relative_focal_length,
+				{0.0f, 0.0f, 0.0f, 1.0f},
+				{},
+				{},
+				m_visualized_dimension,
+				m_windowless_render_surface,
+				!linear
+			);
 			prev_camera_matrix = sample_start_cam_matrix;
+
+			if (reproject) {
+				// Also records the depth of the pixels that were just traced, so keep updating through the last sample.
+				if (m_temporal_reprojection_history.update_mask(m_windowless_render_surface, (uint32_t)spp, m_stream.get()) == 0) {
+					break;
+				}
+			} else if (adaptive_settings.enabled && i + 1 >= (int)adaptive_settings.min_spp && i + 1 < spp) {
+				uint32_t n_active_tiles = m_windowless_render_surface.update_adaptive_sampling_mask(adaptive_settings, m_stream.get());
+				if (n_active_tiles == 0) {
+					break;
+				}
+			}
 		}
 
-		if (path_animation_enabled) {
-			set_camera_from_time(start_time + (end_time-start_time) * (start_alpha + end_alpha) / 2.0f);
-			m_smoothed_camera = m_camera;
+		if (reproject) {
+			m_temporal_reprojection_history.store(
+				m_windowless_render_surface,
+				start_cam_matrix,
+				calc_focal_length(m_windowless_render_surface.in_resolution(), m_relative_focal_length, m_fov_axis, m_zoom),
+				render_screen_center(m_screen_center),
+				m_stream.get()
+			);
 		}
+	};
 
-		if (m_autofocus) {
-			autofocus();
+	py::array_t<float> result({height, width, 4});
+	py::buffer_info buf = result.request();
+
+	auto read_surface = [&](void* dst) {
+		CUDA_CHECK_THROW(cudaMemcpy2DFromArray(dst, width * sizeof(float) * 4, m_windowless_render_surface.surface_provider().array(), 0, 0, width * sizeof(float) * 4, height, cudaMemcpyDeviceToHost));
+	};
+
+	if (temporal_reprojection && m_temporal_reprojection.measure_quality && m_temporal_reprojection_history.has_history()) {
+		// The reference is rendered first, such that the reprojected render leaves its history behind for the next frame.
+		std::vector<float> reference((size_t)width * height * 4);
+		render_samples(false);
+		read_surface(reference.data());
+
+		render_samples(true);
+		read_surface(buf.ptr);
+
+		const float* rendered = (const float*)buf.ptr;
+		double squared_error = 0.0;
+		for (size_t i = 0; i < reference.size(); i += 4) {
+			for (size_t j = 0; j < 3; ++j) {
+				double diff = clamp(rendered[i+j], 0.0f, 1.0f) - clamp(reference[i+j], 0.0f, 1.0f);
+				squared_error += diff * diff;
+			}
 		}
 
-		render_frame(
-			m_stream.get(),
-			sample_start_cam_matrix,
-			sample_end_cam_matrix,
-			prev_camera_matrix,
-			m_screen_center,
-			m_relative_focal_length,
-			{0.0f, 0.0f, 0.0f, 1.0f},
-			{},
-			{},
-			m_visualized_dimension,
-			m_windowless_render_surface,
-			!linear
-		);
-		prev_camera_matrix = sample_start_cam_matrix;
+		auto& stats = m_temporal_reprojection_stats;
+		double mse = squared_error / (double)(reference.size() / 4 * 3);
+		if (mse > 0.0) {
+			stats.psnr = (float)(-10.0 * std::log10(mse));
+			++stats.n_measured_frames;
+			stats.mean_psnr += (stats.psnr - stats.mean_psnr) / (float)stats.n_measured_frames;
+		} else {
+			stats.psnr = std::numeric_limits<float>::infinity();
+		}
+	} else {
+		render_samples(temporal_reprojection);
+		read_surface(buf.ptr);
 	}
 
 	// For cam smoothing when rendering the next frame.
 	m_smoothed_camera = end_cam_matrix;
 
-	py::array_t<float> result({height, width, 4});
-	py::buffer_info buf = result.request();
+	return result;
+}
+
+// Both arrays are indexed densely, so strided views such as poses[:, :3, :] are copied into C order first.
+py::array_t<float> Testbed::render_batch(py::array_t<float, py::array::c_style | py::array::forcecast> poses, py::array_t<float, py::array::c_style | py::array::forcecast> focal_lengths, int width, int height, int spp, bool linear, py::object out, std::function<void(int, py::array_t<float>)> sink) {
+	py::buffer_info poses_buf = poses.request();
+	if (poses_buf.ndim != 3 || poses_buf.shape[1] < 3 || poses_buf.shape[2] != 4) {
+		throw std::runtime_error{"poses should be (N,3,4) or (N,4,4)"};
+	}
+
+	const int n_frames = (int)poses_buf.shape[0];
+	const size_t pose_stride = poses_buf.shape[1] * 4;
+	const float* pose_data = (const float*)poses_buf.ptr;
+
+	// Optional per-pose focal lengths in pixels. If absent, the testbed's current intrinsics are used for all poses.
+	py::buffer_info focal_buf = focal_lengths.request();
+	const float* focal_data = nullptr;
+	if (focal_buf.size > 0) {
+		if (focal_buf.ndim != 2 || focal_buf.shape[0] != n_frames || focal_buf.shape[1] != 2) {
+			throw std::runtime_error{"focal_lengths should be (N,2)"};
+		}
+		focal_data = (const float*)focal_buf.ptr;
+	}
+
+	float* out_data = nullptr;
+	py::array_t<float> result;
+	if (!out.is_none()) {
+		if (!py::isinstance<py::array_t<float, py::array::c_style>>(out)) {
+			throw std::runtime_error{"out should be a C-contiguous float32 array of shape (N,H,W,4)"};
+		}
+
+		result = out.cast<py::array_t<float>>();
+		py::buffer_info out_buf = result.request(true);
+		if (out_buf.ndim != 4 || out_buf.shape[0] != n_frames || out_buf.shape[1] != height || out_buf.shape[2] != width || out_buf.shape[3] != 4) {
+			throw std::runtime_error{"out should be a C-contiguous float32 array of shape (N,H,W,4)"};
+		}
+		out_data = (float*)out_buf.ptr;
+	} else if (!sink) {
+		result = py::array_t<float>({n_frames, height, width, 4});
+		out_data = (float*)result.request().ptr;
+	}
+
+	// The surface is only reallocated if the resolution actually changes.
+	if (m_windowless_render_surface.in_resolution() != ivec2{width, height}) {
+		m_windowless_render_surface.resize({width, height});
+	}
+
+	auto prev_camera = m_camera;
+	auto prev_relative_focal_length = m_relative_focal_length;
+	ScopeGuard camera_guard{[&]() {
+		m_camera = m_smoothed_camera = prev_camera;
+		m_relative_focal_length = prev_relative_focal_length;
+	}};
+
+	// Two pinned staging buffers: while the host consumes frame i from one of them,
+	// frame i+1 is rendered and asynchronously read back into the other.
+	const size_t frame_stride = (size_t)width * height * 4;
+	float* staging[2] = {};
+	cudaEvent_t readback_done[2] = {};
+	ScopeGuard staging_guard{[&]() {
+		for (int i = 0; i < 2; ++i) {
+			if (readback_done[i]) cudaEventDestroy(readback_done[i]);
+			if (staging[i]) cudaFreeHost(staging[i]);
+		}
+	}};
+
+	for (int i = 0; i < 2; ++i) {
+		CUDA_CHECK_THROW(cudaMallocHost(&staging[i], frame_stride * sizeof(float)));
+		CUDA_CHECK_THROW(cudaEventCreateWithFlags(&readback_done[i], cudaEventDisableTiming));
+	}
+
+	auto deliver = [&](int frame) {
+		float* src = staging[frame % 2];
+		CUDA_CHECK_THROW(cudaEventSynchronize(readback_done[frame % 2]));
+
+		if (out_data) {
+			std::memcpy(out_data + frame * frame_stride, src, frame_stride * sizeof(float));
+		}
+
+		if (sink) {
+			// Zero-copy view of the staging buffer. Only valid for the duration of the callback.
+			sink(frame, py::array_t<float>({height, width, 4}, src, py::capsule(src, [](void*) {})));
+		}
+	};
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int frame = 0; frame < n_frames; ++frame) {
+		mat4x3 pose;
+		const float* p = pose_data + frame * pose_stride;
+		for (int c = 0; c < 4; ++c) {
+			for (int r = 0; r < 3; ++r) {
+				pose[c][r] = p[r * 4 + c];
+			}
+		}
+
+		set_nerf_camera_matrix(pose);
+		m_smoothed_camera = m_camera;
+
+		if (focal_data) {
+			m_relative_focal_length = vec2{focal_data[frame * 2 + 0], focal_data[frame * 2 + 1]} / ((float)ivec2{width, height}[m_fov_axis] * m_zoom);
+		}
+
+		m_windowless_render_surface.reset_accumulation();
+		for (int i = 0; i < spp; ++i) {
+			render_frame(
+				m_stream.get(),
+				m_camera,
+				m_camera,
+				m_camera,
+				m_screen_center,
+				m_relative_focal_length,
+				{0.0f, 0.0f, 0.0f, 1.0f},
+				{},
+				{},
+				m_visualized_dimension,
+				m_windowless_render_surface,
+				!linear
+			);
+		}
+
+		// The previous frame's readback has been in flight while this frame was rendering.
+		// Consume it before its staging buffer gets reused by the next readback.
+		if (frame > 0) {
+			deliver(frame - 1);
+		}
+
+		CUDA_CHECK_THROW(cudaMemcpy2DFromArrayAsync(staging[frame % 2], width * sizeof(float) * 4, m_windowless_render_surface.surface_provider().array(), 0, 0, width * sizeof(float) * 4, height, cudaMemcpyDeviceToHost, m_stream.get()));
+		CUDA_CHECK_THROW(cudaEventRecord(readback_done[frame % 2], m_stream.get()));
+	}
+
+	if (n_frames > 0) {
+		deliver(n_frames - 1);
+	}
+
+	float elapsed_s = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	tlog::success() << fmt::format("Rendered {} frames at {}x{} with {} spp in {:.2f}s ({:.2f} frames/s)", n_frames, width, height, spp, elapsed_s, n_frames / std::max(elapsed_s, 1e-6f));
 
-	CUDA_CHECK_THROW(cudaMemcpy2DFromArray(buf.ptr, width * sizeof(float) * 4, m_windowless_render_surface.surface_provider().array(), 0, 0, width * sizeof(float) * 4, height, cudaMemcpyDeviceToHost));
 	return result;
 }
 
-py::array_t<float> Testbed::view(bool linear, size_t view_idx) const {
-	if (m_views.size() <= view_idx) {
-		throw std::runtime_error{fmt::format("View #{} does not exist.", view_idx)};
+py::array_t<float> Testbed::render_views(py::array_t<float> poses, int width, int height, int spp, bool linear, bool compare_to_per_view) {
+	py::buffer_info poses_buf = poses.request();
+	if (poses_buf.ndim != 3 || poses_buf.shape[1] < 3 || poses_buf.shape[2] != 4) {
+		throw std::runtime_error{"poses should be (N,3,4) or (N,4,4)"};
 	}
 
-	auto& view = m_views.at(view_idx);
-	auto& render_buffer = *view.render_buffer;
+	if (!can_render_nerf_views_batched()) {
+		throw std::runtime_error{"Rendering views in one trace requires a NeRF in a render mode other than slice or cost, and no ground truth rendering."};
+	}
 
-	auto res = render_buffer.out_resolution();
+	const int n_views = (int)poses_buf.shape[0];
+	const size_t pose_stride = poses_buf.shape[1] * 4;
+	const float* pose_data = (const float*)poses_buf.ptr;
+
+	std::vector<mat4x3> cameras(n_views);
+	for (int v = 0; v < n_views; ++v) {
+		mat4x3 pose;
+		const float* p = pose_data + v * pose_stride;
+		for (int c = 0; c < 4; ++c) {
+			for (int r = 0; r < 3; ++r) {
+				pose[c][r] = p[r * 4 + c];
+			}
+		}
 
-	py::array_t<float> result({res.y, res.x, 4});
-	py::buffer_info buf = result.request();
-	float* data = (float*)buf.ptr;
+		cameras[v] = m_nerf.training.dataset.nerf_matrix_to_ngp(pose);
+	}
 
-	CUDA_CHECK_THROW(cudaMemcpy2DFromArray(data, res.x * sizeof(float) * 4, render_buffer.surface_provider().array(), 0, 0, res.x * sizeof(float) * 4, res.y, cudaMemcpyDeviceToHost));
+	while (m_multi_view_render_buffers.size() < (size_t)n_views) {
+		m_multi_view_render_buffers.emplace_back(std::make_shared<CudaSurface2D>());
+	}
+
+	for (int v = 0; v < n_views; ++v) {
+		if (m_multi_view_render_buffers[v].in_resolution() != ivec2{width, height}) {
+			m_multi_view_render_buffers[v].resize({width, height});
+		}
+	}
 
-	if (linear) {
-		ThreadPool{}.parallel_for<size_t>(0, res.y, [&](size_t y) {
-			size_t base = y * res.x;
-			for (uint32_t x = 0; x < res.x; ++x) {
-				size_t px = base + x;
-				data[px*4+0] = srgb_to_linear(data[px*4+0]);
-				data[px*4+1] = srgb_to_linear(data[px*4+1]);
-				data[px*4+2] = srgb_to_linear(data[px*4+2]);
+	// Renders `spp` samples of the views [begin,end) with one trace per sample and returns the wall time in milliseconds.
+	NerfTracer::Stats stats;
+	auto render_views_range = [&](int begin, int end) {
+		for (int v = begin; v < end; ++v) {
+			m_multi_view_render_buffers[v].reset_accumulation();
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < spp; ++i) {
+			std::vector<NerfTracer::View> views;
+			for (int v = begin; v < end; ++v) {
+				views.emplace_back(nerf_tracer_view(m_stream.get(), m_multi_view_render_buffers[v], cameras[v], cameras[v], m_screen_center, m_relative_focal_length, {}));
+			}
+
+			auto trace_stats = render_nerf_views(m_stream.get(), views, *m_nerf_network, m_nerf.density_grid_bitfield.data(), m_visualized_dimension, true);
+			stats.n_inference_batches += trace_stats.n_inference_batches;
+			stats.n_queries += trace_stats.n_queries;
+			stats.n_useful_queries += trace_stats.n_useful_queries;
+			stats.n_rays += trace_stats.n_rays;
+			stats.n_empty_space_steps += trace_stats.n_empty_space_steps;
+
+			for (int v = begin; v < end; ++v) {
+				render_frame_epilogue(m_stream.get(), cameras[v], cameras[v], m_screen_center, m_relative_focal_length, {}, {}, m_multi_view_render_buffers[v], !linear);
 			}
-		});
+		}
+
+		CUDA_CHECK_THROW(cudaStreamSynchronize(m_stream.get()));
+		return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	auto occupancy = [&]() {
+		return stats.n_queries > 0 ? (float)((double)stats.n_useful_queries / (double)stats.n_queries) : 0.0f;
+	};
+
+	auto empty_space_steps_per_ray = [&]() {
+		return stats.n_rays > 0 ? (float)((double)stats.n_empty_space_steps / (double)stats.n_rays) : 0.0f;
+	};
+
+	auto& result_stats = m_multi_view_render_stats;
+	result_stats = {};
+	result_stats.n_views = (uint32_t)n_views;
+
+	// The per-view baseline is rendered first, such that the buffers end up holding the result of the shared trace.
+	if (compare_to_per_view) {
+		for (int v = 0; v < n_views; ++v) {
+			result_stats.per_view_ms += render_views_range(v, v + 1);
+		}
+
+		result_stats.per_view_inference_batches = stats.n_inference_batches;
+		result_stats.per_view_occupancy = occupancy();
+		result_stats.per_view_empty_space_steps_per_ray = empty_space_steps_per_ray();
+		stats = {};
+	}
+
+	// Traces are limited to 256 views each
+	for (int begin = 0; begin < n_views; begin += 256) {
+		result_stats.ms += render_views_range(begin, std::min(begin + 256, n_views));
+	}
+
+	result_stats.n_inference_batches = stats.n_inference_batches;
+	result_stats.occupancy = occupancy();
+	result_stats.empty_space_steps_per_ray = empty_space_steps_per_ray();
+
+	if (compare_to_per_view) {
+		result_stats.speedup = result_stats.per_view_ms / std::max(result_stats.ms, 1e-6f);
+		tlog::success() << fmt::format(
+			"Rendered {} views in {:.1f}ms ({} inference batches, {:.1f}% occupancy) vs. {:.1f}ms one view at a time ({} batches, {:.1f}% occupancy): {:.2f}x speedup",
+			n_views, result_stats.ms, result_stats.n_inference_batches, result_stats.occupancy * 100.0f,
+			result_stats.per_view_ms, result_stats.per_view_inference_batches, result_stats.per_view_occupancy * 100.0f, result_stats.speedup
+		);
+	}
+
+	py::array_t<float> result({n_views, height, width, 4});
+	float* out = (float*)result.request().ptr;
+	for (int v = 0; v < n_views; ++v) {
+		CUDA_CHECK_THROW(cudaMemcpy2DFromArray(out + (size_t)v * width * height * 4, width * sizeof(float) * 4, m_multi_view_render_buffers[v].surface_provider().array(), 0, 0, width * sizeof(float) * 4, height, cudaMemcpyDeviceToHost));
+	}
+
+	return result;
+}
+
+std::vector<Testbed::LevelOfDetailBenchmark> Testbed::benchmark_level_of_detail(const std::vector<float>& distances, int width, int height, int n_frames) {
+	if (!can_render_nerf_views_batched()) {
+		throw std::runtime_error{"Benchmarking level of detail requires a NeRF in a render mode other than slice or cost, and no ground truth rendering."};
+	}
+
+	if (m_multi_view_render_buffers.empty()) {
+		m_multi_view_render_buffers.emplace_back(std::make_shared<CudaSurface2D>());
+	}
+
+	auto& render_buffer = m_multi_view_render_buffers.front();
+	if (render_buffer.in_resolution() != ivec2{width, height}) {
+		render_buffer.resize({width, height});
+	}
+
+	bool render_lod = m_nerf.render_lod;
+	ScopeGuard lod_guard{[&]() { m_nerf.render_lod = render_lod; }};
+
+	m_nerf.render_lod = true;
+	if (!nerf_level_of_detail()) {
+		throw std::runtime_error{"Level of detail requires a hash grid encoding."};
+	}
+
+	// Renders `n_frames` single-sample frames and returns the wall time in milliseconds
+	NerfTracer::Stats stats;
+	auto render_frames = [&](const mat4x3& camera, bool lod) {
+		m_nerf.render_lod = lod;
+		render_buffer.reset_accumulation();
+		stats = {};
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < n_frames; ++i) {
+			std::vector<NerfTracer::View> views = {nerf_tracer_view(m_stream.get(), render_buffer, camera, camera, m_screen_center, m_relative_focal_length, {})};
+			auto trace_stats = render_nerf_views(m_stream.get(), views, *m_nerf_network, m_nerf.density_grid_bitfield.data(), m_visualized_dimension, true);
+			stats.n_useful_queries += trace_stats.n_useful_queries;
+			stats.n_level_evaluations += trace_stats.n_level_evaluations;
+		}
+
+		CUDA_CHECK_THROW(cudaStreamSynchronize(m_stream.get()));
+		return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	auto msamples_per_second = [&](float ms) {
+		return ms > 0.0f ? (float)((double)stats.n_useful_queries / (ms * 1000.0)) : 0.0f;
+	};
+
+	// The camera keeps its orientation and moves along its viewing direction, such that it looks at the same point.
+	vec3 center = look_at();
+
+	std::vector<LevelOfDetailBenchmark> results;
+	for (float distance : distances) {
+		mat4x3 camera = m_camera;
+		camera[3] = center - camera[2] * distance;
+
+		LevelOfDetailBenchmark result;
+		result.distance = distance;
+		result.n_levels = (uint32_t)m_n_levels;
+
+		result.full_ms = render_frames(camera, false);
+		result.full_msamples_per_second = msamples_per_second(result.full_ms);
+
+		result.lod_ms = render_frames(camera, true);
+		result.lod_msamples_per_second = msamples_per_second(result.lod_ms);
+		result.lod_mean_levels = stats.n_useful_queries > 0 ? (float)((double)stats.n_level_evaluations / (double)stats.n_useful_queries) : 0.0f;
+		result.speedup = result.full_ms / std::max(result.lod_ms, 1e-6f);
+
+		tlog::info() << fmt::format(
+			"Distance {:.2f}: {:.1f} Msamples/s at full detail, {:.1f} Msamples/s with level of detail ({:.1f}/{} levels per sample): {:.2f}x speedup",
+			result.distance, result.full_msamples_per_second, result.lod_msamples_per_second, result.lod_mean_levels, result.n_levels, result.speedup
+		);
+
+		results.emplace_back(result);
+	}
+
+	return results;
+}
+
+Testbed::TrainingLoopBenchmark Testbed::benchmark_training_loop(uint32_t n_steps, uint32_t loss_readback_interval) {
+	if (!m_training_data_available) {
+		throw std::runtime_error{"Benchmarking the training loop requires training data."};
 	}
 
+	auto steps_per_second = [&](auto&& train_steps) {
+		uint32_t start_step = m_training_step;
+		auto start = std::chrono::steady_clock::now();
+		train_steps();
+		CUDA_CHECK_THROW(cudaStreamSynchronize(m_stream.get()));
+		float s = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		return s > 0.0f ? (float)(m_training_step - start_step) / s : 0.0f;
+	};
+
+	TrainingLoopBenchmark result;
+	result.n_steps = n_steps;
+	result.per_step_steps_per_second = steps_per_second([&]() {
+		for (uint32_t i = 0; i < n_steps; ++i) {
+			train(m_training_batch_size);
+		}
+	});
+
+	result.batched_steps_per_second = steps_per_second([&]() {
+		train_n_steps(n_steps, m_training_batch_size, loss_readback_interval);
+	});
+
+	result.speedup = result.batched_steps_per_second / std::max(result.per_step_steps_per_second, 1e-6f);
+
+	tlog::info() << fmt::format(
+		"Training loop: {:.1f} steps/s with one synchronized step per call, {:.1f} steps/s with train_n_steps: {:.2f}x speedup",
+		result.per_step_steps_per_second, result.batched_steps_per_second, result.speedup
+	);
+
+	return result;
+}
+
+py::array_t<uint32_t> Testbed::render_sample_counts() const {
+	if (!m_windowless_render_surface.adaptive_sampling()) {
+		throw std::runtime_error{"Sample counts are only tracked for renders with adaptive sampling enabled."};
+	}
+
+	auto res = m_windowless_render_surface.in_resolution();
+	py::array_t<uint32_t> result({res.y, res.x});
+	CUDA_CHECK_THROW(cudaMemcpy(result.request().ptr, m_windowless_render_surface.sample_count_buffer(), compMul(res) * sizeof(uint32_t), cudaMemcpyDeviceToHost));
+	return result;
+}
+
+py::dict Testbed::render_aovs_to_cpu(int width, int height, bool normals, const fs::path& exr_path) {
+	auto aovs = render_aovs({width, height}, normals);
+
+	if (!exr_path.empty()) {
+		save_aovs_exr(aovs, exr_path);
+	}
+
+	py::array_t<float> rgb({height, width, 3});
+	py::array_t<float> alpha({height, width});
+	py::array_t<float> depth({height, width});
+	py::array_t<float> median_depth({height, width});
+	py::array_t<uint32_t> n_steps({height, width});
+
+	float* rgb_data = (float*)rgb.request().ptr;
+	for (size_t i = 0; i < aovs.rgba.size(); ++i) {
+		rgb_data[i*3+0] = aovs.rgba[i].r;
+		rgb_data[i*3+1] = aovs.rgba[i].g;
+		rgb_data[i*3+2] = aovs.rgba[i].b;
+	}
+
+	std::memcpy(alpha.request().ptr, aovs.alpha.data(), aovs.alpha.size() * sizeof(float));
+	std::memcpy(depth.request().ptr, aovs.expected_depth.data(), aovs.expected_depth.size() * sizeof(float));
+	std::memcpy(median_depth.request().ptr, aovs.median_depth.data(), aovs.median_depth.size() * sizeof(float));
+	std::memcpy(n_steps.request().ptr, aovs.n_steps.data(), aovs.n_steps.size() * sizeof(uint32_t));
+
+	py::dict result("rgb"_a=rgb, "alpha"_a=alpha, "depth"_a=depth, "median_depth"_a=median_depth, "n_steps"_a=n_steps);
+
+	if (normals) {
+		py::array_t<float> normal({height, width, 3});
+		std::memcpy(normal.request().ptr, aovs.normal.data(), aovs.normal.size() * sizeof(vec3));
+		result["normal"] = normal;
+	}
+
+	return result;
+}
+
+py::array Testbed::view(bool linear, size_t view_idx, const std::string& dtype) const {
+	if (m_views.size() <= view_idx) {
+		throw std::runtime_error{fmt::format("View #{} does not exist.", view_idx)};
+	}
+
+	EReadbackFormat format;
+	if (dtype == "float32") {
+		format = EReadbackFormat::RGBA32F;
+	} else if (dtype == "float16") {
+		format = EReadbackFormat::RGBA16F;
+	} else if (dtype == "uint8") {
+		format = EReadbackFormat::RGBA8;
+	} else {
+		throw std::runtime_error{fmt::format("Unsupported view dtype '{}'. Must be float32, float16, or uint8.", dtype)};
+	}
+
+	auto& view = m_views.at(view_idx);
+	auto& render_buffer = *view.render_buffer;
+
+	auto res = render_buffer.out_resolution();
+
+	// Conversion happens on the device, such that only the final bytes are copied.
+	auto frame = m_readback_ring.enqueue(
+		render_buffer.surface(),
+		res,
+		EColorSpace::SRGB,
+		linear ? EColorSpace::Linear : EColorSpace::SRGB,
+		format,
+		nullptr
+	);
+
+	py::array result{py::dtype(dtype), {res.y, res.x, 4}};
+	std::memcpy(result.request(true).ptr, frame.data(), frame.bytes());
 	return result;
 }
 
@@ -328,6 +846,11 @@ PYBIND11_MODULE(pyngp, m) {
 		.value("Exponential", ENerfActivation::Exponential)
 		.export_values();
 
+	py::enum_<EErrorMapSampler>(m, "ErrorMapSampler")
+		.value("Cdf", EErrorMapSampler::Cdf)
+		.value("Alias", EErrorMapSampler::Alias)
+		.export_values();
+
 	py::enum_<EMeshSdfMode>(m, "MeshSdfMode")
 		.value("Watertight", EMeshSdfMode::Watertight)
 		.value("Raystab", EMeshSdfMode::Raystab)
@@ -401,7 +924,7 @@ PYBIND11_MODULE(pyngp, m) {
 		)
 		.def("destroy_window", &Testbed::destroy_window, "Destroy the window again.")
 		.def("init_vr", &Testbed::init_vr, "Init rendering to a connected and active VR headset. Requires a window to have been previously created via `init_window`.")
-		.def("view", &Testbed::view, "Outputs the currently displayed image by a given view (0 by default).", py::arg("linear")=true, py::arg("view")=0)
+		.def("view", &Testbed::view, "Outputs the currently displayed image by a given view (0 by default) as float32, float16, or uint8.", py::arg("linear")=true, py::arg("view")=0, py::arg("dtype")="float32")
 #ifdef NGP_GUI
 		.def_readwrite("keyboard_event_callback", &Testbed::m_keyboard_event_callback)
 		.def("is_key_pressed", [](py::object& obj, int key) { return ImGui::IsKeyPressed(key); })
@@ -426,7 +949,67 @@ PYBIND11_MODULE(pyngp, m) {
 			py::arg("fps") = 30.f,
 			py::arg("shutter_fraction") = 1.0f
 		)
+		.def("render_views", &Testbed::render_views, "Renders several poses (N,3,4 in NeRF convention), e.g. the views of a light field or a stereo pair, with a single NeRF trace per sample, "
+			"such that ray marching and network inference batches are shared among them. Returns an array of shape (N,H,W,4). "
+			"With `compare_to_per_view`, the views are additionally rendered one trace at a time; see `multi_view_render_stats` for the timings.",
+			py::arg("poses"),
+			py::arg("width") = 1920,
+			py::arg("height") = 1080,
+			py::arg("spp") = 1,
+			py::arg("linear") = true,
+			py::arg("compare_to_per_view") = false
+		)
+		.def("benchmark_level_of_detail", &Testbed::benchmark_level_of_detail, "Measures rendering throughput with and without `nerf.render_lod` from the current camera moved to each of the given distances from the point it looks at. "
+			"Best run on a model trained with `max_level_rand_training`.",
+			py::arg("distances"),
+			py::arg("width") = 1920,
+			py::arg("height") = 1080,
+			py::arg("n_frames") = 8
+		)
+		.def("render_batch", &Testbed::render_batch, "Renders a batch of poses (N,3,4 in NeRF convention) at a fixed resolution. Readback of each frame overlaps rendering of the next. "
+			"Frames are written into `out` (N,H,W,4) if given, passed to `sink(index, image)` if given, or returned as a newly allocated array otherwise. "
+			"Images passed to `sink` are only valid for the duration of the call.",
+			py::arg("poses"),
+			py::arg("focal_lengths") = py::array_t<float>(),
+			py::arg("width") = 1920,
+			py::arg("height") = 1080,
+			py::arg("spp") = 1,
+			py::arg("linear") = true,
+			py::arg("out") = py::none(),
+			py::arg("sink") = nullptr
+		)
+		.def("render_aovs", &Testbed::render_aovs_to_cpu, "Renders color, alpha, expected and median depth, normals and per-pixel step counts of the current camera in a single NeRF trace. "
+			"Returns a dict of arrays and optionally writes all channels into a multi-channel EXR.",
+			py::arg("width") = 1920,
+			py::arg("height") = 1080,
+			py::arg("normals") = true,
+			py::arg("exr_path") = ""
+		)
+		.def("render_sample_counts", &Testbed::render_sample_counts, "Returns the per-pixel sample counts (H,W) of the last adaptively sampled render.")
 		.def("train", &Testbed::train, py::call_guard<py::gil_scoped_release>(), "Perform a single training step with a specified batch size.")
+		.def("train_n_steps", &Testbed::train_n_steps, py::call_guard<py::gil_scoped_release>(), "Perform `n_steps` training steps back to back without synchronizing after each. The loss is read back asynchronously every `loss_readback_interval` steps.",
+			py::arg("n_steps"),
+			py::arg("batch_size") = 1 << 18,
+			py::arg("loss_readback_interval") = 16
+		)
+		.def("train_with_schedule", [](Testbed& testbed, const TrainingScheduleConfig& config, const std::function<float()>& evaluate, const nlohmann::json& replay) {
+			return testbed.train_with_schedule(config, evaluate, replay.is_null() ? std::vector<TrainingDecision>{} : replay.get<std::vector<TrainingDecision>>());
+		}, py::call_guard<py::gil_scoped_release>(), "Trains until the time or step budget of `config` runs out or the loss returned by `evaluate` (e.g. of held-out views, the training loss if None) plateaus, "
+			"tuning the batch size and density grid update cadence along the way. `replay` takes the `decisions_json` of an earlier run to repeat its schedule.",
+			py::arg("config"),
+			py::arg("evaluate") = nullptr,
+			py::arg("replay") = nullptr
+		)
+		.def("benchmark_training_loop", &Testbed::benchmark_training_loop, py::call_guard<py::gil_scoped_release>(), "Trains `n_steps` steps one `train` call at a time and then `n_steps` steps with `train_n_steps`, and compares their step rates. Continues training the current model.",
+			py::arg("n_steps") = 256,
+			py::arg("loss_readback_interval") = 16
+		)
+		.def("benchmark_error_map_sampler", &Testbed::benchmark_error_map_sampler, py::call_guard<py::gil_scoped_release>(), "Builds the error map's CDFs and alias tables from a synthetic error of `n_images` images, fully and after error was deposited into `touched_fraction` of them, and compares their build times and sampling rates.",
+			py::arg("n_images") = 10000,
+			py::arg("resolution") = ivec2(32),
+			py::arg("touched_fraction") = 0.1f,
+			py::arg("n_samples") = 1 << 22
+		)
 		.def("reset", &Testbed::reset_network, py::arg("reset_density_grid") = true, "Reset training.")
 		.def("reset_accumulation", &Testbed::reset_accumulation, "Reset rendering accumulation.",
 			py::arg("due_to_camera_movement") = false,
@@ -448,9 +1031,39 @@ PYBIND11_MODULE(pyngp, m) {
 		.def("n_encoding_params", &Testbed::n_encoding_params, "Number of trainable parameters in the encoding")
 		.def("save_snapshot", &Testbed::save_snapshot, py::arg("path"), py::arg("include_optimizer_state")=false, py::arg("compress")=true, "Save a snapshot of the currently trained model. Optionally compressed (only when saving '.ingp' files).")
 		.def("load_snapshot", &Testbed::load_snapshot, py::arg("path"), "Load a previously saved snapshot")
+		.def("save_nerf_reference_outputs", &Testbed::save_nerf_reference_outputs, py::arg("path"), py::arg("n_samples")=1u<<16, "Save raw network outputs of random inputs, against which `CpuNerf.check_reference` can verify CPU inference.")
+		.def("bake_nerf", &Testbed::bake_nerf, py::arg("path"), py::arg("resolution")=512, py::arg("sh_degree")=1, py::arg("n_directions")=32, "Bake density and spherical harmonics color of the occupied parts of the render aabb into a sparse voxel file that `BakedNerf` can render without the network.")
+		.def("set_density_grid_shape", &Testbed::set_density_grid_shape, py::arg("shape"), "Change the size and cascade count of the NeRF density grid, resampling its current estimate.")
+		.def("check_density_grid_distance_field", &Testbed::check_density_grid_distance_field, py::arg("n_brute_force_samples")=1024, "Compare the density grid's distance field, which rendering uses to skip empty space, against a host implementation and a brute-force reference.")
+		.def("check_nerf_ray_compaction", &Testbed::check_nerf_ray_compaction, py::arg("n_rays")=1u<<16, "Compact random NeRF rays on the GPU and compare the result against a host compaction of the former array-of-structures ray layout.")
 		.def("load_camera_path", &Testbed::load_camera_path, py::arg("path"), "Load a camera path")
+		.def("skip_camera_path_frame", &Testbed::skip_camera_path_frame, "Advances camera smoothing and motion-blur state past a camera-path frame without rendering it.",
+			py::arg("start_t"),
+			py::arg("end_t"),
+			py::arg("fps") = 30.f
+		)
 		.def("load_file", &Testbed::load_file, py::arg("path"), "Load a file and automatically determine how to handle it. Can be a snapshot, dataset, network config, or camera path.")
 		.def_property("loop_animation", &Testbed::loop_animation, &Testbed::set_loop_animation)
+		.def_property("camera_path_constant_speed",
+			[](py::object& obj) { return obj.cast<Testbed&>().m_camera_path.constant_speed; },
+			[](const py::object& obj, bool value) { obj.cast<Testbed&>().m_camera_path.constant_speed = value; }
+		)
+		.def("camera_path_poses", [](Testbed& testbed, const std::vector<float>& ts, bool nerf_space) {
+			auto poses = testbed.camera_path_poses(ts, nerf_space);
+			py::array_t<float> result({(py::ssize_t)poses.size(), (py::ssize_t)3, (py::ssize_t)4});
+			float* data = (float*)result.request().ptr;
+			for (size_t i = 0; i < poses.size(); ++i) {
+				for (int r = 0; r < 3; ++r) {
+					for (int c = 0; c < 4; ++c) {
+						data[i * 12 + r * 4 + c] = poses[i][c][r];
+					}
+				}
+			}
+			return result;
+		}, "Evaluates the camera path at many times at once. Returns an array of shape (N,3,4) that can be passed to `render_batch`.",
+			py::arg("ts"),
+			py::arg("nerf_space") = true
+		)
 		.def("compute_and_save_png_slices", &Testbed::compute_and_save_png_slices,
 			py::arg("filename"),
 			py::arg("resolution") = ivec3(256),
@@ -501,6 +1114,11 @@ PYBIND11_MODULE(pyngp, m) {
 		.def_readwrite("autofocus_target", &Testbed::m_autofocus_target)
 		.def_readwrite("floor_enable", &Testbed::m_floor_enable)
 		.def_readwrite("exposure", &Testbed::m_exposure)
+		.def_readwrite("adaptive_sampling", &Testbed::m_adaptive_sampling)
+		.def_readwrite("progressive_tiles", &Testbed::m_progressive_tiles)
+		.def_readonly("multi_view_render_stats", &Testbed::m_multi_view_render_stats)
+		.def_readwrite("temporal_reprojection", &Testbed::m_temporal_reprojection)
+		.def_readonly("temporal_reprojection_stats", &Testbed::m_temporal_reprojection_stats)
 		.def_property("scale", &Testbed::scale, &Testbed::set_scale)
 		.def_readonly("bounding_radius", &Testbed::m_bounding_radius)
 		.def_readwrite("render_aabb", &Testbed::m_render_aabb)
@@ -509,6 +1127,7 @@ PYBIND11_MODULE(pyngp, m) {
 		.def_readwrite("raw_aabb", &Testbed::m_raw_aabb)
 		.def_property("fov", &Testbed::fov, &Testbed::set_fov)
 		.def_property("fov_xy", &Testbed::fov_xy, &Testbed::set_fov_xy)
+		.def_readwrite("relative_focal_length", &Testbed::m_relative_focal_length)
 		.def_readwrite("fov_axis", &Testbed::m_fov_axis)
 		.def_readwrite("zoom", &Testbed::m_zoom)
 		.def_readwrite("screen_center", &Testbed::m_screen_center)
@@ -568,10 +1187,579 @@ PYBIND11_MODULE(pyngp, m) {
 			[](py::object& obj) { return obj.cast<Testbed&>().root_dir().str(); },
 			[](const py::object& obj, const std::string& value) { obj.cast<Testbed&>().m_root_dir = value; }
 		)
+		.def_property_readonly("training_profiler", [](Testbed& testbed) -> TrainingProfiler& {
+			// Wait for outstanding device events, such that the profile is complete up to the current step.
+			testbed.poll_training_profiler(true);
+			return testbed.m_training_profiler;
+		}, "Per-phase timings of training steps. Disabled by default.")
+		;
+
+	py::class_<FrameChunk>(m, "FrameChunk")
+		.def_readonly("id", &FrameChunk::id)
+		.def_readonly("begin_frame", &FrameChunk::begin_frame)
+		.def_readonly("end_frame", &FrameChunk::end_frame)
+		;
+
+	py::class_<FrameRangeCoordinator>(m, "FrameRangeCoordinator")
+		.def(py::init<uint32_t, uint32_t, double>(), py::arg("n_frames"), py::arg("chunk_size"), py::arg("lease_timeout_seconds"))
+		.def("lease", [](FrameRangeCoordinator& c, const std::string& worker, double now) -> py::object {
+			FrameChunk chunk;
+			return c.lease(worker, now, chunk) ? py::cast(chunk) : py::none();
+		}, py::arg("worker"), py::arg("now"))
+		.def("heartbeat", &FrameRangeCoordinator::heartbeat, py::arg("worker"), py::arg("now"))
+		.def("complete", &FrameRangeCoordinator::complete, py::arg("worker"), py::arg("chunk_id"), py::arg("now"))
+		.def("expire", &FrameRangeCoordinator::expire, py::arg("now"))
+		.def("pop_assemblable_frames", &FrameRangeCoordinator::pop_assemblable_frames)
+		.def("finished", &FrameRangeCoordinator::finished)
+		;
+
+	py::class_<SpoolDirectoryCoordinator>(m, "SpoolDirectoryCoordinator")
+		.def(py::init<const fs::path&, uint32_t, uint32_t, double>(), py::arg("spool_dir"), py::arg("n_frames"), py::arg("chunk_size"), py::arg("lease_timeout_seconds") = 60.0)
+		.def("poll", &SpoolDirectoryCoordinator::poll, "Performs one round of coordination. Returns true once all frames are done.")
+		.def("pop_assemblable_frames", &SpoolDirectoryCoordinator::pop_assemblable_frames, "Frames that can be assembled in order since the last call.")
+		.def_property_readonly("frame_dir", [](const SpoolDirectoryCoordinator& c) { return c.frame_dir().str(); })
+		;
+
+	py::class_<SpoolDirectoryWorker>(m, "SpoolDirectoryWorker")
+		.def(py::init<const fs::path&, const std::string&>(), py::arg("spool_dir"), py::arg("id"))
+		.def("heartbeat", &SpoolDirectoryWorker::heartbeat)
+		.def("start_heartbeat_thread", &SpoolDirectoryWorker::start_heartbeat_thread, py::arg("interval_seconds"), "Heartbeat from a background thread, such that the lease survives frames that render for longer than the lease timeout.")
+		.def("next_chunk", [](SpoolDirectoryWorker& w) -> py::object {
+			FrameChunk chunk;
+			return w.next_chunk(chunk) ? py::cast(chunk) : py::none();
+		})
+		.def("complete", &SpoolDirectoryWorker::complete, py::arg("chunk"))
+		.def("finished", &SpoolDirectoryWorker::finished)
+		.def_property_readonly("frame_dir", [](const SpoolDirectoryWorker& w) { return w.frame_dir().str(); })
+		;
+
+	py::class_<AdaptiveSamplingSettings>(m, "AdaptiveSamplingSettings")
+		.def(py::init<>())
+		.def_readwrite("enabled", &AdaptiveSamplingSettings::enabled)
+		.def_property("tile_size",
+			[](const AdaptiveSamplingSettings& s) { return s.tile_size; },
+			[](AdaptiveSamplingSettings& s, uint32_t tile_size) {
+				if (tile_size == 0) {
+					throw std::runtime_error{"tile_size must be positive"};
+				}
+				s.tile_size = tile_size;
+			}
+		)
+		.def_readwrite("min_spp", &AdaptiveSamplingSettings::min_spp)
+		.def_readwrite("relative_variance_threshold", &AdaptiveSamplingSettings::relative_variance_threshold)
+		;
+
+	py::class_<ProgressiveTileSettings>(m, "ProgressiveTileSettings")
+		.def(py::init<>())
+		.def_readwrite("enabled", &ProgressiveTileSettings::enabled)
+		.def_readwrite("tile_size", &ProgressiveTileSettings::tile_size)
+		.def_readwrite("frame_budget_ms", &ProgressiveTileSettings::frame_budget_ms)
+		;
+
+	py::class_<Testbed::MultiViewRenderStats>(m, "MultiViewRenderStats")
+		.def_readonly("n_views", &Testbed::MultiViewRenderStats::n_views)
+		.def_readonly("ms", &Testbed::MultiViewRenderStats::ms)
+		.def_readonly("n_inference_batches", &Testbed::MultiViewRenderStats::n_inference_batches)
+		.def_readonly("occupancy", &Testbed::MultiViewRenderStats::occupancy)
+		.def_readonly("empty_space_steps_per_ray", &Testbed::MultiViewRenderStats::empty_space_steps_per_ray)
+		.def_readonly("per_view_ms", &Testbed::MultiViewRenderStats::per_view_ms)
+		.def_readonly("per_view_inference_batches", &Testbed::MultiViewRenderStats::per_view_inference_batches)
+		.def_readonly("per_view_occupancy", &Testbed::MultiViewRenderStats::per_view_occupancy)
+		.def_readonly("per_view_empty_space_steps_per_ray", &Testbed::MultiViewRenderStats::per_view_empty_space_steps_per_ray)
+		.def_readonly("speedup", &Testbed::MultiViewRenderStats::speedup)
+		;
+
+	py::class_<Testbed::LevelOfDetailBenchmark>(m, "LevelOfDetailBenchmark")
+		.def_readonly("distance", &Testbed::LevelOfDetailBenchmark::distance)
+		.def_readonly("full_ms", &Testbed::LevelOfDetailBenchmark::full_ms)
+		.def_readonly("full_msamples_per_second", &Testbed::LevelOfDetailBenchmark::full_msamples_per_second)
+		.def_readonly("lod_ms", &Testbed::LevelOfDetailBenchmark::lod_ms)
+		.def_readonly("lod_msamples_per_second", &Testbed::LevelOfDetailBenchmark::lod_msamples_per_second)
+		.def_readonly("lod_mean_levels", &Testbed::LevelOfDetailBenchmark::lod_mean_levels)
+		.def_readonly("n_levels", &Testbed::LevelOfDetailBenchmark::n_levels)
+		.def_readonly("speedup", &Testbed::LevelOfDetailBenchmark::speedup)
+		;
+
+	py::class_<Testbed::TrainingLoopBenchmark>(m, "TrainingLoopBenchmark")
+		.def_readonly("n_steps", &Testbed::TrainingLoopBenchmark::n_steps)
+		.def_readonly("per_step_steps_per_second", &Testbed::TrainingLoopBenchmark::per_step_steps_per_second)
+		.def_readonly("batched_steps_per_second", &Testbed::TrainingLoopBenchmark::batched_steps_per_second)
+		.def_readonly("speedup", &Testbed::TrainingLoopBenchmark::speedup)
+		;
+
+	py::class_<Testbed::ErrorMapSamplerBenchmark>(m, "ErrorMapSamplerBenchmark")
+		.def_readonly("n_images", &Testbed::ErrorMapSamplerBenchmark::n_images)
+		.def_readonly("resolution", &Testbed::ErrorMapSamplerBenchmark::resolution)
+		.def_readonly("touched_fraction", &Testbed::ErrorMapSamplerBenchmark::touched_fraction)
+		.def_readonly("cdf_build_ms", &Testbed::ErrorMapSamplerBenchmark::cdf_build_ms)
+		.def_readonly("alias_build_ms", &Testbed::ErrorMapSamplerBenchmark::alias_build_ms)
+		.def_readonly("alias_incremental_build_ms", &Testbed::ErrorMapSamplerBenchmark::alias_incremental_build_ms)
+		.def_readonly("host_build_ms", &Testbed::ErrorMapSamplerBenchmark::host_build_ms)
+		.def_readonly("host_incremental_build_ms", &Testbed::ErrorMapSamplerBenchmark::host_incremental_build_ms)
+		.def_readonly("cdf_msamples_per_second", &Testbed::ErrorMapSamplerBenchmark::cdf_msamples_per_second)
+		.def_readonly("alias_msamples_per_second", &Testbed::ErrorMapSamplerBenchmark::alias_msamples_per_second)
+		.def_readonly("max_pmf_difference", &Testbed::ErrorMapSamplerBenchmark::max_pmf_difference)
+		.def_readonly("max_alias_error", &Testbed::ErrorMapSamplerBenchmark::max_alias_error)
+		;
+
+	py::class_<DensityGridShape>(m, "DensityGridShape")
+		.def(py::init<>())
+		.def(py::init<uint32_t, uint32_t>(), py::arg("size"), py::arg("n_cascades"))
+		.def_readwrite("size", &DensityGridShape::size)
+		.def_readwrite("n_cascades", &DensityGridShape::n_cascades)
+		.def_property_readonly("n_cells", &DensityGridShape::n_cells)
+		;
+
+	py::class_<Testbed::DensityGridDistanceFieldCheck>(m, "DensityGridDistanceFieldCheck")
+		.def_readonly("n_cells", &Testbed::DensityGridDistanceFieldCheck::n_cells)
+		.def_readonly("n_mismatches", &Testbed::DensityGridDistanceFieldCheck::n_mismatches)
+		.def_readonly("host_ms", &Testbed::DensityGridDistanceFieldCheck::host_ms)
+		.def_readonly("n_brute_force_samples", &Testbed::DensityGridDistanceFieldCheck::n_brute_force_samples)
+		.def_readonly("n_brute_force_mismatches", &Testbed::DensityGridDistanceFieldCheck::n_brute_force_mismatches)
+		.def_readonly("mean_distance", &Testbed::DensityGridDistanceFieldCheck::mean_distance)
+		;
+
+	py::class_<Testbed::NerfRayCompactionCheck>(m, "NerfRayCompactionCheck")
+		.def_readonly("n_rays", &Testbed::NerfRayCompactionCheck::n_rays)
+		.def_readonly("n_alive", &Testbed::NerfRayCompactionCheck::n_alive)
+		.def_readonly("n_hit", &Testbed::NerfRayCompactionCheck::n_hit)
+		.def_readonly("n_mismatches", &Testbed::NerfRayCompactionCheck::n_mismatches)
+		.def_readonly("aos_bytes_per_ray", &Testbed::NerfRayCompactionCheck::aos_bytes_per_ray)
+		.def_readonly("soa_bytes_per_ray", &Testbed::NerfRayCompactionCheck::soa_bytes_per_ray)
+		;
+
+	py::class_<TemporalReprojectionSettings>(m, "TemporalReprojectionSettings")
+		.def(py::init<>())
+		.def_readwrite("enabled", &TemporalReprojectionSettings::enabled)
+		.def_readwrite("depth_tolerance", &TemporalReprojectionSettings::depth_tolerance)
+		.def_readwrite("min_normal_cos", &TemporalReprojectionSettings::min_normal_cos)
+		.def_readwrite("max_age", &TemporalReprojectionSettings::max_age)
+		.def_readwrite("measure_quality", &TemporalReprojectionSettings::measure_quality)
+		;
+
+	py::class_<TemporalReprojectionStats>(m, "TemporalReprojectionStats")
+		.def_readonly("n_frames", &TemporalReprojectionStats::n_frames)
+		.def_readonly("reused_fraction", &TemporalReprojectionStats::reused_fraction)
+		.def_readonly("mean_reused_fraction", &TemporalReprojectionStats::mean_reused_fraction)
+		.def_readonly("n_measured_frames", &TemporalReprojectionStats::n_measured_frames)
+		.def_readonly("psnr", &TemporalReprojectionStats::psnr)
+		.def_readonly("mean_psnr", &TemporalReprojectionStats::mean_psnr)
+		;
+
+	py::enum_<ECpuIsa>(m, "CpuIsa")
+		.value("Scalar", ECpuIsa::Scalar)
+		.value("Avx2", ECpuIsa::Avx2)
+		.value("Avx512", ECpuIsa::Avx512)
+		.export_values();
+
+	py::class_<CpuNerfReferenceCheck>(m, "CpuNerfReferenceCheck")
+		.def_readonly("n_samples", &CpuNerfReferenceCheck::n_samples)
+		.def_readonly("max_abs_error", &CpuNerfReferenceCheck::max_abs_error)
+		.def_readonly("mean_abs_error", &CpuNerfReferenceCheck::mean_abs_error)
+		.def_readonly("n_failed", &CpuNerfReferenceCheck::n_failed)
+		.def_property_readonly("passed", &CpuNerfReferenceCheck::passed)
+		;
+
+	py::class_<CpuNerfBenchmarkResult>(m, "CpuNerfBenchmarkResult")
+		.def_readonly("n_threads", &CpuNerfBenchmarkResult::n_threads)
+		.def_readonly("msamples_per_second", &CpuNerfBenchmarkResult::msamples_per_second)
+		.def_readonly("parallel_efficiency", &CpuNerfBenchmarkResult::parallel_efficiency)
+		;
+
+	py::class_<CpuNerfRenderStats>(m, "CpuNerfRenderStats")
+		.def_readonly("n_rays", &CpuNerfRenderStats::n_rays)
+		.def_readonly("n_samples", &CpuNerfRenderStats::n_samples)
+		.def_readonly("ms", &CpuNerfRenderStats::ms)
+		.def_property_readonly("msamples_per_second", &CpuNerfRenderStats::msamples_per_second)
+		;
+
+	py::class_<CpuNerf>(m, "CpuNerf")
+		.def(py::init<const fs::path&>(), py::arg("snapshot_path"), "Loads a NeRF snapshot for inference and rendering on the CPU.")
+		.def("inference", [](CpuNerf& cpu_nerf, py::array_t<float, py::array::c_style | py::array::forcecast> inputs) {
+			py::buffer_info buf = inputs.request();
+			if (buf.ndim != 2 || buf.shape[1] != (py::ssize_t)cpu_nerf.n_input_dims()) {
+				throw std::runtime_error{fmt::format("inputs should be (N,{})", cpu_nerf.n_input_dims())};
+			}
+
+			size_t n = (size_t)buf.shape[0];
+			py::array_t<float> result({(py::ssize_t)n, (py::ssize_t)4});
+			const float* in = (const float*)buf.ptr;
+			float* out = (float*)result.request().ptr;
+			{
+				py::gil_scoped_release release;
+				cpu_nerf.inference(in, out, n);
+			}
+			return result;
+		}, "Raw network outputs (N,4), i.e. color and density before their activations, of inputs (N,7) laid out like NerfCoordinate.", py::arg("inputs"))
+		.def("render", [](CpuNerf& cpu_nerf, int width, int height, py::object camera_matrix, py::object focal_length) {
+			ivec2 resolution = {width, height};
+			mat4x3 camera = camera_matrix.is_none() ? cpu_nerf.camera() : cpu_nerf.nerf_matrix_to_ngp(camera_matrix.cast<mat4x3>());
+			vec2 focal = focal_length.is_none() ? cpu_nerf.focal_length(resolution) : focal_length.cast<vec2>();
+
+			std::vector<vec4> frame;
+			{
+				py::gil_scoped_release release;
+				frame = cpu_nerf.render(resolution, camera, focal, cpu_nerf.screen_center());
+			}
+
+			py::array_t<float> result({height, width, 4});
+			std::memcpy(result.request().ptr, frame.data(), frame.size() * sizeof(vec4));
+			return result;
+		}, "Renders linear, premultiplied RGBA (H,W,4) on the CPU. Defaults to the snapshot's camera and focal length; `camera_matrix` is a (3,4) pose in NeRF convention.",
+			py::arg("width"),
+			py::arg("height"),
+			py::arg("camera_matrix") = py::none(),
+			py::arg("focal_length") = py::none()
+		)
+		.def("check_reference", &CpuNerf::check_reference, py::call_guard<py::gil_scoped_release>(), "Compares CPU inference against outputs saved by `Testbed.save_nerf_reference_outputs` for the same snapshot.",
+			py::arg("path"),
+			py::arg("abs_tolerance") = 5e-2f,
+			py::arg("rel_tolerance") = 2e-2f
+		)
+		.def("benchmark", &CpuNerf::benchmark, py::call_guard<py::gil_scoped_release>(), "Measures inference throughput for each of the given thread counts.",
+			py::arg("n_samples") = 1u<<20,
+			py::arg("thread_counts") = std::vector<uint32_t>{std::thread::hardware_concurrency()},
+			py::arg("n_repetitions") = 3
+		)
+		.def_property("n_threads", &CpuNerf::n_threads, &CpuNerf::set_n_threads)
+		.def_property("isa", &CpuNerf::isa, &CpuNerf::set_isa)
+		.def_readwrite("cone_angle_constant", &CpuNerf::cone_angle_constant)
+		.def_readwrite("min_transmittance", &CpuNerf::min_transmittance)
+		.def_property_readonly("render_stats", &CpuNerf::render_stats)
+		.def_property_readonly("architecture", &CpuNerf::architecture)
+		;
+
+	py::class_<BakedNerfRenderStats>(m, "BakedNerfRenderStats")
+		.def_readonly("n_rays", &BakedNerfRenderStats::n_rays)
+		.def_readonly("n_samples", &BakedNerfRenderStats::n_samples)
+		.def_readonly("ms", &BakedNerfRenderStats::ms)
+		.def_property_readonly("fps", &BakedNerfRenderStats::fps)
+		;
+
+	py::class_<BakedNerf>(m, "BakedNerf")
+		.def(py::init<const fs::path&>(), py::arg("path"), "Loads a NeRF baked by `Testbed.bake_nerf` for rendering on the CPU.")
+		.def("render", [](BakedNerf& baked_nerf, int width, int height, py::object camera_matrix, py::object focal_length) {
+			ivec2 resolution = {width, height};
+			mat4x3 camera = camera_matrix.is_none() ? baked_nerf.camera() : camera_matrix.cast<mat4x3>();
+			vec2 focal = focal_length.is_none() ? baked_nerf.focal_length(resolution) : focal_length.cast<vec2>();
+
+			std::vector<vec4> frame;
+			{
+				py::gil_scoped_release release;
+				frame = baked_nerf.render(resolution, camera, focal, baked_nerf.screen_center());
+			}
+
+			py::array_t<float> result({height, width, 4});
+			std::memcpy(result.request().ptr, frame.data(), frame.size() * sizeof(vec4));
+			return result;
+		}, "Renders linear, premultiplied RGBA (H,W,4) on the CPU. Defaults to the camera and focal length at the time of baking; `camera_matrix` is a (3,4) pose like `Testbed.camera_matrix`.",
+			py::arg("width"),
+			py::arg("height"),
+			py::arg("camera_matrix") = py::none(),
+			py::arg("focal_length") = py::none()
+		)
+		.def_property("n_threads", &BakedNerf::n_threads, &BakedNerf::set_n_threads)
+		.def_readwrite("step_size", &BakedNerf::step_size)
+		.def_readwrite("min_transmittance", &BakedNerf::min_transmittance)
+		.def_property_readonly("render_stats", &BakedNerf::render_stats)
+		.def_property_readonly("n_bytes", &BakedNerf::n_bytes)
+		.def_property_readonly("sh_degree", [](const BakedNerf& baked_nerf) { return baked_nerf.header().sh_degree; })
+		.def_property_readonly("n_allocated_bricks", [](const BakedNerf& baked_nerf) { return baked_nerf.header().n_allocated_bricks; })
+		.def_property_readonly("voxel_size", [](const BakedNerf& baked_nerf) { return baked_nerf.header().voxel_size; })
+		;
+
+	py::class_<NerfSceneCamera>(m, "NerfSceneCamera")
+		.def(py::init<>())
+		.def_readwrite("camera", &NerfSceneCamera::camera)
+		.def_readwrite("resolution", &NerfSceneCamera::resolution)
+		.def_readwrite("focal_length", &NerfSceneCamera::focal_length)
+		.def_readwrite("screen_center", &NerfSceneCamera::screen_center)
+		.def_readwrite("near_distance", &NerfSceneCamera::near_distance)
+		.def_readwrite("far_distance", &NerfSceneCamera::far_distance)
+		;
+
+	py::class_<NerfScenePartitionCheck>(m, "NerfScenePartitionCheck")
+		.def_readonly("n_rays", &NerfScenePartitionCheck::n_rays)
+		.def_readonly("n_culling_errors", &NerfScenePartitionCheck::n_culling_errors)
+		.def_readonly("n_order_errors", &NerfScenePartitionCheck::n_order_errors)
+		.def_readonly("n_residency_frames", &NerfScenePartitionCheck::n_residency_frames)
+		.def_readonly("n_residency_errors", &NerfScenePartitionCheck::n_residency_errors)
+		;
+
+	py::class_<NerfScenePartition>(m, "NerfScenePartition")
+		.def(py::init<const vec3&, const vec3&, const ivec3&>(), py::arg("origin"), py::arg("block_size"), py::arg("n_blocks"))
+		.def_static("load", &NerfScenePartition::load, py::arg("path"), "Loads the JSON index of a partitioned scene.")
+		.def("add_block", &NerfScenePartition::add_block, py::arg("cell"), py::arg("snapshot"), py::arg("n_bytes") = 0)
+		.def_property_readonly("n_blocks", [](const NerfScenePartition& partition) { return partition.blocks().size(); })
+		.def("visible_blocks", &NerfScenePartition::visible_blocks, py::arg("camera"), "Blocks that the camera sees, front to back.")
+		.def("check", &check_nerf_scene_partition, py::arg("n_views") = 64, py::arg("n_rays_per_view") = 256, "Compares culling, ordering, and residency against brute-force references.")
+		;
+
+	py::class_<NerfSceneRenderStats>(m, "NerfSceneRenderStats")
+		.def_readonly("n_visible_blocks", &NerfSceneRenderStats::n_visible_blocks)
+		.def_readonly("n_rendered_blocks", &NerfSceneRenderStats::n_rendered_blocks)
+		.def_readonly("n_loaded_blocks", &NerfSceneRenderStats::n_loaded_blocks)
+		.def_readonly("n_evicted_blocks", &NerfSceneRenderStats::n_evicted_blocks)
+		.def_readonly("n_skipped_blocks", &NerfSceneRenderStats::n_skipped_blocks)
+		.def_readonly("load_ms", &NerfSceneRenderStats::load_ms)
+		.def_readonly("render_ms", &NerfSceneRenderStats::render_ms)
+		;
+
+	py::class_<NerfScene>(m, "NerfScene")
+		.def(py::init<const fs::path&, size_t>(), py::arg("path"), py::arg("memory_budget_bytes"), "Loads the index of a scene that is partitioned into separately trained NeRF blocks.")
+		.def("render", [](NerfScene& scene, const NerfSceneCamera& camera) {
+			std::vector<vec4> frame;
+			{
+				py::gil_scoped_release release;
+				frame = scene.render(camera);
+			}
+
+			py::array_t<float> result({camera.resolution.y, camera.resolution.x, 4});
+			std::memcpy(result.request().ptr, frame.data(), frame.size() * sizeof(vec4));
+			return result;
+		}, "Renders linear, premultiplied RGBA (H,W,4) from the visible blocks, loading and evicting blocks as needed.", py::arg("camera"))
+		.def_property_readonly("partition", &NerfScene::partition, py::return_value_policy::reference_internal)
+		.def_property_readonly("n_resident_blocks", [](const NerfScene& scene) { return scene.residency().n_resident(); })
+		.def_property_readonly("n_resident_bytes", [](const NerfScene& scene) { return scene.residency().n_resident_bytes(); })
+		.def("set_memory_budget", &NerfScene::set_memory_budget, py::arg("memory_budget_bytes"))
+		.def_readwrite("min_transmittance", &NerfScene::min_transmittance)
+		.def_property_readonly("render_stats", &NerfScene::render_stats)
+		;
+
+	py::class_<HashGridLevelAnalysis>(m, "HashGridLevelAnalysis")
+		.def_readonly("resolution", &HashGridLevelAnalysis::resolution)
+		.def_readonly("dense_size", &HashGridLevelAnalysis::dense_size)
+		.def_readonly("hashmap_size", &HashGridLevelAnalysis::hashmap_size)
+		.def_readonly("n_occupied_vertices", &HashGridLevelAnalysis::n_occupied_vertices)
+		.def_readonly("subsampled", &HashGridLevelAnalysis::subsampled)
+		.def_readonly("collision_rates", &HashGridLevelAnalysis::collision_rates)
+		.def_readonly("collision_rate", &HashGridLevelAnalysis::collision_rate)
+		.def_readonly("suggested_size", &HashGridLevelAnalysis::suggested_size)
+		.def_readonly("suggested_collision_rate", &HashGridLevelAnalysis::suggested_collision_rate)
+		.def_property_readonly("load_factor", &HashGridLevelAnalysis::load_factor)
+		;
+
+	py::class_<HashGridAnalysis>(m, "HashGridAnalysis")
+		.def_readonly("min_log2_size", &HashGridAnalysis::min_log2_size)
+		.def_readonly("max_log2_size", &HashGridAnalysis::max_log2_size)
+		.def_readonly("n_features_per_level", &HashGridAnalysis::n_features_per_level)
+		.def_readonly("log2_hashmap_size", &HashGridAnalysis::log2_hashmap_size)
+		.def_readonly("n_occupied_cells", &HashGridAnalysis::n_occupied_cells)
+		.def_readonly("levels", &HashGridAnalysis::levels)
+		.def_readonly("n_bytes", &HashGridAnalysis::n_bytes)
+		.def_readonly("budget_bytes", &HashGridAnalysis::budget_bytes)
+		.def_readonly("suggested_n_bytes", &HashGridAnalysis::suggested_n_bytes)
+		.def_readonly("suggested_log2_hashmap_size", &HashGridAnalysis::suggested_log2_hashmap_size)
+		.def_readonly("suggested_uniform_n_bytes", &HashGridAnalysis::suggested_uniform_n_bytes)
+		.def_readonly("collision_rate", &HashGridAnalysis::collision_rate)
+		.def_readonly("suggested_collision_rate", &HashGridAnalysis::suggested_collision_rate)
+		.def_readonly("suggested_uniform_collision_rate", &HashGridAnalysis::suggested_uniform_collision_rate)
+		.def_readonly("network_config", &HashGridAnalysis::network_config)
+		.def("tuned_network_config", &HashGridAnalysis::tuned_network_config, "The snapshot's network config with the suggested uniform hash table size.")
+		.def_readonly("ms", &HashGridAnalysis::ms)
+		;
+
+	m.def("analyze_hash_grid", &analyze_hash_grid,
+		"Simulates the hash grid indexing of a NeRF snapshot's occupied space to measure collisions per level and table size, and suggests table sizes for a memory budget. Runs on the CPU.",
+		py::arg("snapshot"),
+		py::arg("budget_bytes") = 0,
+		py::arg("max_vertices_per_level") = (size_t)1 << 24
+	);
+
+	py::enum_<ETrainingPhase>(m, "TrainingPhase")
+		.value("Step", ETrainingPhase::Step)
+		.value("Prep", ETrainingPhase::Prep)
+		.value("GenerateSamples", ETrainingPhase::GenerateSamples)
+		.value("Inference", ETrainingPhase::Inference)
+		.value("Loss", ETrainingPhase::Loss)
+		.value("ForwardBackward", ETrainingPhase::ForwardBackward)
+		.value("InputGradients", ETrainingPhase::InputGradients)
+		.value("OptimizerStep", ETrainingPhase::OptimizerStep)
+		.value("CounterReadback", ETrainingPhase::CounterReadback)
+		.value("ErrorMapCdf", ETrainingPhase::ErrorMapCdf)
+		.value("ExtraDimsUpdate", ETrainingPhase::ExtraDimsUpdate)
+		.value("CameraUpdate", ETrainingPhase::CameraUpdate)
+		.export_values();
+
+	py::enum_<ETrainingTrack>(m, "TrainingTrack")
+		.value("Host", ETrainingTrack::Host)
+		.value("Device", ETrainingTrack::Device)
+		.export_values();
+
+	py::class_<TrainingPhaseStats>(m, "TrainingPhaseStats")
+		.def_readonly("phase", &TrainingPhaseStats::phase)
+		.def_readonly("track", &TrainingPhaseStats::track)
+		.def_readonly("count", &TrainingPhaseStats::count)
+		.def_readonly("total_ms", &TrainingPhaseStats::total_ms)
+		.def_readonly("mean_ms", &TrainingPhaseStats::mean_ms)
+		.def_readonly("min_ms", &TrainingPhaseStats::min_ms)
+		.def_readonly("p50_ms", &TrainingPhaseStats::p50_ms)
+		.def_readonly("p90_ms", &TrainingPhaseStats::p90_ms)
+		.def_readonly("p99_ms", &TrainingPhaseStats::p99_ms)
+		.def_readonly("max_ms", &TrainingPhaseStats::max_ms)
+		;
+
+	py::class_<TrainingProfiler>(m, "TrainingProfiler")
+		.def(py::init<>())
+		.def_property("enabled", &TrainingProfiler::enabled, &TrainingProfiler::set_enabled)
+		.def("set_trace_range", &TrainingProfiler::set_trace_range, "Keep the individual events of steps in [begin_step, end_step) for the Chrome trace.", py::arg("begin_step"), py::arg("end_step"))
+		.def_property_readonly("trace_begin_step", &TrainingProfiler::trace_begin_step)
+		.def_property_readonly("trace_end_step", &TrainingProfiler::trace_end_step)
+		.def_readwrite("max_trace_events", &TrainingProfiler::max_trace_events)
+		.def("record", &TrainingProfiler::record, "Adds a duration to the phase's histogram and, within the trace range, to the trace.",
+			py::arg("phase"),
+			py::arg("track"),
+			py::arg("step"),
+			py::arg("start_us"),
+			py::arg("duration_us")
+		)
+		.def_property_readonly("n_events", [](const TrainingProfiler& profiler) { return profiler.events().size(); })
+		.def_property_readonly("n_dropped_events", &TrainingProfiler::n_dropped_events)
+		.def("stats", &TrainingProfiler::stats, "Count, mean and percentiles of each phase and track.")
+		.def("summary", &TrainingProfiler::summary)
+		.def("chrome_trace", &TrainingProfiler::chrome_trace)
+		.def("save_chrome_trace", &TrainingProfiler::save_chrome_trace, py::arg("path"))
+		.def("reset", &TrainingProfiler::reset)
 		;
 
+	py::enum_<ETrainingDecision>(m, "TrainingDecisionType")
+		.value("ProbeBatchSize", ETrainingDecision::ProbeBatchSize)
+		.value("BatchSize", ETrainingDecision::BatchSize)
+		.value("DensityGridInterval", ETrainingDecision::DensityGridInterval)
+		.value("Stop", ETrainingDecision::Stop)
+		.export_values();
+
+	py::enum_<ETrainingStopReason>(m, "TrainingStopReason")
+		.value("None", ETrainingStopReason::None)
+		.value("StepBudget", ETrainingStopReason::StepBudget)
+		.value("TimeBudget", ETrainingStopReason::TimeBudget)
+		.value("Converged", ETrainingStopReason::Converged)
+		.value("Aborted", ETrainingStopReason::Aborted)
+		.export_values();
+
+	py::class_<TrainingDecision>(m, "TrainingDecision")
+		.def_readonly("type", &TrainingDecision::type)
+		.def_readonly("step", &TrainingDecision::step)
+		.def_readonly("elapsed_seconds", &TrainingDecision::elapsed_seconds)
+		.def_readonly("batch_size", &TrainingDecision::batch_size)
+		.def_readonly("density_grid_interval", &TrainingDecision::density_grid_interval)
+		.def_readonly("stop_reason", &TrainingDecision::stop_reason)
+		.def_readonly("reason", &TrainingDecision::reason)
+		;
+
+	py::class_<TrainingEvaluation>(m, "TrainingEvaluation")
+		.def_readonly("step", &TrainingEvaluation::step)
+		.def_readonly("elapsed_seconds", &TrainingEvaluation::elapsed_seconds)
+		.def_readonly("loss", &TrainingEvaluation::loss)
+		;
+
+	py::class_<TrainingScheduleConfig>(m, "TrainingScheduleConfig")
+		.def(py::init<>())
+		.def_readwrite("time_budget_seconds", &TrainingScheduleConfig::time_budget_seconds)
+		.def_readwrite("step_budget", &TrainingScheduleConfig::step_budget)
+		.def_readwrite("decision_interval", &TrainingScheduleConfig::decision_interval)
+		.def_readwrite("tune_batch_size", &TrainingScheduleConfig::tune_batch_size)
+		.def_readwrite("min_batch_size", &TrainingScheduleConfig::min_batch_size)
+		.def_readwrite("max_batch_size", &TrainingScheduleConfig::max_batch_size)
+		.def_readwrite("n_probe_warmup_steps", &TrainingScheduleConfig::n_probe_warmup_steps)
+		.def_readwrite("n_probe_steps", &TrainingScheduleConfig::n_probe_steps)
+		.def_readwrite("throughput_tolerance", &TrainingScheduleConfig::throughput_tolerance)
+		.def_readwrite("tune_density_grid_interval", &TrainingScheduleConfig::tune_density_grid_interval)
+		.def_readwrite("max_density_grid_overhead", &TrainingScheduleConfig::max_density_grid_overhead)
+		.def_readwrite("max_density_grid_interval", &TrainingScheduleConfig::max_density_grid_interval)
+		.def_readwrite("eval_interval", &TrainingScheduleConfig::eval_interval)
+		.def_readwrite("patience", &TrainingScheduleConfig::patience)
+		.def_readwrite("min_relative_improvement", &TrainingScheduleConfig::min_relative_improvement)
+		.def_readwrite("min_steps", &TrainingScheduleConfig::min_steps)
+		;
+
+	// Can be driven by synthetic step times and losses to try out a schedule without training.
+	py::class_<TrainingScheduler>(m, "TrainingScheduler")
+		.def(py::init<const TrainingScheduleConfig&, uint32_t, uint32_t>(), py::arg("config"), py::arg("start_step") = 0, py::arg("batch_size") = 1 << 18)
+		.def(py::init([](const TrainingScheduleConfig& config, uint32_t start_step, const nlohmann::json& replay) {
+			return TrainingScheduler{config, start_step, replay.get<std::vector<TrainingDecision>>()};
+		}), py::arg("config"), py::arg("start_step"), py::arg("replay"))
+		.def_property_readonly("config", &TrainingScheduler::config)
+		.def_property_readonly("replaying", &TrainingScheduler::replaying)
+		.def_property_readonly("step", &TrainingScheduler::step)
+		.def_property_readonly("n_steps_done", &TrainingScheduler::n_steps_done)
+		.def_property_readonly("elapsed_seconds", &TrainingScheduler::elapsed_seconds)
+		.def_property_readonly("batch_size", &TrainingScheduler::batch_size)
+		.def_property_readonly("density_grid_interval", &TrainingScheduler::density_grid_interval)
+		.def_property_readonly("done", &TrainingScheduler::done)
+		.def_property_readonly("stop_reason", &TrainingScheduler::stop_reason)
+		.def_property_readonly("wants_evaluation", &TrainingScheduler::wants_evaluation)
+		.def("next_chunk_steps", &TrainingScheduler::next_chunk_steps)
+		.def("observe_steps", &TrainingScheduler::observe_steps, "Reports steps that took `seconds`, of which `prep_seconds` went into `n_preps` density grid updates.",
+			py::arg("n_steps"),
+			py::arg("seconds"),
+			py::arg("prep_seconds") = 0.0,
+			py::arg("n_preps") = 0
+		)
+		.def("observe_evaluation", &TrainingScheduler::observe_evaluation, py::arg("loss"), py::arg("seconds") = 0.0)
+		.def("abort", &TrainingScheduler::abort, py::arg("reason"))
+		.def_property_readonly("decisions", &TrainingScheduler::decisions)
+		.def_property_readonly("decisions_json", [](const TrainingScheduler& scheduler) { return nlohmann::json(scheduler.decisions()); }, "The decisions in the form that replays them.")
+		.def_property_readonly("evaluations", &TrainingScheduler::evaluations)
+		.def_property_readonly("best_loss", &TrainingScheduler::best_loss)
+		.def_property_readonly("measured_throughput", &TrainingScheduler::measured_throughput)
+		.def_property_readonly("step_ms", &TrainingScheduler::step_ms)
+		.def_property_readonly("density_grid_update_ms", &TrainingScheduler::density_grid_update_ms)
+		;
+
+	py::class_<DensityGridScheduleConfig>(m, "DensityGridScheduleConfig")
+		.def(py::init<>())
+		.def_readwrite("enabled", &DensityGridScheduleConfig::enabled)
+		.def_readwrite("target_flip_rate", &DensityGridScheduleConfig::target_flip_rate)
+		.def_readwrite("max_interval_multiplier", &DensityGridScheduleConfig::max_interval_multiplier)
+		.def_readwrite("min_sample_fraction", &DensityGridScheduleConfig::min_sample_fraction)
+		.def_readwrite("restrict_to_changed_cascades", &DensityGridScheduleConfig::restrict_to_changed_cascades)
+		.def_readwrite("max_skipped_updates", &DensityGridScheduleConfig::max_skipped_updates)
+		.def_readwrite("warmup_steps", &DensityGridScheduleConfig::warmup_steps)
+		;
+
+	py::class_<DensityGridSchedule>(m, "DensityGridSchedule")
+		.def_property_readonly("config", &DensityGridSchedule::config)
+		.def_property_readonly("flip_rate", &DensityGridSchedule::flip_rate, "Fraction of the occupancy bits that flipped per training step in the most recently measured update.")
+		.def_property_readonly("cascade_flip_rates", &DensityGridSchedule::cascade_flip_rates)
+		.def_property_readonly("n_measurements", &DensityGridSchedule::n_measurements)
+		.def("interval_multiplier", &DensityGridSchedule::interval_multiplier, py::arg("step"))
+		.def("sample_fraction", &DensityGridSchedule::sample_fraction, py::arg("step"))
+		.def_property_readonly("n_updates", &DensityGridSchedule::n_updates)
+		.def_property_readonly("n_default_updates", &DensityGridSchedule::n_default_updates, "Updates that the default schedule would have done over the same steps.")
+		.def_property_readonly("n_queries", &DensityGridSchedule::n_queries)
+		.def_property_readonly("n_default_queries", &DensityGridSchedule::n_default_queries, "Network queries that the default schedule would have issued over the same steps.")
+		.def_property_readonly("n_queries_saved", &DensityGridSchedule::n_queries_saved)
+		;
+
+	py::class_<BatchedAdamBenchmark>(m, "BatchedAdamBenchmark")
+		.def_readonly("n_items", &BatchedAdamBenchmark::n_items)
+		.def_readonly("dims", &BatchedAdamBenchmark::dims)
+		.def_readonly("n_steps", &BatchedAdamBenchmark::n_steps)
+		.def_readonly("per_item_ms", &BatchedAdamBenchmark::per_item_ms)
+		.def_readonly("batched_ms", &BatchedAdamBenchmark::batched_ms)
+		.def_readonly("batched_parallel_ms", &BatchedAdamBenchmark::batched_parallel_ms)
+		.def_readonly("gpu_ms", &BatchedAdamBenchmark::gpu_ms)
+		.def_readonly("max_abs_difference", &BatchedAdamBenchmark::max_abs_difference)
+		.def_readonly("max_abs_difference_gpu", &BatchedAdamBenchmark::max_abs_difference_gpu)
+		;
+
+	m.def("benchmark_batched_adam", [](uint32_t n_items, uint32_t dims, uint32_t n_steps) {
+			ThreadPool pool;
+			return benchmark_batched_adam(n_items, dims, n_steps, &pool);
+		},
+		py::call_guard<py::gil_scoped_release>(),
+		"Times one Adam optimizer per item, as the training loop used to step per-camera parameters, against the batched optimizer on one thread, on all threads and on the GPU, and checks that their results agree.",
+		py::arg("n_items") = 10000,
+		py::arg("dims") = 3,
+		py::arg("n_steps") = 100
+	);
+
+	m.def("cpu_supports", &cpu_supports, py::arg("isa"), "Whether this build and the executing CPU support the given instruction set.");
+
 	py::class_<Lens> lens(m, "Lens");
 	lens
+		.def("__copy__", [](const Lens& self) { return Lens(self); })
 		.def_readwrite("mode", &Lens::mode)
 		.def_property_readonly("params", [](py::object& obj) {
 			Lens& o = obj.cast<Lens&>();
@@ -593,7 +1781,12 @@ PYBIND11_MODULE(pyngp, m) {
 		.def_readwrite("render_lens", &Testbed::Nerf::render_lens)
 		.def_readwrite("rendering_min_transmittance", &Testbed::Nerf::render_min_transmittance)
 		.def_readwrite("render_min_transmittance", &Testbed::Nerf::render_min_transmittance)
+		.def_readwrite("render_views_in_one_trace", &Testbed::Nerf::render_views_in_one_trace)
+		.def_readwrite("render_lod", &Testbed::Nerf::render_lod)
+		.def_readwrite("render_lod_bias", &Testbed::Nerf::render_lod_bias)
 		.def_readwrite("cone_angle_constant", &Testbed::Nerf::cone_angle_constant)
+		.def_readwrite("skip_empty_space_with_distance_field", &Testbed::Nerf::skip_empty_space_with_distance_field)
+		.def_readonly("density_grid_shape", &Testbed::Nerf::density_grid_shape)
 		.def_readwrite("visualize_cameras", &Testbed::Nerf::visualize_cameras)
 		.def_readwrite("glow_y_cutoff", &Testbed::Nerf::glow_y_cutoff)
 		.def_readwrite("glow_mode", &Testbed::Nerf::glow_mode)
@@ -644,23 +1837,32 @@ PYBIND11_MODULE(pyngp, m) {
 	py::class_<Testbed::Nerf::Training>(nerf, "Training")
 		.def_readwrite("random_bg_color", &Testbed::Nerf::Training::random_bg_color)
 		.def_readwrite("n_images_for_training", &Testbed::Nerf::Training::n_images_for_training)
+		.def_readwrite("view", &Testbed::Nerf::Training::view)
 		.def_readwrite("linear_colors", &Testbed::Nerf::Training::linear_colors)
 		.def_readwrite("loss_type", &Testbed::Nerf::Training::loss_type)
 		.def_readwrite("depth_loss_type", &Testbed::Nerf::Training::depth_loss_type)
 		.def_readwrite("snap_to_pixel_centers", &Testbed::Nerf::Training::snap_to_pixel_centers)
 		.def_readwrite("optimize_extrinsics", &Testbed::Nerf::Training::optimize_extrinsics)
 		.def_readwrite("optimize_extra_dims", &Testbed::Nerf::Training::optimize_extra_dims)
+		.def_readwrite("optimize_extra_dims_on_gpu", &Testbed::Nerf::Training::optimize_extra_dims_on_gpu)
 		.def_readwrite("optimize_exposure", &Testbed::Nerf::Training::optimize_exposure)
 		.def_readwrite("optimize_distortion", &Testbed::Nerf::Training::optimize_distortion)
 		.def_readwrite("optimize_focal_length", &Testbed::Nerf::Training::optimize_focal_length)
 		.def_readwrite("n_steps_between_cam_updates", &Testbed::Nerf::Training::n_steps_between_cam_updates)
 		.def_readwrite("sample_focal_plane_proportional_to_error", &Testbed::Nerf::Training::sample_focal_plane_proportional_to_error)
 		.def_readwrite("sample_image_proportional_to_error", &Testbed::Nerf::Training::sample_image_proportional_to_error)
+		.def_readwrite("error_map_sampler", &Testbed::Nerf::Training::error_map_sampler)
 		.def_readwrite("include_sharpness_in_error", &Testbed::Nerf::Training::include_sharpness_in_error)
 		.def_readonly("transforms", &Testbed::Nerf::Training::transforms)
 		//.def_readonly("focal_lengths", &Testbed::Nerf::Training::focal_lengths) // use training.dataset.metadata instead
 		.def_readwrite("near_distance", &Testbed::Nerf::Training::near_distance)
 		.def_readwrite("density_grid_decay", &Testbed::Nerf::Training::density_grid_decay)
+		.def_property("density_grid_schedule_config",
+			[](const Testbed::Nerf::Training& training) { return training.density_grid_schedule.config(); },
+			[](Testbed::Nerf::Training& training, const DensityGridScheduleConfig& config) { training.density_grid_schedule.set_config(config); },
+			"Adapts the density grid updates to the rate at which occupancy changes. Setting it resets the schedule's statistics."
+		)
+		.def_readonly("density_grid_schedule", &Testbed::Nerf::Training::density_grid_schedule)
 		.def_readwrite("extrinsic_l2_reg", &Testbed::Nerf::Training::extrinsic_l2_reg)
 		.def_readwrite("extrinsic_learning_rate", &Testbed::Nerf::Training::extrinsic_learning_rate)
 		.def_readwrite("intrinsic_l2_reg", &Testbed::Nerf::Training::intrinsic_l2_reg)
@@ -21,6 +21,8 @@
 
 #include <filesystem/path.h>
 
+#include <cuda_fp16.h>
+
 #ifdef NGP_GUI
 #  ifdef _WIN32
 #    include <GL/gl3w.h>
@@ -227,7 +229,16 @@ const float* GLTexture::CUDAMapping::data_cpu() {
 }
 #endif //NGP_GUI
 
-__global__ void accumulate_kernel(ivec2 resolution, vec4* frame_buffer, vec4* accumulate_buffer, float sample_count, EColorSpace color_space) {
+__global__ void accumulate_kernel(
+	ivec2 resolution,
+	vec4* frame_buffer,
+	vec4* accumulate_buffer,
+	float sample_count,
+	EColorSpace color_space,
+	float* __restrict__ second_moment_buffer,
+	uint32_t* __restrict__ sample_count_buffer,
+	const uint8_t* __restrict__ active_mask
+) {
 	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
 	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
 
@@ -237,9 +248,24 @@ __global__ void accumulate_kernel(ivec2 resolution, vec4* frame_buffer, vec4* ac
 
 	uint32_t idx = x + resolution.x * y;
 
+	// With adaptive sampling, pixels outside of the active mask were not traced this
+	// frame and must not be accumulated. The sample count is then tracked per pixel.
+	if (active_mask && !active_mask[idx]) {
+		return;
+	}
+
 	vec4 color = frame_buffer[idx];
 	vec4 tmp = accumulate_buffer[idx];
 
+	if (sample_count_buffer) {
+		sample_count = (float)sample_count_buffer[idx];
+
+		// Pixels without samples of their own may still show the previous frame, which the first sample replaces.
+		if (sample_count == 0.0f) {
+			tmp = vec4(0.0f);
+		}
+	}
+
 	switch (color_space) {
 		case EColorSpace::VisPosNeg:
 			{
@@ -261,6 +287,70 @@ __global__ void accumulate_kernel(ivec2 resolution, vec4* frame_buffer, vec4* ac
 
 	tmp.a = (tmp.a * sample_count + color.a) / (sample_count+1);
 	accumulate_buffer[idx] = tmp;
+
+	if (second_moment_buffer) {
+		float lum = sample_luminance(color.rgb);
+		second_moment_buffer[idx] = (second_moment_buffer[idx] * sample_count + lum * lum) / (sample_count+1);
+	}
+
+	if (sample_count_buffer) {
+		sample_count_buffer[idx] = (uint32_t)sample_count + 1;
+	}
+}
+
+__global__ void adaptive_tile_convergence_kernel(
+	ivec2 resolution,
+	uint32_t tile_size,
+	const vec4* __restrict__ accumulate_buffer,
+	const float* __restrict__ second_moment_buffer,
+	const uint32_t* __restrict__ sample_count_buffer,
+	uint32_t min_spp,
+	uint32_t max_spp,
+	float threshold,
+	uint8_t* __restrict__ tile_active
+) {
+	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
+	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
+
+	if (x >= resolution.x || y >= resolution.y) {
+		return;
+	}
+
+	uint32_t idx = x + resolution.x * y;
+	float mean = sample_luminance(accumulate_buffer[idx].rgb());
+
+	if (!pixel_converged(mean, second_moment_buffer[idx], sample_count_buffer[idx], min_spp, max_spp, threshold)) {
+		// Benign race: all writers store the same value.
+		uint32_t tile_res_x = div_round_up((uint32_t)resolution.x, tile_size);
+		tile_active[x / tile_size + (y / tile_size) * tile_res_x] = 1;
+	}
+}
+
+__global__ void expand_tile_mask_kernel(ivec2 resolution, uint32_t tile_size, const uint8_t* __restrict__ tile_active, uint8_t* __restrict__ pixel_mask) {
+	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
+	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
+
+	if (x >= resolution.x || y >= resolution.y) {
+		return;
+	}
+
+	uint32_t tile_res_x = div_round_up((uint32_t)resolution.x, tile_size);
+	pixel_mask[x + resolution.x * y] = tile_active[x / tile_size + (y / tile_size) * tile_res_x];
+}
+
+// Clears the pixels of `pixel_mask` that `mask` hides. `mask` may be of a different resolution.
+__global__ void intersect_pixel_mask_kernel(ivec2 resolution, Buffer2DView<const uint8_t> mask, uint8_t* __restrict__ pixel_mask) {
+	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
+	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
+
+	if (x >= resolution.x || y >= resolution.y) {
+		return;
+	}
+
+	vec2 uv = (vec2{(float)x, (float)y} + 0.5f) / vec2(resolution);
+	if (!mask.at(uv)) {
+		pixel_mask[x + resolution.x * y] = 0;
+	}
 }
 
 __device__ vec3 tonemap(vec3 x, ETonemapCurve curve) {
@@ -616,6 +706,10 @@ void CudaRenderBuffer::resize(const ivec2& res) {
 		m_depth_target->resize(res, 1);
 	}
 	m_accumulate_buffer.enlarge(res.x * res.y);
+	if (m_adaptive_sampling) {
+		m_second_moment_buffer.enlarge(res.x * res.y);
+		m_sample_count_buffer.enlarge(res.x * res.y);
+	}
 
 	ivec2 out_res = m_dlss ? m_dlss->out_resolution() : res;
 	auto prev_out_res = out_resolution();
@@ -635,8 +729,17 @@ void CudaRenderBuffer::accumulate(float exposure, cudaStream_t stream) {
 
 	uint32_t accum_spp = m_dlss ? 0 : m_spp;
 
-	if (accum_spp == 0) {
-		CUDA_CHECK_THROW(cudaMemsetAsync(m_accumulate_buffer.data(), 0, m_accumulate_buffer.bytes(), stream));
+	if (accum_spp == 0 && !m_accumulation_seeded) {
+		// With per-pixel sample counts, pixels keep showing the previous frame until they receive their first sample,
+		// e.g. progressive tiles that are yet to be rendered after the camera moved.
+		if (!m_adaptive_sampling || m_accumulated_resolution != res) {
+			CUDA_CHECK_THROW(cudaMemsetAsync(m_accumulate_buffer.data(), 0, m_accumulate_buffer.bytes(), stream));
+		}
+
+		if (m_adaptive_sampling) {
+			CUDA_CHECK_THROW(cudaMemsetAsync(m_second_moment_buffer.data(), 0, m_second_moment_buffer.bytes(), stream));
+			CUDA_CHECK_THROW(cudaMemsetAsync(m_sample_count_buffer.data(), 0, m_sample_count_buffer.bytes(), stream));
+		}
 	}
 
 	const dim3 threads = { 16, 8, 1 };
@@ -646,12 +749,133 @@ void CudaRenderBuffer::accumulate(float exposure, cudaStream_t stream) {
 		frame_buffer(),
 		accumulate_buffer(),
 		(float)accum_spp,
-		m_color_space
+		m_color_space,
+		m_adaptive_sampling ? second_moment_buffer() : nullptr,
+		m_adaptive_sampling ? sample_count_buffer() : nullptr,
+		(m_adaptive_sampling && m_adaptive_mask && m_sample_mask_installed) ? m_adaptive_mask->data() : nullptr
 	);
 
+	m_accumulated_resolution = res;
 	++m_spp;
 }
 
+void CudaRenderBuffer::enable_adaptive_sampling(bool enabled) {
+	if (enabled == m_adaptive_sampling) {
+		return;
+	}
+
+	m_adaptive_sampling = enabled;
+	reset_accumulation();
+
+	if (enabled) {
+		auto res = in_resolution();
+		m_second_moment_buffer.enlarge(res.x * res.y);
+		m_sample_count_buffer.enlarge(res.x * res.y);
+	} else {
+		m_sample_mask_installed = false;
+		m_adaptive_mask = nullptr;
+		m_second_moment_buffer.free_memory();
+		m_sample_count_buffer.free_memory();
+		m_tile_active.free_memory();
+	}
+}
+
+uint32_t CudaRenderBuffer::update_adaptive_sampling_mask(const AdaptiveSamplingSettings& settings, cudaStream_t stream) {
+	if (!m_adaptive_sampling) {
+		throw std::runtime_error{"Adaptive sampling must be enabled before updating its mask."};
+	}
+
+	auto res = in_resolution();
+	ivec2 tile_res = adaptive_tile_resolution(res, settings.tile_size);
+	m_tile_active.enlarge(compMul(tile_res));
+	CUDA_CHECK_THROW(cudaMemsetAsync(m_tile_active.data(), 0, m_tile_active.bytes(), stream));
+
+	const dim3 threads = { 16, 8, 1 };
+	const dim3 blocks = { div_round_up((uint32_t)res.x, threads.x), div_round_up((uint32_t)res.y, threads.y), 1 };
+	adaptive_tile_convergence_kernel<<<blocks, threads, 0, stream>>>(
+		res,
+		settings.tile_size,
+		accumulate_buffer(),
+		second_moment_buffer(),
+		sample_count_buffer(),
+		settings.min_spp,
+		settings.max_spp,
+		settings.relative_variance_threshold,
+		m_tile_active.data()
+	);
+
+	install_tile_mask(settings.tile_size, stream);
+
+	std::vector<uint8_t> tile_active(compMul(tile_res));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(tile_active.data(), m_tile_active.data(), tile_active.size(), cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+
+	uint32_t n_active = 0;
+	for (uint8_t a : tile_active) {
+		n_active += a;
+	}
+
+	return n_active;
+}
+
+void CudaRenderBuffer::set_active_tiles(const std::vector<uint8_t>& tile_active, uint32_t tile_size, cudaStream_t stream) {
+	if (!m_adaptive_sampling) {
+		throw std::runtime_error{"Adaptive sampling must be enabled before setting active tiles."};
+	}
+
+	size_t n_tiles = compMul(adaptive_tile_resolution(in_resolution(), tile_size));
+	if (tile_active.size() != n_tiles) {
+		throw std::runtime_error{fmt::format("Expected {} tiles, but got {}.", n_tiles, tile_active.size())};
+	}
+
+	m_tile_active.enlarge(n_tiles);
+	CUDA_CHECK_THROW(cudaMemcpyAsync(m_tile_active.data(), tile_active.data(), n_tiles, cudaMemcpyHostToDevice, stream));
+
+	install_tile_mask(tile_size, stream);
+}
+
+uint8_t* CudaRenderBuffer::sample_mask() {
+	if (!m_adaptive_sampling) {
+		throw std::runtime_error{"Adaptive sampling must be enabled to use a sample mask."};
+	}
+
+	auto res = in_resolution();
+	if (!m_adaptive_mask || m_adaptive_mask->resolution() != res) {
+		m_adaptive_mask = std::make_shared<Buffer2D<uint8_t>>(res);
+	}
+
+	return m_adaptive_mask->data();
+}
+
+void CudaRenderBuffer::install_tile_mask(uint32_t tile_size, cudaStream_t stream) {
+	auto res = in_resolution();
+	uint8_t* mask = sample_mask();
+
+	const dim3 threads = { 16, 8, 1 };
+	const dim3 blocks = { div_round_up((uint32_t)res.x, threads.x), div_round_up((uint32_t)res.y, threads.y), 1 };
+	expand_tile_mask_kernel<<<blocks, threads, 0, stream>>>(res, tile_size, m_tile_active.data(), mask);
+
+	install_sample_mask(stream);
+}
+
+void CudaRenderBuffer::install_sample_mask(cudaStream_t stream) {
+	if (!m_adaptive_mask) {
+		throw std::runtime_error{"The sample mask must be filled before it is installed."};
+	}
+
+	// Pixels that the external mask hides stay hidden. Both masks are looked up at the same (warped) uv.
+	if (m_hidden_area_mask) {
+		auto res = m_adaptive_mask->resolution();
+		const dim3 threads = { 16, 8, 1 };
+		const dim3 blocks = { div_round_up((uint32_t)res.x, threads.x), div_round_up((uint32_t)res.y, threads.y), 1 };
+		intersect_pixel_mask_kernel<<<blocks, threads, 0, stream>>>(res, m_hidden_area_mask->const_view(), m_adaptive_mask->data());
+	}
+
+	// The active pixel mask takes the place of the hidden area mask, which every
+	// ray generator already respects, so only active pixels get re-traced.
+	m_sample_mask_installed = true;
+}
+
 void CudaRenderBuffer::tonemap(float exposure, const vec4& background_color, EColorSpace output_color_space, float znear, float zfar, bool snap_to_pixel_centers, cudaStream_t stream) {
 	assert(m_dlss || out_resolution() == in_resolution());
 
@@ -791,4 +1015,193 @@ void CudaRenderBuffer::disable_dlss() {
 	m_dlss = nullptr;
 }
 
+__global__ void readback_convert_kernel(
+	ivec2 resolution,
+	cudaSurfaceObject_t surface,
+	EColorSpace surface_color_space,
+	EColorSpace output_color_space,
+	EReadbackFormat format,
+	uint8_t* __restrict__ out
+) {
+	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
+	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
+
+	if (x >= resolution.x || y >= resolution.y) {
+		return;
+	}
+
+	vec4 color;
+	surf2Dread((float4*)&color, surface, x * sizeof(float4), y);
+
+	if (surface_color_space == EColorSpace::Linear && output_color_space == EColorSpace::SRGB) {
+		color.rgb = linear_to_srgb(color.rgb);
+	} else if (surface_color_space == EColorSpace::SRGB && output_color_space == EColorSpace::Linear) {
+		color.rgb = srgb_to_linear(color.rgb);
+	}
+
+	uint32_t idx = x + resolution.x * y;
+	switch (format) {
+		case EReadbackFormat::RGB8:
+			for (uint32_t i = 0; i < 3; ++i) {
+				out[idx * 3 + i] = (uint8_t)(tcnn::clamp(color[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+			}
+			break;
+		case EReadbackFormat::RGBA8:
+			for (uint32_t i = 0; i < 4; ++i) {
+				out[idx * 4 + i] = (uint8_t)(tcnn::clamp(color[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+			}
+			break;
+		case EReadbackFormat::RGBA16F:
+			for (uint32_t i = 0; i < 4; ++i) {
+				((__half*)out)[idx * 4 + i] = (__half)color[i];
+			}
+			break;
+		case EReadbackFormat::RGBA32F:
+			((vec4*)out)[idx] = color;
+			break;
+	}
+}
+
+ReadbackFrame& ReadbackFrame::operator=(ReadbackFrame&& other) {
+	release();
+	std::swap(m_ring, other.m_ring);
+	std::swap(m_slot, other.m_slot);
+	std::swap(m_resolution, other.m_resolution);
+	std::swap(m_format, other.m_format);
+	return *this;
+}
+
+const void* ReadbackFrame::data() const {
+	if (!m_ring) {
+		throw std::runtime_error{"Readback frame has already been released."};
+	}
+
+	return m_ring->wait(m_slot);
+}
+
+void ReadbackFrame::release() {
+	if (m_ring) {
+		m_ring->release(m_slot);
+		m_ring = nullptr;
+	}
+}
+
+ReadbackRing::~ReadbackRing() {
+	for (auto& slot : m_slots) {
+		if (slot.done) {
+			cudaEventSynchronize(slot.done);
+			cudaEventDestroy(slot.done);
+		}
+
+		if (slot.start) {
+			cudaEventDestroy(slot.start);
+		}
+
+		if (slot.host_buffer) {
+			cudaFreeHost(slot.host_buffer);
+		}
+	}
+}
+
+ReadbackFrame ReadbackRing::enqueue(
+	cudaSurfaceObject_t surface,
+	const ivec2& resolution,
+	EColorSpace surface_color_space,
+	EColorSpace output_color_space,
+	EReadbackFormat format,
+	cudaStream_t stream
+) {
+	uint32_t slot_idx;
+	{
+		std::unique_lock<std::mutex> lock{m_mutex};
+		m_slot_released.wait(lock, [&]() {
+			for (const auto& slot : m_slots) {
+				if (!slot.in_use) {
+					return true;
+				}
+			}
+			return false;
+		});
+
+		// Round robin over the free slots, such that the most recently released buffer has the most time to go cold.
+		while (m_slots[m_next_slot].in_use) {
+			m_next_slot = (m_next_slot + 1) % m_slots.size();
+		}
+
+		slot_idx = m_next_slot;
+		m_next_slot = (m_next_slot + 1) % m_slots.size();
+		m_slots[slot_idx].in_use = true;
+	}
+
+	auto& slot = m_slots[slot_idx];
+
+	size_t n_bytes = compMul(resolution) * readback_bytes_per_pixel(format);
+	if (slot.host_buffer_bytes < n_bytes) {
+		if (slot.host_buffer) {
+			CUDA_CHECK_THROW(cudaEventSynchronize(slot.done));
+			CUDA_CHECK_THROW(cudaFreeHost(slot.host_buffer));
+		}
+
+		CUDA_CHECK_THROW(cudaMallocHost(&slot.host_buffer, n_bytes));
+		slot.host_buffer_bytes = n_bytes;
+	}
+
+	if (!slot.start) {
+		CUDA_CHECK_THROW(cudaEventCreate(&slot.start));
+		CUDA_CHECK_THROW(cudaEventCreate(&slot.done));
+	}
+
+	// The previous user of this slot's device buffer may still be in flight on another stream.
+	CUDA_CHECK_THROW(cudaStreamWaitEvent(stream, slot.done, 0));
+	slot.device_buffer.enlarge(n_bytes);
+	slot.timing_reported = false;
+
+	CUDA_CHECK_THROW(cudaEventRecord(slot.start, stream));
+
+	const dim3 threads = { 16, 8, 1 };
+	const dim3 blocks = { div_round_up((uint32_t)resolution.x, threads.x), div_round_up((uint32_t)resolution.y, threads.y), 1 };
+	readback_convert_kernel<<<blocks, threads, 0, stream>>>(resolution, surface, surface_color_space, output_color_space, format, slot.device_buffer.data());
+
+	CUDA_CHECK_THROW(cudaMemcpyAsync(slot.host_buffer, slot.device_buffer.data(), n_bytes, cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaEventRecord(slot.done, stream));
+
+	ReadbackFrame frame;
+	frame.m_ring = this;
+	frame.m_slot = slot_idx;
+	frame.m_resolution = resolution;
+	frame.m_format = format;
+	return frame;
+}
+
+const void* ReadbackRing::wait(uint32_t slot_idx) {
+	auto& slot = m_slots[slot_idx];
+	CUDA_CHECK_THROW(cudaEventSynchronize(slot.done));
+
+	std::lock_guard<std::mutex> lock{m_mutex};
+	if (!slot.timing_reported) {
+		float ms;
+		CUDA_CHECK_THROW(cudaEventElapsedTime(&ms, slot.start, slot.done));
+		m_timings.emplace_back(ms);
+		slot.timing_reported = true;
+	}
+
+	return slot.host_buffer;
+}
+
+void ReadbackRing::release(uint32_t slot_idx) {
+	{
+		std::lock_guard<std::mutex> lock{m_mutex};
+		m_slots[slot_idx].in_use = false;
+	}
+
+	m_slot_released.notify_one();
+}
+
+std::vector<float> ReadbackRing::pop_readback_timings() {
+	std::lock_guard<std::mutex> lock{m_mutex};
+	std::vector<float> result;
+	std::swap(result, m_timings);
+	return result;
+}
+
 NGP_NAMESPACE_END
@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   render_farm.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/render_farm.h>
+
+#include <filesystem/directory.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
+
+NGP_NAMESPACE_BEGIN
+
+FrameRangeCoordinator::FrameRangeCoordinator(uint32_t n_frames, uint32_t chunk_size, double lease_timeout_seconds)
+: m_n_frames{n_frames}, m_lease_timeout{lease_timeout_seconds} {
+	if (chunk_size == 0) {
+		throw std::runtime_error{"Chunk size must be positive."};
+	}
+
+	for (uint32_t begin = 0; begin < n_frames; begin += chunk_size) {
+		ChunkState state;
+		state.chunk = {(uint32_t)m_chunks.size(), begin, std::min(begin + chunk_size, n_frames)};
+		m_chunks.emplace_back(state);
+	}
+}
+
+bool FrameRangeCoordinator::lease(const std::string& worker, double now, FrameChunk& chunk) {
+	heartbeat(worker, now);
+
+	// A worker only ever holds one lease. Asking again returns the same chunk.
+	for (auto& c : m_chunks) {
+		if (c.state == EChunkState::Leased && c.worker == worker) {
+			chunk = c.chunk;
+			return true;
+		}
+	}
+
+	for (auto& c : m_chunks) {
+		if (c.state == EChunkState::Pending) {
+			c.state = EChunkState::Leased;
+			c.worker = worker;
+			chunk = c.chunk;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FrameRangeCoordinator::heartbeat(const std::string& worker, double now) {
+	m_last_seen[worker] = now;
+}
+
+bool FrameRangeCoordinator::complete(const std::string& worker, uint32_t chunk_id, double now) {
+	if (chunk_id >= m_chunks.size()) {
+		throw std::runtime_error{fmt::format("Worker {} completed unknown chunk #{}.", worker, chunk_id)};
+	}
+
+	auto& c = m_chunks[chunk_id];
+	if (c.state == EChunkState::Done) {
+		return false;
+	}
+
+	heartbeat(worker, now);
+
+	c.state = EChunkState::Done;
+	c.worker = worker;
+	++m_n_completed;
+	return true;
+}
+
+std::vector<std::string> FrameRangeCoordinator::expire(double now) {
+	std::vector<std::string> dead;
+	for (const auto& w : m_last_seen) {
+		if (now - w.second > m_lease_timeout) {
+			dead.emplace_back(w.first);
+		}
+	}
+
+	for (const auto& worker : dead) {
+		m_last_seen.erase(worker);
+		for (auto& c : m_chunks) {
+			if (c.state == EChunkState::Leased && c.worker == worker) {
+				tlog::warning() << fmt::format("Worker {} timed out. Re-leasing frames [{},{}).", worker, c.chunk.begin_frame, c.chunk.end_frame);
+				c.state = EChunkState::Pending;
+				c.worker.clear();
+			}
+		}
+	}
+
+	return dead;
+}
+
+std::vector<uint32_t> FrameRangeCoordinator::pop_assemblable_frames() {
+	std::vector<uint32_t> frames;
+	while (m_next_chunk_to_assemble < m_chunks.size() && m_chunks[m_next_chunk_to_assemble].state == EChunkState::Done) {
+		const auto& chunk = m_chunks[m_next_chunk_to_assemble].chunk;
+		for (uint32_t i = chunk.begin_frame; i < chunk.end_frame; ++i) {
+			frames.emplace_back(i);
+		}
+		++m_next_chunk_to_assemble;
+	}
+
+	return frames;
+}
+
+bool FrameRangeCoordinator::is_alive(const std::string& worker) const {
+	return m_last_seen.count(worker) > 0;
+}
+
+bool FrameRangeCoordinator::holds_lease(const std::string& worker) const {
+	for (const auto& c : m_chunks) {
+		if (c.state == EChunkState::Leased && c.worker == worker) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void write_file_atomic(const fs::path& path, const std::string& content) {
+	// Unique per process and call, such that concurrent writers of the same file, e.g. two workers that finished the same
+	// re-leased chunk, never share a temporary file.
+	static std::atomic<uint64_t> s_n_writes{0};
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = getpid();
+#endif
+	fs::path tmp = fmt::format("{}.{}.{}.tmp", path.str(), pid, s_n_writes++);
+	{
+		std::ofstream f{native_string(tmp), std::ios::out | std::ios::binary | std::ios::trunc};
+		if (!f) {
+			throw std::runtime_error{fmt::format("Failed to write {}.", tmp.str())};
+		}
+		f << content;
+	}
+
+#ifdef _WIN32
+	// rename() does not replace existing files on Windows.
+	path.remove_file();
+#endif
+
+	if (std::rename(tmp.str().c_str(), path.str().c_str()) != 0) {
+		tmp.remove_file();
+		throw std::runtime_error{fmt::format("Failed to rename {} to {}.", tmp.str(), path.str())};
+	}
+}
+
+// Chunk ids are the only names in done/ apart from temporary files, but other tools may leave files there.
+static bool parse_chunk_id(const std::string& name, uint32_t& chunk_id) {
+	if (name.empty() || name.size() > 9 || name.find_first_not_of("0123456789") != std::string::npos) {
+		return false;
+	}
+
+	chunk_id = (uint32_t)std::strtoul(name.c_str(), nullptr, 10);
+	return true;
+}
+
+static bool read_file(const fs::path& path, std::string& content) {
+	std::ifstream f{native_string(path), std::ios::in | std::ios::binary};
+	if (!f) {
+		return false;
+	}
+
+	std::stringstream ss;
+	ss << f.rdbuf();
+	content = ss.str();
+	return true;
+}
+
+static void create_spool_dirs(const fs::path& spool_dir) {
+	for (const char* sub : {"workers", "leases", "done", "frames"}) {
+		fs::path dir = spool_dir / sub;
+		if (!dir.exists() && !fs::create_directories(dir)) {
+			throw std::runtime_error{fmt::format("Failed to create spool directory {}.", dir.str())};
+		}
+	}
+}
+
+SpoolDirectoryCoordinator::SpoolDirectoryCoordinator(const fs::path& spool_dir, uint32_t n_frames, uint32_t chunk_size, double lease_timeout_seconds)
+: m_spool_dir{spool_dir}, m_coordinator{n_frames, chunk_size, lease_timeout_seconds}, m_start_time{std::chrono::steady_clock::now()} {
+	create_spool_dirs(m_spool_dir);
+
+	// Whatever an earlier job left in the spool directory must not count as progress of this one. Workers that are
+	// already waiting recreate their heartbeat file with their next heartbeat.
+	for (const char* sub : {"workers", "leases", "done", "frames"}) {
+		std::vector<fs::path> stale;
+		for (const auto& path : fs::directory{m_spool_dir / sub}) {
+			if (path.is_file()) {
+				stale.emplace_back(path);
+			}
+		}
+
+		for (const auto& path : stale) {
+			// Temporary files may have been renamed in the meantime.
+			if (!path.remove_file() && path.exists()) {
+				throw std::runtime_error{fmt::format("Failed to remove {} of an earlier job.", path.str())};
+			}
+		}
+	}
+
+	(m_spool_dir / "finished").remove_file();
+
+	tlog::info() << fmt::format("Coordinating {} frames in {} chunks via {}", n_frames, m_coordinator.n_chunks(), m_spool_dir.str());
+}
+
+double SpoolDirectoryCoordinator::now() const {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start_time).count();
+}
+
+bool SpoolDirectoryCoordinator::poll() {
+	double t = now();
+
+	// Heartbeats are counters rather than timestamps, such that workers and coordinator need not share a clock.
+	// A worker counts as alive whenever its counter changed since the last poll.
+	std::vector<std::string> workers;
+	for (const auto& path : fs::directory{m_spool_dir / "workers"}) {
+		if (!path.is_file() || path.extension() == "tmp") {
+			continue;
+		}
+
+		std::string id = path.filename(), content;
+		if (!read_file(path, content)) {
+			continue;
+		}
+
+		workers.emplace_back(id);
+		auto it = m_heartbeats.find(id);
+		if (it == m_heartbeats.end() || it->second != content) {
+			m_heartbeats[id] = content;
+			m_coordinator.heartbeat(id, t);
+		}
+	}
+
+	for (const auto& path : fs::directory{m_spool_dir / "done"}) {
+		if (!path.is_file() || path.extension() == "tmp") {
+			continue;
+		}
+
+		uint32_t chunk_id;
+		if (!parse_chunk_id(path.filename(), chunk_id) || chunk_id >= m_coordinator.n_chunks()) {
+			continue;
+		}
+
+		std::string worker;
+		if (!read_file(path, worker)) {
+			continue;
+		}
+
+		if (m_coordinator.complete(worker, chunk_id, t)) {
+			tlog::info() << fmt::format("Worker {} finished chunk #{} ({}/{})", worker, chunk_id, m_coordinator.n_completed(), m_coordinator.n_chunks());
+		}
+	}
+
+	// Expired workers keep their last heartbeat in m_heartbeats, so they only come back once their counter moves again.
+	for (const auto& worker : m_coordinator.expire(t)) {
+		(m_spool_dir / "leases" / worker).remove_file();
+	}
+
+	for (const auto& worker : workers) {
+		if (!m_coordinator.is_alive(worker) || m_coordinator.holds_lease(worker)) {
+			continue;
+		}
+
+		FrameChunk chunk;
+		if (m_coordinator.lease(worker, t, chunk)) {
+			write_file_atomic(m_spool_dir / "leases" / worker, fmt::format("{} {} {}", chunk.id, chunk.begin_frame, chunk.end_frame));
+		}
+	}
+
+	if (m_coordinator.finished()) {
+		write_file_atomic(m_spool_dir / "finished", "");
+		return true;
+	}
+
+	return false;
+}
+
+SpoolDirectoryWorker::SpoolDirectoryWorker(const fs::path& spool_dir, const std::string& id)
+: m_spool_dir{spool_dir}, m_id{id} {
+	create_spool_dirs(m_spool_dir);
+	heartbeat();
+}
+
+SpoolDirectoryWorker::~SpoolDirectoryWorker() {
+	{
+		std::lock_guard<std::mutex> lock{m_heartbeat_mutex};
+		m_stop_heartbeat_thread = true;
+	}
+
+	m_heartbeat_cv.notify_all();
+	if (m_heartbeat_thread.joinable()) {
+		m_heartbeat_thread.join();
+	}
+}
+
+void SpoolDirectoryWorker::heartbeat() {
+	std::lock_guard<std::mutex> lock{m_heartbeat_mutex};
+	write_file_atomic(m_spool_dir / "workers" / m_id, std::to_string(++m_heartbeat_counter));
+}
+
+void SpoolDirectoryWorker::start_heartbeat_thread(double interval_seconds) {
+	if (m_heartbeat_thread.joinable()) {
+		return;
+	}
+
+	auto interval = std::chrono::duration<double>{interval_seconds};
+	m_heartbeat_thread = std::thread{[this, interval]() {
+		std::unique_lock<std::mutex> lock{m_heartbeat_mutex};
+		while (!m_heartbeat_cv.wait_for(lock, interval, [this]() { return m_stop_heartbeat_thread; })) {
+			try {
+				write_file_atomic(m_spool_dir / "workers" / m_id, std::to_string(++m_heartbeat_counter));
+			} catch (const std::runtime_error& e) {
+				// Transient, e.g. a network share hiccup. The next heartbeat may succeed.
+				tlog::warning() << e.what();
+			}
+		}
+	}};
+}
+
+bool SpoolDirectoryWorker::next_chunk(FrameChunk& chunk) {
+	std::string content;
+	if (!read_file(m_spool_dir / "leases" / m_id, content)) {
+		return false;
+	}
+
+	std::istringstream ss{content};
+	if (!(ss >> chunk.id >> chunk.begin_frame >> chunk.end_frame)) {
+		return false;
+	}
+
+	return (int64_t)chunk.id != m_last_completed_chunk && !(m_spool_dir / "done" / std::to_string(chunk.id)).exists();
+}
+
+void SpoolDirectoryWorker::complete(const FrameChunk& chunk) {
+	fs::path done = m_spool_dir / "done" / std::to_string(chunk.id);
+	try {
+		write_file_atomic(done, m_id);
+	} catch (const std::runtime_error&) {
+		// Another worker that held an earlier lease of the chunk finished it at the same time.
+		if (!done.exists()) {
+			throw;
+		}
+	}
+
+	m_last_completed_chunk = chunk.id;
+}
+
+bool SpoolDirectoryWorker::finished() const {
+	return (m_spool_dir / "finished").exists();
+}
+
+NGP_NAMESPACE_END
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   temporal_reprojection.cu
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/common_device.cuh>
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/temporal_reprojection.h>
+
+using namespace tcnn;
+
+NGP_NAMESPACE_BEGIN
+
+// Larger than any view depth. Results from memsetting a float buffer to 0x7f.
+static constexpr float NO_SPLAT = 3.0e38f;
+
+inline __device__ vec3 pixel_world_pos(const ivec2& px, float depth, const ivec2& resolution, const vec2& focal_length, const mat4x3& camera, const vec2& screen_center, const vec3& parallax_shift) {
+	return uv_to_ray(0, (vec2(px) + vec2(0.5f)) / vec2(resolution), resolution, focal_length, camera, screen_center, parallax_shift)(depth);
+}
+
+// Normal of the surface seen through a pixel, derived from its neighbors' depths. Per axis, the neighbor with the
+// closer depth is used, such that normals do not smear across depth discontinuities.
+inline __device__ bool depth_normal(
+	const float* __restrict__ depth,
+	const ivec2& px,
+	const ivec2& resolution,
+	const vec2& focal_length,
+	const mat4x3& camera,
+	const vec2& screen_center,
+	const vec3& parallax_shift,
+	vec3& normal
+) {
+	float d = depth[px.x + px.y * resolution.x];
+	vec3 pos = pixel_world_pos(px, d, resolution, focal_length, camera, screen_center, parallax_shift);
+
+	vec3 tangents[2];
+	for (int axis = 0; axis < 2; ++axis) {
+		float best_diff = NO_SPLAT;
+		for (int sign = -1; sign <= 1; sign += 2) {
+			ivec2 n = px;
+			n[axis] += sign;
+			if (n.x < 0 || n.y < 0 || n.x >= resolution.x || n.y >= resolution.y) {
+				continue;
+			}
+
+			float nd = depth[n.x + n.y * resolution.x];
+			if (nd >= NO_SPLAT || fabsf(nd - d) >= best_diff) {
+				continue;
+			}
+
+			best_diff = fabsf(nd - d);
+			tangents[axis] = (pixel_world_pos(n, nd, resolution, focal_length, camera, screen_center, parallax_shift) - pos) * (float)sign;
+		}
+
+		if (best_diff >= NO_SPLAT) {
+			return false;
+		}
+	}
+
+	vec3 n = cross(tangents[0], tangents[1]);
+	float len = length(n);
+	if (len == 0.0f) {
+		return false;
+	}
+
+	normal = n / len;
+	return true;
+}
+
+__global__ void reprojection_splat_kernel(
+	ivec2 resolution,
+	const float* __restrict__ prev_depth,
+	mat4x3 prev_camera,
+	vec2 prev_focal_length,
+	vec2 prev_screen_center,
+	mat4x3 camera,
+	mat3 inv_rotation,
+	vec2 focal_length,
+	vec2 screen_center,
+	vec3 parallax_shift,
+	float* __restrict__ splat_depth
+) {
+	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
+	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
+
+	if (x >= resolution.x || y >= resolution.y) {
+		return;
+	}
+
+	vec3 pos = pixel_world_pos(ivec2((int)x, (int)y), prev_depth[x + y * resolution.x], resolution, prev_focal_length, prev_camera, prev_screen_center, parallax_shift);
+
+	float view_depth = (inv_rotation * (pos - camera[3])).z;
+	if (view_depth <= 0.0f) {
+		return;
+	}
+
+	// Nearest-pixel splat. It leaves cracks where the view magnifies, but those are simply traced again,
+	// whereas a wider footprint would dilate foreground depth into the background.
+	ivec2 px = ivec2(floor(pos_to_pixel(pos, resolution, focal_length, camera, screen_center, parallax_shift)));
+	if (px.x < 0 || px.y < 0 || px.x >= resolution.x || px.y >= resolution.y) {
+		return;
+	}
+
+	// Positive floats order like their bit patterns, so the nearest surface wins an integer atomicMin.
+	atomicMin((int*)&splat_depth[px.x + px.y * resolution.x], __float_as_int(view_depth));
+}
+
+__global__ void reprojection_gather_kernel(
+	ivec2 resolution,
+	const float* __restrict__ splat_depth,
+	mat4x3 camera,
+	vec2 focal_length,
+	vec2 screen_center,
+	const vec4* __restrict__ prev_color,
+	const float* __restrict__ prev_depth,
+	const uint32_t* __restrict__ prev_sample_count,
+	const uint8_t* __restrict__ prev_age,
+	mat4x3 prev_camera,
+	mat3 prev_inv_rotation,
+	vec2 prev_focal_length,
+	vec2 prev_screen_center,
+	vec3 parallax_shift,
+	uint32_t target_spp,
+	float depth_tolerance,
+	float min_normal_cos,
+	uint32_t max_age,
+	vec4* __restrict__ accumulate_buffer,
+	float* __restrict__ second_moment_buffer,
+	uint32_t* __restrict__ sample_count_buffer,
+	float* __restrict__ depth,
+	uint8_t* __restrict__ age,
+	uint32_t* __restrict__ n_reused
+) {
+	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
+	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
+
+	if (x >= resolution.x || y >= resolution.y) {
+		return;
+	}
+
+	uint32_t idx = x + resolution.x * y;
+
+	accumulate_buffer[idx] = vec4(0.0f);
+	second_moment_buffer[idx] = 0.0f;
+	sample_count_buffer[idx] = 0;
+	depth[idx] = MAX_DEPTH();
+	age[idx] = 0;
+
+	float d = splat_depth[idx];
+	if (d >= NO_SPLAT) {
+		return; // disoccluded
+	}
+
+	vec3 pos = pixel_world_pos(ivec2((int)x, (int)y), d, resolution, focal_length, camera, screen_center, parallax_shift);
+	float expected_prev_depth = (prev_inv_rotation * (pos - prev_camera[3])).z;
+	if (expected_prev_depth <= 0.0f) {
+		return;
+	}
+
+	// Bilinear lookup in pixel-center coordinates of the previous frame
+	vec2 prev_px = pos_to_pixel(pos, resolution, prev_focal_length, prev_camera, prev_screen_center, parallax_shift) - vec2(0.5f);
+	ivec2 p0 = ivec2(floor(prev_px));
+	if (p0.x < 0 || p0.y < 0 || p0.x + 1 >= resolution.x || p0.y + 1 >= resolution.y) {
+		return;
+	}
+
+	vec2 w = prev_px - vec2(p0);
+
+	// The depth test has to pass on all four taps, such that colors never bleed across depth discontinuities.
+	vec4 color = vec4(0.0f);
+	float max_error = 0.0f;
+	uint32_t min_sample_count = 0xFFFFFFFFu;
+	uint32_t max_prev_age = 0;
+	for (int dy = 0; dy < 2; ++dy) {
+		for (int dx = 0; dx < 2; ++dx) {
+			uint32_t tap = (p0.x + dx) + (p0.y + dy) * resolution.x;
+			float weight = (dx ? w.x : 1.0f - w.x) * (dy ? w.y : 1.0f - w.y);
+
+			max_error = fmaxf(max_error, fabsf(prev_depth[tap] - expected_prev_depth) / expected_prev_depth);
+			min_sample_count = min(min_sample_count, prev_sample_count[tap]);
+			max_prev_age = max(max_prev_age, (uint32_t)prev_age[tap]);
+			color += weight * prev_color[tap];
+		}
+	}
+
+	if (max_error > depth_tolerance || max_prev_age + 1 > max_age) {
+		return;
+	}
+
+	// Background has no meaningful normal; the depth test suffices there.
+	if (d < MAX_DEPTH() * 0.5f) {
+		vec3 normal, prev_normal;
+		ivec2 prev_nearest = clamp(ivec2(round(prev_px)), ivec2(0), resolution - ivec2(1));
+		if (
+			depth_normal(splat_depth, ivec2((int)x, (int)y), resolution, focal_length, camera, screen_center, parallax_shift, normal) &&
+			depth_normal(prev_depth, prev_nearest, resolution, prev_focal_length, prev_camera, prev_screen_center, parallax_shift, prev_normal) &&
+			dot(normal, prev_normal) < min_normal_cos
+		) {
+			return;
+		}
+	}
+
+	// The closer a pixel is to failing the depth test, the fewer of its samples are trusted and the
+	// more fresh samples it receives this frame.
+	float confidence = 1.0f - max_error / depth_tolerance;
+	uint32_t sample_count = min((uint32_t)(confidence * (float)min_sample_count), target_spp);
+	if (sample_count == 0) {
+		return;
+	}
+
+	float lum = sample_luminance(color.rgb());
+	accumulate_buffer[idx] = color;
+	second_moment_buffer[idx] = lum * lum;
+	sample_count_buffer[idx] = sample_count;
+	depth[idx] = d;
+	age[idx] = (uint8_t)(max_prev_age + 1);
+	atomicAdd(n_reused, 1u);
+}
+
+__global__ void reprojection_sample_mask_kernel(
+	ivec2 resolution,
+	uint32_t target_spp,
+	const uint32_t* __restrict__ sample_count_buffer,
+	const float* __restrict__ depth_buffer,
+	bool capture_depth,
+	float* __restrict__ depth,
+	uint8_t* __restrict__ mask,
+	uint32_t* __restrict__ n_active
+) {
+	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
+	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
+
+	if (x >= resolution.x || y >= resolution.y) {
+		return;
+	}
+
+	uint32_t idx = x + resolution.x * y;
+
+	if (capture_depth && mask[idx]) {
+		depth[idx] = depth_buffer[idx];
+	}
+
+	bool active = sample_count_buffer[idx] < target_spp;
+	mask[idx] = active;
+	if (active) {
+		atomicAdd(n_active, 1u);
+	}
+}
+
+uint32_t TemporalReprojection::reproject(
+	CudaRenderBuffer& render_buffer,
+	const mat4x3& camera,
+	const vec2& focal_length,
+	const vec2& screen_center,
+	const vec3& parallax_shift,
+	uint32_t target_spp,
+	const TemporalReprojectionSettings& settings,
+	cudaStream_t stream
+) {
+	if (!render_buffer.adaptive_sampling()) {
+		throw std::runtime_error{"Temporal reprojection requires adaptive sampling for per-pixel sample counts."};
+	}
+
+	auto res = render_buffer.in_resolution();
+	size_t n_pixels = compMul(res);
+
+	m_depth.enlarge(n_pixels);
+	m_age.enlarge(n_pixels);
+	// Slot 0 counts reused pixels, slot 1 the pixels that update_mask() leaves active.
+	m_counter.enlarge(2);
+
+	if (!m_history_valid || m_resolution != res) {
+		m_history_valid = false;
+		CUDA_CHECK_THROW(cudaMemsetAsync(render_buffer.accumulate_buffer(), 0, n_pixels * sizeof(vec4), stream));
+		CUDA_CHECK_THROW(cudaMemsetAsync(render_buffer.second_moment_buffer(), 0, n_pixels * sizeof(float), stream));
+		CUDA_CHECK_THROW(cudaMemsetAsync(render_buffer.sample_count_buffer(), 0, n_pixels * sizeof(uint32_t), stream));
+		CUDA_CHECK_THROW(cudaMemsetAsync(m_age.data(), 0, n_pixels * sizeof(uint8_t), stream));
+		render_buffer.seed_accumulation();
+		update_mask(render_buffer, target_spp, false, stream);
+		return 0;
+	}
+
+	m_splat_depth.enlarge(n_pixels);
+	CUDA_CHECK_THROW(cudaMemsetAsync(m_splat_depth.data(), 0x7f, n_pixels * sizeof(float), stream));
+	CUDA_CHECK_THROW(cudaMemsetAsync(m_counter.data(), 0, sizeof(uint32_t), stream));
+
+	const dim3 threads = { 16, 8, 1 };
+	const dim3 blocks = { div_round_up((uint32_t)res.x, threads.x), div_round_up((uint32_t)res.y, threads.y), 1 };
+
+	reprojection_splat_kernel<<<blocks, threads, 0, stream>>>(
+		res,
+		m_history_depth.data(),
+		m_camera,
+		m_focal_length,
+		m_screen_center,
+		camera,
+		inverse(mat3(camera)),
+		focal_length,
+		screen_center,
+		parallax_shift,
+		m_splat_depth.data()
+	);
+
+	reprojection_gather_kernel<<<blocks, threads, 0, stream>>>(
+		res,
+		m_splat_depth.data(),
+		camera,
+		focal_length,
+		screen_center,
+		m_history_color.data(),
+		m_history_depth.data(),
+		m_history_sample_count.data(),
+		m_history_age.data(),
+		m_camera,
+		inverse(mat3(m_camera)),
+		m_focal_length,
+		m_screen_center,
+		parallax_shift,
+		target_spp,
+		settings.depth_tolerance,
+		settings.min_normal_cos,
+		std::min(settings.max_age, 255u),
+		render_buffer.accumulate_buffer(),
+		render_buffer.second_moment_buffer(),
+		render_buffer.sample_count_buffer(),
+		m_depth.data(),
+		m_age.data(),
+		m_counter.data()
+	);
+
+	uint32_t n_reused;
+	CUDA_CHECK_THROW(cudaMemcpyAsync(&n_reused, m_counter.data(), sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+
+	render_buffer.seed_accumulation();
+
+	// Synchronizes the stream, which completes the above copy as well.
+	update_mask(render_buffer, target_spp, false, stream);
+
+	return n_reused;
+}
+
+uint32_t TemporalReprojection::update_mask(CudaRenderBuffer& render_buffer, uint32_t target_spp, cudaStream_t stream) {
+	return update_mask(render_buffer, target_spp, true, stream);
+}
+
+uint32_t TemporalReprojection::update_mask(CudaRenderBuffer& render_buffer, uint32_t target_spp, bool capture_depth, cudaStream_t stream) {
+	auto res = render_buffer.in_resolution();
+	uint8_t* mask = render_buffer.sample_mask();
+
+	m_counter.enlarge(2);
+	CUDA_CHECK_THROW(cudaMemsetAsync(m_counter.data() + 1, 0, sizeof(uint32_t), stream));
+
+	const dim3 threads = { 16, 8, 1 };
+	const dim3 blocks = { div_round_up((uint32_t)res.x, threads.x), div_round_up((uint32_t)res.y, threads.y), 1 };
+	reprojection_sample_mask_kernel<<<blocks, threads, 0, stream>>>(
+		res,
+		target_spp,
+		render_buffer.sample_count_buffer(),
+		render_buffer.depth_buffer(),
+		capture_depth,
+		m_depth.data(),
+		mask,
+		m_counter.data() + 1
+	);
+
+	render_buffer.install_sample_mask(stream);
+
+	uint32_t n_active;
+	CUDA_CHECK_THROW(cudaMemcpyAsync(&n_active, m_counter.data() + 1, sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+	return n_active;
+}
+
+void TemporalReprojection::store(CudaRenderBuffer& render_buffer, const mat4x3& camera, const vec2& focal_length, const vec2& screen_center, cudaStream_t stream) {
+	auto res = render_buffer.in_resolution();
+	size_t n_pixels = compMul(res);
+
+	m_history_color.enlarge(n_pixels);
+	m_history_depth.enlarge(n_pixels);
+	m_history_sample_count.enlarge(n_pixels);
+	m_history_age.enlarge(n_pixels);
+
+	CUDA_CHECK_THROW(cudaMemcpyAsync(m_history_color.data(), render_buffer.accumulate_buffer(), n_pixels * sizeof(vec4), cudaMemcpyDeviceToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(m_history_depth.data(), m_depth.data(), n_pixels * sizeof(float), cudaMemcpyDeviceToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(m_history_sample_count.data(), render_buffer.sample_count_buffer(), n_pixels * sizeof(uint32_t), cudaMemcpyDeviceToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(m_history_age.data(), m_age.data(), n_pixels * sizeof(uint8_t), cudaMemcpyDeviceToDevice, stream));
+
+	m_history_valid = true;
+	m_resolution = res;
+	m_camera = camera;
+	m_focal_length = focal_length;
+	m_screen_center = screen_center;
+}
+
+NGP_NAMESPACE_END
@@ -40,6 +40,7 @@
 
 #include <zstr.hpp>
 
+#include <deque>
 #include <fstream>
 #include <set>
 #include <unordered_set>
@@ -454,6 +455,8 @@ void Testbed::add_training_views_to_camera_path() {
 		n = std::max(0, int(m_camera_path.keyframes.size()) - 1);
 		m_camera_path.play_time = n ? float(j) / float(n) : 1.f;
 	}
+
+	m_camera_path.keyframes_changed();
 }
 
 void Testbed::set_camera_to_training_view(int trainview) {
@@ -794,20 +797,22 @@ void Testbed::imgui() {
 
 			static std::vector<float> X;
 			static std::vector<float> Y;
+			m_nerf.training.sync_extra_dims_to_host(m_stream.get());
 			uint32_t n_extra_dims = m_nerf.training.dataset.n_extra_dims();
 			std::vector<float> mean(n_extra_dims, 0.0f);
 			uint32_t n = m_nerf.training.n_images_for_training;
 			float norm = 1.0f / n;
 			for (uint32_t i = 0; i < n; ++i) {
 				for (uint32_t j = 0; j < n_extra_dims; ++j) {
-					mean[j] += m_nerf.training.extra_dims_opt[i].variable()[j] * norm;
+					mean[j] += m_nerf.training.extra_dims_opt.variable(i)[j] * norm;
 				}
 			}
 
 			std::vector<float> cov(n_extra_dims * n_extra_dims, 0.0f);
 			float scale = 0.001f;	// compute scale
 			for (uint32_t i = 0; i < n; ++i) {
-				std::vector<float> v = m_nerf.training.extra_dims_opt[i].variable();
+				const float* latent = m_nerf.training.extra_dims_opt.variable(i);
+				std::vector<float> v(latent, latent + n_extra_dims);
 				for (uint32_t j = 0; j < n_extra_dims; ++j) {
 					v[j] -= mean[j];
 				}
@@ -878,7 +883,8 @@ void Testbed::imgui() {
 			for (uint32_t i = 0; i < n; ++i) {
 				vec2 p = vec2(0.0f);
 
-				std::vector<float> v = m_nerf.training.extra_dims_opt[i].variable();
+				const float* latent = m_nerf.training.extra_dims_opt.variable(i);
+				std::vector<float> v(latent, latent + n_extra_dims);
 				for (uint32_t j = 0; j < n_extra_dims; ++j) {
 					p.x += (v[j] - mean[j]) * X[j] / scale;
 					p.y += (v[j] - mean[j]) * Y[j] / scale;
@@ -938,6 +944,10 @@ void Testbed::imgui() {
 			ImGui::Checkbox("distortion", &m_nerf.training.optimize_distortion);
 			ImGui::SameLine();
 			ImGui::Checkbox("per-image latents", &m_nerf.training.optimize_extra_dims);
+			if (m_nerf.training.optimize_extra_dims) {
+				ImGui::SameLine();
+				ImGui::Checkbox("on GPU", &m_nerf.training.optimize_extra_dims_on_gpu);
+			}
 
 
 			static bool export_extrinsics_in_quat_format = true;
@@ -988,6 +998,24 @@ void Testbed::imgui() {
 		ImGui::Text("Steps: %d, Loss: %0.6f (%0.2f dB), Elapsed: %.1fs", m_training_step, m_loss_scalar.ema_val(), linear_to_db(m_loss_scalar.ema_val()), elapsed_training);
 		ImGui::PlotLines("loss graph", m_loss_graph.data(), std::min(m_loss_graph_samples, m_loss_graph.size()), (m_loss_graph_samples < m_loss_graph.size()) ? 0 : (m_loss_graph_samples % m_loss_graph.size()), 0, FLT_MAX, FLT_MAX, ImVec2(0, 50.f));
 
+		if (ImGui::TreeNode("Training profiler")) {
+			bool profile = m_training_profiler.enabled();
+			if (ImGui::Checkbox("Profile training phases", &profile)) {
+				m_training_profiler.set_enabled(profile);
+			}
+
+			ImGui::SameLine();
+			if (ImGui::Button("Reset##training profiler")) {
+				m_training_profiler.reset();
+			}
+
+			for (const auto& s : m_training_profiler.stats()) {
+				ImGui::Text("%s %s: mean %.3fms, p99 %.3fms", to_string(s.phase).c_str(), s.track == ETrainingTrack::Host ? "host" : "device", s.mean_ms, s.p99_ms);
+			}
+
+			ImGui::TreePop();
+		}
+
 		if (m_testbed_mode == ETestbedMode::Nerf && ImGui::TreeNode("NeRF training options")) {
 			ImGui::Checkbox("Random bg color", &m_nerf.training.random_bg_color);
 			ImGui::SameLine();
@@ -1006,12 +1034,31 @@ void Testbed::imgui() {
 			ImGui::SameLine();
 			ImGui::Checkbox("Sample focal plane ~sharpness", &m_nerf.training.include_sharpness_in_error);
 			ImGui::Checkbox("Sample image ~error", &m_nerf.training.sample_image_proportional_to_error);
+			ImGui::Combo("Error map sampler", (int*)&m_nerf.training.error_map_sampler, ErrorMapSamplerStr);
 			ImGui::Text("%dx%d error res w/ %d steps between updates", m_nerf.training.error_map.resolution.x, m_nerf.training.error_map.resolution.y, m_nerf.training.n_steps_between_error_map_updates);
+			ImGui::Text("%d images rebuilt in the last update", m_nerf.training.error_map.n_rebuilt_images);
 			ImGui::Checkbox("Display error overlay", &m_nerf.training.render_error_overlay);
 			if (m_nerf.training.render_error_overlay) {
 				ImGui::SliderFloat("Error overlay brightness", &m_nerf.training.error_overlay_brightness, 0.f, 1.f);
 			}
 			ImGui::SliderFloat("Density grid decay", &m_nerf.training.density_grid_decay, 0.f, 1.f,"%.4f");
+
+			auto& schedule = m_nerf.training.density_grid_schedule;
+			DensityGridScheduleConfig schedule_config = schedule.config();
+			bool schedule_changed = ImGui::Checkbox("Adaptive density grid updates", &schedule_config.enabled);
+			if (schedule_config.enabled) {
+				schedule_changed |= ImGui::SliderFloat("Target flip rate", &schedule_config.target_flip_rate, 1e-7f, 1e-3f, "%.2e", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_NoRoundToFormat);
+				schedule_changed |= ImGui::Checkbox("Restrict to changed cascades", &schedule_config.restrict_to_changed_cascades);
+				ImGui::Text("Flip rate: %.2e per step, interval: %dx default, samples: %.0f%%", schedule.flip_rate(), schedule.interval_multiplier(m_training_step), schedule.sample_fraction(m_training_step) * 100.0f);
+				ImGui::Text("%llu/%llu updates, %.1fM queries saved (%.0f%%)",
+					(unsigned long long)schedule.n_updates(), (unsigned long long)schedule.n_default_updates(), schedule.n_queries_saved() / 1e6,
+					schedule.n_default_queries() > 0 ? 100.0 * schedule.n_queries_saved() / schedule.n_default_queries() : 0.0
+				);
+			}
+
+			if (schedule_changed) {
+				schedule.set_config(schedule_config);
+			}
 			ImGui::SliderFloat("Extrinsic L2 reg.", &m_nerf.training.extrinsic_l2_reg, 1e-8f, 0.1f, "%.6f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_NoRoundToFormat);
 			ImGui::SliderFloat("Intrinsic L2 reg.", &m_nerf.training.intrinsic_l2_reg, 1e-8f, 0.1f, "%.6f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_NoRoundToFormat);
 			ImGui::SliderFloat("Exposure L2 reg.", &m_nerf.training.exposure_l2_reg, 1e-8f, 0.1f, "%.6f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_NoRoundToFormat);
@@ -1113,7 +1160,8 @@ void Testbed::imgui() {
 
 		const auto& render_buffer = m_views.front().render_buffer;
 		std::string spp_string = m_dlss ? std::string{""} : fmt::format("({} spp)", std::max(render_buffer->spp(), 1u));
-		ImGui::Text(": %.01fms for %dx%d %s", m_render_ms.ema_val(), render_buffer->in_resolution().x, render_buffer->in_resolution().y, spp_string.c_str());
+		std::string readback_string = m_camera_path.rendering ? fmt::format(", readback {:.02f}ms", m_readback_ms.ema_val()) : std::string{""};
+		ImGui::Text(": %.01fms for %dx%d %s%s", m_render_ms.ema_val(), render_buffer->in_resolution().x, render_buffer->in_resolution().y, spp_string.c_str(), readback_string.c_str());
 
 		ImGui::SameLine();
 		if (ImGui::Checkbox("VSync", &m_vsync)) {
@@ -1253,6 +1301,11 @@ void Testbed::imgui() {
 
 		if (ImGui::TreeNode("Advanced rendering options")) {
 			ImGui::SliderInt("Max spp", &m_max_spp, 0, 1024, "%d", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_NoRoundToFormat);
+			ImGui::Checkbox("Progressive tiles", &m_progressive_tiles.enabled);
+			if (m_progressive_tiles.enabled) {
+				ImGui::SameLine();
+				ImGui::SliderFloat("Frame budget (ms)", &m_progressive_tiles.frame_budget_ms, 1.0f, 100.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+			}
 			accum_reset |= ImGui::Checkbox("Render transparency as checkerboard", &m_render_transparency_as_checkerboard);
 			accum_reset |= ImGui::Combo("Color space", (int*)&m_color_space, ColorSpaceStr);
 			accum_reset |= ImGui::Checkbox("Snap to pixel centers", &m_snap_to_pixel_centers);
@@ -1325,6 +1378,16 @@ void Testbed::imgui() {
 			}
 
 			accum_reset |= ImGui::SliderFloat("Min transmittance", &m_nerf.render_min_transmittance, 0.0f, 1.0f, "%.3f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_NoRoundToFormat);
+			ImGui::Checkbox("Render all views in one trace", &m_nerf.render_views_in_one_trace);
+			ImGui::Checkbox("Skip empty space with distance field", &m_nerf.skip_empty_space_with_distance_field);
+			accum_reset |= ImGui::Checkbox("Level of detail", &m_nerf.render_lod);
+			if (m_nerf.render_lod) {
+				accum_reset |= ImGui::SliderFloat("Level of detail bias", &m_nerf.render_lod_bias, -4.0f, 4.0f);
+				if (!m_max_level_rand_training) {
+					ImGui::SameLine();
+					ImGui::TextDisabled("(train with random levels)");
+				}
+			}
 			ImGui::TreePop();
 		}
 
@@ -1377,7 +1440,7 @@ void Testbed::imgui() {
 			if (m_testbed_mode == ETestbedMode::Nerf) {
 				ImGui::SameLine();
 				ImGui::Checkbox("Visualize cameras", &m_nerf.visualize_cameras);
-				accum_reset |= ImGui::SliderInt("Show acceleration", &m_nerf.show_accel, -1, 7);
+				accum_reset |= ImGui::SliderInt("Show acceleration", &m_nerf.show_accel, -1, (int)m_nerf.density_grid_shape.n_cascades - 1);
 			}
 
 			if (!m_single_view) { ImGui::BeginDisabled(); }
@@ -1428,7 +1491,7 @@ void Testbed::imgui() {
 				if (m_nerf.training.optimize_exposure) {
 					std::vector<float> exposures(m_nerf.training.dataset.n_images);
 					for (uint32_t i = 0; i < m_nerf.training.dataset.n_images; ++i) {
-						exposures[i] = m_nerf.training.cam_exposure[i].variable().x;
+						exposures[i] = m_nerf.training.cam_exposure.variable(i)[0];
 					}
 
 					ImGui::PlotLines("Training view exposures", exposures.data(), exposures.size(), 0, nullptr, FLT_MAX, FLT_MAX, ImVec2(0, 60.f));
@@ -2580,31 +2643,6 @@ void Testbed::draw_gui() {
 }
 #endif //NGP_GUI
 
-__global__ void to_8bit_color_kernel(
-	ivec2 resolution,
-	EColorSpace output_color_space,
-	cudaSurfaceObject_t surface,
-	uint8_t* result
-) {
-	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
-	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
-
-	if (x >= resolution.x || y >= resolution.y) {
-		return;
-	}
-
-	vec4 color;
-	surf2Dread((float4*)&color, surface, x * sizeof(float4), y);
-
-	if (output_color_space == EColorSpace::Linear) {
-		color.rgb = linear_to_srgb(color.rgb);
-	}
-
-	for (uint32_t i = 0; i < 3; ++i) {
-		result[(x + resolution.x * y) * 3 + i] = (uint8_t)(tcnn::clamp(color[i], 0.0f, 1.0f) * 255.0f + 0.5f);
-	}
-}
-
 void Testbed::prepare_next_camera_path_frame() {
 	if (!m_camera_path.rendering) {
 		return;
@@ -2623,22 +2661,21 @@ void Testbed::prepare_next_camera_path_frame() {
 			}
 		}
 
-		ivec2 res = m_views.front().render_buffer->out_resolution();
-		const dim3 threads = { 16, 8, 1 };
-		const dim3 blocks = { div_round_up((uint32_t)res.x, threads.x), div_round_up((uint32_t)res.y, threads.y), 1 };
-
-		GPUMemory<uint8_t> image_data(compMul(res) * 3);
-		to_8bit_color_kernel<<<blocks, threads>>>(
-			res,
-			EColorSpace::SRGB, // the GUI always renders in SRGB
+		// The readback overlaps with rendering the next frame. The frame's pinned buffer returns to
+		// the ring once the image has been written.
+		auto frame = std::make_shared<ReadbackFrame>(m_readback_ring.enqueue(
 			m_views.front().render_buffer->surface(),
-			image_data.data()
-		);
+			m_views.front().render_buffer->out_resolution(),
+			EColorSpace::SRGB, // the GUI always renders in SRGB
+			EColorSpace::SRGB,
+			EReadbackFormat::RGB8,
+			m_stream.get()
+		));
 
-		m_render_futures.emplace_back(m_thread_pool.enqueue_task([image_data=std::move(image_data), frame_idx=m_camera_path.render_frame_idx++, res, tmp_dir] {
-			std::vector<uint8_t> cpu_image_data(image_data.size());
-			CUDA_CHECK_THROW(cudaMemcpy(cpu_image_data.data(), image_data.data(), image_data.bytes(), cudaMemcpyDeviceToHost));
-			write_stbi(tmp_dir / fmt::format("{:06d}.jpg", frame_idx), res.x, res.y, 3, cpu_image_data.data(), 100);
+		m_render_futures.emplace_back(m_thread_pool.enqueue_task([frame, frame_idx=m_camera_path.render_frame_idx++, tmp_dir] {
+			ivec2 res = frame->resolution();
+			write_stbi(tmp_dir / fmt::format("{:06d}.jpg", frame_idx), res.x, res.y, 3, (const uint8_t*)frame->data(), 100);
+			frame->release();
 		}));
 
 		reset_accumulation(true);
@@ -2909,6 +2946,22 @@ void Testbed::train_and_render(bool skip_rendering) {
 			} else {
 				view.foveation = {};
 			}
+
+			// Progressive tiles accumulate with per-pixel sample counts, which DLSS and video frames do not support.
+			bool progressive_tiles = m_progressive_tiles.enabled && !view.render_buffer->dlss() && !m_camera_path.rendering;
+			view.render_buffer->enable_adaptive_sampling(progressive_tiles);
+			if (progressive_tiles) {
+				auto& scheduler = view.tile_scheduler;
+
+				// A fresh accumulation, e.g. because the camera moved, cancels all tiles that were scheduled for the previous one.
+				if (view.render_buffer->spp() == 0 || scheduler.resolution() != render_res || scheduler.tile_size() != m_progressive_tiles.tile_size) {
+					scheduler.reset(render_res, m_progressive_tiles.tile_size, view.screen_center, m_max_spp > 0 ? (uint32_t)m_max_spp : std::numeric_limits<uint32_t>::max());
+				} else {
+					scheduler.report_frame_time(m_render_ms.val());
+				}
+
+				view.render_buffer->set_active_tiles(scheduler.tile_mask(scheduler.next_tiles(m_progressive_tiles.frame_budget_ms)), scheduler.tile_size(), m_stream.get());
+			}
 		}
 	}
 
@@ -2923,11 +2976,26 @@ void Testbed::train_and_render(bool skip_rendering) {
 		sync_device(*view.render_buffer, *view.device);
 	}
 
+	bool views_in_one_trace = m_nerf.render_views_in_one_trace && m_views.size() > 1 && can_render_nerf_views_batched();
+	for (auto& view : m_views) {
+		views_in_one_trace &= view.device && view.device->is_primary() && view.visualized_dimension == m_views.front().visualized_dimension;
+	}
+
+	if (views_in_one_trace) {
+		// Rendered on the main stream, which the per-view streams of the epilogues below wait for.
+		std::vector<NerfTracer::View> tracer_views;
+		for (auto& view : m_views) {
+			tracer_views.emplace_back(nerf_tracer_view(m_stream.get(), *view.render_buffer, view.camera0, view.camera1, view.screen_center, view.relative_focal_length, view.foveation));
+		}
+
+		render_nerf_views(m_stream.get(), tracer_views, *primary_device().nerf_network(), primary_device().data().density_grid_bitfield_ptr, m_views.front().visualized_dimension);
+	}
+
 	{
 		SyncedMultiStream synced_streams{m_stream.get(), m_views.size()};
 
 		std::vector<std::future<void>> futures(m_views.size());
-		for (size_t i = 0; i < m_views.size(); ++i) {
+		for (size_t i = 0; i < m_views.size() && !views_in_one_trace; ++i) {
 			auto& view = m_views[i];
 			futures[i] = view.device->enqueue_task([this, &view, stream=synced_streams.get(i)]() {
 				auto device_guard = use_device(stream, *view.render_buffer, *view.device);
@@ -3361,7 +3429,13 @@ bool Testbed::frame() {
 	}
 	bool skip_rendering = m_render_skip_due_to_lack_of_camera_movement_counter++ != 0;
 
-	if (!m_dlss && m_max_spp > 0 && !m_views.empty() && m_views.front().render_buffer->spp() >= m_max_spp) {
+	bool converged = false;
+	if (!m_views.empty()) {
+		const auto& view = m_views.front();
+		converged = view.render_buffer->adaptive_sampling() ? view.tile_scheduler.finished() : view.render_buffer->spp() >= m_max_spp;
+	}
+
+	if (!m_dlss && m_max_spp > 0 && converged) {
 		skip_rendering = true;
 		if (!m_train) {
 			std::this_thread::sleep_for(1ms);
@@ -3373,6 +3447,10 @@ bool Testbed::frame() {
 		skip_rendering = false;
 	}
 
+	for (float ms : m_readback_ring.pop_readback_timings()) {
+		m_readback_ms.update(ms);
+	}
+
 #ifdef NGP_GUI
 	if (m_hmd && m_hmd->is_visible()) {
 		skip_rendering = false;
@@ -3483,6 +3561,25 @@ void Testbed::set_camera_from_time(float t) {
 	set_camera_from_keyframe(m_camera_path.eval_camera_path(t));
 }
 
+void Testbed::skip_camera_path_frame(float start_time, float end_time, float fps) {
+	// Mirrors the camera bookkeeping of render_to_cpu(). The per-sample camera updates of the latter
+	// need not be replayed, because the next frame overwrites them before they are used.
+	if (end_time < 0.f) {
+		end_time = start_time;
+	}
+
+	// The skipped frame is never rendered, so the next one has nothing to reproject from.
+	m_temporal_reprojection_history.invalidate();
+
+	if (start_time == 0.f) {
+		set_camera_from_time(start_time);
+		m_smoothed_camera = m_camera;
+	}
+
+	set_camera_from_time(end_time);
+	apply_camera_smoothing(1000.f / fps);
+}
+
 void Testbed::update_loss_graph() {
 	m_loss_graph[m_loss_graph_samples++ % m_loss_graph.size()] = std::log(m_loss_scalar.val());
 }
@@ -3600,7 +3697,9 @@ void Testbed::reset_network(bool clear_density_grid) {
 	m_nerf.training.n_rays_since_error_map_update = 0;
 	m_nerf.training.n_steps_between_error_map_updates = 128;
 	m_nerf.training.error_map.is_cdf_valid = false;
+	m_nerf.training.error_map.alias_n_images = 0;
 	m_nerf.training.density_grid_rng = default_rng_t{m_rng.next_uint()};
+	m_nerf.training.density_grid_schedule.reset();
 
 	m_nerf.training.reset_camera_extrinsics();
 
@@ -3637,6 +3736,15 @@ void Testbed::reset_network(bool clear_density_grid) {
 		// so just create a dummy L2 loss there. The NeRF code path will bypass
 		// the tcnn::Loss in any case.
 		loss_config["otype"] = "L2";
+
+		// Unless configured otherwise, the density grid has as many cascades as the dataset's `aabb_scale` requires.
+		DensityGridShape density_grid_shape;
+		density_grid_shape.n_cascades = std::max(density_grid_shape.n_cascades, m_nerf.max_cascade + 1);
+		if (config.contains("density_grid")) {
+			from_json(config["density_grid"], density_grid_shape);
+		}
+
+		set_density_grid_shape(density_grid_shape);
 	}
 
 	// Automatically determine certain parameters if we're dealing with the (hash)grid encoding
@@ -3691,9 +3799,9 @@ void Testbed::reset_network(bool clear_density_grid) {
 
 	size_t n_encoding_params = 0;
 	if (m_testbed_mode == ETestbedMode::Nerf) {
-		m_nerf.training.cam_exposure.resize(m_nerf.training.dataset.n_images, AdamOptimizer<vec3>(1e-3f));
-		m_nerf.training.cam_pos_offset.resize(m_nerf.training.dataset.n_images, AdamOptimizer<vec3>(1e-4f));
-		m_nerf.training.cam_rot_offset.resize(m_nerf.training.dataset.n_images, RotationAdamOptimizer(1e-4f));
+		m_nerf.training.cam_exposure.resize(m_nerf.training.dataset.n_images);
+		m_nerf.training.cam_pos_offset.resize(m_nerf.training.dataset.n_images);
+		m_nerf.training.cam_rot_offset.resize(m_nerf.training.dataset.n_images);
 		m_nerf.training.cam_focal_length_offset = AdamOptimizer<vec2>(1e-5f);
 
 		m_nerf.training.reset_extra_dims(m_rng);
@@ -3961,10 +4069,10 @@ bool Testbed::clear_tmp_dir() {
 	return success;
 }
 
-void Testbed::train(uint32_t batch_size) {
+bool Testbed::prepare_training() {
 	if (!m_training_data_available || m_camera_path.rendering) {
 		m_train = false;
-		return;
+		return false;
 	}
 
 	if (m_testbed_mode == ETestbedMode::None) {
@@ -3996,24 +4104,20 @@ void Testbed::train(uint32_t batch_size) {
 		reset_accumulation(false, false);
 	}
 
-	uint32_t n_prep_to_skip = m_testbed_mode == ETestbedMode::Nerf ? tcnn::clamp(m_training_step / 16u, 1u, 16u) : 1u;
-	if (m_training_step % n_prep_to_skip == 0) {
-		auto start = std::chrono::steady_clock::now();
-		ScopeGuard timing_guard{[&]() {
-			m_training_prep_ms.update(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now()-start).count() / n_prep_to_skip);
-		}};
-
-		switch (m_testbed_mode) {
-			case ETestbedMode::Nerf: training_prep_nerf(batch_size, m_stream.get()); break;
-			case ETestbedMode::Sdf: training_prep_sdf(batch_size, m_stream.get()); break;
-			case ETestbedMode::Image: training_prep_image(batch_size, m_stream.get()); break;
-			case ETestbedMode::Volume: training_prep_volume(batch_size, m_stream.get()); break;
-			default: throw std::runtime_error{"Invalid training mode."};
-		}
+	return true;
+}
 
-		CUDA_CHECK_THROW(cudaStreamSynchronize(m_stream.get()));
+void Testbed::training_prep(uint32_t batch_size, cudaStream_t stream) {
+	switch (m_testbed_mode) {
+		case ETestbedMode::Nerf: training_prep_nerf(batch_size, stream); break;
+		case ETestbedMode::Sdf: training_prep_sdf(batch_size, stream); break;
+		case ETestbedMode::Image: training_prep_image(batch_size, stream); break;
+		case ETestbedMode::Volume: training_prep_volume(batch_size, stream); break;
+		default: throw std::runtime_error{"Invalid training mode."};
 	}
+}
 
+void Testbed::update_optimizer_hyperparams() {
 	// Find leaf optimizer and update its settings
 	json* leaf_optimizer_config = &m_network_config["optimizer"];
 	while (leaf_optimizer_config->contains("nested")) {
@@ -4021,7 +4125,38 @@ void Testbed::train(uint32_t batch_size) {
 	}
 	(*leaf_optimizer_config)["optimize_matrix_params"] = m_train_network;
 	(*leaf_optimizer_config)["optimize_non_matrix_params"] = m_train_encoding;
+
+	if (m_applied_optimizer == m_optimizer.get() && m_applied_optimizer_config == m_network_config["optimizer"]) {
+		return;
+	}
+
 	m_optimizer->update_hyperparams(m_network_config["optimizer"]);
+	m_applied_optimizer_config = m_network_config["optimizer"];
+	m_applied_optimizer = m_optimizer.get();
+}
+
+void Testbed::train(uint32_t batch_size) {
+	if (!prepare_training()) {
+		return;
+	}
+
+	// Events of earlier steps that have completed by now
+	poll_training_profiler(false);
+	auto profile_step = profile_training_phase(ETrainingPhase::Step, m_stream.get());
+
+	uint32_t n_prep_to_skip = training_prep_interval();
+	if (m_training_step % n_prep_to_skip == 0) {
+		auto start = std::chrono::steady_clock::now();
+		ScopeGuard timing_guard{[&]() {
+			m_training_prep_ms.update(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now()-start).count() / n_prep_to_skip);
+		}};
+
+		auto profile_prep = profile_training_phase(ETrainingPhase::Prep, m_stream.get());
+		training_prep(batch_size, m_stream.get());
+		CUDA_CHECK_THROW(cudaStreamSynchronize(m_stream.get()));
+	}
+
+	update_optimizer_hyperparams();
 
 	bool get_loss_scalar = m_training_step % 16 == 0;
 
@@ -4047,6 +4182,252 @@ void Testbed::train(uint32_t batch_size) {
 	}
 }
 
+void Testbed::train_n_steps(uint32_t n_steps, uint32_t batch_size, uint32_t loss_readback_interval) {
+	if (n_steps == 0 || !prepare_training()) {
+		return;
+	}
+
+	loss_readback_interval = std::max(loss_readback_interval, 1u);
+
+	// The GUI and Python can only change the optimizer settings between calls.
+	update_optimizer_hyperparams();
+
+	cudaStream_t stream = m_stream.get();
+	auto start = std::chrono::steady_clock::now();
+
+	bool aborted = false;
+	auto consume_readbacks = [&](bool wait) {
+		for (const auto& readback : m_nerf.training.counters_rgb.poll_readbacks(wait)) {
+			if (readback.has_loss) {
+				m_loss_scalar.update(readback.loss);
+				update_loss_graph();
+			}
+
+			if (readback.measured_batch_size == 0) {
+				m_loss_scalar.set(0.f);
+				tlog::warning() << "Nerf training generated 0 samples. Aborting training.";
+				m_train = false;
+				aborted = true;
+			}
+		}
+	};
+
+	uint32_t n_steps_done = 0;
+	for (; n_steps_done < n_steps; ++n_steps_done) {
+		poll_training_profiler(false);
+		auto profile_step = profile_training_phase(ETrainingPhase::Step, stream);
+
+		uint32_t n_prep_to_skip = training_prep_interval();
+		if (m_training_step % n_prep_to_skip == 0) {
+			auto profile_prep = profile_training_phase(ETrainingPhase::Prep, stream);
+			training_prep(batch_size, stream);
+		}
+
+		bool get_loss_scalar = m_training_step % loss_readback_interval == 0;
+
+		switch (m_testbed_mode) {
+			case ETestbedMode::Nerf:
+				train_nerf(batch_size, get_loss_scalar, stream, true);
+				consume_readbacks(false);
+				break;
+			// These read their loss synchronously, but only every `loss_readback_interval` steps.
+			case ETestbedMode::Sdf: train_sdf(batch_size, get_loss_scalar, stream); break;
+			case ETestbedMode::Image: train_image(batch_size, get_loss_scalar, stream); break;
+			case ETestbedMode::Volume: train_volume(batch_size, get_loss_scalar, stream); break;
+			default: throw std::runtime_error{"Invalid training mode."};
+		}
+
+		if (m_testbed_mode != ETestbedMode::Nerf && get_loss_scalar) {
+			update_loss_graph();
+		}
+
+		// A batch that generated no samples stops training, just like in train().
+		if (aborted) {
+			++n_steps_done;
+			break;
+		}
+	}
+
+	if (m_testbed_mode == ETestbedMode::Nerf) {
+		consume_readbacks(true);
+	}
+
+	CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+	poll_training_profiler(false);
+
+	// Prep is not timed separately, since timing it would require synchronizing.
+	float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	m_training_ms.update(ms / std::max(n_steps_done, 1u));
+}
+
+uint32_t Testbed::training_prep_interval() const {
+	if (m_testbed_mode != ETestbedMode::Nerf) {
+		return 1;
+	}
+
+	uint32_t interval = m_training_prep_interval > 0 ? m_training_prep_interval : TrainingScheduler::default_density_grid_interval(m_training_step);
+	return interval * m_nerf.training.density_grid_schedule.interval_multiplier(m_training_step);
+}
+
+TrainingScheduler Testbed::train_with_schedule(const TrainingScheduleConfig& config, const std::function<float()>& evaluate, const std::vector<TrainingDecision>& replay) {
+	TrainingScheduler scheduler = replay.empty() ?
+		TrainingScheduler{config, m_training_step, m_training_batch_size} :
+		TrainingScheduler{config, m_training_step, replay};
+
+	// The density grid updates are timed by the training profiler's device events.
+	bool profiler_was_enabled = m_training_profiler.enabled();
+	m_training_profiler.set_enabled(true);
+	ScopeGuard restore_guard{[&]() {
+		m_training_profiler.set_enabled(profiler_was_enabled);
+		m_training_prep_interval = 0;
+	}};
+
+	const TrainingPhaseHistogram& prep = m_training_profiler.histogram(ETrainingPhase::Prep, ETrainingTrack::Device);
+
+	while (!scheduler.done()) {
+		if (scheduler.wants_evaluation()) {
+			auto start = std::chrono::steady_clock::now();
+			float loss = evaluate ? evaluate() : m_loss_scalar.ema_val();
+			scheduler.observe_evaluation(loss, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+			continue;
+		}
+
+		uint32_t n_steps = scheduler.next_chunk_steps();
+		uint32_t batch_size = next_multiple(scheduler.batch_size(), batch_size_granularity);
+		m_training_prep_interval = scheduler.tuned_density_grid_interval();
+
+		uint32_t first_step = m_training_step;
+		uint64_t n_preps = prep.count();
+		double prep_us = prep.total_us();
+
+		auto start = std::chrono::steady_clock::now();
+		train_n_steps(n_steps, batch_size);
+		poll_training_profiler(true);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		uint32_t n_steps_done = m_training_step - first_step;
+		if (n_steps_done < n_steps) {
+			scheduler.abort(fmt::format("trained {} of {} steps", n_steps_done, n_steps));
+			break;
+		}
+
+		scheduler.observe_steps(n_steps, seconds, (prep.total_us() - prep_us) * 1e-6, (uint32_t)(prep.count() - n_preps));
+	}
+
+	// Keep training at the chosen batch size, e.g. in the GUI
+	m_training_batch_size = next_multiple(scheduler.batch_size(), batch_size_granularity);
+	return scheduler;
+}
+
+struct Testbed::TrainingProfilerEvents {
+	struct Pending {
+		ETrainingPhase phase;
+		uint32_t step;
+		cudaEvent_t start;
+		cudaEvent_t end;
+	};
+
+	TrainingProfilerEvents(cudaStream_t stream) {
+		CUDA_CHECK_THROW(cudaEventCreate(&epoch));
+		CUDA_CHECK_THROW(cudaEventRecord(epoch, stream));
+		host_epoch = std::chrono::steady_clock::now();
+	}
+
+	~TrainingProfilerEvents() {
+		for (auto& p : pending) {
+			cudaEventSynchronize(p.end);
+			cudaEventDestroy(p.start);
+			cudaEventDestroy(p.end);
+		}
+
+		for (auto event : free_events) {
+			cudaEventDestroy(event);
+		}
+
+		cudaEventDestroy(epoch);
+	}
+
+	cudaEvent_t acquire() {
+		if (free_events.empty()) {
+			cudaEvent_t event;
+			CUDA_CHECK_THROW(cudaEventCreate(&event));
+			return event;
+		}
+
+		cudaEvent_t event = free_events.back();
+		free_events.pop_back();
+		return event;
+	}
+
+	// Origins of the device and host timelines
+	cudaEvent_t epoch = nullptr;
+	std::chrono::steady_clock::time_point host_epoch;
+
+	std::vector<cudaEvent_t> free_events;
+	// In the order in which the phases ended, which is the order in which they complete on the stream
+	std::deque<Pending> pending;
+};
+
+tcnn::ScopeGuard Testbed::profile_training_phase(ETrainingPhase phase, cudaStream_t stream) {
+	if (!m_training_profiler.enabled()) {
+		return {};
+	}
+
+	if (!m_training_profiler_events) {
+		m_training_profiler_events = std::make_shared<TrainingProfilerEvents>(stream);
+	}
+
+	auto events = m_training_profiler_events;
+	uint32_t step = m_training_step;
+
+	cudaEvent_t start = events->acquire();
+	CUDA_CHECK_THROW(cudaEventRecord(start, stream));
+	auto host_start = std::chrono::steady_clock::now();
+
+	return tcnn::ScopeGuard{[this, events, phase, step, start, host_start, stream]() {
+		auto host_end = std::chrono::steady_clock::now();
+		m_training_profiler.record(
+			phase, ETrainingTrack::Host, step,
+			std::chrono::duration<double, std::micro>(host_start - events->host_epoch).count(),
+			std::chrono::duration<double, std::micro>(host_end - host_start).count()
+		);
+
+		cudaEvent_t end = events->acquire();
+		CUDA_CHECK_PRINT(cudaEventRecord(end, stream));
+		events->pending.push_back({phase, step, start, end});
+	}};
+}
+
+void Testbed::poll_training_profiler(bool wait) {
+	if (!m_training_profiler_events) {
+		return;
+	}
+
+	auto& events = *m_training_profiler_events;
+	while (!events.pending.empty()) {
+		auto& p = events.pending.front();
+		if (wait) {
+			CUDA_CHECK_THROW(cudaEventSynchronize(p.end));
+		} else {
+			cudaError_t result = cudaEventQuery(p.end);
+			if (result == cudaErrorNotReady) {
+				break;
+			}
+
+			CUDA_CHECK_THROW(result);
+		}
+
+		float start_ms, duration_ms;
+		CUDA_CHECK_THROW(cudaEventElapsedTime(&start_ms, events.epoch, p.start));
+		CUDA_CHECK_THROW(cudaEventElapsedTime(&duration_ms, p.start, p.end));
+		m_training_profiler.record(p.phase, ETrainingTrack::Device, p.step, start_ms * 1000.0, duration_ms * 1000.0);
+
+		events.free_events.push_back(p.start);
+		events.free_events.push_back(p.end);
+		events.pending.pop_front();
+	}
+}
+
 vec2 Testbed::calc_focal_length(const ivec2& resolution, const vec2& relative_focal_length, int fov_axis, float zoom) const {
 	return relative_focal_length * (float)resolution[fov_axis] * zoom;
 }
@@ -4296,6 +4677,33 @@ void Testbed::render_frame(
 	render_frame_epilogue(stream, camera_matrix0, prev_camera_matrix, orig_screen_center, relative_focal_length, foveation, prev_foveation, render_buffer, to_srgb);
 }
 
+Testbed::NerfTracer::View Testbed::nerf_tracer_view(
+	cudaStream_t stream,
+	CudaRenderBuffer& render_buffer,
+	const mat4x3& camera_matrix0,
+	const mat4x3& camera_matrix1,
+	const vec2& orig_screen_center,
+	const vec2& relative_focal_length,
+	const Foveation& foveation
+) {
+	auto view = render_buffer.view();
+	view.clear(stream);
+
+	return {
+		view.spp,
+		view.resolution,
+		calc_focal_length(view.resolution, relative_focal_length, m_fov_axis, m_zoom),
+		camera_matrix0,
+		camera_matrix1,
+		{0.0f, 0.0f, 0.0f, 1.0f},
+		render_screen_center(orig_screen_center),
+		foveation,
+		view.frame_buffer,
+		view.depth_buffer,
+		view.hidden_area_mask ? view.hidden_area_mask->const_view() : Buffer2DView<const uint8_t>{},
+	};
+}
+
 void Testbed::render_frame_main(
 	CudaDevice& device,
 	const mat4x3& camera_matrix0,
@@ -4497,7 +4905,7 @@ void Testbed::render_frame_epilogue(
 			if (m_ground_truth_render_mode == EGroundTruthRenderMode::Shade) {
 				render_buffer.overlay_image(
 					m_ground_truth_alpha,
-					vec3(m_exposure) + m_nerf.training.cam_exposure[m_nerf.training.view].variable(),
+					vec3(m_exposure) + m_nerf.training.cam_exposure.variable_as<vec3>(m_nerf.training.view),
 					m_background_color,
 					output_color_space,
 					metadata.pixels,
@@ -4575,6 +4983,118 @@ void Testbed::render_frame_epilogue(
 #endif
 }
 
+Testbed::AovImages Testbed::render_aovs(const ivec2& resolution, bool normals) {
+	if (m_testbed_mode != ETestbedMode::Nerf) {
+		throw std::runtime_error{"AOV rendering is only supported for NeRF."};
+	}
+
+	size_t n_pixels = compMul(resolution);
+	GPUMemory<float> alpha(n_pixels), expected_depth(n_pixels), median_depth(n_pixels);
+	GPUMemory<vec3> normal(normals ? n_pixels : 0);
+	GPUMemory<uint32_t> n_steps(n_pixels);
+
+	alpha.memset(0);
+	expected_depth.memset(0);
+	median_depth.memset(0);
+	n_steps.memset(0);
+	if (normals) {
+		normal.memset(0);
+	}
+
+	auto prev_render_mode = m_render_mode;
+	ScopeGuard aov_guard{[&]() {
+		m_nerf.render_aovs = {};
+		m_render_mode = prev_render_mode;
+	}};
+
+	m_render_mode = ERenderMode::Shade;
+	m_nerf.render_aovs = {alpha.data(), expected_depth.data(), median_depth.data(), normals ? normal.data() : nullptr, n_steps.data()};
+
+	m_windowless_render_surface.resize(resolution);
+	m_windowless_render_surface.reset_accumulation();
+	m_smoothed_camera = m_camera;
+
+	render_frame(
+		m_stream.get(),
+		m_camera,
+		m_camera,
+		m_camera,
+		m_screen_center,
+		m_relative_focal_length,
+		{0.0f, 0.0f, 0.0f, 1.0f},
+		{},
+		{},
+		-1,
+		m_windowless_render_surface,
+		false
+	);
+
+	AovImages result;
+	result.resolution = resolution;
+	result.rgba.resize(n_pixels);
+	result.alpha.resize(n_pixels);
+	result.expected_depth.resize(n_pixels);
+	result.median_depth.resize(n_pixels);
+	result.n_steps.resize(n_pixels);
+
+	CUDA_CHECK_THROW(cudaMemcpy2DFromArray(result.rgba.data(), resolution.x * sizeof(vec4), m_windowless_render_surface.surface_provider().array(), 0, 0, resolution.x * sizeof(vec4), resolution.y, cudaMemcpyDeviceToHost));
+	alpha.copy_to_host(result.alpha);
+	expected_depth.copy_to_host(result.expected_depth);
+	median_depth.copy_to_host(result.median_depth);
+	n_steps.copy_to_host(result.n_steps);
+	if (normals) {
+		result.normal.resize(n_pixels);
+		normal.copy_to_host(result.normal);
+	}
+
+	float depth_scale = 1.0f / m_nerf.training.dataset.scale;
+	for (size_t i = 0; i < n_pixels; ++i) {
+		result.expected_depth[i] = result.alpha[i] > 0.0f ? result.expected_depth[i] / result.alpha[i] * depth_scale : 0.0f;
+		result.median_depth[i] *= depth_scale;
+		result.alpha[i] = std::min(result.alpha[i], 1.0f);
+		if (normals && length2(result.normal[i]) > 0.0f) {
+			result.normal[i] = normalize(result.normal[i]);
+		}
+	}
+
+	return result;
+}
+
+void Testbed::save_aovs_exr(const AovImages& aovs, const fs::path& path) {
+	size_t n_pixels = compMul(aovs.resolution);
+
+	std::vector<float> planes[8];
+	for (auto& p : planes) {
+		p.resize(n_pixels);
+	}
+
+	for (size_t i = 0; i < n_pixels; ++i) {
+		for (int c = 0; c < 3; ++c) {
+			planes[c][i] = aovs.rgba[i][c];
+			planes[4 + c][i] = aovs.normal.empty() ? 0.0f : aovs.normal[i][c];
+		}
+		planes[3][i] = (float)aovs.n_steps[i];
+	}
+
+	std::vector<std::pair<std::string, const float*>> channels = {
+		{"R", planes[0].data()},
+		{"G", planes[1].data()},
+		{"B", planes[2].data()},
+		{"A", aovs.alpha.data()},
+		{"Z", aovs.expected_depth.data()},
+		{"median.Z", aovs.median_depth.data()},
+		{"steps.Y", planes[3].data()},
+	};
+
+	if (!aovs.normal.empty()) {
+		channels.emplace_back("N.X", planes[4].data());
+		channels.emplace_back("N.Y", planes[5].data());
+		channels.emplace_back("N.Z", planes[6].data());
+	}
+
+	save_exr(channels, aovs.resolution.x, aovs.resolution.y, path);
+}
+
 float Testbed::get_depth_from_renderbuffer(const CudaRenderBuffer& render_buffer, const vec2& uv) {
 	if (!render_buffer.depth_buffer()) {
 		return m_scale;
@@ -4681,7 +5201,7 @@ void Testbed::save_snapshot(const fs::path& path, bool include_optimizer_state,
 	snapshot["mode"] = to_string(m_testbed_mode);
 
 	if (m_testbed_mode == ETestbedMode::Nerf) {
-		snapshot["density_grid_size"] = NERF_GRIDSIZE();
+		snapshot["density_grid_size"] = m_nerf.density_grid_shape.size;
 
 		GPUMemory<__half> density_grid_fp16(m_nerf.density_grid.size());
 		parallel_for_gpu(density_grid_fp16.size(), [density_grid=m_nerf.density_grid.data(), density_grid_fp16=density_grid_fp16.data()] __device__ (size_t i) {
@@ -4693,6 +5213,8 @@ void Testbed::save_snapshot(const fs::path& path, bool include_optimizer_state,
 
 		snapshot["nerf"]["cam_pos_offset"] = m_nerf.training.cam_pos_offset;
 		snapshot["nerf"]["cam_rot_offset"] = m_nerf.training.cam_rot_offset;
+
+		m_nerf.training.sync_extra_dims_to_host(m_stream.get());
 		snapshot["nerf"]["extra_dims_opt"] = m_nerf.training.extra_dims_opt;
 	}
 
@@ -4763,10 +5285,18 @@ void Testbed::load_snapshot(const fs::path& path) {
 	m_bounding_radius = snapshot.value("bounding_radius", m_bounding_radius);
 
 	if (m_testbed_mode == ETestbedMode::Nerf) {
-		if (snapshot["density_grid_size"] != NERF_GRIDSIZE()) {
-			throw std::runtime_error{"Incompatible grid size."};
+		// The model's density grid shape. Snapshots from before it was configurable use the default shape. Neither
+		// the previous model's grid nor its cascade count apply to it; load_nerf_post() recomputes the latter and
+		// adds cascades if the scene needs them.
+		DensityGridShape density_grid_shape;
+		if (config.contains("density_grid")) {
+			from_json(config["density_grid"], density_grid_shape);
 		}
 
+		m_nerf.density_grid.free_memory();
+		m_nerf.max_cascade = 0;
+		set_density_grid_shape(density_grid_shape);
+
 		m_nerf.training.counters_rgb.rays_per_batch = snapshot["nerf"]["rgb"]["rays_per_batch"];
 		m_nerf.training.counters_rgb.measured_batch_size = snapshot["nerf"]["rgb"]["measured_batch_size"];
 		m_nerf.training.counters_rgb.measured_batch_size_before_compaction = snapshot["nerf"]["rgb"]["measured_batch_size_before_compaction"];
@@ -4795,11 +5325,15 @@ void Testbed::load_snapshot(const fs::path& path) {
 			density_grid[i] = (float)density_grid_fp16[i];
 		});
 
-		if (m_nerf.density_grid.size() == NERF_GRID_N_CELLS() * (m_nerf.max_cascade + 1)) {
+		// A size of 0 indicates that the density grid was never populated, which is a valid state of a (yet) untrained model.
+		if (m_nerf.density_grid.size() != 0) {
+			// The stored grid may differ from the model's shape, e.g. if the snapshot's config was edited.
+			uint32_t snapshot_grid_size = snapshot.value("density_grid_size", NERF_GRIDSIZE());
+			if (snapshot_grid_size != m_nerf.density_grid_shape.size || m_nerf.density_grid.size() != m_nerf.density_grid_shape.n_cells() * (m_nerf.max_cascade + 1)) {
+				resample_density_grid_nerf(snapshot_grid_size, nullptr);
+			}
+
 			update_density_grid_mean_and_bitfield(nullptr);
-		} else if (m_nerf.density_grid.size() != 0) {
-			// A size of 0 indicates that the density grid was never populated, which is a valid state of a (yet) untrained model.
-			throw std::runtime_error{"Incompatible number of grid cascades."};
 		}
 	}
 
@@ -4850,9 +5384,13 @@ void Testbed::load_snapshot(const fs::path& path) {
 		// in the first place), load dataset-specific optimized quantities, such as
 		// extrinsics, exposure, latents.
 		if (snapshot["nerf"].contains("dataset") && m_nerf.training.dataset.is_same(snapshot["nerf"]["dataset"])) {
-			if (snapshot["nerf"].contains("cam_pos_offset")) m_nerf.training.cam_pos_offset = snapshot["nerf"].at("cam_pos_offset").get<std::vector<AdamOptimizer<vec3>>>();
-			if (snapshot["nerf"].contains("cam_rot_offset")) m_nerf.training.cam_rot_offset = snapshot["nerf"].at("cam_rot_offset").get<std::vector<RotationAdamOptimizer>>();
-			if (snapshot["nerf"].contains("extra_dims_opt")) m_nerf.training.extra_dims_opt = snapshot["nerf"].at("extra_dims_opt").get<std::vector<VarAdamOptimizer>>();
+			if (snapshot["nerf"].contains("cam_pos_offset")) m_nerf.training.cam_pos_offset.from_json(snapshot["nerf"].at("cam_pos_offset"));
+			if (snapshot["nerf"].contains("cam_rot_offset")) m_nerf.training.cam_rot_offset.from_json(snapshot["nerf"].at("cam_rot_offset"));
+			if (snapshot["nerf"].contains("extra_dims_opt")) {
+				m_nerf.training.extra_dims_opt_gpu = {};
+				m_nerf.training.extra_dims_opt.from_json(snapshot["nerf"].at("extra_dims_opt"));
+			}
+
 			m_nerf.training.update_transforms();
 			m_nerf.training.update_extra_dims();
 		}
@@ -4971,5 +5509,16 @@ void Testbed::set_loop_animation(bool value) {
 	m_camera_path.loop = value;
 }
 
+std::vector<mat4x3> Testbed::camera_path_poses(const std::vector<float>& ts, bool nerf_space) {
+	std::vector<CameraKeyframe> keyframes = m_camera_path.eval_many(ts);
+
+	std::vector<mat4x3> poses(keyframes.size());
+	for (size_t i = 0; i < keyframes.size(); ++i) {
+		poses[i] = nerf_space ? m_nerf.training.dataset.ngp_matrix_to_nerf(keyframes[i].m()) : keyframes[i].m();
+	}
+
+	return poses;
+}
+
 NGP_NAMESPACE_END
 
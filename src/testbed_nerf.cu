@@ -13,12 +13,16 @@
  */
 
 #include <neural-graphics-primitives/adam_optimizer.h>
+#include <neural-graphics-primitives/baked_nerf.h>
+#include <neural-graphics-primitives/chebyshev_distance.h>
 #include <neural-graphics-primitives/common_device.cuh>
 #include <neural-graphics-primitives/common.h>
 #include <neural-graphics-primitives/envmap.cuh>
+#include <neural-graphics-primitives/error_map_sampler.h>
 #include <neural-graphics-primitives/json_binding.h>
 #include <neural-graphics-primitives/marching_cubes.h>
 #include <neural-graphics-primitives/nerf_loader.h>
+#include <neural-graphics-primitives/nerf_march_schedule.h>
 #include <neural-graphics-primitives/nerf_network.h>
 #include <neural-graphics-primitives/render_buffer.h>
 #include <neural-graphics-primitives/testbed.h>
@@ -36,6 +40,15 @@
 #include <filesystem/directory.h>
 #include <filesystem/path.h>
 
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <thread>
+
 
 #ifdef copysign
 #undef copysign
@@ -47,12 +60,12 @@ NGP_NAMESPACE_BEGIN
 
 inline constexpr __device__ float NERF_RENDERING_NEAR_DISTANCE() { return 0.05f; }
 inline constexpr __device__ uint32_t NERF_STEPS() { return 1024; } // finest number of steps per unit length
-inline constexpr __device__ uint32_t NERF_CASCADES() { return 8; }
 
 inline constexpr __device__ float SQRT3() { return 1.73205080757f; }
 inline constexpr __device__ float STEPSIZE() { return (SQRT3() / NERF_STEPS()); } // for nerf raymarch
 inline constexpr __device__ float MIN_CONE_STEPSIZE() { return STEPSIZE(); }
-// Maximum step size is the width of the coarsest gridsize cell.
+// Maximum step size is the width of the coarsest cell of the default grid shape, such that sampling does not depend on
+// the density grid shape of a model.
 inline constexpr __device__ float MAX_CONE_STEPSIZE() { return STEPSIZE() * (1<<(NERF_CASCADES()-1)) * NERF_STEPS() / NERF_GRIDSIZE(); }
 
 // Used to index into the PRNG stream. Must be larger than the number of
@@ -66,6 +79,8 @@ static constexpr uint32_t MARCH_ITER = 10000;
 
 static constexpr uint32_t MIN_STEPS_INBETWEEN_COMPACTION = 1;
 static constexpr uint32_t MAX_STEPS_INBETWEEN_COMPACTION = 8;
+// Number of compactions by which the alive count that plans a marching step may lag behind the device. See NerfMarchSchedule.
+static constexpr uint32_t MAX_ALIVE_COUNT_STALENESS = 1;
 
 Testbed::NetworkDims Testbed::network_dims_nerf() const {
 	NetworkDims dims;
@@ -75,8 +90,15 @@ Testbed::NetworkDims Testbed::network_dims_nerf() const {
 	return dims;
 }
 
+// Density grid kernels are specialized for the grid sizes of dispatch_density_grid_size().
+template <uint32_t GRID_SIZE>
+inline constexpr __host__ __device__ uint32_t grid_n_cells() {
+	return GRID_SIZE * GRID_SIZE * GRID_SIZE;
+}
+
+template <uint32_t GRID_SIZE>
 inline __host__ __device__ uint32_t grid_mip_offset(uint32_t mip) {
-	return NERF_GRID_N_CELLS() * mip;
+	return grid_n_cells<GRID_SIZE>() * mip;
 }
 
 inline __host__ __device__ float calc_cone_angle(float cosine, const vec2& focal_length, float cone_angle_constant) {
@@ -231,20 +253,23 @@ inline __device__ LossAndGradient mape_loss(const vec3& target, const vec3& pred
 	};
 }
 
-inline __device__ float distance_to_next_voxel(const vec3& pos, const vec3& dir, const vec3& idir, float res) { // dda like step
+// `n_skip_cells` additional cells in the direction of the ray are known to be empty and get skipped as well.
+inline __device__ float distance_to_next_voxel(const vec3& pos, const vec3& dir, const vec3& idir, float res, uint32_t n_skip_cells = 0) { // dda like step
 	vec3 p = res * (pos - vec3(0.5f));
-	float tx = (floorf(p.x + 0.5f + 0.5f * sign(dir.x)) - p.x) * idir.x;
-	float ty = (floorf(p.y + 0.5f + 0.5f * sign(dir.y)) - p.y) * idir.y;
-	float tz = (floorf(p.z + 0.5f + 0.5f * sign(dir.z)) - p.z) * idir.z;
+	float skip = (float)n_skip_cells;
+	float tx = (floorf(p.x + 0.5f + 0.5f * sign(dir.x)) + skip * sign(dir.x) - p.x) * idir.x;
+	float ty = (floorf(p.y + 0.5f + 0.5f * sign(dir.y)) + skip * sign(dir.y) - p.y) * idir.y;
+	float tz = (floorf(p.z + 0.5f + 0.5f * sign(dir.z)) + skip * sign(dir.z) - p.z) * idir.z;
 	float t = min(min(tx, ty), tz);
 
 	return fmaxf(t / res, 0.0f);
 }
 
-inline __device__ float advance_to_next_voxel(float t, float cone_angle, const vec3& pos, const vec3& dir, const vec3& idir, uint32_t mip) {
-	float res = scalbnf(NERF_GRIDSIZE(), -(int)mip);
+template <uint32_t GRID_SIZE>
+inline __device__ float advance_to_next_voxel(float t, float cone_angle, const vec3& pos, const vec3& dir, const vec3& idir, uint32_t mip, uint32_t n_skip_cells = 0) {
+	float res = scalbnf((float)GRID_SIZE, -(int)mip);
 
-	float t_target = t + distance_to_next_voxel(pos, dir, idir, res);
+	float t_target = t + distance_to_next_voxel(pos, dir, idir, res, n_skip_cells);
 
 	// Analytic stepping in multiples of 1 in the "log-space" of our exponential stepping routine
 	t = to_stepping_space(t, cone_angle);
@@ -366,43 +391,58 @@ __device__ float unwarp_dt(float dt) {
 	return dt * (max_stepsize - MIN_CONE_STEPSIZE()) + MIN_CONE_STEPSIZE();
 }
 
+template <uint32_t GRID_SIZE>
 __device__ uint32_t cascaded_grid_idx_at(vec3 pos, uint32_t mip) {
 	float mip_scale = scalbnf(1.0f, -mip);
 	pos -= vec3(0.5f);
 	pos *= mip_scale;
 	pos += vec3(0.5f);
 
-	ivec3 i = pos * (float)NERF_GRIDSIZE();
-	if (i.x < 0 || i.x >= NERF_GRIDSIZE() || i.y < 0 || i.y >= NERF_GRIDSIZE() || i.z < 0 || i.z >= NERF_GRIDSIZE()) {
+	ivec3 i = pos * (float)GRID_SIZE;
+	if (i.x < 0 || i.x >= GRID_SIZE || i.y < 0 || i.y >= GRID_SIZE || i.z < 0 || i.z >= GRID_SIZE) {
 		return 0xFFFFFFFF;
 	}
 
 	return tcnn::morton3D(i.x, i.y, i.z);
 }
 
+template <uint32_t GRID_SIZE>
 __device__ bool density_grid_occupied_at(const vec3& pos, const uint8_t* density_grid_bitfield, uint32_t mip) {
-	uint32_t idx = cascaded_grid_idx_at(pos, mip);
+	uint32_t idx = cascaded_grid_idx_at<GRID_SIZE>(pos, mip);
 	if (idx == 0xFFFFFFFF) {
 		return false;
 	}
-	return density_grid_bitfield[idx/8+grid_mip_offset(mip)/8] & (1<<(idx%8));
+	return density_grid_bitfield[idx/8+grid_mip_offset<GRID_SIZE>(mip)/8] & (1<<(idx%8));
+}
+
+// Chebyshev distance, in cells of cascade `mip`, from the cell at `pos` to the nearest occupied cell or the boundary
+// of the cascade. 0 means occupied.
+template <uint32_t GRID_SIZE>
+__device__ uint32_t density_grid_distance_at(const vec3& pos, const uint8_t* density_grid_distance_field, uint32_t mip) {
+	uint32_t idx = cascaded_grid_idx_at<GRID_SIZE>(pos, mip);
+	if (idx == 0xFFFFFFFF) {
+		return 0;
+	}
+	return density_grid_distance_field[idx+grid_mip_offset<GRID_SIZE>(mip)];
 }
 
+template <uint32_t GRID_SIZE>
 __device__ float cascaded_grid_at(vec3 pos, const float* cascaded_grid, uint32_t mip) {
-	uint32_t idx = cascaded_grid_idx_at(pos, mip);
+	uint32_t idx = cascaded_grid_idx_at<GRID_SIZE>(pos, mip);
 	if (idx == 0xFFFFFFFF) {
 		return 0.0f;
 	}
-	return cascaded_grid[idx+grid_mip_offset(mip)];
+	return cascaded_grid[idx+grid_mip_offset<GRID_SIZE>(mip)];
 }
 
+template <uint32_t GRID_SIZE>
 __device__ float& cascaded_grid_at(vec3 pos, float* cascaded_grid, uint32_t mip) {
-	uint32_t idx = cascaded_grid_idx_at(pos, mip);
+	uint32_t idx = cascaded_grid_idx_at<GRID_SIZE>(pos, mip);
 	if (idx == 0xFFFFFFFF) {
 		idx = 0;
 		printf("WARNING: invalid cascaded grid access.");
 	}
-	return cascaded_grid[idx+grid_mip_offset(mip)];
+	return cascaded_grid[idx+grid_mip_offset<GRID_SIZE>(mip)];
 }
 
 __global__ void extract_srgb_with_activation(const uint32_t n_elements,	const uint32_t rgb_stride, const float* __restrict__ rgbd, float* __restrict__ rgb, ENerfActivation rgb_activation, bool from_linear) {
@@ -420,6 +460,7 @@ __global__ void extract_srgb_with_activation(const uint32_t n_elements,	const ui
 	rgb[elem_idx*rgb_stride + dim_idx] = c;
 }
 
+template <uint32_t GRID_SIZE>
 __global__ void mark_untrained_density_grid(const uint32_t n_elements,  float* __restrict__ grid_out,
 	const uint32_t n_training_images,
 	const TrainingImageMetadata* __restrict__ metadata,
@@ -429,15 +470,15 @@ __global__ void mark_untrained_density_grid(const uint32_t n_elements,  float* _
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= n_elements) return;
 
-	uint32_t level = i / NERF_GRID_N_CELLS();
-	uint32_t pos_idx = i % NERF_GRID_N_CELLS();
+	uint32_t level = i / grid_n_cells<GRID_SIZE>();
+	uint32_t pos_idx = i % grid_n_cells<GRID_SIZE>();
 
 	uint32_t x = tcnn::morton3D_invert(pos_idx>>0);
 	uint32_t y = tcnn::morton3D_invert(pos_idx>>1);
 	uint32_t z = tcnn::morton3D_invert(pos_idx>>2);
 
-	float voxel_size = scalbnf(1.0f / NERF_GRIDSIZE(), level);
-	vec3 pos = (vec3{(float)x, (float)y, (float)z} / (float)NERF_GRIDSIZE() - vec3(0.5f)) * scalbnf(1.0f, level) + vec3(0.5f);
+	float voxel_size = scalbnf(1.0f / GRID_SIZE, level);
+	vec3 pos = (vec3{(float)x, (float)y, (float)z} / (float)GRID_SIZE - vec3(0.5f)) * scalbnf(1.0f, level) + vec3(0.5f);
 
 	vec3 corners[8] = {
 		pos + vec3{0.0f,       0.0f,       0.0f      },
@@ -509,7 +550,8 @@ __global__ void generate_grid_samples_nerf_uniform(ivec3 res_3d, const uint32_t
 }
 
 // generate samples for uniform grid including constant ray direction
-__global__ void generate_grid_samples_nerf_uniform_dir(ivec3 res_3d, const uint32_t step, BoundingBox render_aabb, mat3 render_aabb_to_local, BoundingBox train_aabb, vec3 ray_dir, PitchedPtr<NerfCoordinate> network_input, const float* extra_dims, bool voxel_centers) {
+template <uint32_t N_EXTRA_DIMS>
+__global__ void generate_grid_samples_nerf_uniform_dir(ivec3 res_3d, const uint32_t step, BoundingBox render_aabb, mat3 render_aabb_to_local, BoundingBox train_aabb, vec3 ray_dir, NerfCoordinates<N_EXTRA_DIMS> network_input, const float* extra_dims, bool voxel_centers) {
 	// check grid_in for negative values -> must be negative on output
 	uint32_t x = threadIdx.x + blockIdx.x * blockDim.x;
 	uint32_t y = threadIdx.y + blockIdx.y * blockDim.y;
@@ -528,19 +570,20 @@ __global__ void generate_grid_samples_nerf_uniform_dir(ivec3 res_3d, const uint3
 
 	pos = transpose(render_aabb_to_local) * (pos * (render_aabb.max - render_aabb.min) + render_aabb.min);
 
-	network_input(i)->set_with_optional_extra_dims(warp_position(pos, train_aabb), warp_direction(ray_dir), warp_dt(MIN_CONE_STEPSIZE()), extra_dims, network_input.stride_in_bytes);
+	network_input.set(i, warp_position(pos, train_aabb), warp_direction(ray_dir), warp_dt(MIN_CONE_STEPSIZE()), extra_dims);
 }
 
-inline __device__ uint32_t mip_from_pos(const vec3& pos, uint32_t max_cascade = NERF_CASCADES()-1) {
+inline __device__ uint32_t mip_from_pos(const vec3& pos, uint32_t max_cascade = NERF_MAX_CASCADES()-1) {
 	int exponent;
 	float maxval = compMax(abs(pos - vec3(0.5f)));
 	frexpf(maxval, &exponent);
 	return (uint32_t)tcnn::clamp(exponent+1, 0, (int)max_cascade);
 }
 
-inline __device__ uint32_t mip_from_dt(float dt, const vec3& pos, uint32_t max_cascade = NERF_CASCADES()-1) {
+template <uint32_t GRID_SIZE>
+inline __device__ uint32_t mip_from_dt(float dt, const vec3& pos, uint32_t max_cascade = NERF_MAX_CASCADES()-1) {
 	uint32_t mip = mip_from_pos(pos, max_cascade);
-	dt *= 2 * NERF_GRIDSIZE();
+	dt *= 2 * GRID_SIZE;
 	if (dt < 1.0f) {
 		return mip;
 	}
@@ -550,32 +593,39 @@ inline __device__ uint32_t mip_from_dt(float dt, const vec3& pos, uint32_t max_c
 	return (uint32_t)tcnn::clamp((int)mip, exponent, (int)max_cascade);
 }
 
-__global__ void generate_grid_samples_nerf_nonuniform(const uint32_t n_elements, default_rng_t rng, const uint32_t step, BoundingBox aabb, const float* __restrict__ grid_in, NerfPosition* __restrict__ out, uint32_t* __restrict__ indices, uint32_t n_cascades, float thresh) {
+template <uint32_t GRID_SIZE>
+__global__ void generate_grid_samples_nerf_nonuniform(const uint32_t n_elements, default_rng_t rng, const uint32_t step, BoundingBox aabb, const float* __restrict__ grid_in, NerfPosition* __restrict__ out, uint32_t* __restrict__ indices, uint32_t cascade_mask, float thresh) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= n_elements) return;
 
-	// 1 random number to select the level, 3 to select the position.
+	// 1 random number to select the level among those in `cascade_mask`, 3 to select the position.
 	rng.advance(i*4);
-	uint32_t level = (uint32_t)(random_val(rng) * n_cascades) % n_cascades;
+	uint32_t n_cascades = __popc(cascade_mask);
+	uint32_t mask = cascade_mask;
+	for (uint32_t j = (uint32_t)(random_val(rng) * n_cascades) % n_cascades; j > 0; --j) {
+		mask &= mask - 1;
+	}
+
+	uint32_t level = __ffs(mask) - 1;
 
 	// Select grid cell that has density
 	uint32_t idx;
 	for (uint32_t j = 0; j < 10; ++j) {
-		idx = ((i+step*n_elements) * 56924617 + j * 19349663 + 96925573) % NERF_GRID_N_CELLS();
-		idx += level * NERF_GRID_N_CELLS();
+		idx = ((i+step*n_elements) * 56924617 + j * 19349663 + 96925573) % grid_n_cells<GRID_SIZE>();
+		idx += level * grid_n_cells<GRID_SIZE>();
 		if (grid_in[idx] > thresh) {
 			break;
 		}
 	}
 
 	// Random position within that cellq
-	uint32_t pos_idx = idx % NERF_GRID_N_CELLS();
+	uint32_t pos_idx = idx % grid_n_cells<GRID_SIZE>();
 
 	uint32_t x = tcnn::morton3D_invert(pos_idx>>0);
 	uint32_t y = tcnn::morton3D_invert(pos_idx>>1);
 	uint32_t z = tcnn::morton3D_invert(pos_idx>>2);
 
-	vec3 pos = ((vec3{(float)x, (float)y, (float)z} + random_val_3d(rng)) / (float)NERF_GRIDSIZE() - vec3(0.5f)) * scalbnf(1.0f, level) + vec3(0.5f);
+	vec3 pos = ((vec3{(float)x, (float)y, (float)z} + random_val_3d(rng)) / (float)GRID_SIZE - vec3(0.5f)) * scalbnf(1.0f, level) + vec3(0.5f);
 
 	out[i] = { warp_position(pos, aabb), warp_dt(MIN_CONE_STEPSIZE()) };
 	indices[i] = idx;
@@ -599,6 +649,7 @@ __global__ void splat_grid_samples_nerf_max_nearest_neighbor(const uint32_t n_el
 	atomicMax((uint32_t*)&grid_out[local_idx], __float_as_uint(optical_thickness));
 }
 
+template <uint32_t GRID_SIZE>
 __global__ void grid_samples_half_to_float(const uint32_t n_elements, BoundingBox aabb, float* dst, const tcnn::network_precision_t* network_output, ENerfActivation density_activation, const NerfPosition* __restrict__ coords_in, const float* __restrict__ grid_in, uint32_t max_cascade) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= n_elements) return;
@@ -609,7 +660,7 @@ __global__ void grid_samples_half_to_float(const uint32_t n_elements, BoundingBo
 
 	if (grid_in) {
 		vec3 pos = unwarp_position(coords_in[i].p, aabb);
-		float grid_density = cascaded_grid_at(pos, grid_in, mip_from_pos(pos, max_cascade));
+		float grid_density = cascaded_grid_at<GRID_SIZE>(pos, grid_in, mip_from_pos(pos, max_cascade));
 		if (grid_density < NERF_MIN_OPTICAL_THICKNESS()) {
 			mlp = -10000.0f;
 		}
@@ -621,12 +672,17 @@ __global__ void grid_samples_half_to_float(const uint32_t n_elements, BoundingBo
 __global__ void ema_grid_samples_nerf(const uint32_t n_elements,
 	float decay,
 	const uint32_t count,
+	const uint32_t n_cells,
+	const uint32_t cascade_mask,
 	float* __restrict__ grid_out,
 	const float* __restrict__ grid_in
 ) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= n_elements) return;
 
+	// Cascades that were not sampled keep their values rather than decaying.
+	if (!(cascade_mask & (1u << (i / n_cells)))) return;
+
 	float importance = grid_in[i];
 
 	// float ema_debias_old = 1 - (float)powf(decay, count);
@@ -649,6 +705,49 @@ __global__ void decay_sharpness_grid_nerf(const uint32_t n_elements, float decay
 	grid[i] *= decay;
 }
 
+// Resamples each cascade of a density grid into a grid of a different size. Upsampling replicates a coarse cell into
+// its children, downsampling keeps the densest child, such that no occupied space is lost. Cascades that the source
+// lacks start out empty.
+__global__ void resample_density_grid(
+	const uint32_t n_elements,
+	const uint32_t src_size,
+	const uint32_t src_n_cascades,
+	const float* __restrict__ src,
+	const uint32_t dst_size,
+	float* __restrict__ dst
+) {
+	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
+	if (i >= n_elements) return;
+
+	const uint32_t dst_n_cells = dst_size * dst_size * dst_size;
+	const uint32_t level = i / dst_n_cells;
+	if (level >= src_n_cascades) {
+		dst[i] = 0.f;
+		return;
+	}
+
+	const uint32_t pos_idx = i % dst_n_cells;
+	const uint32_t x = tcnn::morton3D_invert(pos_idx>>0);
+	const uint32_t y = tcnn::morton3D_invert(pos_idx>>1);
+	const uint32_t z = tcnn::morton3D_invert(pos_idx>>2);
+
+	const float* src_level = src + level * src_size * src_size * src_size;
+	if (dst_size >= src_size) {
+		const uint32_t r = dst_size / src_size;
+		dst[i] = src_level[tcnn::morton3D(x / r, y / r, z / r)];
+		return;
+	}
+
+	// Children are contiguous in Morton order. Untrained (negative) cells only survive if no child was trained.
+	const uint32_t n_children = (src_size / dst_size) * (src_size / dst_size) * (src_size / dst_size);
+	float result = -std::numeric_limits<float>::infinity();
+	for (uint32_t j = 0; j < n_children; ++j) {
+		result = fmaxf(result, src_level[pos_idx * n_children + j]);
+	}
+
+	dst[i] = result;
+}
+
 __global__ void grid_to_bitfield(
 	const uint32_t n_elements,
 	const uint32_t n_nonzero_elements,
@@ -675,6 +774,29 @@ __global__ void grid_to_bitfield(
 	grid_bitfield[i] = bits;
 }
 
+// Adds the number of bits that differ between two occupancy bitfields to the count of their cascade. Cascades span
+// whole warps, such that each warp sums its bits before a single atomic.
+__global__ void count_bitfield_flips(
+	const uint32_t n_elements,
+	const uint32_t n_words_per_cascade,
+	const uint32_t* __restrict__ prev,
+	const uint32_t* __restrict__ bitfield,
+	uint32_t* __restrict__ n_flipped
+) {
+	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
+	uint32_t flipped = i < n_elements ? __popc(prev[i] ^ bitfield[i]) : 0;
+
+	NGP_PRAGMA_UNROLL
+	for (uint32_t offset = 16; offset > 0; offset /= 2) {
+		flipped += __shfl_xor_sync(0xFFFFFFFF, flipped, offset);
+	}
+
+	if (i < n_elements && threadIdx.x % 32 == 0 && flipped > 0) {
+		atomicAdd(&n_flipped[i / n_words_per_cascade], flipped);
+	}
+}
+
+template <uint32_t GRID_SIZE>
 __global__ void bitfield_max_pool(const uint32_t n_elements,
 	const uint8_t* __restrict__ prev_level,
 	uint8_t* __restrict__ next_level
@@ -691,14 +813,59 @@ __global__ void bitfield_max_pool(const uint32_t n_elements,
 		bits |= prev_level[i*8+j] > 0 ? ((uint8_t)1 << j) : 0;
 	}
 
-	uint32_t x = tcnn::morton3D_invert(i>>0) + NERF_GRIDSIZE()/8;
-	uint32_t y = tcnn::morton3D_invert(i>>1) + NERF_GRIDSIZE()/8;
-	uint32_t z = tcnn::morton3D_invert(i>>2) + NERF_GRIDSIZE()/8;
+	uint32_t x = tcnn::morton3D_invert(i>>0) + GRID_SIZE/8;
+	uint32_t y = tcnn::morton3D_invert(i>>1) + GRID_SIZE/8;
+	uint32_t z = tcnn::morton3D_invert(i>>2) + GRID_SIZE/8;
 
 	next_level[tcnn::morton3D(x, y, z)] |= bits;
 }
 
-template <bool MIP_FROM_DT=false>
+// One pass of the separable Chebyshev distance transform along `axis` for all lines of all cascades. The first pass
+// reads the occupancy from the bitfield, later passes read the output of the previous one.
+template <uint32_t GRID_SIZE>
+__global__ void chebyshev_distance_pass_nerf(
+	const uint32_t n_elements,
+	const uint32_t axis,
+	const uint8_t* __restrict__ bitfield,
+	const uint8_t* __restrict__ src,
+	uint8_t* __restrict__ dst
+) {
+	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
+	if (i >= n_elements) return;
+
+	uint32_t level = i / (GRID_SIZE * GRID_SIZE);
+	uint32_t a = i % GRID_SIZE;
+	uint32_t b = (i / GRID_SIZE) % GRID_SIZE;
+
+	auto cell = [&](uint32_t j) {
+		switch (axis) {
+			case 0: return tcnn::morton3D(j, a, b);
+			case 1: return tcnn::morton3D(a, j, b);
+			default: return tcnn::morton3D(a, b, j);
+		}
+	};
+
+	uint8_t in[GRID_SIZE], out[GRID_SIZE];
+	int16_t queue[GRID_SIZE+1];
+
+	for (uint32_t j = 0; j < GRID_SIZE; ++j) {
+		uint32_t idx = cell(j);
+		if (bitfield) {
+			bool occupied = bitfield[idx/8+grid_mip_offset<GRID_SIZE>(level)/8] & (1<<(idx%8));
+			in[j] = occupied ? 0 : CHEBYSHEV_DISTANCE_MAX;
+		} else {
+			in[j] = src[idx+grid_mip_offset<GRID_SIZE>(level)];
+		}
+	}
+
+	chebyshev_distance_transform_line(GRID_SIZE, in, out, queue);
+
+	for (uint32_t j = 0; j < GRID_SIZE; ++j) {
+		dst[cell(j)+grid_mip_offset<GRID_SIZE>(level)] = out[j];
+	}
+}
+
+template <uint32_t GRID_SIZE, bool MIP_FROM_DT=false>
 __device__ float if_unoccupied_advance_to_next_occupied_voxel(
 	float t,
 	float cone_angle,
@@ -708,7 +875,9 @@ __device__ float if_unoccupied_advance_to_next_occupied_voxel(
 	uint32_t min_mip,
 	uint32_t max_mip,
 	BoundingBox aabb,
-	mat3 aabb_to_local = mat3(1.0f)
+	mat3 aabb_to_local = mat3(1.0f),
+	const uint8_t* __restrict__ distance_field = nullptr,
+	uint32_t* n_steps = nullptr
 ) {
 	while (true) {
 		vec3 pos = ray(t);
@@ -716,87 +885,97 @@ __device__ float if_unoccupied_advance_to_next_occupied_voxel(
 			return MAX_DEPTH();
 		}
 
-		uint32_t mip = tcnn::clamp(MIP_FROM_DT ? mip_from_dt(calc_dt(t, cone_angle), pos) : mip_from_pos(pos), min_mip, max_mip);
+		uint32_t mip = tcnn::clamp(MIP_FROM_DT ? mip_from_dt<GRID_SIZE>(calc_dt(t, cone_angle), pos, max_mip) : mip_from_pos(pos, max_mip), min_mip, max_mip);
 
-		if (!density_grid || density_grid_occupied_at(pos, density_grid, mip)) {
+		if (!density_grid || density_grid_occupied_at<GRID_SIZE>(pos, density_grid, mip)) {
 			return t;
 		}
 
 		// Find largest empty voxel surrounding us, such that we can advance as far as possible in the next step.
 		// Other places that do voxel stepping don't need this, because they don't rely on thread coherence as
 		// much as this one here.
-		while (mip < max_mip && !density_grid_occupied_at(pos, density_grid, mip+1)) {
+		while (mip < max_mip && !density_grid_occupied_at<GRID_SIZE>(pos, density_grid, mip+1)) {
 			++mip;
 		}
 
-		t = advance_to_next_voxel(t, cone_angle, pos, ray.d, idir, mip);
+		// The distance field tells how many more cells around this one are empty, which lets the ray leave all
+		// of them at once rather than one cell per iteration.
+		uint32_t n_skip_cells = 0;
+		if (distance_field) {
+			uint32_t distance = density_grid_distance_at<GRID_SIZE>(pos, distance_field, mip);
+			n_skip_cells = distance > 1 ? distance - 1 : 0;
+		}
+
+		t = advance_to_next_voxel<GRID_SIZE>(t, cone_angle, pos, ray.d, idir, mip, n_skip_cells);
+		if (n_steps) {
+			++*n_steps;
+		}
 	}
 }
 
-__device__ void advance_pos_nerf(
-	NerfPayload& payload,
-	const BoundingBox& render_aabb,
-	const mat3& render_aabb_to_local,
-	const vec3& camera_fwd,
-	const vec2& focal_length,
-	uint32_t sample_index,
+template <uint32_t GRID_SIZE>
+__global__ void advance_pos_nerf_kernel(
+	const uint32_t n_elements,
+	BoundingBox render_aabb,
+	mat3 render_aabb_to_local,
+	const NerfTraceView* __restrict__ views,
+	NerfPayloads payloads,
 	const uint8_t* __restrict__ density_grid,
 	uint32_t min_mip,
 	uint32_t max_mip,
-	float cone_angle_constant
+	float cone_angle_constant,
+	const uint8_t* __restrict__ distance_field,
+	uint32_t* __restrict__ n_empty_space_steps
 ) {
-	if (!payload.alive) {
+	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
+	if (i >= n_elements) return;
+
+	NerfRayState state = payloads.state[i];
+	if (!state.alive()) {
 		return;
 	}
 
-	vec3 origin = payload.origin;
-	vec3 dir = payload.dir;
+	const NerfTraceView& view = views[state.view()];
+	uint32_t idx = payloads.idx[i];
+	vec3 origin = view.origin[idx];
+	vec3 dir = view.dir[idx];
 	vec3 idir = vec3(1.0f) / dir;
 
-	float cone_angle = calc_cone_angle(dot(dir, camera_fwd), focal_length, cone_angle_constant);
+	float cone_angle = calc_cone_angle(dot(dir, view.camera[2]), view.focal_length, cone_angle_constant);
+
+	float t = advance_n_steps(payloads.t[i], cone_angle, ld_random_val(view.sample_index, idx * 786433));
+	uint32_t n_steps = 0;
+	t = if_unoccupied_advance_to_next_occupied_voxel<GRID_SIZE>(t, cone_angle, {origin, dir}, idir, density_grid, min_mip, max_mip, render_aabb, render_aabb_to_local, distance_field, n_empty_space_steps ? &n_steps : nullptr);
+	if (n_empty_space_steps && n_steps > 0) {
+		atomicAdd(n_empty_space_steps, n_steps);
+	}
 
-	float t = advance_n_steps(payload.t, cone_angle, ld_random_val(sample_index, payload.idx * 786433));
-	t = if_unoccupied_advance_to_next_occupied_voxel(t, cone_angle, {origin, dir}, idir, density_grid, min_mip, max_mip, render_aabb, render_aabb_to_local);
 	if (t >= MAX_DEPTH()) {
-		payload.alive = false;
+		state.set_alive(false);
+		payloads.state[i] = state;
 	} else {
-		payload.t = t;
+		payloads.t[i] = t;
 	}
 }
 
-__global__ void advance_pos_nerf_kernel(
-	const uint32_t n_elements,
-	BoundingBox render_aabb,
-	mat3 render_aabb_to_local,
-	vec3 camera_fwd,
-	vec2 focal_length,
-	uint32_t sample_index,
-	NerfPayload* __restrict__ payloads,
-	const uint8_t* __restrict__ density_grid,
-	uint32_t min_mip,
-	uint32_t max_mip,
-	float cone_angle_constant
-) {
-	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
-	if (i >= n_elements) return;
-
-	advance_pos_nerf(payloads[i], render_aabb, render_aabb_to_local, camera_fwd, focal_length, sample_index, density_grid, min_mip, max_mip, cone_angle_constant);
-}
-
-__global__ void generate_nerf_network_inputs_from_positions(const uint32_t n_elements, BoundingBox aabb, const vec3* __restrict__ pos, PitchedPtr<NerfCoordinate> network_input, const float* extra_dims) {
+template <uint32_t N_EXTRA_DIMS>
+__global__ void generate_nerf_network_inputs_from_positions(const uint32_t n_elements, BoundingBox aabb, const vec3* __restrict__ pos, NerfCoordinates<N_EXTRA_DIMS> network_input, const float* extra_dims) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= n_elements) return;
 
 	vec3 dir = normalize(pos[i] - vec3(0.5f)); // choose outward pointing directions, for want of a better choice
-	network_input(i)->set_with_optional_extra_dims(warp_position(pos[i], aabb), warp_direction(dir), warp_dt(MIN_CONE_STEPSIZE()), extra_dims, network_input.stride_in_bytes);
+	network_input.set(i, warp_position(pos[i], aabb), warp_direction(dir), warp_dt(MIN_CONE_STEPSIZE()), extra_dims);
 }
 
-__global__ void generate_nerf_network_inputs_at_current_position(const uint32_t n_elements, BoundingBox aabb, const NerfPayload* __restrict__ payloads, PitchedPtr<NerfCoordinate> network_input, const float* extra_dims) {
+template <uint32_t N_EXTRA_DIMS>
+__global__ void generate_nerf_network_inputs_at_current_position(const uint32_t n_elements, BoundingBox aabb, const NerfTraceView* __restrict__ views, NerfPayloads payloads, NerfCoordinates<N_EXTRA_DIMS> network_input, const float* extra_dims) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= n_elements) return;
 
-	vec3 dir = payloads[i].dir;
-	network_input(i)->set_with_optional_extra_dims(warp_position(payloads[i].origin + dir * payloads[i].t, aabb), warp_direction(dir), warp_dt(MIN_CONE_STEPSIZE()), extra_dims, network_input.stride_in_bytes);
+	const NerfTraceView& view = views[payloads.state[i].view()];
+	uint32_t idx = payloads.idx[i];
+	vec3 dir = view.dir[idx];
+	network_input.set(i, warp_position(view.origin[idx] + dir * payloads.t[i], aabb), warp_direction(dir), warp_dt(MIN_CONE_STEPSIZE()), extra_dims);
 }
 
 __device__ vec4 compute_nerf_rgba(const vec4& network_output, ENerfActivation rgb_activation, ENerfActivation density_activation, float depth, bool density_as_alpha = false) {
@@ -821,96 +1000,151 @@ __global__ void compute_nerf_rgba_kernel(const uint32_t n_elements, vec4* networ
 	network_output[i] = compute_nerf_rgba(network_output[i], rgb_activation, density_activation, depth, density_as_alpha);
 }
 
+template <uint32_t GRID_SIZE, uint32_t N_EXTRA_DIMS>
 __global__ void generate_next_nerf_network_inputs(
 	const uint32_t n_elements,
+	const uint32_t* __restrict__ n_alive,
 	BoundingBox render_aabb,
 	mat3 render_aabb_to_local,
 	BoundingBox train_aabb,
-	vec2 focal_length,
-	vec3 camera_fwd,
-	NerfPayload* __restrict__ payloads,
-	PitchedPtr<NerfCoordinate> network_input,
+	const NerfTraceView* __restrict__ views,
+	NerfPayloads payloads,
+	NerfCoordinates<N_EXTRA_DIMS> network_input,
 	uint32_t n_steps,
 	const uint8_t* __restrict__ density_grid,
 	uint32_t min_mip,
 	uint32_t max_mip,
 	float cone_angle_constant,
-	const float* extra_dims
+	const float* extra_dims,
+	uint32_t* __restrict__ n_useful_queries,
+	const uint8_t* __restrict__ distance_field,
+	uint32_t* __restrict__ n_empty_space_steps,
+	NerfLevelOfDetail lod,
+	float* __restrict__ max_level,
+	uint32_t* __restrict__ n_level_evaluations
 ) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
-	if (i >= n_elements) return;
-
-	NerfPayload& payload = payloads[i];
+	if (i >= n_elements || i >= *n_alive) return;
 
-	if (!payload.alive) {
+	NerfRayState state = payloads.state[i];
+	if (!state.alive()) {
 		return;
 	}
 
-	vec3 origin = payload.origin;
-	vec3 dir = payload.dir;
+	const NerfTraceView& view = views[state.view()];
+	uint32_t idx = payloads.idx[i];
+	vec3 origin = view.origin[idx];
+	vec3 dir = view.dir[idx];
 	vec3 idir = vec3(1.0f) / dir;
 
-	float cone_angle = calc_cone_angle(dot(dir, camera_fwd), focal_length, cone_angle_constant);
+	float cone_angle = calc_cone_angle(dot(dir, view.camera[2]), view.focal_length, cone_angle_constant);
 
-	float t = payload.t;
+	float t = payloads.t[i];
+
+	// Diameter of the pixel cone per unit distance, relative to the unit cube of the encoding
+	float lod_footprint = lod ? 2.0f / ((view.focal_length.x + view.focal_length.y) * compMax(train_aabb.diag())) : 0.0f;
+
+	uint32_t n_skip_steps = 0, n_levels = 0;
+	auto count_steps_and_levels = [&]() {
+		if (n_empty_space_steps && n_skip_steps > 0) {
+			atomicAdd(n_empty_space_steps, n_skip_steps);
+		}
+		if (n_level_evaluations && n_levels > 0) {
+			atomicAdd(n_level_evaluations, n_levels);
+		}
+	};
 
 	for (uint32_t j = 0; j < n_steps; ++j) {
-		t = if_unoccupied_advance_to_next_occupied_voxel(t, cone_angle, {origin, dir}, idir, density_grid, min_mip, max_mip, render_aabb, render_aabb_to_local);
+		t = if_unoccupied_advance_to_next_occupied_voxel<GRID_SIZE>(t, cone_angle, {origin, dir}, idir, density_grid, min_mip, max_mip, render_aabb, render_aabb_to_local, distance_field, n_empty_space_steps ? &n_skip_steps : nullptr);
 		if (t >= MAX_DEPTH()) {
-			payload.n_steps = j;
+			state.set_n_steps(j);
+			payloads.state[i] = state;
+			if (n_useful_queries) {
+				atomicAdd(n_useful_queries, j);
+			}
+			count_steps_and_levels();
 			return;
 		}
 
 		float dt = calc_dt(t, cone_angle);
-		network_input(i + j * n_elements)->set_with_optional_extra_dims(warp_position(origin + dir * t, train_aabb), warp_direction(dir), warp_dt(dt), extra_dims, network_input.stride_in_bytes); // XXXCONE
+		network_input.set(i + j * n_elements, warp_position(origin + dir * t, train_aabb), warp_direction(dir), warp_dt(dt), extra_dims); // XXXCONE
+		if (lod) {
+			float level = lod.max_level(t * lod_footprint);
+			max_level[i + j * n_elements] = level;
+			n_levels += lod.n_evaluated_levels(level);
+		}
 		t += dt;
 	}
 
-	payload.t = t;
-	payload.n_steps = n_steps;
+	payloads.t[i] = t;
+	state.set_n_steps(n_steps);
+	payloads.state[i] = state;
+	if (n_useful_queries) {
+		atomicAdd(n_useful_queries, n_steps);
+	}
+	count_steps_and_levels();
 }
 
 __global__ void composite_kernel_nerf(
 	const uint32_t n_elements,
+	const uint32_t* __restrict__ n_alive,
 	const uint32_t stride,
 	const uint32_t current_step,
 	BoundingBox aabb,
 	float glow_y_cutoff,
 	int glow_mode,
-	mat4x3 camera_matrix,
-	vec2 focal_length,
+	const NerfTraceView* __restrict__ views,
 	float depth_scale,
 	vec4* __restrict__ rgba,
 	float* __restrict__ depth,
-	NerfPayload* payloads,
+	NerfPayloads payloads,
 	PitchedPtr<NerfCoordinate> network_input,
 	const tcnn::network_precision_t* __restrict__ network_output,
 	uint32_t padded_output_width,
 	uint32_t n_steps,
 	ERenderMode render_mode,
 	const uint8_t* __restrict__ density_grid,
+	uint32_t density_grid_size,
+	uint32_t density_grid_n_cascades,
 	ENerfActivation rgb_activation,
 	ENerfActivation density_activation,
 	int show_accel,
-	float min_transmittance
+	float min_transmittance,
+	NerfAovBuffers aovs,
+	PitchedPtr<const NerfCoordinate> input_gradients
 ) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
-	if (i >= n_elements) return;
+	if (i >= n_elements || i >= *n_alive) return;
 
-	NerfPayload& payload = payloads[i];
-
-	if (!payload.alive) {
+	NerfRayState state = payloads.state[i];
+	if (!state.alive()) {
 		return;
 	}
 
+	const uint32_t idx = payloads.idx[i];
 	vec4 local_rgba = rgba[i];
 	float local_depth = depth[i];
-	vec3 origin = payload.origin;
+	float max_weight = payloads.max_weight[i];
+	const NerfTraceView& view = views[state.view()];
+	vec3 origin = view.origin[idx];
+	const mat4x3& camera_matrix = view.camera;
 	vec3 cam_fwd = camera_matrix[2];
 	// Composite in the last n steps
-	uint32_t actual_n_steps = payload.n_steps;
+	uint32_t actual_n_steps = state.n_steps();
 	uint32_t j = 0;
 
+	float aov_alpha = 0.0f, aov_expected_depth = 0.0f;
+	vec3 aov_normal = vec3(0.0f);
+	uint32_t aov_n_steps = 0;
+	if (aovs) {
+		aov_alpha = aovs.alpha[idx];
+		aov_expected_depth = aovs.expected_depth[idx];
+		if (aovs.normal) {
+			aov_normal = aovs.normal[idx];
+		}
+		aov_n_steps = aovs.n_steps[idx];
+	}
+
 	for (; j < actual_n_steps; ++j) {
 		tcnn::vector_t<tcnn::network_precision_t, 4> local_network_output;
 		local_network_output[0] = network_output[i + j * n_elements + 0 * stride];
@@ -1038,12 +1272,12 @@ __global__ void composite_kernel_nerf(
 		} else if (render_mode == ERenderMode::Positions) {
 			if (show_accel >= 0) {
 				uint32_t mip = max(show_accel, mip_from_pos(pos));
-				uint32_t res = NERF_GRIDSIZE() >> mip;
+				uint32_t res = density_grid_size >> mip;
 				int ix = pos.x * res;
 				int iy = pos.y * res;
 				int iz = pos.z * res;
 				default_rng_t rng(ix + iy * 232323 + iz * 727272);
-				rgb.x = 1.f - mip * (1.f / (NERF_CASCADES() - 1));
+				rgb.x = 1.f - min(mip, density_grid_n_cascades - 1) * (1.f / max(density_grid_n_cascades - 1, 1u));
 				rgb.y = rng.next_float();
 				rgb.z = rng.next_float();
 			} else {
@@ -1057,9 +1291,23 @@ __global__ void composite_kernel_nerf(
 			rgb = vec3(alpha);
 		}
 
+		if (aovs) {
+			float sample_depth = dot(cam_fwd, pos - camera_matrix[3]);
+			if (aov_alpha < 0.5f && aov_alpha + weight >= 0.5f) {
+				aovs.median_depth[idx] = sample_depth;
+			}
+
+			aov_alpha += weight;
+			aov_expected_depth += weight * sample_depth;
+			if (aovs.normal) {
+				aov_normal += weight * -network_to_density_derivative(float(local_network_output[3]), density_activation) * input_gradients(i + j * n_elements)->pos.p;
+			}
+			++aov_n_steps;
+		}
+
 		local_rgba += vec4(rgb * weight, weight);
-		if (weight > payload.max_weight) {
-			payload.max_weight = weight;
+		if (weight > max_weight) {
+			max_weight = weight;
 			local_depth = dot(cam_fwd, pos - camera_matrix[3]);
 		}
 
@@ -1070,12 +1318,23 @@ __global__ void composite_kernel_nerf(
 	}
 
 	if (j < n_steps) {
-		payload.alive = false;
-		payload.n_steps = j + current_step;
+		state.set_alive(false);
+		state.set_n_steps(j + current_step);
+		payloads.state[i] = state;
 	}
 
 	rgba[i] = local_rgba;
 	depth[i] = local_depth;
+	payloads.max_weight[i] = max_weight;
+
+	if (aovs) {
+		aovs.alpha[idx] = aov_alpha;
+		aovs.expected_depth[idx] = aov_expected_depth;
+		if (aovs.normal) {
+			aovs.normal[idx] = aov_normal;
+		}
+		aovs.n_steps[idx] = aov_n_steps;
+	}
 }
 
 static constexpr float UNIFORM_SAMPLING_FRACTION = 0.5f;
@@ -1134,11 +1393,37 @@ inline __device__ float pdf_2d(vec2 sample, uint32_t img, const ivec2& res, cons
 	return UNIFORM_SAMPLING_FRACTION + pmf * compMul(res) * (1.0f - UNIFORM_SAMPLING_FRACTION);
 }
 
-inline __device__ vec2 nerf_random_image_pos_training(default_rng_t& rng, const ivec2& resolution, bool snap_to_pixel_centers, const float* __restrict__ cdf_x_cond_y, const float* __restrict__ cdf_y, const ivec2& cdf_res, uint32_t img, float* __restrict__ pdf = nullptr) {
+inline __device__ vec2 sample_alias_2d(vec2 sample, uint32_t img, const ErrorMapSampler& error_map, float* __restrict__ pdf) {
+	if (sample.x < UNIFORM_SAMPLING_FRACTION) {
+		sample.x /= UNIFORM_SAMPLING_FRACTION;
+		return sample;
+	}
+
+	sample.x = (sample.x - UNIFORM_SAMPLING_FRACTION) / (1.0f - UNIFORM_SAMPLING_FRACTION);
+
+	const ivec2& res = error_map.resolution;
+
+	// Row, then column within the row, each with a single lookup
+	uint32_t y = sample_alias_table(sample.y, res.y, error_map.alias_y + img * res.y);
+	uint32_t row = img * res.y + y;
+	uint32_t x = sample_alias_table(sample.x, res.x, error_map.alias_x_cond_y + row * res.x);
+
+	if (pdf) {
+		*pdf = error_map.pmf_x_cond_y[row * res.x + x] * error_map.pmf_y[row] * compMul(res);
+	}
+
+	return {((float)x + sample.x) / (float)res.x, ((float)y + sample.y) / (float)res.y};
+}
+
+inline __device__ vec2 nerf_random_image_pos_training(default_rng_t& rng, const ivec2& resolution, bool snap_to_pixel_centers, const ErrorMapSampler& error_map, uint32_t img, float* __restrict__ pdf = nullptr) {
 	vec2 uv = random_val_2d(rng);
 
-	if (cdf_x_cond_y) {
-		uv = sample_cdf_2d(uv, img, cdf_res, cdf_x_cond_y, cdf_y, pdf);
+	if (error_map.samples_focal_plane()) {
+		if (error_map.mode == EErrorMapSampler::Alias) {
+			uv = sample_alias_2d(uv, img, error_map, pdf);
+		} else {
+			uv = sample_cdf_2d(uv, img, error_map.resolution, error_map.cdf_x_cond_y, error_map.cdf_y, pdf);
+		}
 	} else if (pdf) {
 		*pdf = 1.0f;
 	}
@@ -1150,7 +1435,20 @@ inline __device__ vec2 nerf_random_image_pos_training(default_rng_t& rng, const
 	return uv;
 }
 
-inline __device__ uint32_t image_idx(uint32_t base_idx, uint32_t n_rays, uint32_t n_rays_total, uint32_t n_training_images, const float* __restrict__ cdf = nullptr, float* __restrict__ pdf = nullptr) {
+inline __device__ uint32_t image_idx(uint32_t base_idx, uint32_t n_rays, uint32_t n_rays_total, uint32_t n_training_images, const ErrorMapSampler& error_map, float* __restrict__ pdf = nullptr) {
+	if (error_map.samples_images() && error_map.mode == EErrorMapSampler::Alias) {
+		float sample = ld_random_val(base_idx/* + n_rays_total*/, 0xdeadbeef);
+		uint32_t img = sample_alias_table(sample, error_map.n_images, error_map.alias_img);
+
+		if (pdf) {
+			*pdf = error_map.pmf_img[img] * error_map.n_images;
+		}
+
+		// Images that were added after the table was built are not sampled from it
+		return min(img, n_training_images - 1);
+	}
+
+	const float* __restrict__ cdf = error_map.cdf_img;
 	if (cdf) {
 		float sample = ld_random_val(base_idx/* + n_rays_total*/, 0xdeadbeef);
 		// float sample = random_val(base_idx/* + n_rays_total*/);
@@ -1191,6 +1489,7 @@ __device__ LossAndGradient loss_and_gradient(const vec3& target, const vec3& pre
 }
 
 
+template <uint32_t GRID_SIZE, uint32_t N_EXTRA_DIMS>
 __global__ void generate_training_samples_nerf(
 	const uint32_t n_rays,
 	BoundingBox aabb,
@@ -1202,7 +1501,7 @@ __global__ void generate_training_samples_nerf(
 	uint32_t* __restrict__ ray_indices_out,
 	Ray* __restrict__ rays_out_unnormalized,
 	uint32_t* __restrict__ numsteps_out,
-	PitchedPtr<NerfCoordinate> coords_out,
+	NerfCoordinates<N_EXTRA_DIMS> coords_out,
 	const uint32_t n_training_images,
 	const TrainingImageMetadata* __restrict__ metadata,
 	const TrainingXForm* training_xforms,
@@ -1214,21 +1513,18 @@ __global__ void generate_training_samples_nerf(
 	bool train_envmap,
 	float cone_angle_constant,
 	Buffer2DView<const vec2> distortion,
-	const float* __restrict__ cdf_x_cond_y,
-	const float* __restrict__ cdf_y,
-	const float* __restrict__ cdf_img,
-	const ivec2 cdf_res,
+	const ErrorMapSampler error_map,
 	const float* __restrict__ extra_dims_gpu,
 	uint32_t n_extra_dims
 ) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= n_rays) return;
 
-	uint32_t img = image_idx(i, n_rays, n_rays_total, n_training_images, cdf_img);
+	uint32_t img = image_idx(i, n_rays, n_rays_total, n_training_images, error_map);
 	ivec2 resolution = metadata[img].resolution;
 
 	rng.advance(i * N_MAX_RANDOM_SAMPLES_PER_RAY());
-	vec2 uv = nerf_random_image_pos_training(rng, resolution, snap_to_pixel_centers, cdf_x_cond_y, cdf_y, cdf_res, img);
+	vec2 uv = nerf_random_image_pos_training(rng, resolution, snap_to_pixel_centers, error_map, img);
 
 	// Negative values indicate masked-away regions
 	size_t pix_idx = pixel_idx(uv, resolution, 0);
@@ -1297,12 +1593,12 @@ __global__ void generate_training_samples_nerf(
 
 	while (aabb.contains(pos = ray_unnormalized.o + t * ray_d_normalized) && j < NERF_STEPS()) {
 		float dt = calc_dt(t, cone_angle);
-		uint32_t mip = mip_from_dt(dt, pos, max_mip);
-		if (density_grid_occupied_at(pos, density_grid, mip)) {
+		uint32_t mip = mip_from_dt<GRID_SIZE>(dt, pos, max_mip);
+		if (density_grid_occupied_at<GRID_SIZE>(pos, density_grid, mip)) {
 			++j;
 			t += dt;
 		} else {
-			t = advance_to_next_voxel(t, cone_angle, pos, ray_d_normalized, idir, mip);
+			t = advance_to_next_voxel<GRID_SIZE>(t, cone_angle, pos, ray_d_normalized, idir, mip);
 		}
 	}
 	if (j == 0 && !train_envmap) {
@@ -1328,13 +1624,13 @@ __global__ void generate_training_samples_nerf(
 	j=0;
 	while (aabb.contains(pos = ray_unnormalized.o + t * ray_d_normalized) && j < numsteps) {
 		float dt = calc_dt(t, cone_angle);
-		uint32_t mip = mip_from_dt(dt, pos, max_mip);
-		if (density_grid_occupied_at(pos, density_grid, mip)) {
-			coords_out(j)->set_with_optional_extra_dims(warp_position(pos, aabb), warped_dir, warp_dt(dt), extra_dims, coords_out.stride_in_bytes);
+		uint32_t mip = mip_from_dt<GRID_SIZE>(dt, pos, max_mip);
+		if (density_grid_occupied_at<GRID_SIZE>(pos, density_grid, mip)) {
+			coords_out.set(j, warp_position(pos, aabb), warped_dir, warp_dt(dt), extra_dims);
 			++j;
 			t += dt;
 		} else {
-			t = advance_to_next_voxel(t, cone_angle, pos, ray_d_normalized, idir, mip);
+			t = advance_to_next_voxel<GRID_SIZE>(t, cone_angle, pos, ray_d_normalized, idir, mip);
 		}
 	}
 
@@ -1346,7 +1642,7 @@ __global__ void generate_training_samples_nerf(
 	}
 }
 
-
+template <uint32_t N_EXTRA_DIMS>
 __global__ void compute_loss_kernel_train_nerf(
 	const uint32_t n_rays,
 	BoundingBox aabb,
@@ -1371,8 +1667,8 @@ __global__ void compute_loss_kernel_train_nerf(
 	const uint32_t* __restrict__ ray_indices_in,
 	const Ray* __restrict__ rays_in_unnormalized,
 	uint32_t* __restrict__ numsteps_in,
-	PitchedPtr<const NerfCoordinate> coords_in,
-	PitchedPtr<NerfCoordinate> coords_out,
+	NerfCoordinates<N_EXTRA_DIMS> coords_in,
+	NerfCoordinates<N_EXTRA_DIMS> coords_out,
 	tcnn::network_precision_t* dloss_doutput,
 	ELossType loss_type,
 	ELossType depth_loss_type,
@@ -1383,11 +1679,9 @@ __global__ void compute_loss_kernel_train_nerf(
 	ENerfActivation density_activation,
 	bool snap_to_pixel_centers,
 	float* __restrict__ error_map,
-	const float* __restrict__ cdf_x_cond_y,
-	const float* __restrict__ cdf_y,
-	const float* __restrict__ cdf_img,
+	uint8_t* __restrict__ error_map_touched,
 	const ivec2 error_map_res,
-	const ivec2 error_map_cdf_res,
+	const ErrorMapSampler error_map_sampler,
 	const float* __restrict__ sharpness_data,
 	ivec2 sharpness_resolution,
 	float* __restrict__ sharpness_grid,
@@ -1450,11 +1744,11 @@ __global__ void compute_loss_kernel_train_nerf(
 	rng.advance(ray_idx * N_MAX_RANDOM_SAMPLES_PER_RAY());
 
 	float img_pdf = 1.0f;
-	uint32_t img = image_idx(ray_idx, n_rays, n_rays_total, n_training_images, cdf_img, &img_pdf);
+	uint32_t img = image_idx(ray_idx, n_rays, n_rays_total, n_training_images, error_map_sampler, &img_pdf);
 	ivec2 resolution = metadata[img].resolution;
 
 	float uv_pdf = 1.0f;
-	vec2 uv = nerf_random_image_pos_training(rng, resolution, snap_to_pixel_centers, cdf_x_cond_y, cdf_y, error_map_cdf_res, img, &uv_pdf);
+	vec2 uv = nerf_random_image_pos_training(rng, resolution, snap_to_pixel_centers, error_map_sampler, img, &uv_pdf);
 	float max_level = max_level_rand_training ? (random_val(rng) * 2.0f) : 1.0f; // Multiply by 2 to ensure 50% of training is at max level
 	rng.advance(1); // motionblur_time
 
@@ -1545,12 +1839,16 @@ __global__ void compute_loss_kernel_train_nerf(
 			atomicAdd(&error_map[img * compMul(error_map_res) + y * error_map_res.x + x], val);
 		};
 
+		if (error_map_touched) {
+			error_map_touched[img] |= 1;
+		}
+
 		if (sharpness_data && aabb.contains(hitpoint)) {
 			ivec2 sharpness_pos = clamp(ivec2(uv * vec2(sharpness_resolution)), ivec2(0), sharpness_resolution - ivec2(1));
 			float sharp = sharpness_data[img * compMul(sharpness_resolution) + sharpness_pos.y * sharpness_resolution.x + sharpness_pos.x] + 1e-6f;
 
 			// The maximum value of positive floats interpreted in uint format is the same as the maximum value of the floats.
-			float grid_sharp = __uint_as_float(atomicMax((uint32_t*)&cascaded_grid_at(hitpoint, sharpness_grid, mip_from_pos(hitpoint, max_mip)), __float_as_uint(sharp)));
+			float grid_sharp = __uint_as_float(atomicMax((uint32_t*)&cascaded_grid_at<NERF_GRIDSIZE()>(hitpoint, sharpness_grid, mip_from_pos(hitpoint, max_mip)), __float_as_uint(sharp)));
 			grid_sharp = fmaxf(sharp, grid_sharp); // atomicMax returns the old value, so compute the new one locally.
 
 			mean_loss *= fmaxf(sharp / grid_sharp, 0.01f);
@@ -1576,9 +1874,8 @@ __global__ void compute_loss_kernel_train_nerf(
 			max_level_compacted_ptr[j] = max_level;
 		}
 		// Compact network inputs
-		NerfCoordinate* coord_out = coords_out(j);
 		const NerfCoordinate* coord_in = coords_in(j);
-		coord_out->copy(*coord_in, coords_out.stride_in_bytes);
+		coords_out.copy(j, *coord_in);
 
 		const vec3 pos = unwarp_position(coord_in->pos.p, aabb);
 		float depth = distance(pos, ray_o);
@@ -1690,10 +1987,7 @@ __global__ void compute_cam_gradient_train_nerf(
 	float* __restrict__ distortion_gradient_weight,
 	const ivec2 distortion_resolution,
 	vec2* cam_focal_length_gradient,
-	const float* __restrict__ cdf_x_cond_y,
-	const float* __restrict__ cdf_y,
-	const float* __restrict__ cdf_img,
-	const ivec2 error_map_res
+	const ErrorMapSampler error_map
 ) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= *rays_counter) { return; }
@@ -1712,7 +2006,7 @@ __global__ void compute_cam_gradient_train_nerf(
 	// Must be same seed as above to obtain the same
 	// background color.
 	uint32_t ray_idx = ray_indices_in[i];
-	uint32_t img = image_idx(ray_idx, n_rays, n_rays_total, n_training_images, cdf_img);
+	uint32_t img = image_idx(ray_idx, n_rays, n_rays_total, n_training_images, error_map);
 	ivec2 resolution = metadata[img].resolution;
 
 	const mat4x3& xform = training_xforms[img].start;
@@ -1738,7 +2032,7 @@ __global__ void compute_cam_gradient_train_nerf(
 	rng.advance(ray_idx * N_MAX_RANDOM_SAMPLES_PER_RAY());
 	float uv_pdf = 1.0f;
 
-	vec2 uv = nerf_random_image_pos_training(rng, resolution, snap_to_pixel_centers, cdf_x_cond_y, cdf_y, error_map_res, img, &uv_pdf);
+	vec2 uv = nerf_random_image_pos_training(rng, resolution, snap_to_pixel_centers, error_map, img, &uv_pdf);
 
 	if (distortion_gradient) {
 		// Projection of the raydir gradient onto the plane normal to raydir,
@@ -1787,7 +2081,7 @@ __global__ void compute_extra_dims_gradient_train_nerf(
 	const uint32_t* __restrict__ ray_indices_in,
 	uint32_t* __restrict__ numsteps_in,
 	PitchedPtr<NerfCoordinate> coords_gradient,
-	const float* __restrict__ cdf_img
+	const ErrorMapSampler error_map
 ) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= *rays_counter) { return; }
@@ -1803,7 +2097,7 @@ __global__ void compute_extra_dims_gradient_train_nerf(
 	// Must be same seed as above to obtain the same
 	// background color.
 	uint32_t ray_idx = ray_indices_in[i];
-	uint32_t img = image_idx(ray_idx, n_rays, n_rays_total, n_training_images, cdf_img);
+	uint32_t img = image_idx(ray_idx, n_rays, n_rays_total, n_training_images, error_map);
 
 	extra_dims_gradient += n_extra_dims * img;
 
@@ -1819,22 +2113,25 @@ __global__ void shade_kernel_nerf(
 	const uint32_t n_elements,
 	vec4* __restrict__ rgba,
 	float* __restrict__ depth,
-	NerfPayload* __restrict__ payloads,
+	NerfPayloads payloads,
 	ERenderMode render_mode,
 	bool train_in_linear_colors,
-	vec4* __restrict__ frame_buffer,
-	float* __restrict__ depth_buffer
+	const NerfTraceView* __restrict__ views,
+	bool composite_behind
 ) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= n_elements) return;
-	NerfPayload& payload = payloads[i];
+	NerfRayState state = payloads.state[i];
+	uint32_t idx = payloads.idx[i];
+	vec4* frame_buffer = views[state.view()].frame_buffer;
+	float* depth_buffer = views[state.view()].depth_buffer;
 
 	vec4 tmp = rgba[i];
 	if (render_mode == ERenderMode::Normals) {
 		vec3 n = normalize(tmp.xyz());
 		tmp.rgb = (0.5f * n + vec3(0.5f)) * tmp.a;
 	} else if (render_mode == ERenderMode::Cost) {
-		float col = (float)payload.n_steps / 128;
+		float col = (float)state.n_steps() / 128;
 		tmp = {col, col, col, 1.0f};
 	}
 
@@ -1843,40 +2140,70 @@ __global__ void shade_kernel_nerf(
 		tmp.rgb = srgb_to_linear(tmp.rgb);
 	}
 
-	frame_buffer[payload.idx] = tmp + frame_buffer[payload.idx] * (1.0f - tmp.a);
+	if (composite_behind) {
+		// The depth is that of the trace during which the pixel's accumulated alpha crosses the threshold.
+		vec4 prev = frame_buffer[idx];
+		frame_buffer[idx] = prev + tmp * (1.0f - prev.a);
+		if (render_mode != ERenderMode::Slice && prev.a <= 0.2f && frame_buffer[idx].a > 0.2f) {
+			depth_buffer[idx] = depth[i];
+		}
+		return;
+	}
+
+	frame_buffer[idx] = tmp + frame_buffer[idx] * (1.0f - tmp.a);
 	if (render_mode != ERenderMode::Slice && tmp.a > 0.2f) {
-		depth_buffer[payload.idx] = depth[i];
+		depth_buffer[idx] = depth[i];
 	}
 }
 
+__device__ void copy_nerf_ray(uint32_t src_i, const RaysNerfSoa& src, uint32_t dst_i, const RaysNerfSoa& dst) {
+	dst.payload.t[dst_i] = src.payload.t[src_i];
+	dst.payload.max_weight[dst_i] = src.payload.max_weight[src_i];
+	dst.payload.idx[dst_i] = src.payload.idx[src_i];
+	dst.payload.state[dst_i] = src.payload.state[src_i];
+	dst.rgba[dst_i] = src.rgba[src_i];
+	dst.depth[dst_i] = src.depth[src_i];
+}
+
 __global__ void compact_kernel_nerf(
 	const uint32_t n_elements,
-	vec4* src_rgba, float* src_depth, NerfPayload* src_payloads,
-	vec4* dst_rgba, float* dst_depth, NerfPayload* dst_payloads,
-	vec4* dst_final_rgba, float* dst_final_depth, NerfPayload* dst_final_payloads,
+	const uint32_t* __restrict__ n_src_elements,
+	RaysNerfSoa src,
+	RaysNerfSoa dst,
+	RaysNerfSoa dst_final,
 	uint32_t* counter, uint32_t* finalCounter
 ) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
-	if (i >= n_elements) return;
-
-	NerfPayload& src_payload = src_payloads[i];
+	if (i >= n_elements || (n_src_elements && i >= *n_src_elements)) return;
 
-	if (src_payload.alive) {
-		uint32_t idx = atomicAdd(counter, 1);
-		dst_payloads[idx] = src_payload;
-		dst_rgba[idx] = src_rgba[i];
-		dst_depth[idx] = src_depth[i];
-	} else if (src_rgba[i].a > 0.001f) {
-		uint32_t idx = atomicAdd(finalCounter, 1);
-		dst_final_payloads[idx] = src_payload;
-		dst_final_rgba[idx] = src_rgba[i];
-		dst_final_depth[idx] = src_depth[i];
+	if (src.payload.state[i].alive()) {
+		copy_nerf_ray(i, src, atomicAdd(counter, 1), dst);
+	} else if (src.rgba[i].a > 0.001f) {
+		copy_nerf_ray(i, src, atomicAdd(finalCounter, 1), dst_final);
 	}
 }
 
+// Alive count of a marching iteration, tagged with the trace's generation in the upper and the iteration in the lower
+// 32 bits, such that the host can tell it apart from the counts of earlier iterations and traces in the same slot.
+struct NerfAliveCountSlot {
+	uint64_t tag;
+	uint64_t count;
+};
+
+// Writes the count before the tag, such that the host sees the count of any tag that it sees.
+__global__ void publish_alive_count_nerf(const uint32_t* __restrict__ counter, uint64_t tag, NerfAliveCountSlot* __restrict__ slot) {
+	((volatile NerfAliveCountSlot*)slot)->count = *counter;
+	__threadfence_system();
+	((volatile NerfAliveCountSlot*)slot)->tag = tag;
+	__threadfence_system();
+}
+
 __global__ void init_rays_with_payload_kernel_nerf(
 	uint32_t sample_index,
-	NerfPayload* __restrict__ payloads,
+	uint32_t view,
+	NerfPayloads payloads,
+	vec3* __restrict__ origins,
+	vec3* __restrict__ dirs,
 	ivec2 resolution,
 	vec2 focal_length,
 	mat4x3 camera_matrix0,
@@ -1897,7 +2224,9 @@ __global__ void init_rays_with_payload_kernel_nerf(
 	float* __restrict__ depth_buffer,
 	Buffer2DView<const uint8_t> hidden_area_mask,
 	Buffer2DView<const vec2> distortion,
-	ERenderMode render_mode
+	ERenderMode render_mode,
+	bool composite_behind,
+	float min_transmittance
 ) {
 	uint32_t x = threadIdx.x + blockDim.x * blockIdx.x;
 	uint32_t y = threadIdx.y + blockDim.y * blockIdx.y;
@@ -1932,40 +2261,47 @@ __global__ void init_rays_with_payload_kernel_nerf(
 		distortion
 	);
 
-	NerfPayload& payload = payloads[idx];
-	payload.max_weight = 0.0f;
+	payloads.max_weight[idx] = 0.0f;
+	payloads.idx[idx] = idx;
 
-	depth_buffer[idx] = MAX_DEPTH();
+	if (composite_behind) {
+		// Pixels that earlier traces left (nearly) opaque need no further rays.
+		if (frame_buffer[idx].a >= 1.0f - min_transmittance) {
+			origins[idx] = ray.o;
+			payloads.state[idx] = NerfRayState::make(0, view, false);
+			return;
+		}
+	} else {
+		depth_buffer[idx] = MAX_DEPTH();
+	}
 
 	if (!ray.is_valid()) {
-		payload.origin = ray.o;
-		payload.alive = false;
+		origins[idx] = ray.o;
+		payloads.state[idx] = NerfRayState::make(0, view, false);
 		return;
 	}
 
 	if (plane_z < 0) {
 		float n = length(ray.d);
-		payload.origin = ray.o;
-		payload.dir = (1.0f/n) * ray.d;
-		payload.t = -plane_z*n;
-		payload.idx = idx;
-		payload.n_steps = 0;
-		payload.alive = false;
+		origins[idx] = ray.o;
+		dirs[idx] = (1.0f/n) * ray.d;
+		payloads.t[idx] = -plane_z*n;
+		payloads.state[idx] = NerfRayState::make(0, view, false);
 		depth_buffer[idx] = -plane_z;
 		return;
 	}
 
 	ray.d = normalize(ray.d);
 
-	if (envmap) {
+	if (envmap && !composite_behind) {
 		frame_buffer[idx] = read_envmap(envmap, ray.d);
 	}
 
 	float t = fmaxf(render_aabb.ray_intersect(render_aabb_to_local * ray.o, render_aabb_to_local * ray.d).x, 0.0f) + 1e-6f;
 
 	if (!render_aabb.contains(render_aabb_to_local * ray(t))) {
-		payload.origin = ray.o;
-		payload.alive = false;
+		origins[idx] = ray.o;
+		payloads.state[idx] = NerfRayState::make(0, view, false);
 		return;
 	}
 
@@ -1978,21 +2314,17 @@ __global__ void init_rays_with_payload_kernel_nerf(
 		frame_buffer[idx].rgb() = to_rgb(offset * 50.0f);
 		frame_buffer[idx].a = 1.0f;
 		depth_buffer[idx] = 1.0f;
-		payload.origin = ray(MAX_DEPTH());
-		payload.alive = false;
+		origins[idx] = ray(MAX_DEPTH());
+		payloads.state[idx] = NerfRayState::make(0, view, false);
 		return;
 	}
 
-	payload.origin = ray.o;
-	payload.dir = ray.d;
-	payload.t = t;
-	payload.idx = idx;
-	payload.n_steps = 0;
-	payload.alive = true;
+	origins[idx] = ray.o;
+	dirs[idx] = ray.d;
+	payloads.t[idx] = t;
+	payloads.state[idx] = NerfRayState::make(0, view, true);
 }
 
-static constexpr float MIN_PDF = 0.01f;
-
 __global__ void construct_cdf_2d(
 	uint32_t n_images,
 	uint32_t height,
@@ -2011,7 +2343,7 @@ __global__ void construct_cdf_2d(
 
 	float cum = 0;
 	for (uint32_t x = 0; x < width; ++x) {
-		cum += data[x] + 1e-10f;
+		cum += data[x] + ERROR_MAP_BIAS;
 		cdf_x_cond_y[x] = cum;
 	}
 
@@ -2019,7 +2351,7 @@ __global__ void construct_cdf_2d(
 	float norm = __frcp_rn(cum);
 
 	for (uint32_t x = 0; x < width; ++x) {
-		cdf_x_cond_y[x] = (1.0f - MIN_PDF) * cdf_x_cond_y[x] * norm + MIN_PDF * (float)(x+1) / (float)width;
+		cdf_x_cond_y[x] = (1.0f - ERROR_MAP_MIN_PDF) * cdf_x_cond_y[x] * norm + ERROR_MAP_MIN_PDF * (float)(x+1) / (float)width;
 	}
 }
 
@@ -2044,10 +2376,87 @@ __global__ void construct_cdf_1d(
 
 	float norm = __frcp_rn(cum);
 	for (uint32_t y = 0; y < height; ++y) {
-		cdf_y[y] = (1.0f - MIN_PDF) * cdf_y[y] * norm + MIN_PDF * (float)(y+1) / (float)height;
+		cdf_y[y] = (1.0f - ERROR_MAP_MIN_PDF) * cdf_y[y] * norm + ERROR_MAP_MIN_PDF * (float)(y+1) / (float)height;
 	}
 }
 
+__global__ void update_error_map_dirty_flags(
+	uint32_t n_images,
+	bool rebuild_all,
+	uint8_t* __restrict__ touched,
+	uint8_t* __restrict__ dirty
+) {
+	const uint32_t img = threadIdx.x + blockIdx.x * blockDim.x;
+	if (img >= n_images) return;
+
+	// An image's error changed if any was deposited in this or the previous update, whose error has since been cleared.
+	uint8_t t = touched[img];
+	dirty[img] = rebuild_all || t != 0;
+	touched[img] = (t & 1) << 1;
+}
+
+__global__ void build_error_map_column_tables(
+	uint32_t n_images,
+	uint32_t height,
+	uint32_t width,
+	const float* __restrict__ data,
+	const uint8_t* __restrict__ dirty,
+	float* __restrict__ pmf_x_cond_y,
+	AliasEntry* __restrict__ alias_x_cond_y,
+	float* __restrict__ row_weight,
+	uint32_t* __restrict__ scratch
+) {
+	const uint32_t y = threadIdx.x + blockIdx.x * blockDim.x;
+	const uint32_t img = threadIdx.y + blockIdx.y * blockDim.y;
+	if (y >= height || img >= n_images || !dirty[img]) return;
+
+	const uint32_t offset_xy = img * height * width + y * width;
+	row_weight[img * height + y] = build_weighted_alias_table(
+		width, data + offset_xy, ERROR_MAP_BIAS, ERROR_MAP_MIN_PDF, pmf_x_cond_y + offset_xy, alias_x_cond_y + offset_xy, scratch + offset_xy
+	);
+}
+
+__global__ void build_error_map_row_tables(
+	uint32_t n_images,
+	uint32_t height,
+	const uint8_t* __restrict__ dirty,
+	const float* __restrict__ row_weight,
+	float* __restrict__ pmf_y,
+	AliasEntry* __restrict__ alias_y,
+	float* __restrict__ image_weight,
+	uint32_t* __restrict__ scratch
+) {
+	const uint32_t img = threadIdx.x + blockIdx.x * blockDim.x;
+	if (img >= n_images || !dirty[img]) return;
+
+	const uint32_t offset_y = img * height;
+	image_weight[img] = build_weighted_alias_table(
+		height, row_weight + offset_y, 0.0f, ERROR_MAP_MIN_PDF, pmf_y + offset_y, alias_y + offset_y, scratch + offset_y
+	);
+}
+
+__global__ void sample_error_map_benchmark(
+	uint32_t n_samples,
+	uint32_t n_images,
+	const ErrorMapSampler error_map,
+	default_rng_t rng,
+	float* __restrict__ result
+) {
+	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
+	if (i >= n_samples) return;
+
+	rng.advance(i * 2);
+
+	float img_pdf = 1.0f;
+	uint32_t img = image_idx(i, n_samples, n_samples, n_images, error_map, &img_pdf);
+
+	float uv_pdf = 1.0f;
+	vec2 uv = nerf_random_image_pos_training(rng, error_map.resolution, false, error_map, img, &uv_pdf);
+
+	// Keeps the samples from being optimized away
+	result[i] = uv.x + uv.y + img_pdf * uv_pdf;
+}
+
 __global__ void safe_divide(const uint32_t num_elements, float* __restrict__ inout, const float* __restrict__ divisor) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= num_elements) return;
@@ -2087,21 +2496,10 @@ void Testbed::NerfTracer::init_rays_from_camera(
 	ERenderMode render_mode,
 	cudaStream_t stream
 ) {
-	// Make sure we have enough memory reserved to render at the requested resolution
-	size_t n_pixels = (size_t)resolution.x * resolution.y;
-	enlarge(n_pixels, padded_output_width, n_extra_dims, stream);
-
-	const dim3 threads = { 16, 8, 1 };
-	const dim3 blocks = { div_round_up((uint32_t)resolution.x, threads.x), div_round_up((uint32_t)resolution.y, threads.y), 1 };
-	init_rays_with_payload_kernel_nerf<<<blocks, threads, 0, stream>>>(
-		sample_index,
-		m_rays[0].payload,
-		resolution,
-		focal_length,
-		camera_matrix0,
-		camera_matrix1,
-		rolling_shutter,
-		screen_center,
+	init_rays_from_views(
+		padded_output_width,
+		n_extra_dims,
+		{{sample_index, resolution, focal_length, camera_matrix0, camera_matrix1, rolling_shutter, screen_center, foveation, frame_buffer, depth_buffer, hidden_area_mask}},
 		parallax_shift,
 		snap_to_pixel_centers,
 		render_aabb,
@@ -2109,118 +2507,305 @@ void Testbed::NerfTracer::init_rays_from_camera(
 		near_distance,
 		plane_z,
 		aperture_size,
-		foveation,
 		lens,
 		envmap,
-		frame_buffer,
-		depth_buffer,
-		hidden_area_mask,
 		distortion,
-		render_mode
-	);
-
-	m_n_rays_initialized = resolution.x * resolution.y;
-
-	CUDA_CHECK_THROW(cudaMemsetAsync(m_rays[0].rgba, 0, m_n_rays_initialized * sizeof(vec4), stream));
-	CUDA_CHECK_THROW(cudaMemsetAsync(m_rays[0].depth, 0, m_n_rays_initialized * sizeof(float), stream));
-
-	linear_kernel(advance_pos_nerf_kernel, 0, stream,
-		m_n_rays_initialized,
-		render_aabb,
-		render_aabb_to_local,
-		camera_matrix1[2],
-		focal_length,
-		sample_index,
-		m_rays[0].payload,
 		grid,
-		(show_accel >= 0) ? show_accel : 0,
+		show_accel,
 		max_mip,
-		cone_angle_constant
+		cone_angle_constant,
+		render_mode,
+		stream
 	);
 }
 
-uint32_t Testbed::NerfTracer::trace(
-	NerfNetwork<network_precision_t>& network,
+void Testbed::NerfTracer::init_rays_from_views(
+	uint32_t padded_output_width,
+	uint32_t n_extra_dims,
+	const std::vector<View>& views,
+	const vec3& parallax_shift,
+	bool snap_to_pixel_centers,
 	const BoundingBox& render_aabb,
 	const mat3& render_aabb_to_local,
-	const BoundingBox& train_aabb,
-	const vec2& focal_length,
-	float cone_angle_constant,
+	float near_distance,
+	float plane_z,
+	float aperture_size,
+	const Lens& lens,
+	const Buffer2DView<const vec4>& envmap,
+	const Buffer2DView<const vec2>& distortion,
 	const uint8_t* grid,
-	ERenderMode render_mode,
-	const mat4x3 &camera_matrix,
-	float depth_scale,
-	int visualized_layer,
-	int visualized_dim,
-	ENerfActivation rgb_activation,
-	ENerfActivation density_activation,
 	int show_accel,
 	uint32_t max_mip,
-	float min_transmittance,
-	float glow_y_cutoff,
-	int glow_mode,
-	const float* extra_dims_gpu,
+	float cone_angle_constant,
+	ERenderMode render_mode,
 	cudaStream_t stream
 ) {
-	if (m_n_rays_initialized == 0) {
-		return 0;
+	if (views.empty() || views.size() > 256) {
+		throw std::runtime_error{fmt::format("A NeRF trace supports between 1 and 256 views, but got {}.", views.size())};
+	}
+
+	// Make sure we have enough memory reserved to render all views at their requested resolutions
+	size_t n_pixels = 0;
+	for (const auto& view : views) {
+		n_pixels += (size_t)view.resolution.x * view.resolution.y;
+	}
+
+	enlarge(n_pixels, padded_output_width, n_extra_dims, stream);
+
+	// The rays of all views are laid out back to back in one pool. NerfPayloads::idx remains the pixel
+	// index within the ray's view, such that shading scatters directly into the per-view buffers.
+	std::vector<NerfTraceView> trace_views;
+	size_t offset = 0;
+	for (size_t i = 0; i < views.size(); ++i) {
+		const auto& view = views[i];
+
+		const dim3 threads = { 16, 8, 1 };
+		const dim3 blocks = { div_round_up((uint32_t)view.resolution.x, threads.x), div_round_up((uint32_t)view.resolution.y, threads.y), 1 };
+		init_rays_with_payload_kernel_nerf<<<blocks, threads, 0, stream>>>(
+			view.sample_index,
+			(uint32_t)i,
+			m_rays[0].payload + offset,
+			m_ray_origin + offset,
+			m_ray_dir + offset,
+			view.resolution,
+			view.focal_length,
+			view.camera_matrix0,
+			view.camera_matrix1,
+			view.rolling_shutter,
+			view.screen_center,
+			parallax_shift,
+			snap_to_pixel_centers,
+			render_aabb,
+			render_aabb_to_local,
+			near_distance,
+			plane_z,
+			aperture_size,
+			view.foveation,
+			lens,
+			envmap,
+			view.frame_buffer,
+			view.depth_buffer,
+			view.hidden_area_mask,
+			distortion,
+			render_mode,
+			m_composite_behind,
+			m_composite_behind_min_transmittance
+		);
+
+		trace_views.push_back({view.camera_matrix1, view.focal_length, view.sample_index, view.frame_buffer, view.depth_buffer, m_ray_origin + offset, m_ray_dir + offset});
+		offset += (size_t)view.resolution.x * view.resolution.y;
+	}
+
+	m_views_alloc = allocate_workspace(stream, trace_views.size() * sizeof(NerfTraceView));
+	m_views = (NerfTraceView*)m_views_alloc.data();
+	m_n_views = (uint32_t)trace_views.size();
+	CUDA_CHECK_THROW(cudaMemcpyAsync(m_views, trace_views.data(), trace_views.size() * sizeof(NerfTraceView), cudaMemcpyHostToDevice, stream));
+
+	m_n_rays_initialized = (uint32_t)n_pixels;
+
+	CUDA_CHECK_THROW(cudaMemsetAsync(m_rays[0].rgba, 0, m_n_rays_initialized * sizeof(vec4), stream));
+	CUDA_CHECK_THROW(cudaMemsetAsync(m_rays[0].depth, 0, m_n_rays_initialized * sizeof(float), stream));
+
+	// Empty-space steps are counted from here on, since the rays already skip empty space on their way to the
+	// first occupied cell.
+	if (m_count_useful_queries) {
+		CUDA_CHECK_THROW(cudaMemsetAsync(m_counters + EmptySpaceSteps, 0, sizeof(uint32_t), stream));
+	}
+
+	dispatch_density_grid_size(m_density_grid_shape.size, [&](auto grid_size) {
+		linear_kernel(advance_pos_nerf_kernel<decltype(grid_size)::value>, 0, stream,
+			m_n_rays_initialized,
+			render_aabb,
+			render_aabb_to_local,
+			m_views,
+			m_rays[0].payload,
+			grid,
+			(show_accel >= 0) ? show_accel : 0,
+			max_mip,
+			cone_angle_constant,
+			distance_field(grid),
+			m_count_useful_queries ? m_counters + EmptySpaceSteps : nullptr
+		);
+	});
+}
+
+// Mapped host memory into which the device publishes the alive counts of the marching loop. Each host thread
+// traces one frame at a time, so one set of slots per thread suffices.
+struct NerfMarchFeedback {
+	static constexpr uint32_t N_SLOTS = 64;
+
+	NerfMarchFeedback() {
+		CUDA_CHECK_THROW(cudaHostAlloc((void**)&slots, N_SLOTS * sizeof(NerfAliveCountSlot), cudaHostAllocMapped | cudaHostAllocPortable));
+		std::memset(slots, 0, N_SLOTS * sizeof(NerfAliveCountSlot));
+	}
+
+	~NerfMarchFeedback() {
+		cudaFreeHost(slots);
+	}
+
+	NerfMarchFeedback(const NerfMarchFeedback&) = delete;
+	NerfMarchFeedback& operator=(const NerfMarchFeedback&) = delete;
+
+	// Unified addressing makes this pointer valid on the host and on every device.
+	NerfAliveCountSlot* slots = nullptr;
+	// Starts at 1 and skips 0 when wrapping, such that no tag matches a zero-initialized slot.
+	uint32_t generation = 0;
+};
+
+NerfMarchFeedback& march_feedback() {
+	thread_local NerfMarchFeedback feedback;
+	return feedback;
+}
+
+uint32_t Testbed::NerfTracer::trace(
+	NerfNetwork<network_precision_t>& network,
+	const BoundingBox& render_aabb,
+	const mat3& render_aabb_to_local,
+	const BoundingBox& train_aabb,
+	float cone_angle_constant,
+	const uint8_t* grid,
+	ERenderMode render_mode,
+	float depth_scale,
+	int visualized_layer,
+	int visualized_dim,
+	ENerfActivation rgb_activation,
+	ENerfActivation density_activation,
+	int show_accel,
+	uint32_t max_mip,
+	float min_transmittance,
+	float glow_y_cutoff,
+	int glow_mode,
+	const float* extra_dims_gpu,
+	cudaStream_t stream,
+	const NerfAovBuffers& aovs
+) {
+	m_stats = {};
+	m_stats.n_views = m_n_views;
+	m_stats.n_rays = m_n_rays_initialized;
+
+	if (m_n_rays_initialized == 0) {
+		return 0;
 	}
 
 	CUDA_CHECK_THROW(cudaMemsetAsync(m_hit_counter, 0, sizeof(uint32_t), stream));
+	if (m_count_useful_queries) {
+		CUDA_CHECK_THROW(cudaMemsetAsync(m_counters + UsefulQueries, 0, sizeof(uint32_t), stream));
+	}
+
+	// Normals as an AOV need the density gradient next to the regular network inputs, so they get their own buffer.
+	GPUMemoryArena::Allocation gradient_alloc;
+	if (aovs.normal) {
+		size_t num_floats = sizeof(NerfCoordinate) / sizeof(float) + network.n_extra_dims();
+		gradient_alloc = allocate_workspace(stream, m_rays[0].size * MAX_STEPS_INBETWEEN_COMPACTION * num_floats * sizeof(float));
+	}
+
+	// The alive count after each compaction travels to the host through mapped memory. The host plans the next
+	// marching step from the latest count that has arrived, which bounds the actual count from above, and only waits
+	// for a count once it gets too far ahead of the device. The marching kernels read the actual count on the device.
+	auto& feedback = march_feedback();
+	if (++feedback.generation == 0) {
+		++feedback.generation;
+	}
+
+	uint64_t generation = feedback.generation;
+	auto tag = [&](uint32_t iteration) {
+		return (generation << 32) | iteration;
+	};
+
+	// Level of detail truncates the levels of the hash encoding per sample. Other encodings render at full detail.
+	auto lod_encoding = m_lod ? dynamic_cast<GridEncoding<network_precision_t>*>(network.pos_encoding().get()) : nullptr;
+	if (m_count_useful_queries) {
+		CUDA_CHECK_THROW(cudaMemsetAsync(m_counters + LevelEvaluations, 0, sizeof(uint32_t), stream));
+	}
+
+	NerfMarchSchedule schedule{m_n_rays_initialized, MIN_STEPS_INBETWEEN_COMPACTION, MAX_STEPS_INBETWEEN_COMPACTION, 2 * 1024 * 1024, MAX_ALIVE_COUNT_STALENESS};
 
-	uint32_t n_alive = m_n_rays_initialized;
-	// m_n_rays_initialized = 0;
+	// Alive counts of the two most recent compactions
+	auto alive_counter = [&](uint32_t iteration) {
+		return m_counters + (iteration % 2 == 0 ? AliveCount0 : AliveCount1);
+	};
 
 	uint32_t i = 1;
-	uint32_t double_buffer_index = 0;
+	uint32_t iteration = 0;
 	while (i < MARCH_ITER) {
-		RaysNerfSoa& rays_current = m_rays[(double_buffer_index + 1) % 2];
-		RaysNerfSoa& rays_tmp = m_rays[double_buffer_index % 2];
-		++double_buffer_index;
+		RaysNerfSoa& rays_current = m_rays[(iteration + 1) % 2];
+		RaysNerfSoa& rays_tmp = m_rays[iteration % 2];
 
 		// Compact rays that did not diverge yet
 		{
-			CUDA_CHECK_THROW(cudaMemsetAsync(m_alive_counter, 0, sizeof(uint32_t), stream));
+			CUDA_CHECK_THROW(cudaMemsetAsync(alive_counter(iteration), 0, sizeof(uint32_t), stream));
 			linear_kernel(compact_kernel_nerf, 0, stream,
-				n_alive,
-				rays_tmp.rgba, rays_tmp.depth, rays_tmp.payload,
-				rays_current.rgba, rays_current.depth, rays_current.payload,
-				m_rays_hit.rgba, m_rays_hit.depth, m_rays_hit.payload,
-				m_alive_counter, m_hit_counter
+				schedule.alive_bound(),
+				iteration == 0 ? nullptr : alive_counter(iteration - 1),
+				rays_tmp,
+				rays_current,
+				m_rays_hit,
+				alive_counter(iteration), m_hit_counter
 			);
-			CUDA_CHECK_THROW(cudaMemcpyAsync(&n_alive, m_alive_counter, sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
-			CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+			publish_alive_count_nerf<<<1, 1, 0, stream>>>(alive_counter(iteration), tag(iteration), feedback.slots + iteration % NerfMarchFeedback::N_SLOTS);
+		}
+
+		bool waited = false;
+		while (schedule.n_known() <= iteration) {
+			uint32_t known = schedule.n_known();
+			volatile NerfAliveCountSlot* slot = feedback.slots + known % NerfMarchFeedback::N_SLOTS;
+			if (slot->tag == tag(known)) {
+				schedule.report(known, (uint32_t)slot->count);
+			} else if (schedule.must_wait(iteration)) {
+				m_stats.n_host_waits += waited ? 0 : 1;
+				waited = true;
+				std::this_thread::yield();
+			} else {
+				break;
+			}
 		}
 
-		if (n_alive == 0) {
+		if (schedule.finished()) {
 			break;
 		}
 
-		// Want a large number of queries to saturate the GPU and to ensure compaction doesn't happen toooo frequently.
-		uint32_t target_n_queries = 2 * 1024 * 1024;
-		uint32_t n_steps_between_compaction = tcnn::clamp(target_n_queries / n_alive, (uint32_t)MIN_STEPS_INBETWEEN_COMPACTION, (uint32_t)MAX_STEPS_INBETWEEN_COMPACTION);
+		uint32_t n_alive = schedule.alive_bound();
+		uint32_t n_steps_between_compaction = schedule.n_steps();
 
 		uint32_t extra_stride = network.n_extra_dims() * sizeof(float);
 		PitchedPtr<NerfCoordinate> input_data((NerfCoordinate*)m_network_input, 1, 0, extra_stride);
-		linear_kernel(generate_next_nerf_network_inputs, 0, stream,
-			n_alive,
-			render_aabb,
-			render_aabb_to_local,
-			train_aabb,
-			focal_length,
-			camera_matrix[2],
-			rays_current.payload,
-			input_data,
-			n_steps_between_compaction,
-			grid,
-			(show_accel>=0) ? show_accel : 0,
-			max_mip,
-			cone_angle_constant,
-			extra_dims_gpu
-		);
+		dispatch_density_grid_size(m_density_grid_shape.size, [&](auto grid_size) {
+			dispatch_nerf_extra_dims(network.n_extra_dims(), [&](auto n_extra_dims) {
+				linear_kernel(generate_next_nerf_network_inputs<decltype(grid_size)::value, decltype(n_extra_dims)::value>, 0, stream,
+					n_alive,
+					alive_counter(iteration),
+					render_aabb,
+					render_aabb_to_local,
+					train_aabb,
+					m_views,
+					rays_current.payload,
+					NerfCoordinates<decltype(n_extra_dims)::value>((NerfCoordinate*)m_network_input, network.n_extra_dims()),
+					n_steps_between_compaction,
+					grid,
+					(show_accel>=0) ? show_accel : 0,
+					max_mip,
+					cone_angle_constant,
+					extra_dims_gpu,
+					m_count_useful_queries ? m_counters + UsefulQueries : nullptr,
+					distance_field(grid),
+					m_count_useful_queries ? m_counters + EmptySpaceSteps : nullptr,
+					m_lod,
+					m_max_level,
+					m_count_useful_queries && m_lod ? m_counters + LevelEvaluations : nullptr
+				);
+			});
+		});
 		uint32_t n_elements = next_multiple(n_alive * n_steps_between_compaction, tcnn::batch_size_granularity);
+		++m_stats.n_inference_batches;
+		m_stats.n_queries += n_elements;
 		GPUMatrix<float> positions_matrix((float*)m_network_input, (sizeof(NerfCoordinate) + extra_stride) / sizeof(float), n_elements);
 		GPUMatrix<network_precision_t, RM> rgbsigma_matrix((network_precision_t*)m_network_output, network.padded_output_width(), n_elements);
+
+		// Padding elements of the batch read stale levels, but their outputs are never composited.
+		if (lod_encoding) {
+			lod_encoding->set_max_level_gpu(m_max_level);
+		}
+
 		network.inference_mixed_precision(stream, positions_matrix, rgbsigma_matrix);
 
 		if (render_mode == ERenderMode::Normals) {
@@ -2229,15 +2814,26 @@ uint32_t Testbed::NerfTracer::trace(
 			network.visualize_activation(stream, visualized_layer, visualized_dim, positions_matrix, positions_matrix);
 		}
 
+		PitchedPtr<const NerfCoordinate> gradient_data;
+		if (aovs.normal) {
+			GPUMatrix<float> gradient_matrix((float*)gradient_alloc.data(), positions_matrix.m(), n_elements);
+			network.input_gradient(stream, 3, positions_matrix, gradient_matrix);
+			gradient_data = PitchedPtr<const NerfCoordinate>((const NerfCoordinate*)gradient_alloc.data(), 1, 0, extra_stride);
+		}
+
+		if (lod_encoding) {
+			lod_encoding->set_max_level_gpu(nullptr);
+		}
+
 		linear_kernel(composite_kernel_nerf, 0, stream,
 			n_alive,
+			alive_counter(iteration),
 			n_elements,
 			i,
 			train_aabb,
 			glow_y_cutoff,
 			glow_mode,
-			camera_matrix,
-			focal_length,
+			m_views,
 			depth_scale,
 			rays_current.rgba,
 			rays_current.depth,
@@ -2248,64 +2844,93 @@ uint32_t Testbed::NerfTracer::trace(
 			n_steps_between_compaction,
 			render_mode,
 			grid,
+			m_density_grid_shape.size,
+			m_density_grid_shape.n_cascades,
 			rgb_activation,
 			density_activation,
 			show_accel,
-			min_transmittance
+			min_transmittance,
+			aovs,
+			gradient_data
 		);
 
 		i += n_steps_between_compaction;
+		++iteration;
 	}
 
-	uint32_t n_hit;
+	m_stats.n_iterations = iteration;
+
+	uint32_t n_hit, n_useful_queries = 0, n_empty_space_steps = 0, n_level_evaluations = 0;
 	CUDA_CHECK_THROW(cudaMemcpyAsync(&n_hit, m_hit_counter, sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+	if (m_count_useful_queries) {
+		CUDA_CHECK_THROW(cudaMemcpyAsync(&n_useful_queries, m_counters + UsefulQueries, sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+		CUDA_CHECK_THROW(cudaMemcpyAsync(&n_empty_space_steps, m_counters + EmptySpaceSteps, sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+		CUDA_CHECK_THROW(cudaMemcpyAsync(&n_level_evaluations, m_counters + LevelEvaluations, sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+	}
 	CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+	++m_stats.n_stream_syncs;
+	m_stats.n_useful_queries = n_useful_queries;
+	m_stats.n_empty_space_steps = n_empty_space_steps;
+	m_stats.n_level_evaluations = n_level_evaluations;
 	return n_hit;
 }
 
+const uint8_t* Testbed::NerfTracer::distance_field(const uint8_t* grid) const {
+	return m_skip_empty_space_with_distance_field && grid ? grid + m_density_grid_shape.distance_field_offset() : nullptr;
+}
+
 void Testbed::NerfTracer::enlarge(size_t n_elements, uint32_t padded_output_width, uint32_t n_extra_dims, cudaStream_t stream) {
 	n_elements = next_multiple(n_elements, size_t(tcnn::batch_size_granularity));
 	size_t num_floats = sizeof(NerfCoordinate) / sizeof(float) + n_extra_dims;
 	auto scratch = allocate_workspace_and_distribute<
-		vec4, float, NerfPayload, // m_rays[0]
-		vec4, float, NerfPayload, // m_rays[1]
-		vec4, float, NerfPayload, // m_rays_hit
+		vec4, float, float, float, uint32_t, NerfRayState, // m_rays[0]
+		vec4, float, float, float, uint32_t, NerfRayState, // m_rays[1]
+		vec4, float, float, float, uint32_t, NerfRayState, // m_rays_hit
+		vec3, vec3, // m_ray_origin, m_ray_dir
 
 		network_precision_t,
 		float,
+		float, // m_max_level
 		uint32_t,
 		uint32_t
 	>(
 		stream, &m_scratch_alloc,
-		n_elements, n_elements, n_elements,
-		n_elements, n_elements, n_elements,
-		n_elements, n_elements, n_elements,
+		n_elements, n_elements, n_elements, n_elements, n_elements, n_elements,
+		n_elements, n_elements, n_elements, n_elements, n_elements, n_elements,
+		n_elements, n_elements, n_elements, n_elements, n_elements, n_elements,
+		n_elements, n_elements,
 		n_elements * MAX_STEPS_INBETWEEN_COMPACTION * padded_output_width,
 		n_elements * MAX_STEPS_INBETWEEN_COMPACTION * num_floats,
+		m_lod ? n_elements * MAX_STEPS_INBETWEEN_COMPACTION : 0,
 		32, // 2 full cache lines to ensure no overlap
-		32  // 2 full cache lines to ensure no overlap
+		next_multiple((size_t)NumCounters, (size_t)32) // full cache lines to ensure no overlap
 	);
 
-	m_rays[0].set(std::get<0>(scratch), std::get<1>(scratch), std::get<2>(scratch), n_elements);
-	m_rays[1].set(std::get<3>(scratch), std::get<4>(scratch), std::get<5>(scratch), n_elements);
-	m_rays_hit.set(std::get<6>(scratch), std::get<7>(scratch), std::get<8>(scratch), n_elements);
+	m_rays[0].set(std::get<0>(scratch), std::get<1>(scratch), {std::get<2>(scratch), std::get<3>(scratch), std::get<4>(scratch), std::get<5>(scratch)}, n_elements);
+	m_rays[1].set(std::get<6>(scratch), std::get<7>(scratch), {std::get<8>(scratch), std::get<9>(scratch), std::get<10>(scratch), std::get<11>(scratch)}, n_elements);
+	m_rays_hit.set(std::get<12>(scratch), std::get<13>(scratch), {std::get<14>(scratch), std::get<15>(scratch), std::get<16>(scratch), std::get<17>(scratch)}, n_elements);
 
-	m_network_output = std::get<9>(scratch);
-	m_network_input = std::get<10>(scratch);
+	m_ray_origin = std::get<18>(scratch);
+	m_ray_dir = std::get<19>(scratch);
 
-	m_hit_counter = std::get<11>(scratch);
-	m_alive_counter = std::get<12>(scratch);
+	m_network_output = std::get<20>(scratch);
+	m_network_input = std::get<21>(scratch);
+	m_max_level = std::get<22>(scratch);
+
+	m_hit_counter = std::get<23>(scratch);
+	m_counters = std::get<24>(scratch);
 }
 
 void Testbed::Nerf::Training::reset_extra_dims(default_rng_t& rng) {
 	uint32_t n_extra_dims = dataset.n_extra_dims();
 	std::vector<float> extra_dims_cpu(n_extra_dims * (dataset.n_images + 1)); // n_images + 1 since we use an extra 'slot' for the inference latent code
 	float* dst = extra_dims_cpu.data();
-	extra_dims_opt = std::vector<VarAdamOptimizer>(dataset.n_images, VarAdamOptimizer(n_extra_dims, 1e-4f));
+	extra_dims_opt = BatchedAdamOptimizer(n_extra_dims, 1e-4f);
+	extra_dims_opt.resize(dataset.n_images);
+	extra_dims_opt_gpu = {};
 	for (uint32_t i = 0; i < dataset.n_images; ++i) {
 		vec3 light_dir = warp_direction(normalize(dataset.metadata[i].light_dir));
-		extra_dims_opt[i].reset_state();
-		std::vector<float>& optimzer_value = extra_dims_opt[i].variable();
+		float* optimzer_value = extra_dims_opt.variable(i);
 		for (uint32_t j = 0; j < n_extra_dims; ++j) {
 			if (dataset.has_light_dirs && j < 3) {
 				dst[j] = light_dir[j];
@@ -2320,16 +2945,156 @@ void Testbed::Nerf::Training::reset_extra_dims(default_rng_t& rng) {
 }
 
 void Testbed::Nerf::Training::update_extra_dims() {
-	uint32_t n_extra_dims = dataset.n_extra_dims();
-	std::vector<float> extra_dims_cpu(extra_dims_gpu.size());
-	for (uint32_t i = 0; i < extra_dims_opt.size(); ++i) {
-		const std::vector<float>& value = extra_dims_opt[i].variable();
-		for (uint32_t j = 0; j < n_extra_dims; ++j) {
-			extra_dims_cpu[i * n_extra_dims + j] = value[j];
+	// The latent codes are already laid out like extra_dims_gpu, minus its trailing inference slot.
+	CUDA_CHECK_THROW(cudaMemcpyAsync(extra_dims_gpu.data(), extra_dims_opt.variables().data(), extra_dims_opt.variables().size() * sizeof(float), cudaMemcpyHostToDevice));
+}
+
+void Testbed::Nerf::Training::sync_extra_dims_to_host(cudaStream_t stream) {
+	extra_dims_opt_gpu.download(extra_dims_opt, extra_dims_gpu.data(), stream);
+}
+
+void Testbed::Nerf::Training::ErrorMap::build_cdf(uint32_t n_images, cudaStream_t stream) {
+	cdf_resolution = resolution;
+	cdf_x_cond_y.resize(compMul(cdf_resolution) * n_images);
+	cdf_y.resize(cdf_resolution.y * n_images);
+	cdf_img.resize(n_images);
+
+	CUDA_CHECK_THROW(cudaMemsetAsync(cdf_x_cond_y.data(), 0, cdf_x_cond_y.get_bytes(), stream));
+	CUDA_CHECK_THROW(cudaMemsetAsync(cdf_y.data(), 0, cdf_y.get_bytes(), stream));
+	CUDA_CHECK_THROW(cudaMemsetAsync(cdf_img.data(), 0, cdf_img.get_bytes(), stream));
+
+	const dim3 threads = { 16, 8, 1 };
+	const dim3 blocks = { div_round_up((uint32_t)cdf_resolution.y, threads.x), div_round_up(n_images, threads.y), 1 };
+	construct_cdf_2d<<<blocks, threads, 0, stream>>>(
+		n_images, cdf_resolution.y, cdf_resolution.x,
+		data.data(),
+		cdf_x_cond_y.data(),
+		cdf_y.data()
+	);
+	linear_kernel(construct_cdf_1d, 0, stream,
+		n_images,
+		cdf_resolution.y,
+		cdf_y.data(),
+		cdf_img.data()
+	);
+
+	// Compute image CDF on the CPU. It's single-threaded anyway. No use parallelizing.
+	pmf_img_cpu.resize(cdf_img.size());
+	cdf_img.copy_to_host(pmf_img_cpu);
+	std::vector<float> cdf_img_cpu = pmf_img_cpu; // Copy unnormalized PDF into CDF buffer
+	float cum = 0;
+	for (float& f : cdf_img_cpu) {
+		cum += f;
+		f = cum;
+	}
+	float norm = 1.0f / cum;
+	for (size_t i = 0; i < cdf_img_cpu.size(); ++i) {
+		pmf_img_cpu[i] = (1.0f - ERROR_MAP_MIN_PMF) * pmf_img_cpu[i] * norm + ERROR_MAP_MIN_PMF / (float)n_images;
+		cdf_img_cpu[i] = (1.0f - ERROR_MAP_MIN_PMF) * cdf_img_cpu[i] * norm + ERROR_MAP_MIN_PMF * (float)(i+1) / (float)n_images;
+	}
+	cdf_img.copy_from_host(cdf_img_cpu);
+
+	// The alias tables missed this update's error
+	alias_n_images = 0;
+	n_rebuilt_images = n_images;
+}
+
+void Testbed::Nerf::Training::ErrorMap::build_alias_tables(uint32_t n_images, cudaStream_t stream) {
+	bool rebuild_all = alias_n_images == 0 || alias_n_images != n_images || alias_resolution != resolution;
+	uint32_t n_rows = resolution.y * n_images;
+	uint32_t n_cells = compMul(resolution) * n_images;
+
+	if (rebuild_all) {
+		alias_resolution = resolution;
+		alias_n_images = n_images;
+		pmf_x_cond_y.resize(n_cells);
+		alias_x_cond_y.resize(n_cells);
+		alias_scratch.resize(n_cells);
+		row_weight.resize(n_rows);
+		pmf_y.resize(n_rows);
+		alias_y.resize(n_rows);
+		image_weight.resize(n_images);
+		dirty.resize(n_images);
+	}
+
+	if (touched.size() != n_images) {
+		touched.resize(n_images);
+		CUDA_CHECK_THROW(cudaMemsetAsync(touched.data(), 0, touched.get_bytes(), stream));
+	}
+
+	linear_kernel(update_error_map_dirty_flags, 0, stream, n_images, rebuild_all, touched.data(), dirty.data());
+
+	// One thread per table. The column tables of all rows share the scratch space with the row tables that follow.
+	const dim3 threads = { 16, 8, 1 };
+	const dim3 blocks = { div_round_up((uint32_t)resolution.y, threads.x), div_round_up(n_images, threads.y), 1 };
+	build_error_map_column_tables<<<blocks, threads, 0, stream>>>(
+		n_images, resolution.y, resolution.x,
+		data.data(),
+		dirty.data(),
+		pmf_x_cond_y.data(),
+		alias_x_cond_y.data(),
+		row_weight.data(),
+		alias_scratch.data()
+	);
+	linear_kernel(build_error_map_row_tables, 0, stream,
+		n_images,
+		resolution.y,
+		dirty.data(),
+		row_weight.data(),
+		pmf_y.data(),
+		alias_y.data(),
+		image_weight.data(),
+		alias_scratch.data()
+	);
+
+	// The image-level table is a single sequential construction, so it is built on the CPU.
+	std::vector<float> image_weight_cpu(n_images);
+	std::vector<uint8_t> dirty_cpu(n_images);
+	CUDA_CHECK_THROW(cudaMemcpyAsync(image_weight_cpu.data(), image_weight.data(), n_images * sizeof(float), cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(dirty_cpu.data(), dirty.data(), n_images * sizeof(uint8_t), cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+
+	n_rebuilt_images = (uint32_t)std::count(dirty_cpu.begin(), dirty_cpu.end(), (uint8_t)1);
+	build_image_alias_table(image_weight_cpu, pmf_img_cpu, alias_img_cpu);
+	pmf_img.resize_and_copy_from_host(pmf_img_cpu);
+	alias_img.resize_and_copy_from_host(alias_img_cpu);
+}
+
+ErrorMapSampler Testbed::Nerf::Training::ErrorMap::sampler(EErrorMapSampler mode, bool sample_focal_plane, bool sample_image) const {
+	ErrorMapSampler result;
+	result.mode = mode;
+
+	if (mode == EErrorMapSampler::Alias) {
+		if (alias_n_images == 0) {
+			return result;
+		}
+
+		result.resolution = alias_resolution;
+		result.n_images = alias_n_images;
+		if (sample_focal_plane) {
+			result.alias_x_cond_y = alias_x_cond_y.data();
+			result.alias_y = alias_y.data();
+			result.pmf_x_cond_y = pmf_x_cond_y.data();
+			result.pmf_y = pmf_y.data();
+		}
+
+		if (sample_image) {
+			result.alias_img = alias_img.data();
+			result.pmf_img = pmf_img.data();
+		}
+	} else {
+		result.resolution = cdf_resolution;
+		if (sample_focal_plane) {
+			result.cdf_x_cond_y = cdf_x_cond_y.data();
+			result.cdf_y = cdf_y.data();
+		}
+
+		if (sample_image) {
+			result.cdf_img = cdf_img.data();
 		}
 	}
 
-	CUDA_CHECK_THROW(cudaMemcpyAsync(extra_dims_gpu.data(), extra_dims_cpu.data(), extra_dims_opt.size() * n_extra_dims * sizeof(float), cudaMemcpyHostToDevice));
+	return result;
 }
 
 const float* Testbed::get_inference_extra_dims(cudaStream_t stream) const {
@@ -2374,6 +3139,9 @@ void Testbed::render_nerf(
 	const float* extra_dims_gpu = get_inference_extra_dims(stream);
 
 	NerfTracer tracer;
+	tracer.skip_empty_space_with_distance_field(m_nerf.skip_empty_space_with_distance_field);
+	tracer.set_density_grid_shape(m_nerf.density_grid_shape);
+	tracer.set_level_of_detail(nerf_level_of_detail());
 
 	// Our motion vector code can't undo grid distortions -- so don't render grid distortion if DLSS is enabled
 	auto grid_distortion = m_nerf.render_with_lens_distortion && !m_dlss ? m_distortion.inference_view() : Buffer2DView<const vec2>{};
@@ -2423,11 +3191,9 @@ void Testbed::render_nerf(
 			m_render_aabb,
 			m_render_aabb_to_local,
 			m_aabb,
-			focal_length,
 			m_nerf.cone_angle_constant,
 			density_grid_bitfield,
 			render_mode,
-			camera_matrix1,
 			depth_scale,
 			m_visualized_layer,
 			visualized_dimension,
@@ -2439,7 +3205,8 @@ void Testbed::render_nerf(
 			m_nerf.glow_y_cutoff,
 			m_nerf.glow_mode,
 			extra_dims_gpu,
-			stream
+			stream,
+			m_nerf.render_aovs
 		);
 	}
 	RaysNerfSoa& rays_hit = m_render_mode == ERenderMode::Slice ? tracer.rays_init() : tracer.rays_hit();
@@ -2448,12 +3215,13 @@ void Testbed::render_nerf(
 		// Store colors in the normal buffer
 		uint32_t n_elements = next_multiple(n_hit, tcnn::batch_size_granularity);
 		const uint32_t floats_per_coord = sizeof(NerfCoordinate) / sizeof(float) + nerf_network.n_extra_dims();
-		const uint32_t extra_stride = nerf_network.n_extra_dims() * sizeof(float); // extra stride on top of base NerfCoordinate struct
 
 		GPUMatrix<float> positions_matrix{floats_per_coord, n_elements, stream};
 		GPUMatrix<float> rgbsigma_matrix{4, n_elements, stream};
 
-		linear_kernel(generate_nerf_network_inputs_at_current_position, 0, stream, n_hit, m_aabb, rays_hit.payload, PitchedPtr<NerfCoordinate>((NerfCoordinate*)positions_matrix.data(), 1, 0, extra_stride), extra_dims_gpu );
+		dispatch_nerf_extra_dims(nerf_network.n_extra_dims(), [&](auto n_extra_dims) {
+			linear_kernel(generate_nerf_network_inputs_at_current_position<decltype(n_extra_dims)::value>, 0, stream, n_hit, m_aabb, tracer.views(), rays_hit.payload, NerfCoordinates<decltype(n_extra_dims)::value>((NerfCoordinate*)positions_matrix.data(), nerf_network.n_extra_dims()), extra_dims_gpu);
+		});
 
 		if (visualized_dimension == -1) {
 			nerf_network.inference(stream, positions_matrix, rgbsigma_matrix);
@@ -2469,8 +3237,8 @@ void Testbed::render_nerf(
 			rays_hit.payload,
 			m_render_mode,
 			m_nerf.training.linear_colors,
-			render_buffer.frame_buffer,
-			render_buffer.depth_buffer
+			tracer.views(),
+			false
 		);
 		return;
 	}
@@ -2482,23 +3250,134 @@ void Testbed::render_nerf(
 		rays_hit.payload,
 		m_render_mode,
 		m_nerf.training.linear_colors,
-		render_buffer.frame_buffer,
-		render_buffer.depth_buffer
+		tracer.views(),
+		false
 	);
 
 	if (render_mode == ERenderMode::Cost) {
-		std::vector<NerfPayload> payloads_final_cpu(n_hit);
-		CUDA_CHECK_THROW(cudaMemcpyAsync(payloads_final_cpu.data(), rays_hit.payload, n_hit * sizeof(NerfPayload), cudaMemcpyDeviceToHost, stream));
+		std::vector<NerfRayState> states_final_cpu(n_hit);
+		CUDA_CHECK_THROW(cudaMemcpyAsync(states_final_cpu.data(), rays_hit.payload.state, n_hit * sizeof(NerfRayState), cudaMemcpyDeviceToHost, stream));
 		CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
 
 		size_t total_n_steps = 0;
 		for (uint32_t i = 0; i < n_hit; ++i) {
-			total_n_steps += payloads_final_cpu[i].n_steps;
+			total_n_steps += states_final_cpu[i].n_steps();
 		}
 		tlog::info() << "Total steps per hit= " << total_n_steps << "/" << n_hit << " = " << ((float)total_n_steps/(float)n_hit);
 	}
 }
 
+NerfLevelOfDetail Testbed::nerf_level_of_detail() const {
+	if (!m_nerf.render_lod || !m_nerf_network || !dynamic_cast<GridEncoding<network_precision_t>*>(m_nerf_network->pos_encoding().get())) {
+		return {};
+	}
+
+	NerfLevelOfDetail lod;
+	lod.n_levels = (uint32_t)m_n_levels;
+	lod.base_resolution = (float)m_base_grid_resolution;
+	lod.log_per_level_scale = std::log(m_per_level_scale);
+	lod.bias = m_nerf.render_lod_bias;
+	return lod;
+}
+
+bool Testbed::can_render_nerf_views_batched() const {
+	// Slices and cost visualizations post-process the initial rays of a single view, and AOVs are indexed by pixel,
+	// so all of them keep rendering one view at a time.
+	return
+		m_testbed_mode == ETestbedMode::Nerf &&
+		m_nerf_network &&
+		!m_render_ground_truth &&
+		m_render_mode != ERenderMode::Slice &&
+		m_render_mode != ERenderMode::Cost &&
+		!m_nerf.render_aovs;
+}
+
+Testbed::NerfTracer::Stats Testbed::render_nerf_views(
+	cudaStream_t stream,
+	const std::vector<NerfTracer::View>& views,
+	NerfNetwork<precision_t>& nerf_network,
+	const uint8_t* density_grid_bitfield,
+	int visualized_dimension,
+	bool count_useful_queries,
+	bool composite_behind
+) {
+	if (!can_render_nerf_views_batched()) {
+		throw std::runtime_error{"The current render settings do not support rendering several views in one trace."};
+	}
+
+	ERenderMode render_mode = visualized_dimension > -1 ? ERenderMode::EncodingVis : m_render_mode;
+
+	const float* extra_dims_gpu = get_inference_extra_dims(stream);
+
+	NerfTracer tracer;
+	tracer.count_useful_queries(count_useful_queries);
+	tracer.composite_behind(composite_behind, m_nerf.render_min_transmittance);
+	tracer.skip_empty_space_with_distance_field(m_nerf.skip_empty_space_with_distance_field);
+	tracer.set_density_grid_shape(m_nerf.density_grid_shape);
+	tracer.set_level_of_detail(nerf_level_of_detail());
+
+	auto grid_distortion = m_nerf.render_with_lens_distortion && !m_dlss ? m_distortion.inference_view() : Buffer2DView<const vec2>{};
+	Lens lens = m_nerf.render_with_lens_distortion ? m_nerf.render_lens : Lens{};
+
+	tracer.init_rays_from_views(
+		nerf_network.padded_output_width(),
+		nerf_network.n_extra_dims(),
+		views,
+		m_parallax_shift,
+		m_snap_to_pixel_centers,
+		m_render_aabb,
+		m_render_aabb_to_local,
+		m_render_near_distance,
+		m_slice_plane_z + m_scale,
+		m_aperture_size,
+		lens,
+		m_envmap.inference_view(),
+		grid_distortion,
+		density_grid_bitfield,
+		m_nerf.show_accel,
+		m_nerf.max_cascade,
+		m_nerf.cone_angle_constant,
+		render_mode,
+		stream
+	);
+
+	uint32_t n_hit = tracer.trace(
+		nerf_network,
+		m_render_aabb,
+		m_render_aabb_to_local,
+		m_aabb,
+		m_nerf.cone_angle_constant,
+		density_grid_bitfield,
+		render_mode,
+		1.0f / m_nerf.training.dataset.scale,
+		m_visualized_layer,
+		visualized_dimension,
+		m_nerf.rgb_activation,
+		m_nerf.density_activation,
+		m_nerf.show_accel,
+		m_nerf.max_cascade,
+		m_nerf.render_min_transmittance,
+		m_nerf.glow_y_cutoff,
+		m_nerf.glow_mode,
+		extra_dims_gpu,
+		stream
+	);
+
+	// Scatters every hit to the frame and depth buffer of its view
+	linear_kernel(shade_kernel_nerf, 0, stream,
+		n_hit,
+		tracer.rays_hit().rgba,
+		tracer.rays_hit().depth,
+		tracer.rays_hit().payload,
+		m_render_mode,
+		m_nerf.training.linear_colors,
+		tracer.views(),
+		composite_behind
+	);
+
+	return tracer.stats();
+}
+
 void Testbed::Nerf::Training::set_camera_intrinsics(int frame_idx, float fx, float fy, float cx, float cy, float k1, float k2, float p1, float p2, float k3, float k4, bool is_fisheye) {
 	if (frame_idx < 0 || frame_idx >= dataset.n_images) {
 		return;
@@ -2537,9 +3416,9 @@ void Testbed::Nerf::Training::set_camera_extrinsics_rolling_shutter(int frame_id
 	dataset.metadata[frame_idx].rolling_shutter = rolling_shutter;
 	dataset.update_metadata(frame_idx, frame_idx + 1);
 
-	cam_rot_offset[frame_idx].reset_state();
-	cam_pos_offset[frame_idx].reset_state();
-	cam_exposure[frame_idx].reset_state();
+	cam_rot_offset.reset_state(frame_idx);
+	cam_pos_offset.reset_state(frame_idx);
+	cam_exposure.reset_state(frame_idx);
 	update_transforms(frame_idx, frame_idx + 1);
 }
 
@@ -2548,17 +3427,9 @@ void Testbed::Nerf::Training::set_camera_extrinsics(int frame_idx, mat4x3 camera
 }
 
 void Testbed::Nerf::Training::reset_camera_extrinsics() {
-	for (auto&& opt : cam_rot_offset) {
-		opt.reset_state();
-	}
-
-	for (auto&& opt : cam_pos_offset) {
-		opt.reset_state();
-	}
-
-	for (auto&& opt : cam_exposure) {
-		opt.reset_state();
-	}
+	cam_rot_offset.reset_state();
+	cam_pos_offset.reset_state();
+	cam_exposure.reset_state();
 }
 
 void Testbed::Nerf::Training::export_camera_extrinsics(const fs::path& path, bool export_extrinsics_in_quat_format) {
@@ -2637,14 +3508,14 @@ void Testbed::Nerf::Training::update_transforms(int first, int last) {
 			dataset.xforms[i + first] = xform;
 		}
 
-		mat3 rot = rotmat(cam_rot_offset[i + first].variable());
+		mat3 rot = rotmat(cam_rot_offset.variable_as<vec3>(i + first));
 		auto rot_start = rot * mat3(xform.start);
 		auto rot_end = rot * mat3(xform.end);
 		xform.start = mat4x3(rot_start[0], rot_start[1], rot_start[2], xform.start[3]);
 		xform.end = mat4x3(rot_end[0], rot_end[1], rot_end[2], xform.end[3]);
 
-		xform.start[3] += cam_pos_offset[i + first].variable();
-		xform.end[3] += cam_pos_offset[i + first].variable();
+		xform.start[3] += cam_pos_offset.variable_as<vec3>(i + first);
+		xform.end[3] += cam_pos_offset.variable_as<vec3>(i + first);
 		transforms[i + first] = xform;
 	}
 
@@ -2671,9 +3542,9 @@ void Testbed::load_nerf_post() { // moved the second half of load_nerf here
 	m_nerf.training.cam_pos_gradient.resize(m_nerf.training.dataset.n_images, vec3(0.0f));
 	m_nerf.training.cam_pos_gradient_gpu.resize_and_copy_from_host(m_nerf.training.cam_pos_gradient);
 
-	m_nerf.training.cam_exposure.resize(m_nerf.training.dataset.n_images, AdamOptimizer<vec3>(1e-3f));
-	m_nerf.training.cam_pos_offset.resize(m_nerf.training.dataset.n_images, AdamOptimizer<vec3>(1e-4f));
-	m_nerf.training.cam_rot_offset.resize(m_nerf.training.dataset.n_images, RotationAdamOptimizer(1e-4f));
+	m_nerf.training.cam_exposure.resize(m_nerf.training.dataset.n_images);
+	m_nerf.training.cam_pos_offset.resize(m_nerf.training.dataset.n_images);
+	m_nerf.training.cam_rot_offset.resize(m_nerf.training.dataset.n_images);
 	m_nerf.training.cam_focal_length_offset = AdamOptimizer<vec2>(1e-5f);
 
 	m_nerf.training.cam_rot_gradient.resize(m_nerf.training.dataset.n_images, vec3(0.0f));
@@ -2719,17 +3590,13 @@ void Testbed::load_nerf_post() { // moved the second half of load_nerf here
 		throw std::runtime_error{fmt::format("NeRF dataset's `aabb_scale` must be a power of two, but is {}.", m_nerf.training.dataset.aabb_scale)};
 	}
 
-	int max_aabb_scale = 1 << (NERF_CASCADES()-1);
+	int max_aabb_scale = 1 << (NERF_MAX_CASCADES()-1);
 	if (m_nerf.training.dataset.aabb_scale > max_aabb_scale) {
-		throw std::runtime_error{fmt::format(
-			"NeRF dataset must have `aabb_scale <= {}`, but is {}. "
-			"You can increase this limit by factors of 2 by incrementing `NERF_CASCADES()` and re-compiling.",
-			max_aabb_scale, m_nerf.training.dataset.aabb_scale
-		)};
+		throw std::runtime_error{fmt::format("NeRF dataset must have `aabb_scale <= {}`, but is {}.", max_aabb_scale, m_nerf.training.dataset.aabb_scale)};
 	}
 
 	m_aabb = BoundingBox{vec3(0.5f), vec3(0.5f)};
-	m_aabb.inflate(0.5f * std::min(1 << (NERF_CASCADES()-1), m_nerf.training.dataset.aabb_scale));
+	m_aabb.inflate(0.5f * m_nerf.training.dataset.aabb_scale);
 	m_raw_aabb = m_aabb;
 	m_render_aabb = m_aabb;
 	m_render_aabb_to_local = m_nerf.training.dataset.render_aabb_to_local;
@@ -2742,6 +3609,11 @@ void Testbed::load_nerf_post() { // moved the second half of load_nerf here
 		++m_nerf.max_cascade;
 	}
 
+	if (m_nerf.max_cascade >= m_nerf.density_grid_shape.n_cascades) {
+		tlog::info() << fmt::format("Increasing the number of density grid cascades to {} to cover `aabb_scale={}`.", m_nerf.max_cascade + 1, m_nerf.training.dataset.aabb_scale);
+		set_density_grid_shape({m_nerf.density_grid_shape.size, m_nerf.max_cascade + 1});
+	}
+
 	// Perform fixed-size stepping in unit-cube scenes (like original NeRF) and exponential
 	// stepping in larger scenes.
 	m_nerf.cone_angle_constant = m_nerf.training.dataset.aabb_scale <= 1 ? 0.0f : (1.0f / 256.0f);
@@ -2780,8 +3652,10 @@ void Testbed::load_nerf(const fs::path& data_path) {
 	load_nerf_post();
 }
 
-void Testbed::update_density_grid_nerf(float decay, uint32_t n_uniform_density_grid_samples, uint32_t n_nonuniform_density_grid_samples, cudaStream_t stream) {
-	const uint32_t n_elements = NERF_GRID_N_CELLS() * (m_nerf.max_cascade + 1);
+void Testbed::update_density_grid_nerf(float decay, uint32_t n_uniform_density_grid_samples, uint32_t n_nonuniform_density_grid_samples, cudaStream_t stream, uint32_t cascade_mask) {
+	const uint32_t grid_size = m_nerf.density_grid_shape.size;
+	const uint32_t n_elements = m_nerf.density_grid_shape.n_cells() * (m_nerf.max_cascade + 1);
+	cascade_mask &= all_cascades_mask(m_nerf.max_cascade + 1);
 
 	m_nerf.density_grid.resize(n_elements);
 
@@ -2809,46 +3683,54 @@ void Testbed::update_density_grid_nerf(float decay, uint32_t n_uniform_density_g
 		}
 		// Only cull away empty regions where no camera is looking when the cameras are actually meaningful.
 		if (!m_nerf.training.dataset.has_rays) {
-			linear_kernel(mark_untrained_density_grid, 0, stream, n_elements, m_nerf.density_grid.data(),
-				m_nerf.training.n_images_for_training,
-				m_nerf.training.dataset.metadata_gpu.data(),
-				m_nerf.training.transforms_gpu.data(),
-				m_training_step == 0
-			);
+			dispatch_density_grid_size(grid_size, [&](auto size) {
+				linear_kernel(mark_untrained_density_grid<decltype(size)::value>, 0, stream, n_elements, m_nerf.density_grid.data(),
+					m_nerf.training.n_images_for_training,
+					m_nerf.training.dataset.metadata_gpu.data(),
+					m_nerf.training.transforms_gpu.data(),
+					m_training_step == 0
+				);
+			});
 		} else {
 			CUDA_CHECK_THROW(cudaMemsetAsync(m_nerf.density_grid.data(), 0, sizeof(float)*n_elements, stream));
 		}
 	}
 
+	if (cascade_mask == 0) {
+		return;
+	}
+
 	uint32_t n_steps = 1;
 	for (uint32_t i = 0; i < n_steps; ++i) {
 		CUDA_CHECK_THROW(cudaMemsetAsync(density_grid_tmp, 0, sizeof(float)*n_elements, stream));
 
-		linear_kernel(generate_grid_samples_nerf_nonuniform, 0, stream,
-			n_uniform_density_grid_samples,
-			m_nerf.training.density_grid_rng,
-			m_nerf.density_grid_ema_step,
-			m_aabb,
-			m_nerf.density_grid.data(),
-			density_grid_positions,
-			density_grid_indices,
-			m_nerf.max_cascade+1,
-			-0.01f
-		);
-		m_nerf.training.density_grid_rng.advance();
-
-		linear_kernel(generate_grid_samples_nerf_nonuniform, 0, stream,
-			n_nonuniform_density_grid_samples,
-			m_nerf.training.density_grid_rng,
-			m_nerf.density_grid_ema_step,
-			m_aabb,
-			m_nerf.density_grid.data(),
-			density_grid_positions+n_uniform_density_grid_samples,
-			density_grid_indices+n_uniform_density_grid_samples,
-			m_nerf.max_cascade+1,
-			NERF_MIN_OPTICAL_THICKNESS()
-		);
-		m_nerf.training.density_grid_rng.advance();
+		dispatch_density_grid_size(grid_size, [&](auto size) {
+			linear_kernel(generate_grid_samples_nerf_nonuniform<decltype(size)::value>, 0, stream,
+				n_uniform_density_grid_samples,
+				m_nerf.training.density_grid_rng,
+				m_nerf.density_grid_ema_step,
+				m_aabb,
+				m_nerf.density_grid.data(),
+				density_grid_positions,
+				density_grid_indices,
+				cascade_mask,
+				-0.01f
+			);
+			m_nerf.training.density_grid_rng.advance();
+
+			linear_kernel(generate_grid_samples_nerf_nonuniform<decltype(size)::value>, 0, stream,
+				n_nonuniform_density_grid_samples,
+				m_nerf.training.density_grid_rng,
+				m_nerf.density_grid_ema_step,
+				m_aabb,
+				m_nerf.density_grid.data(),
+				density_grid_positions+n_uniform_density_grid_samples,
+				density_grid_indices+n_uniform_density_grid_samples,
+				cascade_mask,
+				NERF_MIN_OPTICAL_THICKNESS()
+			);
+			m_nerf.training.density_grid_rng.advance();
+		});
 
 		// Evaluate density at the spawned locations in batches.
 		// Otherwise, we can exhaust the maximum index range of cutlass
@@ -2863,7 +3745,7 @@ void Testbed::update_density_grid_nerf(float decay, uint32_t n_uniform_density_g
 		}
 
 		linear_kernel(splat_grid_samples_nerf_max_nearest_neighbor, 0, stream, n_density_grid_samples, density_grid_indices, mlp_out, density_grid_tmp, m_nerf.rgb_activation, m_nerf.density_activation);
-		linear_kernel(ema_grid_samples_nerf, 0, stream, n_elements, decay, m_nerf.density_grid_ema_step, m_nerf.density_grid.data(), density_grid_tmp);
+		linear_kernel(ema_grid_samples_nerf, 0, stream, n_elements, decay, m_nerf.density_grid_ema_step, m_nerf.density_grid_shape.n_cells(), cascade_mask, m_nerf.density_grid.data(), density_grid_tmp);
 
 		++m_nerf.density_grid_ema_step;
 	}
@@ -2872,38 +3754,51 @@ void Testbed::update_density_grid_nerf(float decay, uint32_t n_uniform_density_g
 }
 
 void Testbed::update_density_grid_mean_and_bitfield(cudaStream_t stream) {
-	const uint32_t n_elements = NERF_GRID_N_CELLS();
+	const DensityGridShape& shape = m_nerf.density_grid_shape;
+	const uint32_t n_elements = shape.n_cells();
 
-	size_t size_including_mips = grid_mip_offset(NERF_CASCADES())/8;
-	m_nerf.density_grid_bitfield.enlarge(size_including_mips);
+	m_nerf.density_grid_bitfield.enlarge(shape.buffer_bytes());
 	m_nerf.density_grid_mean.enlarge(reduce_sum_workspace_size(n_elements));
 
 	CUDA_CHECK_THROW(cudaMemsetAsync(m_nerf.density_grid_mean.data(), 0, sizeof(float), stream));
 	reduce_sum(m_nerf.density_grid.data(), [n_elements] __device__ (float val) { return fmaxf(val, 0.f) / (n_elements); }, m_nerf.density_grid_mean.data(), n_elements, stream);
 
-	linear_kernel(grid_to_bitfield, 0, stream, n_elements/8 * NERF_CASCADES(), n_elements/8 * (m_nerf.max_cascade + 1), m_nerf.density_grid.data(), m_nerf.density_grid_bitfield.data(), m_nerf.density_grid_mean.data());
+	linear_kernel(grid_to_bitfield, 0, stream, n_elements/8 * shape.n_cascades, n_elements/8 * (m_nerf.max_cascade + 1), m_nerf.density_grid.data(), m_nerf.density_grid_bitfield.data(), m_nerf.density_grid_mean.data());
 
-	for (uint32_t level = 1; level < NERF_CASCADES(); ++level) {
-		linear_kernel(bitfield_max_pool, 0, stream, n_elements/64, m_nerf.get_density_grid_bitfield_mip(level-1), m_nerf.get_density_grid_bitfield_mip(level));
-	}
+	dispatch_density_grid_size(shape.size, [&](auto size) {
+		constexpr uint32_t GRID_SIZE = decltype(size)::value;
+
+		for (uint32_t level = 1; level < shape.n_cascades; ++level) {
+			linear_kernel(bitfield_max_pool<GRID_SIZE>, 0, stream, n_elements/64, m_nerf.get_density_grid_bitfield_mip(level-1), m_nerf.get_density_grid_bitfield_mip(level));
+		}
+
+		// Chebyshev distance field of the final (max pooled) occupancy of each cascade, one pass per axis.
+		const uint32_t n_lines = GRID_SIZE * GRID_SIZE * shape.n_cascades;
+		uint8_t* distance_field = m_nerf.get_density_grid_distance_field(0);
+		auto distance_field_tmp = allocate_workspace(stream, shape.mip_offset(shape.n_cascades));
+		linear_kernel(chebyshev_distance_pass_nerf<GRID_SIZE>, 0, stream, n_lines, 0u, m_nerf.density_grid_bitfield.data(), nullptr, distance_field);
+		linear_kernel(chebyshev_distance_pass_nerf<GRID_SIZE>, 0, stream, n_lines, 1u, nullptr, distance_field, distance_field_tmp.data());
+		linear_kernel(chebyshev_distance_pass_nerf<GRID_SIZE>, 0, stream, n_lines, 2u, nullptr, distance_field_tmp.data(), distance_field);
+	});
 
 	set_all_devices_dirty();
 }
 
+template <uint32_t GRID_SIZE>
 __global__ void mark_density_grid_in_sphere_empty_kernel(const uint32_t n_elements, float* density_grid, vec3 pos, float radius) {
 	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
 	if (i >= n_elements) return;
 
 	// Random position within that cellq
-	uint32_t level = i / NERF_GRID_N_CELLS();
-	uint32_t pos_idx = i % NERF_GRID_N_CELLS();
+	uint32_t level = i / grid_n_cells<GRID_SIZE>();
+	uint32_t pos_idx = i % grid_n_cells<GRID_SIZE>();
 
 	uint32_t x = tcnn::morton3D_invert(pos_idx>>0);
 	uint32_t y = tcnn::morton3D_invert(pos_idx>>1);
 	uint32_t z = tcnn::morton3D_invert(pos_idx>>2);
 
-	float cell_radius = scalbnf(SQRT3(), level) / NERF_GRIDSIZE();
-	vec3 cell_pos = ((vec3{(float)x+0.5f, (float)y+0.5f, (float)z+0.5f}) / (float)NERF_GRIDSIZE() - vec3(0.5f)) * scalbnf(1.0f, level) + vec3(0.5f);
+	float cell_radius = scalbnf(SQRT3(), level) / GRID_SIZE;
+	vec3 cell_pos = ((vec3{(float)x+0.5f, (float)y+0.5f, (float)z+0.5f}) / (float)GRID_SIZE - vec3(0.5f)) * scalbnf(1.0f, level) + vec3(0.5f);
 
 	// Disable if the cell touches the sphere (conservatively, by bounding the cell with a sphere)
 	if (distance(pos, cell_pos) < radius + cell_radius) {
@@ -2912,35 +3807,87 @@ __global__ void mark_density_grid_in_sphere_empty_kernel(const uint32_t n_elemen
 }
 
 void Testbed::mark_density_grid_in_sphere_empty(const vec3& pos, float radius, cudaStream_t stream) {
-	const uint32_t n_elements = NERF_GRID_N_CELLS() * (m_nerf.max_cascade + 1);
+	const uint32_t n_elements = m_nerf.density_grid_shape.n_cells() * (m_nerf.max_cascade + 1);
 	if (m_nerf.density_grid.size() != n_elements) {
 		return;
 	}
 
-	linear_kernel(mark_density_grid_in_sphere_empty_kernel, 0, stream, n_elements, m_nerf.density_grid.data(), pos, radius);
+	dispatch_density_grid_size(m_nerf.density_grid_shape.size, [&](auto size) {
+		linear_kernel(mark_density_grid_in_sphere_empty_kernel<decltype(size)::value>, 0, stream, n_elements, m_nerf.density_grid.data(), pos, radius);
+	});
 
 	update_density_grid_mean_and_bitfield(stream);
 }
 
-void Testbed::NerfCounters::prepare_for_training_steps(cudaStream_t stream) {
-	numsteps_counter.enlarge(1);
-	numsteps_counter_compacted.enlarge(1);
-	loss.enlarge(rays_per_batch);
-	CUDA_CHECK_THROW(cudaMemsetAsync(numsteps_counter.data(), 0, sizeof(uint32_t), stream)); // clear the counter in the first slot
-	CUDA_CHECK_THROW(cudaMemsetAsync(numsteps_counter_compacted.data(), 0, sizeof(uint32_t), stream)); // clear the counter in the first slot
-	CUDA_CHECK_THROW(cudaMemsetAsync(loss.data(), 0, sizeof(float)*rays_per_batch, stream));
+void Testbed::resample_density_grid_nerf(uint32_t src_size, cudaStream_t stream) {
+	const uint32_t src_n_cells = src_size * src_size * src_size;
+	if (m_nerf.density_grid.size() % src_n_cells != 0) {
+		throw std::runtime_error{fmt::format("Density grid of {} cells does not consist of cascades of {}^3 cells.", m_nerf.density_grid.size(), src_size)};
+	}
+
+	const uint32_t src_n_cascades = (uint32_t)(m_nerf.density_grid.size() / src_n_cells);
+	const uint32_t n_elements = m_nerf.density_grid_shape.n_cells() * (m_nerf.max_cascade + 1);
+
+	GPUMemory<float> resampled(n_elements);
+	linear_kernel(resample_density_grid, 0, stream, n_elements, src_size, src_n_cascades, m_nerf.density_grid.data(), m_nerf.density_grid_shape.size, resampled.data());
+	CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+
+	m_nerf.density_grid = std::move(resampled);
 }
 
-float Testbed::NerfCounters::update_after_training(uint32_t target_batch_size, bool get_loss_scalar, cudaStream_t stream) {
-	std::vector<uint32_t> counter_cpu(1);
-	std::vector<uint32_t> compacted_counter_cpu(1);
-	numsteps_counter.copy_to_host(counter_cpu);
-	numsteps_counter_compacted.copy_to_host(compacted_counter_cpu);
-	measured_batch_size = 0;
-	measured_batch_size_before_compaction = 0;
+void Testbed::set_density_grid_shape(const DensityGridShape& shape) {
+	// Throws for sizes without compiled kernels
+	dispatch_density_grid_size(shape.size, [](auto) {});
 
-	if (counter_cpu[0] == 0 || compacted_counter_cpu[0] == 0) {
-		return 0.f;
+	if (shape.n_cascades == 0 || shape.n_cascades > NERF_MAX_CASCADES()) {
+		throw std::runtime_error{fmt::format("Density grid must have between 1 and {} cascades, but has {}.", NERF_MAX_CASCADES(), shape.n_cascades)};
+	}
+
+	if (shape.n_cascades <= m_nerf.max_cascade) {
+		throw std::runtime_error{fmt::format(
+			"Density grid needs at least {} cascades to cover `aabb_scale={}`, but has {}.",
+			m_nerf.max_cascade + 1, m_nerf.training.dataset.aabb_scale, shape.n_cascades
+		)};
+	}
+
+	// Keep the shape in the config, such that snapshots and network resets retain it.
+	m_network_config["density_grid"] = shape;
+
+	if (shape == m_nerf.density_grid_shape) {
+		return;
+	}
+
+	uint32_t prev_size = m_nerf.density_grid_shape.size;
+	m_nerf.density_grid_shape = shape;
+
+	// A size of 0 indicates that the density grid was never populated.
+	if (m_nerf.density_grid.size() != 0) {
+		resample_density_grid_nerf(prev_size, m_stream.get());
+		update_density_grid_mean_and_bitfield(m_stream.get());
+	}
+
+	tlog::info() << fmt::format("Density grid: {}^3 cells, {} cascades", shape.size, shape.n_cascades);
+}
+
+void Testbed::NerfCounters::prepare_for_training_steps(cudaStream_t stream) {
+	numsteps_counter.enlarge(1);
+	numsteps_counter_compacted.enlarge(1);
+	loss.enlarge(rays_per_batch);
+	CUDA_CHECK_THROW(cudaMemsetAsync(numsteps_counter.data(), 0, sizeof(uint32_t), stream)); // clear the counter in the first slot
+	CUDA_CHECK_THROW(cudaMemsetAsync(numsteps_counter_compacted.data(), 0, sizeof(uint32_t), stream)); // clear the counter in the first slot
+	CUDA_CHECK_THROW(cudaMemsetAsync(loss.data(), 0, sizeof(float)*rays_per_batch, stream));
+}
+
+float Testbed::NerfCounters::update_after_training(uint32_t target_batch_size, bool get_loss_scalar, cudaStream_t stream) {
+	std::vector<uint32_t> counter_cpu(1);
+	std::vector<uint32_t> compacted_counter_cpu(1);
+	numsteps_counter.copy_to_host(counter_cpu);
+	numsteps_counter_compacted.copy_to_host(compacted_counter_cpu);
+	measured_batch_size = 0;
+	measured_batch_size_before_compaction = 0;
+
+	if (counter_cpu[0] == 0 || compacted_counter_cpu[0] == 0) {
+		return 0.f;
 	}
 
 	measured_batch_size_before_compaction = counter_cpu[0];
@@ -2957,15 +3904,167 @@ float Testbed::NerfCounters::update_after_training(uint32_t target_batch_size, b
 	return loss_scalar;
 }
 
-void Testbed::train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaStream_t stream) {
+// Pinned host memory into which a density grid update copies the number of occupancy bits that it flipped per cascade,
+// and an event that signals their arrival.
+struct Testbed::Nerf::Training::DensityGridFlipReadback {
+	DensityGridFlipReadback(uint32_t n_cascades) : n_cascades{n_cascades} {
+		CUDA_CHECK_THROW(cudaMallocHost((void**)&values, n_cascades * sizeof(uint32_t)));
+		CUDA_CHECK_THROW(cudaEventCreateWithFlags(&done, cudaEventDisableTiming));
+	}
+
+	~DensityGridFlipReadback() {
+		cudaEventSynchronize(done);
+		cudaEventDestroy(done);
+		cudaFreeHost(values);
+	}
+
+	DensityGridFlipReadback(const DensityGridFlipReadback&) = delete;
+	DensityGridFlipReadback& operator=(const DensityGridFlipReadback&) = delete;
+
+	uint32_t* values = nullptr;
+	uint32_t n_cascades;
+	uint32_t n_cells = 0;
+	cudaEvent_t done = nullptr;
+	bool pending = false;
+};
+
+// Ring of pinned host memory into which training steps copy their counters and loss, with one event per step.
+struct Testbed::NerfCounters::PendingReadbacks {
+	static constexpr uint32_t N_SLOTS = 8;
+
+	struct Values {
+		uint32_t numsteps;
+		uint32_t numsteps_compacted;
+		float loss;
+	};
+
+	struct Slot {
+		cudaEvent_t done = nullptr;
+		uint32_t target_batch_size = 0;
+		uint32_t rays_per_batch = 0;
+		bool get_loss_scalar = false;
+	};
+
+	PendingReadbacks() {
+		CUDA_CHECK_THROW(cudaMallocHost((void**)&values, N_SLOTS * sizeof(Values)));
+		for (auto& slot : slots) {
+			CUDA_CHECK_THROW(cudaEventCreateWithFlags(&slot.done, cudaEventDisableTiming));
+		}
+	}
+
+	~PendingReadbacks() {
+		for (auto& slot : slots) {
+			cudaEventSynchronize(slot.done);
+			cudaEventDestroy(slot.done);
+		}
+		cudaFreeHost(values);
+	}
+
+	PendingReadbacks(const PendingReadbacks&) = delete;
+	PendingReadbacks& operator=(const PendingReadbacks&) = delete;
+
+	// Same bookkeeping as update_after_training(), but relative to the rays per batch of the step that was measured.
+	void consume_oldest(NerfCounters& counters) {
+		const Slot& slot = slots[first];
+		const Values& value = values[first];
+
+		Readback readback;
+		if (value.numsteps != 0 && value.numsteps_compacted != 0) {
+			readback.measured_batch_size_before_compaction = value.numsteps;
+			readback.measured_batch_size = value.numsteps_compacted;
+
+			if (slot.get_loss_scalar) {
+				readback.has_loss = true;
+				readback.loss = value.loss * (float)readback.measured_batch_size / (float)slot.target_batch_size;
+			}
+
+			uint32_t rays_per_batch = (uint32_t)((float)slot.rays_per_batch * (float)slot.target_batch_size / (float)readback.measured_batch_size);
+			counters.rays_per_batch = std::min(next_multiple(rays_per_batch, tcnn::batch_size_granularity), 1u << 18);
+		}
+
+		counters.measured_batch_size = readback.measured_batch_size;
+		counters.measured_batch_size_before_compaction = readback.measured_batch_size_before_compaction;
+		completed.emplace_back(readback);
+
+		first = (first + 1) % N_SLOTS;
+		--n_pending;
+	}
+
+	Values* values = nullptr;
+	std::array<Slot, N_SLOTS> slots;
+	uint32_t first = 0;
+	uint32_t n_pending = 0;
+
+	std::vector<Readback> completed;
+	GPUMemory<float> loss_sum;
+};
+
+void Testbed::NerfCounters::enqueue_readback(uint32_t target_batch_size, bool get_loss_scalar, cudaStream_t stream) {
+	if (!pending_readbacks) {
+		pending_readbacks = std::make_shared<PendingReadbacks>();
+	}
+
+	auto& pending = *pending_readbacks;
+	if (pending.n_pending == PendingReadbacks::N_SLOTS) {
+		CUDA_CHECK_THROW(cudaEventSynchronize(pending.slots[pending.first].done));
+		pending.consume_oldest(*this);
+	}
+
+	uint32_t idx = (pending.first + pending.n_pending) % PendingReadbacks::N_SLOTS;
+	auto& slot = pending.slots[idx];
+	auto* value = pending.values + idx;
+
+	slot.target_batch_size = target_batch_size;
+	slot.rays_per_batch = rays_per_batch;
+	slot.get_loss_scalar = get_loss_scalar;
+
+	CUDA_CHECK_THROW(cudaMemcpyAsync(&value->numsteps, numsteps_counter.data(), sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(&value->numsteps_compacted, numsteps_counter_compacted.data(), sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+	if (get_loss_scalar) {
+		pending.loss_sum.enlarge(reduce_sum_workspace_size(rays_per_batch));
+		CUDA_CHECK_THROW(cudaMemsetAsync(pending.loss_sum.data(), 0, sizeof(float), stream));
+		reduce_sum(loss.data(), [] __device__ (float val) { return val; }, pending.loss_sum.data(), rays_per_batch, stream);
+		CUDA_CHECK_THROW(cudaMemcpyAsync(&value->loss, pending.loss_sum.data(), sizeof(float), cudaMemcpyDeviceToHost, stream));
+	}
+
+	CUDA_CHECK_THROW(cudaEventRecord(slot.done, stream));
+	++pending.n_pending;
+}
+
+std::vector<Testbed::NerfCounters::Readback> Testbed::NerfCounters::poll_readbacks(bool wait) {
+	if (!pending_readbacks) {
+		return {};
+	}
+
+	auto& pending = *pending_readbacks;
+	while (pending.n_pending > 0) {
+		cudaEvent_t done = pending.slots[pending.first].done;
+		if (wait) {
+			CUDA_CHECK_THROW(cudaEventSynchronize(done));
+		} else {
+			cudaError_t status = cudaEventQuery(done);
+			if (status == cudaErrorNotReady) {
+				break;
+			}
+			CUDA_CHECK_THROW(status);
+		}
+
+		pending.consume_oldest(*this);
+	}
+
+	return std::move(pending.completed);
+}
+
+void Testbed::train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaStream_t stream, bool async_readback) {
 	if (m_nerf.training.n_images_for_training == 0) {
 		return;
 	}
 
 	if (m_nerf.training.include_sharpness_in_error) {
-		size_t n_cells = NERF_GRID_N_CELLS() * NERF_CASCADES();
+		// The loss indexes the grid with mips up to `max_cascade`, which large scenes push past the default cascade count.
+		size_t n_cells = NERF_GRID_N_CELLS() * (m_nerf.max_cascade + 1);
 		if (m_nerf.training.sharpness_grid.size() < n_cells) {
-			m_nerf.training.sharpness_grid.enlarge(NERF_GRID_N_CELLS() * NERF_CASCADES());
+			m_nerf.training.sharpness_grid.enlarge(n_cells);
 			CUDA_CHECK_THROW(cudaMemsetAsync(m_nerf.training.sharpness_grid.data(), 0, m_nerf.training.sharpness_grid.get_bytes(), stream));
 		}
 
@@ -3000,6 +4099,11 @@ void Testbed::train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaS
 		m_nerf.training.error_map.resolution = min(ivec2((int)(std::sqrt(std::sqrt((float)n_samples_per_image)) * 3.5f)), res);
 		m_nerf.training.error_map.data.resize(compMul(m_nerf.training.error_map.resolution) * m_nerf.training.dataset.n_images);
 		CUDA_CHECK_THROW(cudaMemsetAsync(m_nerf.training.error_map.data.data(), 0, m_nerf.training.error_map.data.get_bytes(), stream));
+
+		if (m_nerf.training.error_map.touched.size() != m_nerf.training.dataset.n_images) {
+			m_nerf.training.error_map.touched.resize(m_nerf.training.dataset.n_images);
+			CUDA_CHECK_THROW(cudaMemsetAsync(m_nerf.training.error_map.touched.data(), 0, m_nerf.training.error_map.touched.get_bytes(), stream));
+		}
 	}
 
 	float* envmap_gradient = m_nerf.training.train_envmap ? m_envmap.envmap->gradients() : nullptr;
@@ -3011,72 +4115,50 @@ void Testbed::train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaS
 	train_nerf_step(target_batch_size, m_nerf.training.counters_rgb, stream);
 
 
-	m_trainer->optimizer_step(stream, LOSS_SCALE);
-
-	++m_training_step;
+	{
+		auto profile = profile_training_phase(ETrainingPhase::OptimizerStep, stream);
+		m_trainer->optimizer_step(stream, LOSS_SCALE);
 
-	if (envmap_gradient) {
-		m_envmap.trainer->optimizer_step(stream, LOSS_SCALE);
+		if (envmap_gradient) {
+			m_envmap.trainer->optimizer_step(stream, LOSS_SCALE);
+		}
 	}
 
-	float loss_scalar = m_nerf.training.counters_rgb.update_after_training(target_batch_size, get_loss_scalar, stream);
-	bool zero_records = m_nerf.training.counters_rgb.measured_batch_size == 0;
-	if (get_loss_scalar) {
-		m_loss_scalar.update(loss_scalar);
-	}
+	// Incremented once the step's remaining phases are done, such that the profiler attributes them to this step
+	ScopeGuard increment_step{[this]() { ++m_training_step; }};
 
-	if (zero_records) {
-		m_loss_scalar.set(0.f);
-		tlog::warning() << "Nerf training generated 0 samples. Aborting training.";
-		m_train = false;
+	auto profile_readback = profile_training_phase(ETrainingPhase::CounterReadback, stream);
+	if (async_readback) {
+		// The caller handles the readbacks as they arrive, see Testbed::train_n_steps().
+		m_nerf.training.counters_rgb.enqueue_readback(target_batch_size, get_loss_scalar, stream);
+	} else {
+		float loss_scalar = m_nerf.training.counters_rgb.update_after_training(target_batch_size, get_loss_scalar, stream);
+		bool zero_records = m_nerf.training.counters_rgb.measured_batch_size == 0;
+		if (get_loss_scalar) {
+			m_loss_scalar.update(loss_scalar);
+		}
+
+		if (zero_records) {
+			m_loss_scalar.set(0.f);
+			tlog::warning() << "Nerf training generated 0 samples. Aborting training.";
+			m_train = false;
+		}
 	}
+	profile_readback = {};
 
-	// Compute CDFs from the error map
+	// Build the sampling tables from the error map
 	m_nerf.training.n_steps_since_error_map_update += 1;
 	// This is low-overhead enough to warrant always being on.
 	// It makes for useful visualizations of the training error.
 	bool accumulate_error = true;
 	if (accumulate_error && m_nerf.training.n_steps_since_error_map_update >= m_nerf.training.n_steps_between_error_map_updates) {
-		m_nerf.training.error_map.cdf_resolution = m_nerf.training.error_map.resolution;
-		m_nerf.training.error_map.cdf_x_cond_y.resize(compMul(m_nerf.training.error_map.cdf_resolution) * m_nerf.training.dataset.n_images);
-		m_nerf.training.error_map.cdf_y.resize(m_nerf.training.error_map.cdf_resolution.y * m_nerf.training.dataset.n_images);
-		m_nerf.training.error_map.cdf_img.resize(m_nerf.training.dataset.n_images);
-
-		CUDA_CHECK_THROW(cudaMemsetAsync(m_nerf.training.error_map.cdf_x_cond_y.data(), 0, m_nerf.training.error_map.cdf_x_cond_y.get_bytes(), stream));
-		CUDA_CHECK_THROW(cudaMemsetAsync(m_nerf.training.error_map.cdf_y.data(), 0, m_nerf.training.error_map.cdf_y.get_bytes(), stream));
-		CUDA_CHECK_THROW(cudaMemsetAsync(m_nerf.training.error_map.cdf_img.data(), 0, m_nerf.training.error_map.cdf_img.get_bytes(), stream));
+		auto profile = profile_training_phase(ETrainingPhase::ErrorMapCdf, stream);
 
-		const dim3 threads = { 16, 8, 1 };
-		const dim3 blocks = { div_round_up((uint32_t)m_nerf.training.error_map.cdf_resolution.y, threads.x), div_round_up((uint32_t)m_nerf.training.dataset.n_images, threads.y), 1 };
-		construct_cdf_2d<<<blocks, threads, 0, stream>>>(
-			m_nerf.training.dataset.n_images, m_nerf.training.error_map.cdf_resolution.y, m_nerf.training.error_map.cdf_resolution.x,
-			m_nerf.training.error_map.data.data(),
-			m_nerf.training.error_map.cdf_x_cond_y.data(),
-			m_nerf.training.error_map.cdf_y.data()
-		);
-		linear_kernel(construct_cdf_1d, 0, stream,
-			m_nerf.training.dataset.n_images,
-			m_nerf.training.error_map.cdf_resolution.y,
-			m_nerf.training.error_map.cdf_y.data(),
-			m_nerf.training.error_map.cdf_img.data()
-		);
-
-		// Compute image CDF on the CPU. It's single-threaded anyway. No use parallelizing.
-		m_nerf.training.error_map.pmf_img_cpu.resize(m_nerf.training.error_map.cdf_img.size());
-		m_nerf.training.error_map.cdf_img.copy_to_host(m_nerf.training.error_map.pmf_img_cpu);
-		std::vector<float> cdf_img_cpu = m_nerf.training.error_map.pmf_img_cpu; // Copy unnormalized PDF into CDF buffer
-		float cum = 0;
-		for (float& f : cdf_img_cpu) {
-			cum += f;
-			f = cum;
-		}
-		float norm = 1.0f / cum;
-		for (size_t i = 0; i < cdf_img_cpu.size(); ++i) {
-			constexpr float MIN_PMF = 0.1f;
-			m_nerf.training.error_map.pmf_img_cpu[i] = (1.0f - MIN_PMF) * m_nerf.training.error_map.pmf_img_cpu[i] * norm + MIN_PMF / (float)m_nerf.training.dataset.n_images;
-			cdf_img_cpu[i] = (1.0f - MIN_PMF) * cdf_img_cpu[i] * norm + MIN_PMF * (float)(i+1) / (float)m_nerf.training.dataset.n_images;
+		if (m_nerf.training.error_map_sampler == EErrorMapSampler::Alias) {
+			m_nerf.training.error_map.build_alias_tables(m_nerf.training.dataset.n_images, stream);
+		} else {
+			m_nerf.training.error_map.build_cdf(m_nerf.training.dataset.n_images, stream);
 		}
-		m_nerf.training.error_map.cdf_img.copy_from_host(cdf_img_cpu);
 
 		// Reset counters and decrease update rate.
 		m_nerf.training.n_steps_since_error_map_update = 0;
@@ -3090,28 +4172,38 @@ void Testbed::train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaS
 	m_nerf.training.n_steps_since_cam_update += 1;
 
 	if (train_extra_dims) {
-		std::vector<float> extra_dims_gradient(m_nerf.training.extra_dims_gradient_gpu.size());
-		m_nerf.training.extra_dims_gradient_gpu.copy_to_host(extra_dims_gradient);
-
-		// Optimization step
-		for (uint32_t i = 0; i < m_nerf.training.n_images_for_training; ++i) {
-			std::vector<float> gradient(n_extra_dims);
-			for (uint32_t j = 0; j < n_extra_dims; ++j) {
-				gradient[j] = extra_dims_gradient[i * n_extra_dims + j] / LOSS_SCALE;
-			}
+		auto profile = profile_training_phase(ETrainingPhase::ExtraDimsUpdate, stream);
 
-			//float l2_reg = 1e-4f;
-			//gradient += m_nerf.training.extra_dims_opt[i].variable() * l2_reg;
+		auto& opt = m_nerf.training.extra_dims_opt;
+		auto& opt_gpu = m_nerf.training.extra_dims_opt_gpu;
 
-			m_nerf.training.extra_dims_opt[i].set_learning_rate(m_optimizer->learning_rate());
-			m_nerf.training.extra_dims_opt[i].step(gradient);
+		// The device variant steps all latent codes in lockstep, so it only applies once all images are trained on.
+		bool on_gpu = m_nerf.training.optimize_extra_dims_on_gpu && m_nerf.training.n_images_for_training == opt.size();
+		if (on_gpu && !opt_gpu.active() && !opt_gpu.upload(opt, stream)) {
+			tlog::warning() << "Latent codes have taken different numbers of steps. Optimizing them on the CPU instead.";
+			m_nerf.training.optimize_extra_dims_on_gpu = on_gpu = false;
 		}
 
-		m_nerf.training.update_extra_dims();
+		if (on_gpu) {
+			opt_gpu.step(m_nerf.training.extra_dims_gradient_gpu.data(), 1.0f / LOSS_SCALE, m_optimizer->learning_rate(), m_nerf.training.extra_dims_gpu.data(), stream);
+		} else {
+			m_nerf.training.sync_extra_dims_to_host(stream);
+
+			std::vector<float> extra_dims_gradient(m_nerf.training.extra_dims_gradient_gpu.size());
+			m_nerf.training.extra_dims_gradient_gpu.copy_to_host(extra_dims_gradient);
+
+			// Optimization step. Multiplying by 1/LOSS_SCALE is exact, since it is a power of two.
+			opt.set_learning_rate(m_optimizer->learning_rate());
+			opt.step(m_nerf.training.n_images_for_training, extra_dims_gradient.data(), 1.0f / LOSS_SCALE, 0.0f, EBatchedAdamUpdate::Subtract, &m_thread_pool);
+
+			m_nerf.training.update_extra_dims();
+		}
 	}
 
 	bool train_camera = m_nerf.training.optimize_extrinsics || m_nerf.training.optimize_distortion || m_nerf.training.optimize_focal_length || m_nerf.training.optimize_exposure;
 	if (train_camera && m_nerf.training.n_steps_since_cam_update >= m_nerf.training.n_steps_between_cam_updates) {
+		auto profile = profile_training_phase(ETrainingPhase::CameraUpdate, stream);
+
 		float per_camera_loss_scale = (float)m_nerf.training.n_images_for_training / LOSS_SCALE / (float)m_nerf.training.n_steps_between_cam_updates;
 
 		if (m_nerf.training.optimize_extrinsics) {
@@ -3120,20 +4212,45 @@ void Testbed::train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaS
 
 			CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
 
-			// Optimization step
-			for (uint32_t i = 0; i < m_nerf.training.n_images_for_training; ++i) {
-				vec3 pos_gradient = m_nerf.training.cam_pos_gradient[i] * per_camera_loss_scale;
-				vec3 rot_gradient = m_nerf.training.cam_rot_gradient[i] * per_camera_loss_scale;
+			uint32_t n_images = m_nerf.training.n_images_for_training;
+			auto& pos_opt = m_nerf.training.cam_pos_offset;
+			auto& rot_opt = m_nerf.training.cam_rot_offset;
+
+			// The learning rate decays every 128 steps. Cameras mostly share their step count, so memoize the schedule.
+			uint32_t cached_decay = UINT32_MAX;
+			float cached_learning_rate = 0.0f;
+			auto extrinsic_learning_rate = [&](uint32_t step) {
+				uint32_t decay = step / 128;
+				if (decay != cached_decay) {
+					cached_decay = decay;
+					cached_learning_rate = std::max(m_nerf.training.extrinsic_learning_rate * std::pow(0.33f, (float)decay), m_optimizer->learning_rate()/1000.0f);
+				}
 
-				float l2_reg = m_nerf.training.extrinsic_l2_reg;
-				pos_gradient += m_nerf.training.cam_pos_offset[i].variable() * l2_reg;
-				rot_gradient += m_nerf.training.cam_rot_offset[i].variable() * l2_reg;
+				return cached_learning_rate;
+			};
 
-				m_nerf.training.cam_pos_offset[i].set_learning_rate(std::max(m_nerf.training.extrinsic_learning_rate * std::pow(0.33f, (float)(m_nerf.training.cam_pos_offset[i].step() / 128)), m_optimizer->learning_rate()/1000.0f));
-				m_nerf.training.cam_rot_offset[i].set_learning_rate(std::max(m_nerf.training.extrinsic_learning_rate * std::pow(0.33f, (float)(m_nerf.training.cam_rot_offset[i].step() / 128)), m_optimizer->learning_rate()/1000.0f));
+			for (uint32_t i = 0; i < n_images; ++i) {
+				pos_opt.set_learning_rate(i, extrinsic_learning_rate(pos_opt.step(i)));
+				rot_opt.set_learning_rate(i, extrinsic_learning_rate(rot_opt.step(i)));
+			}
 
-				m_nerf.training.cam_pos_offset[i].step(pos_gradient);
-				m_nerf.training.cam_rot_offset[i].step(rot_gradient);
+			// Optimization step
+			float l2_reg = m_nerf.training.extrinsic_l2_reg;
+			pos_opt.step(n_images, (const float*)m_nerf.training.cam_pos_gradient.data(), per_camera_loss_scale, l2_reg, EBatchedAdamUpdate::Subtract, &m_thread_pool);
+			rot_opt.step(n_images, (const float*)m_nerf.training.cam_rot_gradient.data(), per_camera_loss_scale, l2_reg, EBatchedAdamUpdate::Deferred, &m_thread_pool);
+
+			// Rotation updates compose with the current rotation, as in RotationAdamOptimizer
+			auto compose_rotation = [&](uint32_t i) {
+				vec3& rot = rot_opt.variable_as<vec3>(i);
+				rot = rotvec(rotmat(-*(const vec3*)rot_opt.update(i)) * rotmat(rot));
+			};
+
+			if (n_images >= 1024) {
+				m_thread_pool.parallel_for<uint32_t>(0, n_images, compose_rotation);
+			} else {
+				for (uint32_t i = 0; i < n_images; ++i) {
+					compose_rotation(i);
+				}
 			}
 
 			m_nerf.training.update_transforms();
@@ -3162,19 +4279,15 @@ void Testbed::train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaS
 		if (m_nerf.training.optimize_exposure) {
 			CUDA_CHECK_THROW(cudaMemcpyAsync(m_nerf.training.cam_exposure_gradient.data(), m_nerf.training.cam_exposure_gradient_gpu.data(), m_nerf.training.cam_exposure_gradient_gpu.get_bytes(), cudaMemcpyDeviceToHost, stream));
 
-			vec3 mean_exposure = vec3(0.0f);
+			auto& exposure_opt = m_nerf.training.cam_exposure;
 
 			// Optimization step
-			for (uint32_t i = 0; i < m_nerf.training.n_images_for_training; ++i) {
-				vec3 gradient = m_nerf.training.cam_exposure_gradient[i] * per_camera_loss_scale;
-
-				float l2_reg = m_nerf.training.exposure_l2_reg;
-				gradient += m_nerf.training.cam_exposure[i].variable() * l2_reg;
-
-				m_nerf.training.cam_exposure[i].set_learning_rate(m_optimizer->learning_rate());
-				m_nerf.training.cam_exposure[i].step(gradient);
+			exposure_opt.set_learning_rate(m_optimizer->learning_rate());
+			exposure_opt.step(m_nerf.training.n_images_for_training, (const float*)m_nerf.training.cam_exposure_gradient.data(), per_camera_loss_scale, m_nerf.training.exposure_l2_reg, EBatchedAdamUpdate::Subtract, &m_thread_pool);
 
-				mean_exposure += m_nerf.training.cam_exposure[i].variable();
+			vec3 mean_exposure = vec3(0.0f);
+			for (uint32_t i = 0; i < m_nerf.training.n_images_for_training; ++i) {
+				mean_exposure += exposure_opt.variable_as<vec3>(i);
 			}
 
 			mean_exposure /= m_nerf.training.n_images_for_training;
@@ -3182,7 +4295,7 @@ void Testbed::train_nerf(uint32_t target_batch_size, bool get_loss_scalar, cudaS
 			// Renormalize
 			std::vector<vec3> cam_exposures(m_nerf.training.n_images_for_training);
 			for (uint32_t i = 0; i < m_nerf.training.n_images_for_training; ++i) {
-				cam_exposures[i] = m_nerf.training.cam_exposure[i].variable() -= mean_exposure;
+				cam_exposures[i] = exposure_opt.variable_as<vec3>(i) -= mean_exposure;
 			}
 
 			CUDA_CHECK_THROW(cudaMemcpyAsync(m_nerf.training.cam_exposure_gpu.data(), cam_exposures.data(), m_nerf.training.n_images_for_training * sizeof(vec3), cudaMemcpyHostToDevice, stream));
@@ -3264,6 +4377,7 @@ void Testbed::train_nerf_step(uint32_t target_batch_size, Testbed::NerfCounters&
 
 	bool sample_focal_plane_proportional_to_error = m_nerf.training.error_map.is_cdf_valid && m_nerf.training.sample_focal_plane_proportional_to_error;
 	bool sample_image_proportional_to_error = m_nerf.training.error_map.is_cdf_valid && m_nerf.training.sample_image_proportional_to_error;
+	ErrorMapSampler error_map_sampler = m_nerf.training.error_map.sampler(m_nerf.training.error_map_sampler, sample_focal_plane_proportional_to_error, sample_image_proportional_to_error);
 	bool include_sharpness_in_error = m_nerf.training.include_sharpness_in_error;
 	// This is low-overhead enough to warrant always being on.
 	// It makes for useful visualizations of the training error.
@@ -3273,37 +4387,43 @@ void Testbed::train_nerf_step(uint32_t target_batch_size, Testbed::NerfCounters&
 
 	auto hg_enc = dynamic_cast<GridEncoding<network_precision_t>*>(m_encoding.get());
 
-		linear_kernel(generate_training_samples_nerf, 0, stream,
-			counters.rays_per_batch,
-			m_aabb,
-			max_inference,
-			n_rays_total,
-			m_rng,
-			ray_counter,
-			counters.numsteps_counter.data(),
-			ray_indices,
-			rays_unnormalized,
-			numsteps,
-			PitchedPtr<NerfCoordinate>((NerfCoordinate*)coords, 1, 0, extra_stride),
-			m_nerf.training.n_images_for_training,
-			m_nerf.training.dataset.metadata_gpu.data(),
-			m_nerf.training.transforms_gpu.data(),
-			m_nerf.density_grid_bitfield.data(),
-			m_nerf.max_cascade,
-			m_max_level_rand_training,
-			max_level,
-			m_nerf.training.snap_to_pixel_centers,
-			m_nerf.training.train_envmap,
-			m_nerf.cone_angle_constant,
-			m_distortion.view(),
-			sample_focal_plane_proportional_to_error ? m_nerf.training.error_map.cdf_x_cond_y.data() : nullptr,
-			sample_focal_plane_proportional_to_error ? m_nerf.training.error_map.cdf_y.data() : nullptr,
-			sample_image_proportional_to_error ? m_nerf.training.error_map.cdf_img.data() : nullptr,
-			m_nerf.training.error_map.cdf_resolution,
-			m_nerf.training.extra_dims_gpu.data(),
-			m_nerf_network->n_extra_dims()
-		);
+	{
+		auto profile = profile_training_phase(ETrainingPhase::GenerateSamples, stream);
+		dispatch_density_grid_size(m_nerf.density_grid_shape.size, [&](auto size) {
+			dispatch_nerf_extra_dims(m_nerf_network->n_extra_dims(), [&](auto n_extra_dims) {
+				linear_kernel(generate_training_samples_nerf<decltype(size)::value, decltype(n_extra_dims)::value>, 0, stream,
+					counters.rays_per_batch,
+					m_aabb,
+					max_inference,
+					n_rays_total,
+					m_rng,
+					ray_counter,
+					counters.numsteps_counter.data(),
+					ray_indices,
+					rays_unnormalized,
+					numsteps,
+					NerfCoordinates<decltype(n_extra_dims)::value>((NerfCoordinate*)coords, m_nerf_network->n_extra_dims()),
+					m_nerf.training.n_images_for_training,
+					m_nerf.training.dataset.metadata_gpu.data(),
+					m_nerf.training.transforms_gpu.data(),
+					m_nerf.density_grid_bitfield.data(),
+					m_nerf.max_cascade,
+					m_max_level_rand_training,
+					max_level,
+					m_nerf.training.snap_to_pixel_centers,
+					m_nerf.training.train_envmap,
+					m_nerf.cone_angle_constant,
+					m_distortion.view(),
+					error_map_sampler,
+					m_nerf.training.extra_dims_gpu.data(),
+					m_nerf_network->n_extra_dims()
+				);
+			});
+		});
+	}
 
+	{
+		auto profile = profile_training_phase(ETrainingPhase::Inference, stream);
 		if (hg_enc) {
 			hg_enc->set_max_level_gpu(m_max_level_rand_training ? max_level : nullptr);
 		}
@@ -3315,69 +4435,73 @@ void Testbed::train_nerf_step(uint32_t target_batch_size, Testbed::NerfCounters&
 		if (hg_enc) {
 			hg_enc->set_max_level_gpu(m_max_level_rand_training ? max_level_compacted : nullptr);
 		}
+	}
 
-		linear_kernel(compute_loss_kernel_train_nerf, 0, stream,
-			counters.rays_per_batch,
-			m_aabb,
-			n_rays_total,
-			m_rng,
-			target_batch_size,
-			ray_counter,
-			LOSS_SCALE,
-			padded_output_width,
-			m_envmap.view(),
-			envmap_gradient,
-			m_envmap.resolution,
-			m_envmap.loss_type,
-			m_background_color.rgb,
-			m_color_space,
-			m_nerf.training.random_bg_color,
-			m_nerf.training.linear_colors,
-			m_nerf.training.n_images_for_training,
-			m_nerf.training.dataset.metadata_gpu.data(),
-			mlp_out,
-			counters.numsteps_counter_compacted.data(),
-			ray_indices,
-			rays_unnormalized,
-			numsteps,
-			PitchedPtr<const NerfCoordinate>((NerfCoordinate*)coords, 1, 0, extra_stride),
-			PitchedPtr<NerfCoordinate>((NerfCoordinate*)coords_compacted, 1 ,0, extra_stride),
-			dloss_dmlp_out,
-			m_nerf.training.loss_type,
-			m_nerf.training.depth_loss_type,
-			counters.loss.data(),
-			m_max_level_rand_training,
-			max_level_compacted,
-			m_nerf.rgb_activation,
-			m_nerf.density_activation,
-			m_nerf.training.snap_to_pixel_centers,
-			accumulate_error ? m_nerf.training.error_map.data.data() : nullptr,
-			sample_focal_plane_proportional_to_error ? m_nerf.training.error_map.cdf_x_cond_y.data() : nullptr,
-			sample_focal_plane_proportional_to_error ? m_nerf.training.error_map.cdf_y.data() : nullptr,
-			sample_image_proportional_to_error ? m_nerf.training.error_map.cdf_img.data() : nullptr,
-			m_nerf.training.error_map.resolution,
-			m_nerf.training.error_map.cdf_resolution,
-			include_sharpness_in_error ? m_nerf.training.dataset.sharpness_data.data() : nullptr,
-			m_nerf.training.dataset.sharpness_resolution,
-			m_nerf.training.sharpness_grid.data(),
-			m_nerf.density_grid.data(),
-			m_nerf.density_grid_mean.data(),
-			m_nerf.max_cascade,
-			m_nerf.training.cam_exposure_gpu.data(),
-			m_nerf.training.optimize_exposure ? m_nerf.training.cam_exposure_gradient_gpu.data() : nullptr,
-			m_nerf.training.depth_supervision_lambda,
-			m_nerf.training.near_distance
-		);
+	{
+		auto profile = profile_training_phase(ETrainingPhase::Loss, stream);
+		dispatch_nerf_extra_dims(m_nerf_network->n_extra_dims(), [&](auto n_extra_dims) {
+			linear_kernel(compute_loss_kernel_train_nerf<decltype(n_extra_dims)::value>, 0, stream,
+				counters.rays_per_batch,
+				m_aabb,
+				n_rays_total,
+				m_rng,
+				target_batch_size,
+				ray_counter,
+				LOSS_SCALE,
+				padded_output_width,
+				m_envmap.view(),
+				envmap_gradient,
+				m_envmap.resolution,
+				m_envmap.loss_type,
+				m_background_color.rgb,
+				m_color_space,
+				m_nerf.training.random_bg_color,
+				m_nerf.training.linear_colors,
+				m_nerf.training.n_images_for_training,
+				m_nerf.training.dataset.metadata_gpu.data(),
+				mlp_out,
+				counters.numsteps_counter_compacted.data(),
+				ray_indices,
+				rays_unnormalized,
+				numsteps,
+				NerfCoordinates<decltype(n_extra_dims)::value>((NerfCoordinate*)coords, m_nerf_network->n_extra_dims()),
+				NerfCoordinates<decltype(n_extra_dims)::value>((NerfCoordinate*)coords_compacted, m_nerf_network->n_extra_dims()),
+				dloss_dmlp_out,
+				m_nerf.training.loss_type,
+				m_nerf.training.depth_loss_type,
+				counters.loss.data(),
+				m_max_level_rand_training,
+				max_level_compacted,
+				m_nerf.rgb_activation,
+				m_nerf.density_activation,
+				m_nerf.training.snap_to_pixel_centers,
+				accumulate_error ? m_nerf.training.error_map.data.data() : nullptr,
+				accumulate_error ? m_nerf.training.error_map.touched.data() : nullptr,
+				m_nerf.training.error_map.resolution,
+				error_map_sampler,
+				include_sharpness_in_error ? m_nerf.training.dataset.sharpness_data.data() : nullptr,
+				m_nerf.training.dataset.sharpness_resolution,
+				m_nerf.training.sharpness_grid.data(),
+				m_nerf.density_grid.data(),
+				m_nerf.density_grid_mean.data(),
+				m_nerf.max_cascade,
+				m_nerf.training.cam_exposure_gpu.data(),
+				m_nerf.training.optimize_exposure ? m_nerf.training.cam_exposure_gradient_gpu.data() : nullptr,
+				m_nerf.training.depth_supervision_lambda,
+				m_nerf.training.near_distance
+			);
+		});
 
-	fill_rollover_and_rescale<network_precision_t><<<n_blocks_linear(target_batch_size*padded_output_width), n_threads_linear, 0, stream>>>(
-		target_batch_size, padded_output_width, counters.numsteps_counter_compacted.data(), dloss_dmlp_out
-	);
-	fill_rollover<float><<<n_blocks_linear(target_batch_size * floats_per_coord), n_threads_linear, 0, stream>>>(
-		target_batch_size, floats_per_coord, counters.numsteps_counter_compacted.data(), (float*)coords_compacted
-	);
-	fill_rollover<float><<<n_blocks_linear(target_batch_size), n_threads_linear, 0, stream>>>(
-		target_batch_size, 1, counters.numsteps_counter_compacted.data(), max_level_compacted
-	);
+		fill_rollover_and_rescale<network_precision_t><<<n_blocks_linear(target_batch_size*padded_output_width), n_threads_linear, 0, stream>>>(
+			target_batch_size, padded_output_width, counters.numsteps_counter_compacted.data(), dloss_dmlp_out
+		);
+		fill_rollover<float><<<n_blocks_linear(target_batch_size * floats_per_coord), n_threads_linear, 0, stream>>>(
+			target_batch_size, floats_per_coord, counters.numsteps_counter_compacted.data(), (float*)coords_compacted
+		);
+		fill_rollover<float><<<n_blocks_linear(target_batch_size), n_threads_linear, 0, stream>>>(
+			target_batch_size, 1, counters.numsteps_counter_compacted.data(), max_level_compacted
+		);
+	}
 
 	bool train_camera = m_nerf.training.optimize_extrinsics || m_nerf.training.optimize_distortion || m_nerf.training.optimize_focal_length;
 	bool train_extra_dims = m_nerf.training.dataset.n_extra_learnable_dims > 0 && m_nerf.training.optimize_extra_dims;
@@ -3385,10 +4509,13 @@ void Testbed::train_nerf_step(uint32_t target_batch_size, Testbed::NerfCounters&
 	GPUMatrix<float> coords_gradient_matrix((float*)coords_gradient, floats_per_coord, target_batch_size);
 
 	{
+		auto profile = profile_training_phase(ETrainingPhase::ForwardBackward, stream);
 		auto ctx = m_network->forward(stream, compacted_coords_matrix, &compacted_rgbsigma_matrix, false, prepare_input_gradients);
 		m_network->backward(stream, *ctx, compacted_coords_matrix, compacted_rgbsigma_matrix, gradient_matrix, prepare_input_gradients ? &coords_gradient_matrix : nullptr, false, EGradientMode::Overwrite);
 	}
 
+	auto profile_input_gradients = prepare_input_gradients ? profile_training_phase(ETrainingPhase::InputGradients, stream) : ScopeGuard{};
+
 	if (train_extra_dims) {
 		// Compute extra-dim gradients
 		linear_kernel(compute_extra_dims_gradient_train_nerf, 0, stream,
@@ -3401,7 +4528,7 @@ void Testbed::train_nerf_step(uint32_t target_batch_size, Testbed::NerfCounters&
 			ray_indices,
 			numsteps,
 			PitchedPtr<NerfCoordinate>((NerfCoordinate*)coords_gradient, 1, 0, extra_stride),
-			sample_image_proportional_to_error ? m_nerf.training.error_map.cdf_img.data() : nullptr
+			error_map_sampler
 		);
 	}
 
@@ -3428,13 +4555,12 @@ void Testbed::train_nerf_step(uint32_t target_batch_size, Testbed::NerfCounters&
 			m_nerf.training.optimize_distortion ? m_distortion.map->gradient_weights() : nullptr,
 			m_distortion.resolution,
 			m_nerf.training.optimize_focal_length ? m_nerf.training.cam_focal_length_gradient_gpu.data() : nullptr,
-			sample_focal_plane_proportional_to_error ? m_nerf.training.error_map.cdf_x_cond_y.data() : nullptr,
-			sample_focal_plane_proportional_to_error ? m_nerf.training.error_map.cdf_y.data() : nullptr,
-			sample_image_proportional_to_error ? m_nerf.training.error_map.cdf_img.data() : nullptr,
-			m_nerf.training.error_map.cdf_resolution
+			error_map_sampler
 		);
 	}
 
+	profile_input_gradients = {};
+
 	m_rng.advance();
 
 	if (hg_enc) {
@@ -3450,12 +4576,83 @@ void Testbed::training_prep_nerf(uint32_t batch_size, cudaStream_t stream) {
 
 	float alpha = m_nerf.training.density_grid_decay;
 	uint32_t n_cascades = m_nerf.max_cascade+1;
+	uint32_t n_cells = m_nerf.density_grid_shape.n_cells();
 
-	if (m_training_step < 256) {
-		update_density_grid_nerf(alpha, NERF_GRID_N_CELLS() * n_cascades, 0, stream);
-	} else {
-		update_density_grid_nerf(alpha, NERF_GRID_N_CELLS() / 4 * n_cascades, NERF_GRID_N_CELLS() / 4 * n_cascades, stream);
+	// Uniform and non-uniform samples per cascade
+	uint32_t n_uniform = m_training_step < 256 ? n_cells : n_cells / 4;
+	uint32_t n_nonuniform = m_training_step < 256 ? 0 : n_cells / 4;
+
+	auto& schedule = m_nerf.training.density_grid_schedule;
+	if (!schedule.enabled()) {
+		update_density_grid_nerf(alpha, n_uniform * n_cascades, n_nonuniform * n_cascades, stream);
+		return;
+	}
+
+	// The flips of an earlier update, if they arrived by now
+	auto& readback = m_nerf.training.density_grid_flip_readback;
+	if (readback && readback->pending) {
+		cudaError_t status = cudaEventQuery(readback->done);
+		if (status != cudaErrorNotReady) {
+			CUDA_CHECK_THROW(status);
+			readback->pending = false;
+			schedule.report(readback->values, readback->n_cascades, readback->n_cells);
+		}
+	}
+
+	uint32_t cascade_mask = schedule.cascade_mask(m_training_step, n_cascades);
+	uint32_t n_sampled_cascades = (uint32_t)std::bitset<32>(cascade_mask).count();
+	float sample_fraction = schedule.sample_fraction(m_training_step);
+	n_uniform = next_multiple((uint32_t)(n_uniform * sample_fraction), tcnn::batch_size_granularity) * n_sampled_cascades;
+	n_nonuniform = next_multiple((uint32_t)(n_nonuniform * sample_fraction), tcnn::batch_size_granularity) * n_sampled_cascades;
+
+	// The update that train() and train_n_steps() would have done at each step since the previous one
+	uint64_t n_default_queries = schedule.default_queries_until(m_training_step,
+		[&](uint32_t step) { return m_training_prep_interval > 0 ? m_training_prep_interval : TrainingScheduler::default_density_grid_interval(step); },
+		[&](uint32_t step) { return (uint64_t)(step < 256 ? n_cells : n_cells / 2) * n_cascades; }
+	);
+
+	if (cascade_mask == 0) {
+		schedule.record_update(m_training_step, n_cascades, 0, 0, n_default_queries, false);
+		return;
 	}
+
+	// Flips are counted against the bitfield from before the update, unless no bitfield exists yet or the flips of
+	// an earlier update are still on their way.
+	const DensityGridShape& shape = m_nerf.density_grid_shape;
+	bool measure = m_nerf.density_grid_bitfield.size() >= shape.buffer_bytes() && (!readback || !readback->pending);
+	const uint32_t n_bitfield_bytes = n_cells / 8 * n_cascades;
+	if (measure) {
+		m_nerf.training.density_grid_bitfield_prev.enlarge(n_bitfield_bytes);
+		CUDA_CHECK_THROW(cudaMemcpyAsync(m_nerf.training.density_grid_bitfield_prev.data(), m_nerf.density_grid_bitfield.data(), n_bitfield_bytes, cudaMemcpyDeviceToDevice, stream));
+	}
+
+	// Each cell is sampled less often when fewer samples are taken, so it decays less per update.
+	update_density_grid_nerf(std::pow(alpha, sample_fraction), n_uniform, n_nonuniform, stream, cascade_mask);
+
+	if (measure) {
+		if (!readback || readback->n_cascades != n_cascades) {
+			readback = std::make_shared<Nerf::Training::DensityGridFlipReadback>(n_cascades);
+		}
+
+		readback->n_cells = n_cells;
+
+		auto& flips = m_nerf.training.density_grid_flips;
+		flips.enlarge(n_cascades);
+		CUDA_CHECK_THROW(cudaMemsetAsync(flips.data(), 0, n_cascades * sizeof(uint32_t), stream));
+		linear_kernel(count_bitfield_flips, 0, stream,
+			n_bitfield_bytes / 4,
+			n_cells / 32,
+			(const uint32_t*)m_nerf.training.density_grid_bitfield_prev.data(),
+			(const uint32_t*)m_nerf.density_grid_bitfield.data(),
+			flips.data()
+		);
+
+		CUDA_CHECK_THROW(cudaMemcpyAsync(readback->values, flips.data(), n_cascades * sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+		CUDA_CHECK_THROW(cudaEventRecord(readback->done, stream));
+		readback->pending = true;
+	}
+
+	schedule.record_update(m_training_step, n_cascades, cascade_mask, n_uniform + n_nonuniform, n_default_queries, measure);
 }
 
 void Testbed::optimise_mesh_step(uint32_t n_steps) {
@@ -3466,7 +4663,6 @@ void Testbed::optimise_mesh_step(uint32_t n_steps) {
 
 	const uint32_t padded_output_width = m_nerf_network->padded_density_output_width();
 	const uint32_t floats_per_coord = sizeof(NerfCoordinate) / sizeof(float) + m_nerf_network->n_extra_dims();
-	const uint32_t extra_stride = m_nerf_network->n_extra_dims() * sizeof(float);
 	GPUMemory<float> coords(n_verts * floats_per_coord);
 	GPUMemory<network_precision_t> mlp_out(n_verts * padded_output_width);
 
@@ -3476,13 +4672,15 @@ void Testbed::optimise_mesh_step(uint32_t n_steps) {
 	const float* extra_dims_gpu = get_inference_extra_dims(m_stream.get());
 
 	for (uint32_t i = 0; i < n_steps; ++i) {
-		linear_kernel(generate_nerf_network_inputs_from_positions, 0, m_stream.get(),
-			n_verts,
-			m_aabb,
-			m_mesh.verts.data(),
-			PitchedPtr<NerfCoordinate>((NerfCoordinate*)coords.data(), 1, 0, extra_stride),
-			extra_dims_gpu
-		);
+		dispatch_nerf_extra_dims(m_nerf_network->n_extra_dims(), [&](auto n_extra_dims) {
+			linear_kernel(generate_nerf_network_inputs_from_positions<decltype(n_extra_dims)::value>, 0, m_stream.get(),
+				n_verts,
+				m_aabb,
+				m_mesh.verts.data(),
+				NerfCoordinates<decltype(n_extra_dims)::value>((NerfCoordinate*)coords.data(), m_nerf_network->n_extra_dims()),
+				extra_dims_gpu
+			);
+		});
 
 		// For each optimizer step, we need the density at the given pos...
 		m_nerf_network->density(m_stream.get(), positions_matrix, density_matrix);
@@ -3524,18 +4722,589 @@ void Testbed::compute_mesh_vertex_colors() {
 		const float* extra_dims_gpu = get_inference_extra_dims(m_stream.get());
 
 		const uint32_t floats_per_coord = sizeof(NerfCoordinate) / sizeof(float) + m_nerf_network->n_extra_dims();
-		const uint32_t extra_stride = m_nerf_network->n_extra_dims() * sizeof(float);
-		GPUMemory<float> coords(n_verts * floats_per_coord);
+			GPUMemory<float> coords(n_verts * floats_per_coord);
 		GPUMemory<float> mlp_out(n_verts * 4);
 
 		GPUMatrix<float> positions_matrix((float*)coords.data(), floats_per_coord, n_verts);
 		GPUMatrix<float> color_matrix(mlp_out.data(), 4, n_verts);
-		linear_kernel(generate_nerf_network_inputs_from_positions, 0, m_stream.get(), n_verts, m_aabb, m_mesh.verts.data(), PitchedPtr<NerfCoordinate>((NerfCoordinate*)coords.data(), 1, 0, extra_stride), extra_dims_gpu);
+		dispatch_nerf_extra_dims(m_nerf_network->n_extra_dims(), [&](auto n_extra_dims) {
+			linear_kernel(generate_nerf_network_inputs_from_positions<decltype(n_extra_dims)::value>, 0, m_stream.get(), n_verts, m_aabb, m_mesh.verts.data(), NerfCoordinates<decltype(n_extra_dims)::value>((NerfCoordinate*)coords.data(), m_nerf_network->n_extra_dims()), extra_dims_gpu);
+		});
 		m_network->inference(m_stream.get(), positions_matrix, color_matrix);
 		linear_kernel(extract_srgb_with_activation, 0, m_stream.get(), n_verts * 3, 3, mlp_out.data(), (float*)m_mesh.vert_colors.data(), m_nerf.rgb_activation, m_nerf.training.linear_colors);
 	}
 }
 
+void Testbed::save_nerf_reference_outputs(const fs::path& path, uint32_t n_samples) {
+	if (m_testbed_mode != ETestbedMode::Nerf) {
+		throw std::runtime_error{"Reference outputs can only be saved in NeRF mode."};
+	}
+
+	if (m_nerf_network->n_extra_dims() > 0) {
+		throw std::runtime_error{"Reference outputs do not support extra learnable dimensions."};
+	}
+
+	if (n_samples == 0) {
+		throw std::runtime_error{"Reference outputs require at least one sample."};
+	}
+
+	const uint32_t floats_per_coord = sizeof(NerfCoordinate) / sizeof(float);
+
+	// The network only infers batches of a multiple of its granularity. The padding rows are zero and not saved.
+	const uint32_t n_padded_samples = next_multiple(n_samples, tcnn::batch_size_granularity);
+
+	// Random positions in the unit cube of the aabb and random directions, warped like NerfCoordinate.
+	default_rng_t rng{1337};
+	std::vector<float> coords_cpu(n_samples * floats_per_coord);
+	NerfCoordinates<0> coords_host((NerfCoordinate*)coords_cpu.data());
+	for (uint32_t i = 0; i < n_samples; ++i) {
+		float z = rng.next_float() * 2.0f - 1.0f;
+		float phi = rng.next_float() * 2.0f * 3.141592653589793f;
+		float r = sqrt(std::max(1.0f - z * z, 0.0f));
+		vec3 dir = {r * cos(phi), r * sin(phi), z};
+
+		vec3 pos;
+		pos.x = rng.next_float(); pos.y = rng.next_float(); pos.z = rng.next_float();
+		coords_host.set(i, pos, (dir + vec3(1.0f)) * 0.5f, 0.0f, nullptr);
+	}
+
+	GPUMemory<float> coords(n_padded_samples * floats_per_coord);
+	coords.memset(0);
+	coords.copy_from_host(coords_cpu, coords_cpu.size());
+	GPUMemory<float> mlp_out(n_padded_samples * 4);
+
+	GPUMatrix<float> coords_matrix(coords.data(), floats_per_coord, n_padded_samples);
+	GPUMatrix<float> out_matrix(mlp_out.data(), 4, n_padded_samples);
+	m_network->inference(m_stream.get(), coords_matrix, out_matrix);
+
+	std::vector<float> out_cpu(n_samples * 4);
+	mlp_out.copy_to_host(out_cpu, out_cpu.size());
+
+	auto to_binary = [](const std::vector<float>& v) {
+		return json::binary_t{std::vector<uint8_t>((const uint8_t*)v.data(), (const uint8_t*)(v.data() + v.size()))};
+	};
+
+	json reference = {
+		{"n_input_dims", floats_per_coord},
+		{"n_output_dims", 4},
+		{"n_samples", n_samples},
+		{"inputs", to_binary(coords_cpu)},
+		{"outputs", to_binary(out_cpu)},
+	};
+
+	std::ofstream f{native_string(path), std::ios::out | std::ios::binary};
+	json::to_msgpack(reference, f);
+
+	tlog::success() << "Saved " << n_samples << " reference outputs to '" << path.str() << "'";
+}
+
+template <uint32_t GRID_SIZE>
+__global__ void mark_baked_nerf_bricks_kernel(
+	const uint32_t n_elements,
+	ivec3 n_bricks,
+	vec3 aabb_min,
+	float voxel_size,
+	mat3 render_aabb_to_local,
+	const uint8_t* __restrict__ density_grid_bitfield,
+	uint32_t max_cascade,
+	uint32_t* __restrict__ occupied
+) {
+	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
+	if (i >= n_elements) return;
+
+	const int brick_size = (int)BAKED_NERF_BRICK_SIZE;
+	ivec3 brick = {(int)(i % n_bricks.x), (int)((i / n_bricks.x) % n_bricks.y), (int)(i / (n_bricks.x * n_bricks.y))};
+
+	// Dilate by one voxel, such that trilinear interpolation near the boundary of occupied cells only touches allocated bricks.
+	for (int z = -1; z <= brick_size; ++z) {
+		for (int y = -1; y <= brick_size; ++y) {
+			for (int x = -1; x <= brick_size; ++x) {
+				vec3 local = aabb_min + (vec3(brick * brick_size + ivec3{x, y, z}) + vec3(0.5f)) * voxel_size;
+				vec3 pos = transpose(render_aabb_to_local) * local;
+				if (density_grid_occupied_at<GRID_SIZE>(pos, density_grid_bitfield, mip_from_pos(pos, max_cascade))) {
+					occupied[i] = 1;
+					return;
+				}
+			}
+		}
+	}
+
+	occupied[i] = 0;
+}
+
+__device__ vec3 baked_nerf_voxel_center(uint32_t voxel, const ivec3* __restrict__ brick_coords, vec3 aabb_min, float voxel_size) {
+	const uint32_t brick_size = BAKED_NERF_BRICK_SIZE;
+	const uint32_t voxels_per_brick = brick_size * brick_size * brick_size;
+	uint32_t l = voxel % voxels_per_brick;
+	ivec3 v = brick_coords[voxel / voxels_per_brick] * (int)brick_size + ivec3{(int)(l % brick_size), (int)((l / brick_size) % brick_size), (int)(l / (brick_size * brick_size))};
+	return aabb_min + (vec3(v) + vec3(0.5f)) * voxel_size;
+}
+
+template <uint32_t N_EXTRA_DIMS>
+__global__ void generate_baked_nerf_inputs_kernel(
+	const uint32_t n_elements,
+	uint32_t first_voxel,
+	uint32_t n_directions,
+	const ivec3* __restrict__ brick_coords,
+	vec3 aabb_min,
+	float voxel_size,
+	mat3 render_aabb_to_local,
+	BoundingBox train_aabb,
+	const vec3* __restrict__ directions,
+	NerfCoordinates<N_EXTRA_DIMS> network_input,
+	const float* extra_dims
+) {
+	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
+	if (i >= n_elements) return;
+
+	vec3 pos = transpose(render_aabb_to_local) * baked_nerf_voxel_center(first_voxel + i / n_directions, brick_coords, aabb_min, voxel_size);
+	network_input.set(i, warp_position(pos, train_aabb), warp_direction(directions[i % n_directions]), warp_dt(MIN_CONE_STEPSIZE()), extra_dims);
+}
+
+__global__ void fit_baked_nerf_voxels_kernel(
+	const uint32_t n_elements,
+	uint32_t first_voxel,
+	uint32_t n_directions,
+	uint32_t n_sh_coeffs,
+	const ivec3* __restrict__ brick_coords,
+	vec3 aabb_min,
+	float voxel_size,
+	BoundingBox render_aabb,
+	const vec4* __restrict__ network_output,
+	const float* __restrict__ sh_fit_matrix,
+	ENerfActivation rgb_activation,
+	ENerfActivation density_activation,
+	uint16_t* __restrict__ voxels
+) {
+	const uint32_t i = threadIdx.x + blockIdx.x * blockDim.x;
+	if (i >= n_elements) return;
+
+	const vec4* out = network_output + i * n_directions;
+	uint16_t* dst = voxels + (size_t)(first_voxel + i) * (1 + 3 * n_sh_coeffs);
+
+	// Voxels that only exist because bricks round up the render aabb stay empty, such that the bake does not show
+	// more than the testbed renders.
+	bool inside = render_aabb.contains(baked_nerf_voxel_center(first_voxel + i, brick_coords, aabb_min, voxel_size));
+
+	// Values beyond the largest half would round to infinity, which turns trilinear weights of 0 into NaNs.
+	auto to_half = [](float v) { return __half_as_ushort(__float2half(tcnn::clamp(v, -BAKED_NERF_MAX_HALF, BAKED_NERF_MAX_HALF))); };
+	dst[0] = to_half(inside ? network_to_density(out[0].a, density_activation) : 0.0f);
+
+	for (uint32_t c = 0; c < n_sh_coeffs; ++c) {
+		vec3 coeff = vec3(0.0f);
+		if (inside) {
+			for (uint32_t k = 0; k < n_directions; ++k) {
+				coeff += sh_fit_matrix[c * n_directions + k] * network_to_rgb_vec(out[k].rgb, rgb_activation);
+			}
+		}
+
+		dst[1 + 3 * c] = to_half(coeff.r);
+		dst[2 + 3 * c] = to_half(coeff.g);
+		dst[3 + 3 * c] = to_half(coeff.b);
+	}
+}
+
+void Testbed::bake_nerf(const fs::path& path, uint32_t resolution, uint32_t sh_degree, uint32_t n_directions) {
+	if (m_testbed_mode != ETestbedMode::Nerf) {
+		throw std::runtime_error{"Only NeRFs can be baked."};
+	}
+
+	if (m_nerf.density_grid_bitfield.size() < m_nerf.density_grid_shape.buffer_bytes()) {
+		throw std::runtime_error{"Baking requires a density grid. Train or load a snapshot first."};
+	}
+
+	if (resolution == 0) {
+		throw std::runtime_error{"Bake resolution must be positive."};
+	}
+
+	std::vector<vec3> directions = baked_nerf_fit_directions(n_directions);
+	std::vector<float> sh_fit_matrix = baked_nerf_sh_fit_matrix(sh_degree, directions);
+	const uint32_t n_sh_coeffs = baked_nerf_n_sh_coeffs(sh_degree);
+
+	auto start = std::chrono::steady_clock::now();
+
+	// Voxels are cubes that tile the render aabb along its longest axis with `resolution` voxels.
+	const uint32_t brick_size = BAKED_NERF_BRICK_SIZE;
+	const uint32_t voxels_per_brick = brick_size * brick_size * brick_size;
+	const vec3 extent = m_render_aabb.diag();
+	const float voxel_size = compMax(extent) / resolution;
+	const ivec3 n_voxels = max(ivec3(ceil(extent / voxel_size - vec3(1e-4f))), ivec3(1));
+	const ivec3 n_bricks = (n_voxels + ivec3((int)brick_size - 1)) / (int)brick_size;
+	const uint32_t n_pages = (uint32_t)compMul(n_bricks);
+
+	// Allocate the bricks that overlap occupied cells of the density grid
+	GPUMemory<uint32_t> occupied(n_pages);
+	dispatch_density_grid_size(m_nerf.density_grid_shape.size, [&](auto size) {
+		linear_kernel(mark_baked_nerf_bricks_kernel<decltype(size)::value>, 0, m_stream.get(),
+			n_pages,
+			n_bricks,
+			m_render_aabb.min,
+			voxel_size,
+			m_render_aabb_to_local,
+			m_nerf.density_grid_bitfield.data(),
+			m_nerf.max_cascade,
+			occupied.data()
+		);
+	});
+
+	std::vector<uint32_t> occupied_cpu(n_pages);
+	occupied.copy_to_host(occupied_cpu);
+
+	// Bricks are allocated in x-major order, such that the rank of a brick's occupancy bit is its index.
+	std::vector<uint64_t> occupancy(baked_nerf_n_occupancy_words(n_pages), 0);
+	std::vector<ivec3> brick_coords_cpu;
+	for (uint32_t i = 0; i < n_pages; ++i) {
+		if (occupied_cpu[i]) {
+			occupancy[i / 64] |= 1ull << (i % 64);
+			brick_coords_cpu.emplace_back(ivec3{(int)(i % n_bricks.x), (int)((i / n_bricks.x) % n_bricks.y), (int)(i / (n_bricks.x * n_bricks.y))});
+		}
+	}
+
+	const uint32_t n_allocated_bricks = (uint32_t)brick_coords_cpu.size();
+	const uint32_t n_baked_voxels = n_allocated_bricks * voxels_per_brick;
+
+	GPUMemory<ivec3> brick_coords(std::max(n_allocated_bricks, 1u));
+	brick_coords.copy_from_host(brick_coords_cpu.data(), n_allocated_bricks);
+	GPUMemory<vec3> directions_gpu(n_directions);
+	directions_gpu.copy_from_host(directions);
+	GPUMemory<float> sh_fit_matrix_gpu(sh_fit_matrix.size());
+	sh_fit_matrix_gpu.copy_from_host(sh_fit_matrix);
+
+	const uint32_t values_per_voxel = baked_nerf_values_per_voxel(sh_degree);
+	GPUMemory<uint16_t> voxels((size_t)n_baked_voxels * values_per_voxel);
+
+	// Evaluate all directions of roughly 4M network inputs at a time
+	const float* extra_dims_gpu = get_inference_extra_dims(m_stream.get());
+	const uint32_t floats_per_coord = sizeof(NerfCoordinate) / sizeof(float) + m_nerf_network->n_extra_dims();
+	const uint32_t voxels_per_batch = std::max(next_multiple((1u<<22) / n_directions, tcnn::batch_size_granularity), tcnn::batch_size_granularity);
+	const uint32_t max_batch_size = std::min(voxels_per_batch, next_multiple(std::max(n_baked_voxels, 1u), tcnn::batch_size_granularity)) * n_directions;
+
+	GPUMemoryArena::Allocation alloc;
+	auto scratch = allocate_workspace_and_distribute<float, vec4>(m_stream.get(), &alloc, (size_t)max_batch_size * floats_per_coord, max_batch_size);
+	float* coords = std::get<0>(scratch);
+	vec4* mlp_out = std::get<1>(scratch);
+
+	for (uint32_t first_voxel = 0; first_voxel < n_baked_voxels; first_voxel += voxels_per_batch) {
+		uint32_t n_batch_voxels = std::min(n_baked_voxels - first_voxel, voxels_per_batch);
+		uint32_t n_elements = n_batch_voxels * n_directions;
+
+		dispatch_nerf_extra_dims(m_nerf_network->n_extra_dims(), [&](auto n_extra_dims) {
+			linear_kernel(generate_baked_nerf_inputs_kernel<decltype(n_extra_dims)::value>, 0, m_stream.get(),
+				n_elements,
+				first_voxel,
+				n_directions,
+				brick_coords.data(),
+				m_render_aabb.min,
+				voxel_size,
+				m_render_aabb_to_local,
+				m_aabb,
+				directions_gpu.data(),
+				NerfCoordinates<decltype(n_extra_dims)::value>((NerfCoordinate*)coords, m_nerf_network->n_extra_dims()),
+				extra_dims_gpu
+			);
+		});
+
+		uint32_t padded_n_elements = next_multiple(n_elements, tcnn::batch_size_granularity);
+		GPUMatrix<float> coords_matrix(coords, floats_per_coord, padded_n_elements);
+		GPUMatrix<float> rgbsigma_matrix((float*)mlp_out, 4, padded_n_elements);
+		m_network->inference(m_stream.get(), coords_matrix, rgbsigma_matrix);
+
+		linear_kernel(fit_baked_nerf_voxels_kernel, 0, m_stream.get(),
+			n_batch_voxels,
+			first_voxel,
+			n_directions,
+			n_sh_coeffs,
+			brick_coords.data(),
+			m_render_aabb.min,
+			voxel_size,
+			m_render_aabb,
+			mlp_out,
+			sh_fit_matrix_gpu.data(),
+			m_nerf.rgb_activation,
+			m_nerf.density_activation,
+			voxels.data()
+		);
+	}
+
+	std::vector<uint16_t> voxels_cpu(voxels.size());
+	voxels.copy_to_host(voxels_cpu);
+
+	BakedNerfHeader header;
+	header.sh_degree = sh_degree;
+	header.n_allocated_bricks = n_allocated_bricks;
+	for (uint32_t i = 0; i < 3; ++i) {
+		header.n_bricks[i] = (uint32_t)n_bricks[i];
+		header.aabb_min[i] = m_render_aabb.min[i];
+	}
+
+	header.voxel_size = voxel_size;
+	for (uint32_t i = 0; i < 9; ++i) {
+		header.render_aabb_to_local[i] = m_render_aabb_to_local[i / 3][i % 3];
+	}
+
+	for (uint32_t i = 0; i < 12; ++i) {
+		header.camera[i] = m_camera[i / 3][i % 3];
+	}
+
+	header.relative_focal_length[0] = m_relative_focal_length.x;
+	header.relative_focal_length[1] = m_relative_focal_length.y;
+	header.fov_axis = (int32_t)m_fov_axis;
+	header.zoom = m_zoom;
+	header.screen_center[0] = m_screen_center.x;
+	header.screen_center[1] = m_screen_center.y;
+
+	save_baked_nerf(path, header, occupancy, voxels_cpu);
+
+	tlog::success() << fmt::format(
+		"Baked NeRF to '{}' in {:.1f}s: {}/{} bricks of {}^3 voxels, SH degree {}, {:.1f} MB",
+		path.str(), std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count(),
+		n_allocated_bricks, n_pages, brick_size, sh_degree,
+		(sizeof(BakedNerfHeader) + occupancy.size() * sizeof(uint64_t) + voxels_cpu.size() * sizeof(uint16_t)) / (1024.0 * 1024.0)
+	);
+}
+
+Testbed::DensityGridDistanceFieldCheck Testbed::check_density_grid_distance_field(uint32_t n_brute_force_samples) {
+	if (m_testbed_mode != ETestbedMode::Nerf) {
+		throw std::runtime_error{"The density grid distance field only exists in NeRF mode."};
+	}
+
+	const DensityGridShape& shape = m_nerf.density_grid_shape;
+	const uint32_t res = shape.size;
+	const uint32_t n_cells = shape.n_cells();
+	if (m_nerf.density_grid_bitfield.size() < shape.buffer_bytes()) {
+		throw std::runtime_error{"The density grid distance field has not been built yet."};
+	}
+
+	CUDA_CHECK_THROW(cudaStreamSynchronize(m_stream.get()));
+	std::vector<uint8_t> grid(m_nerf.density_grid_bitfield.size());
+	m_nerf.density_grid_bitfield.copy_to_host(grid);
+	const uint8_t* bitfield = grid.data();
+	const uint8_t* distance_field = grid.data() + shape.distance_field_offset();
+
+	DensityGridDistanceFieldCheck result;
+	result.n_cells = n_cells * shape.n_cascades;
+
+	default_rng_t rng{1337};
+	double distance_sum = 0.0;
+
+	for (uint32_t level = 0; level < shape.n_cascades; ++level) {
+		// The host transform works on a linear layout, the grid is in Morton order.
+		std::vector<uint32_t> linear_idx(n_cells);
+		std::vector<uint8_t> occupied(n_cells);
+		for (uint32_t i = 0; i < n_cells; ++i) {
+			uint32_t x = tcnn::morton3D_invert(i>>0);
+			uint32_t y = tcnn::morton3D_invert(i>>1);
+			uint32_t z = tcnn::morton3D_invert(i>>2);
+			linear_idx[i] = x + res * (y + res * z);
+			occupied[linear_idx[i]] = (bitfield[i/8+shape.mip_offset(level)/8] & (1<<(i%8))) ? 1 : 0;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> host = chebyshev_distance_transform(occupied, res, &m_thread_pool);
+		result.host_ms += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		for (uint32_t i = 0; i < n_cells; ++i) {
+			uint8_t d = distance_field[i+shape.mip_offset(level)];
+			result.n_mismatches += d != host[linear_idx[i]] ? 1 : 0;
+			distance_sum += d;
+		}
+
+		uint32_t n_samples = n_brute_force_samples / shape.n_cascades + (level < n_brute_force_samples % shape.n_cascades ? 1 : 0);
+		for (uint32_t j = 0; j < n_samples; ++j) {
+			ivec3 cell = {(int)(rng.next_uint() % res), (int)(rng.next_uint() % res), (int)(rng.next_uint() % res)};
+			uint8_t reference = chebyshev_distance_brute_force(occupied, res, cell);
+			result.n_brute_force_mismatches += reference != host[cell.x + res * (cell.y + res * cell.z)] ? 1 : 0;
+		}
+		result.n_brute_force_samples += n_samples;
+	}
+
+	result.mean_distance = (float)(distance_sum / result.n_cells);
+
+	std::string message = fmt::format(
+		"Density grid distance field: {}/{} cells differ from the host transform ({:.1f}ms), {}/{} samples from brute force. Mean distance: {:.2f} cells",
+		result.n_mismatches, result.n_cells, result.host_ms, result.n_brute_force_mismatches, result.n_brute_force_samples, result.mean_distance
+	);
+
+	if (result.n_mismatches == 0 && result.n_brute_force_mismatches == 0) {
+		tlog::success() << message;
+	} else {
+		tlog::error() << message;
+	}
+
+	return result;
+}
+
+Testbed::NerfRayCompactionCheck Testbed::check_nerf_ray_compaction(uint32_t n_rays) {
+	if (n_rays == 0) {
+		throw std::runtime_error{"Ray compaction check requires at least one ray."};
+	}
+
+	// Payload of the tracer before rays were stored as a structure of arrays. Compaction moved all of it.
+	struct LegacyNerfPayload {
+		vec3 origin;
+		vec3 dir;
+		float t;
+		float max_weight;
+		uint32_t idx;
+		uint16_t n_steps;
+		bool alive;
+	};
+
+	struct LegacyNerfRay {
+		vec4 rgba;
+		float depth;
+		LegacyNerfPayload payload;
+	};
+
+	// Random rays of a single view with n_rays pixels, shuffled such that pixel indices are out of order
+	default_rng_t rng{1337};
+	std::vector<vec3> origins(n_rays), dirs(n_rays);
+	for (uint32_t i = 0; i < n_rays; ++i) {
+		origins[i] = {rng.next_float(), rng.next_float(), rng.next_float()};
+		dirs[i] = normalize(vec3{rng.next_float(), rng.next_float(), rng.next_float()} - vec3(0.5f));
+	}
+
+	std::vector<uint32_t> pixels(n_rays);
+	for (uint32_t i = 0; i < n_rays; ++i) {
+		pixels[i] = i;
+	}
+	for (uint32_t i = n_rays - 1; i > 0; --i) {
+		std::swap(pixels[i], pixels[rng.next_uint() % (i + 1)]);
+	}
+
+	std::vector<vec4> rgba(n_rays);
+	std::vector<float> depth(n_rays), t(n_rays), max_weight(n_rays);
+	std::vector<NerfRayState> state(n_rays);
+	std::vector<LegacyNerfRay> legacy(n_rays);
+	for (uint32_t i = 0; i < n_rays; ++i) {
+		uint32_t idx = pixels[i];
+		bool alive = rng.next_float() < 0.5f;
+		uint32_t n_steps = rng.next_uint() % (MAX_STEPS_INBETWEEN_COMPACTION + 1);
+
+		// Half of the terminated rays are transparent enough to be dropped
+		rgba[i] = {rng.next_float(), rng.next_float(), rng.next_float(), rng.next_float() < 0.5f ? 0.0f : rng.next_float() + 0.01f};
+		depth[i] = rng.next_float();
+		t[i] = rng.next_float();
+		max_weight[i] = rng.next_float();
+		state[i] = NerfRayState::make(n_steps, 0, alive);
+
+		legacy[i] = {rgba[i], depth[i], {origins[idx], dirs[idx], t[i], max_weight[i], idx, (uint16_t)n_steps, alive}};
+	}
+
+	std::vector<LegacyNerfRay> legacy_alive, legacy_hit;
+	for (const auto& ray : legacy) {
+		if (ray.payload.alive) {
+			legacy_alive.emplace_back(ray);
+		} else if (ray.rgba.a > 0.001f) {
+			legacy_hit.emplace_back(ray);
+		}
+	}
+
+	cudaStream_t stream = m_stream.get();
+	GPUMemoryArena::Allocation alloc;
+	auto scratch = allocate_workspace_and_distribute<
+		vec4, float, float, float, uint32_t, NerfRayState, // src
+		vec4, float, float, float, uint32_t, NerfRayState, // dst
+		vec4, float, float, float, uint32_t, NerfRayState, // dst_final
+		uint32_t
+	>(
+		stream, &alloc,
+		n_rays, n_rays, n_rays, n_rays, n_rays, n_rays,
+		n_rays, n_rays, n_rays, n_rays, n_rays, n_rays,
+		n_rays, n_rays, n_rays, n_rays, n_rays, n_rays,
+		2
+	);
+
+	RaysNerfSoa src, dst, dst_final;
+	src.set(std::get<0>(scratch), std::get<1>(scratch), {std::get<2>(scratch), std::get<3>(scratch), std::get<4>(scratch), std::get<5>(scratch)}, n_rays);
+	dst.set(std::get<6>(scratch), std::get<7>(scratch), {std::get<8>(scratch), std::get<9>(scratch), std::get<10>(scratch), std::get<11>(scratch)}, n_rays);
+	dst_final.set(std::get<12>(scratch), std::get<13>(scratch), {std::get<14>(scratch), std::get<15>(scratch), std::get<16>(scratch), std::get<17>(scratch)}, n_rays);
+	uint32_t* counters = std::get<18>(scratch);
+
+	CUDA_CHECK_THROW(cudaMemcpyAsync(src.rgba, rgba.data(), n_rays * sizeof(vec4), cudaMemcpyHostToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(src.depth, depth.data(), n_rays * sizeof(float), cudaMemcpyHostToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(src.payload.t, t.data(), n_rays * sizeof(float), cudaMemcpyHostToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(src.payload.max_weight, max_weight.data(), n_rays * sizeof(float), cudaMemcpyHostToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(src.payload.idx, pixels.data(), n_rays * sizeof(uint32_t), cudaMemcpyHostToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemcpyAsync(src.payload.state, state.data(), n_rays * sizeof(NerfRayState), cudaMemcpyHostToDevice, stream));
+	CUDA_CHECK_THROW(cudaMemsetAsync(counters, 0, 2 * sizeof(uint32_t), stream));
+
+	linear_kernel(compact_kernel_nerf, 0, stream, n_rays, nullptr, src, dst, dst_final, counters, counters + 1);
+
+	uint32_t n_compacted[2];
+	CUDA_CHECK_THROW(cudaMemcpyAsync(n_compacted, counters, 2 * sizeof(uint32_t), cudaMemcpyDeviceToHost, stream));
+	CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+
+	NerfRayCompactionCheck result;
+	result.n_rays = n_rays;
+	result.n_alive = n_compacted[0];
+	result.n_hit = n_compacted[1];
+	result.aos_bytes_per_ray = sizeof(vec4) + sizeof(float) + sizeof(LegacyNerfPayload);
+	result.soa_bytes_per_ray = sizeof(vec4) + 3 * sizeof(float) + sizeof(uint32_t) + sizeof(NerfRayState);
+
+	// The order of compacted rays depends on the order of atomics, hence both sides are compared in pixel order.
+	auto compare = [&](const RaysNerfSoa& rays, uint32_t n, std::vector<LegacyNerfRay> reference) {
+		if (n != reference.size()) {
+			return (uint32_t)reference.size();
+		}
+
+		std::vector<vec4> rgba_gpu(n);
+		std::vector<float> depth_gpu(n), t_gpu(n), max_weight_gpu(n);
+		std::vector<uint32_t> idx_gpu(n);
+		std::vector<NerfRayState> state_gpu(n);
+		CUDA_CHECK_THROW(cudaMemcpy(rgba_gpu.data(), rays.rgba, n * sizeof(vec4), cudaMemcpyDeviceToHost));
+		CUDA_CHECK_THROW(cudaMemcpy(depth_gpu.data(), rays.depth, n * sizeof(float), cudaMemcpyDeviceToHost));
+		CUDA_CHECK_THROW(cudaMemcpy(t_gpu.data(), rays.payload.t, n * sizeof(float), cudaMemcpyDeviceToHost));
+		CUDA_CHECK_THROW(cudaMemcpy(max_weight_gpu.data(), rays.payload.max_weight, n * sizeof(float), cudaMemcpyDeviceToHost));
+		CUDA_CHECK_THROW(cudaMemcpy(idx_gpu.data(), rays.payload.idx, n * sizeof(uint32_t), cudaMemcpyDeviceToHost));
+		CUDA_CHECK_THROW(cudaMemcpy(state_gpu.data(), rays.payload.state, n * sizeof(NerfRayState), cudaMemcpyDeviceToHost));
+
+		std::vector<uint32_t> order(n);
+		for (uint32_t i = 0; i < n; ++i) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return idx_gpu[a] < idx_gpu[b]; });
+		std::sort(reference.begin(), reference.end(), [](const LegacyNerfRay& a, const LegacyNerfRay& b) { return a.payload.idx < b.payload.idx; });
+
+		uint32_t n_mismatches = 0;
+		for (uint32_t i = 0; i < n; ++i) {
+			uint32_t j = order[i];
+			const LegacyNerfRay& ref = reference[i];
+			uint32_t idx = idx_gpu[j];
+			bool match =
+				idx == ref.payload.idx &&
+				origins[idx] == ref.payload.origin &&
+				dirs[idx] == ref.payload.dir &&
+				t_gpu[j] == ref.payload.t &&
+				max_weight_gpu[j] == ref.payload.max_weight &&
+				state_gpu[j].n_steps() == ref.payload.n_steps &&
+				state_gpu[j].alive() == ref.payload.alive &&
+				state_gpu[j].view() == 0 &&
+				rgba_gpu[j] == ref.rgba &&
+				depth_gpu[j] == ref.depth;
+
+			n_mismatches += match ? 0 : 1;
+		}
+
+		return n_mismatches;
+	};
+
+	result.n_mismatches = compare(dst, result.n_alive, legacy_alive) + compare(dst_final, result.n_hit, legacy_hit);
+
+	std::string message = fmt::format(
+		"NeRF ray compaction: {}/{} rays differ from the array-of-structures reference ({} alive, {} hit). Bytes moved per ray: {} -> {}",
+		result.n_mismatches, result.n_alive + result.n_hit, result.n_alive, result.n_hit, result.aos_bytes_per_ray, result.soa_bytes_per_ray
+	);
+
+	if (result.n_mismatches == 0) {
+		tlog::success() << message;
+	} else {
+		tlog::error() << message;
+	}
+
+	return result;
+}
+
 GPUMemory<float> Testbed::get_density_on_grid(ivec3 res3d, const BoundingBox& aabb, const mat3& render_aabb_to_local) {
 	const uint32_t n_elements = (res3d.x*res3d.y*res3d.z);
 	GPUMemory<float> density(n_elements);
@@ -3572,16 +5341,18 @@ GPUMemory<float> Testbed::get_density_on_grid(ivec3 res3d, const BoundingBox& aa
 		} else {
 			m_network->inference_mixed_precision(m_stream.get(), positions_matrix, density_matrix);
 		}
-		linear_kernel(grid_samples_half_to_float, 0, m_stream.get(),
-			local_batch_size,
-			m_aabb,
-			density.data() + offset , //+ axis_step * n_elements,
-			mlp_out,
-			m_nerf.density_activation,
-			positions + offset,
-			nerf_mode ? m_nerf.density_grid.data() : nullptr,
-			m_nerf.max_cascade
-		);
+		dispatch_density_grid_size(m_nerf.density_grid_shape.size, [&](auto size) {
+			linear_kernel(grid_samples_half_to_float<decltype(size)::value>, 0, m_stream.get(),
+				local_batch_size,
+				m_aabb,
+				density.data() + offset , //+ axis_step * n_elements,
+				mlp_out,
+				m_nerf.density_activation,
+				positions + offset,
+				nerf_mode ? m_nerf.density_grid.data() : nullptr,
+				m_nerf.max_cascade
+			);
+		});
 	}
 
 	return density;
@@ -3594,7 +5365,6 @@ GPUMemory<vec4> Testbed::get_rgba_on_grid(ivec3 res3d, vec3 ray_dir, bool voxel_
 	const float* extra_dims_gpu = get_inference_extra_dims(m_stream.get());
 
 	const uint32_t floats_per_coord = sizeof(NerfCoordinate) / sizeof(float) + m_nerf_network->n_extra_dims();
-	const uint32_t extra_stride = m_nerf_network->n_extra_dims() * sizeof(float);
 
 	GPUMemory<float> positions(n_elements * floats_per_coord);
 
@@ -3603,17 +5373,19 @@ GPUMemory<vec4> Testbed::get_rgba_on_grid(ivec3 res3d, vec3 ray_dir, bool voxel_
 	// generate inputs
 	const dim3 threads = { 16, 8, 1 };
 	const dim3 blocks = { div_round_up((uint32_t)res3d.x, threads.x), div_round_up((uint32_t)res3d.y, threads.y), div_round_up((uint32_t)res3d.z, threads.z) };
-	generate_grid_samples_nerf_uniform_dir<<<blocks, threads, 0, m_stream.get()>>>(
-		res3d,
-		m_nerf.density_grid_ema_step,
-		m_render_aabb,
-		m_render_aabb_to_local,
-		m_aabb,
-		ray_dir,
-		PitchedPtr<NerfCoordinate>((NerfCoordinate*)positions.data(), 1, 0, extra_stride),
-		extra_dims_gpu,
-		voxel_centers
-	);
+	dispatch_nerf_extra_dims(m_nerf_network->n_extra_dims(), [&](auto n_extra_dims) {
+		generate_grid_samples_nerf_uniform_dir<decltype(n_extra_dims)::value><<<blocks, threads, 0, m_stream.get()>>>(
+			res3d,
+			m_nerf.density_grid_ema_step,
+			m_render_aabb,
+			m_render_aabb_to_local,
+			m_aabb,
+			ray_dir,
+			NerfCoordinates<decltype(n_extra_dims)::value>((NerfCoordinate*)positions.data(), m_nerf_network->n_extra_dims()),
+			extra_dims_gpu,
+			voxel_centers
+		);
+	});
 
 	// Only process 1m elements at a time
 	for (uint32_t offset = 0; offset < n_elements; offset += batch_size) {
@@ -3669,7 +5441,11 @@ int Testbed::marching_cubes(ivec3 res3d, const BoundingBox& aabb, const mat3& re
 }
 
 uint8_t* Testbed::Nerf::get_density_grid_bitfield_mip(uint32_t mip) {
-	return density_grid_bitfield.data() + grid_mip_offset(mip)/8;
+	return density_grid_bitfield.data() + density_grid_shape.mip_offset(mip)/8;
+}
+
+uint8_t* Testbed::Nerf::get_density_grid_distance_field(uint32_t mip) {
+	return density_grid_bitfield.data() + density_grid_shape.distance_field_offset() + density_grid_shape.mip_offset(mip);
 }
 
 int Testbed::find_best_training_view(int default_view) {
@@ -3686,4 +5462,141 @@ int Testbed::find_best_training_view(int default_view) {
 	return bestimage;
 }
 
+Testbed::ErrorMapSamplerBenchmark Testbed::benchmark_error_map_sampler(uint32_t n_images, ivec2 resolution, float touched_fraction, uint32_t n_samples) {
+	if (n_images == 0 || compMul(resolution) <= 0 || n_samples == 0) {
+		throw std::runtime_error{"Benchmarking the error map sampler requires at least one image, cell and sample."};
+	}
+
+	uint32_t n_cells_per_image = compMul(resolution);
+	size_t n_cells = (size_t)n_cells_per_image * n_images;
+	uint32_t n_touched = std::min((uint32_t)std::round(clamp(touched_fraction, 0.0f, 1.0f) * n_images), n_images);
+
+	// Exponentially distributed error, as accumulated by the loss kernel, and more of it in the touched images
+	std::mt19937 rng{1337};
+	std::exponential_distribution<float> error_dist{1.0f};
+	std::vector<float> data_cpu(n_cells);
+	for (float& e : data_cpu) {
+		e = error_dist(rng);
+	}
+
+	std::vector<uint32_t> images(n_images);
+	std::iota(images.begin(), images.end(), 0u);
+	std::shuffle(images.begin(), images.end(), rng);
+
+	std::vector<float> touched_data_cpu = data_cpu;
+	std::vector<uint8_t> touched_cpu(n_images, 0);
+	for (uint32_t i = 0; i < n_touched; ++i) {
+		uint32_t img = images[i];
+		touched_cpu[img] = 1;
+		for (uint32_t j = 0; j < n_cells_per_image; ++j) {
+			touched_data_cpu[(size_t)img * n_cells_per_image + j] += 4.0f * error_dist(rng);
+		}
+	}
+
+	cudaStream_t stream;
+	CUDA_CHECK_THROW(cudaStreamCreate(&stream));
+	ScopeGuard stream_guard{[&]() {
+		cudaStreamSynchronize(stream);
+		cudaStreamDestroy(stream);
+	}};
+
+	auto time_ms = [&](auto&& fun) {
+		CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+		auto start = std::chrono::steady_clock::now();
+		fun();
+		CUDA_CHECK_THROW(cudaStreamSynchronize(stream));
+		return (float)std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	ErrorMapSamplerBenchmark result = {};
+	result.n_images = n_images;
+	result.resolution = resolution;
+	result.touched_fraction = (float)n_touched / n_images;
+
+	Nerf::Training::ErrorMap error_map;
+	error_map.resolution = resolution;
+	error_map.data.resize_and_copy_from_host(data_cpu);
+
+	// The CDF build resets the alias tables, so it goes first.
+	result.cdf_build_ms = time_ms([&]() { error_map.build_cdf(n_images, stream); });
+	result.alias_build_ms = time_ms([&]() { error_map.build_alias_tables(n_images, stream); });
+
+	error_map.data.copy_from_host(touched_data_cpu);
+	CUDA_CHECK_THROW(cudaMemcpyAsync(error_map.touched.data(), touched_cpu.data(), n_images * sizeof(uint8_t), cudaMemcpyHostToDevice, stream));
+	result.alias_incremental_build_ms = time_ms([&]() { error_map.build_alias_tables(n_images, stream); });
+
+	if (error_map.n_rebuilt_images != n_touched) {
+		throw std::runtime_error{fmt::format("Incremental alias table build rebuilt {} images instead of {}.", error_map.n_rebuilt_images, n_touched)};
+	}
+
+	ErrorMapAliasTables host;
+	result.host_build_ms = time_ms([&]() { host.build(data_cpu.data(), n_images, resolution, nullptr, &m_thread_pool); });
+	result.host_incremental_build_ms = time_ms([&]() { host.build(touched_data_cpu.data(), n_images, resolution, touched_cpu.data(), &m_thread_pool); });
+
+	GPUMemory<float> samples(n_samples);
+	auto msamples_per_second = [&](EErrorMapSampler mode) {
+		ErrorMapSampler sampler = error_map.sampler(mode, true, true);
+		auto sample = [&]() {
+			linear_kernel(sample_error_map_benchmark, 0, stream, n_samples, n_images, sampler, default_rng_t{m_rng.next_uint()}, samples.data());
+		};
+
+		// Warm up, then average over a few launches
+		constexpr uint32_t N_REPEATS = 16;
+		sample();
+		float ms = time_ms([&]() {
+			for (uint32_t i = 0; i < N_REPEATS; ++i) {
+				sample();
+			}
+		});
+
+		return (float)n_samples * N_REPEATS / (ms * 1000.0f);
+	};
+
+	result.cdf_msamples_per_second = msamples_per_second(EErrorMapSampler::Cdf);
+	result.alias_msamples_per_second = msamples_per_second(EErrorMapSampler::Alias);
+
+	// The GPU's tables against the host's, and each table against the probabilities it represents
+	std::vector<float> pmf_x_cond_y(error_map.pmf_x_cond_y.size());
+	std::vector<float> pmf_y(error_map.pmf_y.size());
+	std::vector<AliasEntry> alias_x_cond_y(error_map.alias_x_cond_y.size());
+	std::vector<AliasEntry> alias_y(error_map.alias_y.size());
+	error_map.pmf_x_cond_y.copy_to_host(pmf_x_cond_y);
+	error_map.pmf_y.copy_to_host(pmf_y);
+	error_map.alias_x_cond_y.copy_to_host(alias_x_cond_y);
+	error_map.alias_y.copy_to_host(alias_y);
+
+	auto max_difference = [](const std::vector<float>& a, const std::vector<float>& b) {
+		float result = 0.0f;
+		for (size_t i = 0; i < a.size(); ++i) {
+			result = std::max(result, std::abs(a[i] - b[i]));
+		}
+
+		return result;
+	};
+
+	result.max_pmf_difference = std::max({
+		max_difference(pmf_x_cond_y, host.pmf_x_cond_y),
+		max_difference(pmf_y, host.pmf_y),
+		max_difference(error_map.pmf_img_cpu, host.pmf_img),
+	});
+
+	uint32_t n_rows = resolution.y * n_images;
+	result.max_alias_error = ErrorMapAliasTables::max_alias_error(n_images, error_map.pmf_img_cpu.data(), error_map.alias_img_cpu.data());
+	for (uint32_t row = 0; row < n_rows; ++row) {
+		result.max_alias_error = std::max(result.max_alias_error, ErrorMapAliasTables::max_alias_error(resolution.x, &pmf_x_cond_y[(size_t)row * resolution.x], &alias_x_cond_y[(size_t)row * resolution.x]));
+	}
+
+	for (uint32_t img = 0; img < n_images; ++img) {
+		result.max_alias_error = std::max(result.max_alias_error, ErrorMapAliasTables::max_alias_error(resolution.y, &pmf_y[(size_t)img * resolution.y], &alias_y[(size_t)img * resolution.y]));
+	}
+
+	tlog::info() << fmt::format(
+		"Error map of {} images at {}x{}: CDF build {:.2f}ms, alias build {:.2f}ms ({:.2f}ms after touching {:.0f}%), host alias build {:.2f}ms ({:.2f}ms). Sampling: {:.1f} (CDF) vs. {:.1f} (alias) Msamples/s. Max pmf difference {}, max alias error {}",
+		n_images, resolution.x, resolution.y, result.cdf_build_ms, result.alias_build_ms, result.alias_incremental_build_ms, result.touched_fraction * 100.0f,
+		result.host_build_ms, result.host_incremental_build_ms, result.cdf_msamples_per_second, result.alias_msamples_per_second, result.max_pmf_difference, result.max_alias_error
+	);
+
+	return result;
+}
+
 NGP_NAMESPACE_END
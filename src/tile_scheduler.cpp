@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   tile_scheduler.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/tile_scheduler.h>
+
+#include <algorithm>
+
+NGP_NAMESPACE_BEGIN
+
+void ProgressiveTileScheduler::reset(const ivec2& resolution, uint32_t tile_size, const vec2& fovea, uint32_t target_spp) {
+	if (tile_size == 0) {
+		throw std::runtime_error{"Tile size must be positive."};
+	}
+
+	m_resolution = resolution;
+	m_tile_size = tile_size;
+	m_tile_resolution = (resolution + ivec2((int)tile_size - 1)) / (int)tile_size;
+	m_target_spp = target_spp;
+	++m_generation;
+
+	uint32_t n_tiles = (uint32_t)compMul(m_tile_resolution);
+	m_order.resize(n_tiles);
+	m_tile_spp.assign(n_tiles, 0);
+	m_cursor = 0;
+	m_pass = n_tiles > 0 ? 0 : target_spp;
+	m_next_tiles.clear();
+	m_n_pixels_in_flight = 0;
+
+	vec2 fovea_px = fovea * vec2(resolution);
+	std::vector<float> distance_sq(n_tiles);
+	for (uint32_t i = 0; i < n_tiles; ++i) {
+		ivec2 tile = {(int)(i % m_tile_resolution.x), (int)(i / m_tile_resolution.x)};
+		ivec2 lo = tile * (int)tile_size;
+		ivec2 hi = min(lo + ivec2((int)tile_size), resolution);
+		vec2 d = (vec2(lo + hi) * 0.5f) - fovea_px;
+		distance_sq[i] = dot(d, d);
+		m_order[i] = i;
+	}
+
+	// Stable, such that equidistant tiles keep their scanline order and the schedule is deterministic.
+	std::stable_sort(m_order.begin(), m_order.end(), [&](uint32_t a, uint32_t b) {
+		return distance_sq[a] < distance_sq[b];
+	});
+}
+
+void ProgressiveTileScheduler::report_frame_time(float ms) {
+	if (m_n_pixels_in_flight == 0) {
+		return;
+	}
+
+	// Frame time is modeled as a fixed overhead plus a cost per pixel, fit by least squares over
+	// exponentially decaying statistics of recent frames.
+	double x = (double)m_n_pixels_in_flight;
+	double a = m_n_measurements == 0 ? 1.0 : 0.2;
+	m_mean_pixels += a * (x - m_mean_pixels);
+	m_mean_ms += a * (ms - m_mean_ms);
+	m_mean_pixels_sq += a * (x * x - m_mean_pixels_sq);
+	m_mean_pixels_ms += a * (x * ms - m_mean_pixels_ms);
+	++m_n_measurements;
+
+	double var = m_mean_pixels_sq - m_mean_pixels * m_mean_pixels;
+	double cov = m_mean_pixels_ms - m_mean_pixels * m_mean_ms;
+
+	m_ms_per_pixel = (float)((var > 1e-3 * m_mean_pixels * m_mean_pixels && cov > 0.0) ? cov / var : m_mean_ms / m_mean_pixels);
+	m_overhead_ms = (float)std::max(m_mean_ms - m_ms_per_pixel * m_mean_pixels, 0.0);
+
+	m_n_pixels_last_frame = m_n_pixels_in_flight;
+	m_n_pixels_in_flight = 0;
+}
+
+uint32_t ProgressiveTileScheduler::tile_n_pixels(uint32_t tile) const {
+	ivec2 lo = ivec2{(int)(tile % m_tile_resolution.x), (int)(tile / m_tile_resolution.x)} * (int)m_tile_size;
+	ivec2 hi = min(lo + ivec2((int)m_tile_size), m_resolution);
+	return (uint32_t)compMul(hi - lo);
+}
+
+const std::vector<uint32_t>& ProgressiveTileScheduler::next_tiles(float budget_ms) {
+	m_next_tiles.clear();
+	m_n_pixels_in_flight = 0;
+
+	// Without a measurement, start with a single tile. Afterwards, grow by at most 2x per frame, such that the
+	// cost model sees a range of frame sizes and a bad estimate cannot stall interactivity for long.
+	size_t max_pixels = m_n_measurements == 0 ? 0 : 2 * std::max(m_n_pixels_last_frame, (size_t)1);
+	float pixel_budget_ms = budget_ms - m_overhead_ms;
+
+	while (!finished() && m_next_tiles.size() < m_order.size()) {
+		uint32_t tile = m_order[m_cursor];
+		size_t n_pixels = tile_n_pixels(tile);
+
+		// Always render at least one tile.
+		if (!m_next_tiles.empty()) {
+			size_t total_pixels = m_n_pixels_in_flight + n_pixels;
+			if (total_pixels > max_pixels || m_ms_per_pixel * (float)total_pixels > pixel_budget_ms) {
+				break;
+			}
+		}
+
+		m_next_tiles.emplace_back(tile);
+		m_n_pixels_in_flight += n_pixels;
+		++m_tile_spp[tile];
+
+		if (++m_cursor == m_order.size()) {
+			m_cursor = 0;
+			++m_pass;
+		}
+	}
+
+	return m_next_tiles;
+}
+
+std::vector<uint8_t> ProgressiveTileScheduler::tile_mask(const std::vector<uint32_t>& tiles) const {
+	std::vector<uint8_t> mask(m_order.size(), 0);
+	for (uint32_t tile : tiles) {
+		mask.at(tile) = 1;
+	}
+
+	return mask;
+}
+
+NGP_NAMESPACE_END
@@ -124,6 +124,68 @@ void save_exr(const float* data, int width, int height, int n_channels, int chan
 	free(buffer);
 }
 
+void save_exr(std::vector<std::pair<std::string, const float*>> channels, int width, int height, const fs::path& path) {
+	// Readers expect the channels of an EXR file to be sorted by name.
+	std::sort(channels.begin(), channels.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	EXRHeader header;
+	InitEXRHeader(&header);
+
+	EXRImage image;
+	InitEXRImage(&image);
+
+	int n_channels = (int)channels.size();
+	image.num_channels = n_channels;
+
+	std::vector<float*> image_ptr(n_channels);
+	for (int i = 0; i < n_channels; ++i) {
+		image_ptr[i] = (float*)channels[i].second;
+	}
+
+	image.images = (unsigned char**)image_ptr.data();
+	image.width = width;
+	image.height = height;
+
+	header.num_channels = n_channels;
+	header.channels = (EXRChannelInfo *)malloc(sizeof(EXRChannelInfo) * header.num_channels);
+	for (int i = 0; i < n_channels; ++i) {
+		strncpy(header.channels[i].name, channels[i].first.c_str(), 255);
+		header.channels[i].name[255] = '\0';
+	}
+
+	// Auxiliary channels such as depth need full precision, so unlike the RGBA variant above, everything is stored as float.
+	header.pixel_types = (int *)malloc(sizeof(int) * header.num_channels);
+	header.requested_pixel_types = (int *)malloc(sizeof(int) * header.num_channels);
+	for (int i = 0; i < header.num_channels; i++) {
+		header.pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
+		header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
+	}
+
+	const char* err = NULL;
+	uint8_t* buffer;
+	size_t n_bytes = SaveEXRImageToMemory(&image, &header, &buffer, &err);
+	if (n_bytes == 0) {
+		std::string error_message = std::string("Failed to save EXR image: ") + err;
+		FreeEXRErrorMessage(err);
+		free(header.channels);
+		free(header.pixel_types);
+		free(header.requested_pixel_types);
+		throw std::runtime_error(error_message);
+	}
+
+	{
+		std::ofstream f{native_string(path), std::ios::out | std::ios::binary};
+		f.write((char*)buffer, n_bytes);
+	}
+
+	tlog::info() << "Saved exr file: " << path.str();
+
+	free(header.channels);
+	free(header.pixel_types);
+	free(header.requested_pixel_types);
+	free(buffer);
+}
+
 void load_exr(float** data, int* width, int* height, const fs::path& path) {
 	std::vector<uint8_t> buffer;
 
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   training_profiler.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/training_profiler.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+using namespace nlohmann;
+
+NGP_NAMESPACE_BEGIN
+
+std::string to_string(ETrainingPhase phase) {
+	switch (phase) {
+		case ETrainingPhase::Step: return "Step";
+		case ETrainingPhase::Prep: return "Prep";
+		case ETrainingPhase::GenerateSamples: return "GenerateSamples";
+		case ETrainingPhase::Inference: return "Inference";
+		case ETrainingPhase::Loss: return "Loss";
+		case ETrainingPhase::ForwardBackward: return "ForwardBackward";
+		case ETrainingPhase::InputGradients: return "InputGradients";
+		case ETrainingPhase::OptimizerStep: return "OptimizerStep";
+		case ETrainingPhase::CounterReadback: return "CounterReadback";
+		case ETrainingPhase::ErrorMapCdf: return "ErrorMapCdf";
+		case ETrainingPhase::ExtraDimsUpdate: return "ExtraDimsUpdate";
+		case ETrainingPhase::CameraUpdate: return "CameraUpdate";
+		default: throw std::runtime_error{"Can not convert invalid training phase to string."};
+	}
+}
+
+static std::string to_string(ETrainingTrack track) {
+	return track == ETrainingTrack::Host ? "Host" : "Device";
+}
+
+uint32_t TrainingPhaseHistogram::bucket(double us) {
+	if (!(us > MIN_US)) {
+		return 0;
+	}
+
+	double b = std::floor(std::log2(us / MIN_US) * N_BUCKETS_PER_OCTAVE);
+	return (uint32_t)std::min(b, (double)(N_BUCKETS - 1));
+}
+
+double TrainingPhaseHistogram::bucket_lower_us(uint32_t bucket) {
+	return bucket == 0 ? 0.0 : MIN_US * std::exp2((double)bucket / N_BUCKETS_PER_OCTAVE);
+}
+
+void TrainingPhaseHistogram::add(double us) {
+	us = std::max(us, 0.0);
+
+	if (m_count == 0) {
+		m_min_us = m_max_us = us;
+	} else {
+		m_min_us = std::min(m_min_us, us);
+		m_max_us = std::max(m_max_us, us);
+	}
+
+	++m_buckets[bucket(us)];
+	++m_count;
+	m_total_us += us;
+}
+
+double TrainingPhaseHistogram::percentile_us(double p) const {
+	if (m_count == 0) {
+		return 0.0;
+	}
+
+	double rank = std::min(std::max(p, 0.0), 1.0) * m_count;
+	uint64_t cumulative = 0;
+	for (uint32_t i = 0; i < N_BUCKETS; ++i) {
+		if (m_buckets[i] == 0 || cumulative + m_buckets[i] < rank) {
+			cumulative += m_buckets[i];
+			continue;
+		}
+
+		// Bounds of the bucket, tightened by the observed range
+		double lo = std::max(bucket_lower_us(i), m_min_us);
+		double hi = std::min(i + 1 < N_BUCKETS ? bucket_lower_us(i + 1) : m_max_us, m_max_us);
+		if (hi <= lo) {
+			return lo;
+		}
+
+		double t = (rank - cumulative) / m_buckets[i];
+		return lo > 0.0 ? lo * std::pow(hi / lo, t) : lo + (hi - lo) * t;
+	}
+
+	return m_max_us;
+}
+
+void TrainingProfiler::set_trace_range(uint32_t begin_step, uint32_t end_step) {
+	if (end_step < begin_step) {
+		throw std::runtime_error{fmt::format("Trace range ends at step {} before it begins at step {}.", end_step, begin_step)};
+	}
+
+	m_trace_begin_step = begin_step;
+	m_trace_end_step = end_step;
+}
+
+void TrainingProfiler::record(ETrainingPhase phase, ETrainingTrack track, uint32_t step, double start_us, double duration_us) {
+	if ((uint32_t)phase >= N_TRAINING_PHASES) {
+		throw std::runtime_error{fmt::format("Invalid training phase {}.", (uint32_t)phase)};
+	}
+
+	m_histograms[(size_t)track * N_TRAINING_PHASES + (size_t)phase].add(duration_us);
+
+	if (step < m_trace_begin_step || step >= m_trace_end_step) {
+		return;
+	}
+
+	if (m_events.size() >= max_trace_events) {
+		++m_n_dropped_events;
+		return;
+	}
+
+	m_events.push_back({phase, track, step, start_us, std::max(duration_us, 0.0)});
+}
+
+std::vector<TrainingPhaseStats> TrainingProfiler::stats() const {
+	std::vector<TrainingPhaseStats> result;
+	for (uint32_t t = 0; t < N_TRAINING_TRACKS; ++t) {
+		for (uint32_t p = 0; p < N_TRAINING_PHASES; ++p) {
+			auto phase = (ETrainingPhase)p;
+			auto track = (ETrainingTrack)t;
+			const auto& h = histogram(phase, track);
+			if (h.count() == 0) {
+				continue;
+			}
+
+			result.push_back({
+				phase,
+				track,
+				h.count(),
+				h.total_us() / 1000.0,
+				h.mean_us() / 1000.0,
+				h.min_us() / 1000.0,
+				h.percentile_us(0.5) / 1000.0,
+				h.percentile_us(0.9) / 1000.0,
+				h.percentile_us(0.99) / 1000.0,
+				h.max_us() / 1000.0,
+			});
+		}
+	}
+
+	return result;
+}
+
+std::string TrainingProfiler::summary() const {
+	std::string result = fmt::format("{:<16} {:<7} {:>8} {:>10} {:>10} {:>10} {:>10}\n", "Phase", "Track", "Count", "Mean ms", "P50 ms", "P99 ms", "Total ms");
+	for (const auto& s : stats()) {
+		result += fmt::format("{:<16} {:<7} {:>8} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.1f}\n", to_string(s.phase), to_string(s.track), s.count, s.mean_ms, s.p50_ms, s.p99_ms, s.total_ms);
+	}
+
+	return result;
+}
+
+json TrainingProfiler::chrome_trace() const {
+	json events = json::array();
+
+	for (uint32_t t = 0; t < N_TRAINING_TRACKS; ++t) {
+		events.push_back({
+			{"name", "process_name"},
+			{"ph", "M"},
+			{"pid", t},
+			{"args", {{"name", to_string((ETrainingTrack)t)}}},
+		});
+	}
+
+	for (const auto& e : m_events) {
+		events.push_back({
+			{"name", to_string(e.phase)},
+			{"cat", "training"},
+			{"ph", "X"},
+			{"pid", (uint32_t)e.track},
+			{"tid", 0},
+			{"ts", e.start_us},
+			{"dur", e.duration_us},
+			{"args", {{"step", e.step}}},
+		});
+	}
+
+	return {
+		{"traceEvents", std::move(events)},
+		{"displayTimeUnit", "ms"},
+		{"otherData", {
+			{"trace_begin_step", m_trace_begin_step},
+			{"trace_end_step", m_trace_end_step},
+			{"dropped_events", m_n_dropped_events},
+		}},
+	};
+}
+
+void TrainingProfiler::save_chrome_trace(const fs::path& path) const {
+	std::ofstream f{native_string(path), std::ios::out | std::ios::binary};
+	f << chrome_trace().dump();
+	if (!f) {
+		throw std::runtime_error{fmt::format("Failed to write training trace '{}'.", path.str())};
+	}
+
+	tlog::success() << "Saved " << m_events.size() << " training events to " << path.str();
+}
+
+void TrainingProfiler::reset() {
+	m_histograms = {};
+	m_events.clear();
+	m_n_dropped_events = 0;
+}
+
+NGP_NAMESPACE_END
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   training_scheduler.cpp
+ *  @author Thomas Müller, NVIDIA
+ */
+
+#include <neural-graphics-primitives/common.h>
+#include <neural-graphics-primitives/training_scheduler.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace nlohmann;
+
+NGP_NAMESPACE_BEGIN
+
+std::string to_string(ETrainingDecision decision) {
+	switch (decision) {
+		case ETrainingDecision::ProbeBatchSize: return "ProbeBatchSize";
+		case ETrainingDecision::BatchSize: return "BatchSize";
+		case ETrainingDecision::DensityGridInterval: return "DensityGridInterval";
+		case ETrainingDecision::Stop: return "Stop";
+		default: throw std::runtime_error{"Can not convert invalid training decision to string."};
+	}
+}
+
+std::string to_string(ETrainingStopReason reason) {
+	switch (reason) {
+		case ETrainingStopReason::None: return "None";
+		case ETrainingStopReason::StepBudget: return "StepBudget";
+		case ETrainingStopReason::TimeBudget: return "TimeBudget";
+		case ETrainingStopReason::Converged: return "Converged";
+		case ETrainingStopReason::Aborted: return "Aborted";
+		default: throw std::runtime_error{"Can not convert invalid training stop reason to string."};
+	}
+}
+
+template <typename T>
+static T enum_from_string(const std::string& str, T n_values) {
+	for (int i = 0; i < (int)n_values; ++i) {
+		if (to_string((T)i) == str) {
+			return (T)i;
+		}
+	}
+
+	throw std::runtime_error{fmt::format("Unknown training schedule value '{}'.", str)};
+}
+
+void to_json(json& j, const TrainingDecision& decision) {
+	j = {
+		{"type", to_string(decision.type)},
+		{"step", decision.step},
+		{"elapsed_seconds", decision.elapsed_seconds},
+		{"batch_size", decision.batch_size},
+		{"density_grid_interval", decision.density_grid_interval},
+		{"stop_reason", to_string(decision.stop_reason)},
+		{"reason", decision.reason},
+	};
+}
+
+void from_json(const json& j, TrainingDecision& decision) {
+	decision.type = enum_from_string(j.at("type").get<std::string>(), (ETrainingDecision)((int)ETrainingDecision::Stop + 1));
+	decision.step = j.at("step");
+	decision.elapsed_seconds = j.value("elapsed_seconds", 0.0);
+	decision.batch_size = j.at("batch_size");
+	decision.density_grid_interval = j.at("density_grid_interval");
+	decision.stop_reason = enum_from_string(j.value("stop_reason", std::string{"None"}), (ETrainingStopReason)((int)ETrainingStopReason::Aborted + 1));
+	decision.reason = j.value("reason", std::string{});
+}
+
+TrainingScheduler::TrainingScheduler(const TrainingScheduleConfig& config, uint32_t start_step, uint32_t batch_size)
+: m_config{config}, m_start_step{start_step}, m_step{start_step}, m_batch_size{batch_size}, m_last_evaluation_step{start_step}, m_best_loss{std::numeric_limits<float>::infinity()} {
+	if (config.time_budget_seconds <= 0.0 && config.step_budget == 0) {
+		throw std::runtime_error{"A training schedule requires a time or step budget."};
+	}
+
+	if (config.decision_interval == 0) {
+		throw std::runtime_error{"A training schedule requires a positive decision interval."};
+	}
+
+	if (!config.tune_batch_size) {
+		decide({ETrainingDecision::BatchSize, 0, 0.0, batch_size, 0, ETrainingStopReason::None, "fixed"});
+		return;
+	}
+
+	if (config.min_batch_size == 0 || config.max_batch_size < config.min_batch_size || config.n_probe_steps == 0) {
+		throw std::runtime_error{fmt::format(
+			"Can not tune the batch size between {} and {} with {} probe steps.", config.min_batch_size, config.max_batch_size, config.n_probe_steps
+		)};
+	}
+
+	for (uint64_t b = config.min_batch_size; b <= config.max_batch_size; b *= 2) {
+		m_candidates.push_back((uint32_t)b);
+	}
+
+	start_probe(0);
+}
+
+TrainingScheduler::TrainingScheduler(const TrainingScheduleConfig& config, uint32_t start_step, const std::vector<TrainingDecision>& replay)
+: m_config{config}, m_start_step{start_step}, m_step{start_step}, m_last_evaluation_step{start_step}, m_best_loss{std::numeric_limits<float>::infinity()}, m_replay{replay} {
+	if (replay.empty() || replay.back().type != ETrainingDecision::Stop) {
+		throw std::runtime_error{"Can only replay training schedules that end with a Stop decision."};
+	}
+
+	if (replay.front().step != start_step) {
+		throw std::runtime_error{fmt::format("Training schedule was recorded from step {}, but training is at step {}.", replay.front().step, start_step)};
+	}
+
+	for (size_t i = 1; i < replay.size(); ++i) {
+		if (replay[i].step < replay[i-1].step) {
+			throw std::runtime_error{"Training schedule decisions must be ordered by step."};
+		}
+	}
+
+	apply_replay();
+}
+
+uint32_t TrainingScheduler::default_density_grid_interval(uint32_t step) {
+	return std::min(std::max(step / 16u, 1u), 16u);
+}
+
+uint32_t TrainingScheduler::density_grid_interval() const {
+	return m_density_grid_interval > 0 ? m_density_grid_interval : default_density_grid_interval(m_step);
+}
+
+bool TrainingScheduler::wants_evaluation() const {
+	return !done() && !m_probing && m_config.eval_interval > 0 && m_step - m_last_evaluation_step >= m_config.eval_interval;
+}
+
+uint32_t TrainingScheduler::next_chunk_steps() const {
+	if (done()) {
+		return 0;
+	}
+
+	uint32_t n = m_config.decision_interval;
+	if (m_probing) {
+		n = std::min(n, m_probe_steps_left);
+	}
+
+	if (m_config.eval_interval > 0) {
+		uint32_t since_evaluation = m_step - m_last_evaluation_step;
+		if (since_evaluation < m_config.eval_interval) {
+			n = std::min(n, m_config.eval_interval - since_evaluation);
+		}
+	}
+
+	if (replaying()) {
+		if (m_replay_pos < m_replay.size()) {
+			n = std::min(n, m_replay[m_replay_pos].step - m_step);
+		}
+
+		return std::max(n, 1u);
+	}
+
+	if (m_config.step_budget > 0) {
+		n = std::min(n, m_config.step_budget - n_steps_done());
+	}
+
+	// Don't overshoot the time budget by more than a step
+	if (m_config.time_budget_seconds > 0.0 && m_step_seconds > 0.0) {
+		double seconds_per_step = m_step_seconds + m_prep_seconds_per_update / density_grid_interval();
+		double remaining = std::max(m_config.time_budget_seconds - m_elapsed_seconds, 0.0) / seconds_per_step;
+		n = std::min(n, (uint32_t)std::max(std::min(remaining, (double)n), 1.0));
+	}
+
+	return std::max(n, 1u);
+}
+
+void TrainingScheduler::observe_steps(uint32_t n_steps, double seconds, double prep_seconds, uint32_t n_preps) {
+	if (done()) {
+		throw std::runtime_error{"Can not observe steps of a finished training schedule."};
+	}
+
+	m_step += n_steps;
+	m_elapsed_seconds += seconds;
+
+	double compute_seconds = std::max(seconds - prep_seconds, 0.0);
+	if (n_steps > 0) {
+		m_step_seconds = compute_seconds / n_steps;
+	}
+
+	if (n_preps > 0) {
+		m_prep_seconds_per_update = prep_seconds / n_preps;
+	}
+
+	if (replaying()) {
+		apply_replay();
+		return;
+	}
+
+	if (m_probing) {
+		uint32_t n_probed = std::min(n_steps, m_probe_steps_left);
+		m_probe_steps_left -= n_probed;
+
+		if (!m_probe_warmup) {
+			m_probe_seconds += compute_seconds;
+			m_probe_n_steps += n_steps;
+		}
+
+		if (m_probe_steps_left == 0) {
+			if (m_probe_warmup) {
+				m_probe_warmup = false;
+				m_probe_steps_left = m_config.n_probe_steps;
+			} else {
+				float throughput = m_probe_seconds > 0.0 ? (float)(m_batch_size * (double)m_probe_n_steps / m_probe_seconds) : 0.0f;
+				float best = 0.0f;
+				for (const auto& t : m_throughput) {
+					best = std::max(best, t.second);
+				}
+
+				m_throughput.emplace_back(m_batch_size, throughput);
+
+				// Larger batches than one that did not raise the throughput have nothing to gain
+				if (m_probe + 1 < m_candidates.size() && throughput > best) {
+					start_probe(m_probe + 1);
+				} else {
+					finish_probing();
+				}
+			}
+		}
+	}
+
+	if (m_config.tune_density_grid_interval) {
+		tune_density_grid_interval();
+	}
+
+	check_budgets();
+}
+
+void TrainingScheduler::observe_evaluation(float loss, double seconds) {
+	if (done()) {
+		throw std::runtime_error{"Can not observe evaluations of a finished training schedule."};
+	}
+
+	m_elapsed_seconds += seconds;
+	m_last_evaluation_step = m_step;
+	m_evaluations.push_back({m_step, m_elapsed_seconds, loss});
+
+	if (replaying()) {
+		m_best_loss = std::min(m_best_loss, loss);
+		return;
+	}
+
+	if (loss < m_best_loss * (1.0f - m_config.min_relative_improvement)) {
+		m_n_evaluations_without_improvement = 0;
+	} else {
+		++m_n_evaluations_without_improvement;
+	}
+
+	m_best_loss = std::min(m_best_loss, loss);
+
+	if (m_n_evaluations_without_improvement >= m_config.patience && n_steps_done() >= m_config.min_steps) {
+		stop(ETrainingStopReason::Converged, fmt::format(
+			"loss {} did not improve on {} by {}% in {} evaluations", loss, m_best_loss, m_config.min_relative_improvement * 100.0f, m_n_evaluations_without_improvement
+		));
+		return;
+	}
+
+	check_budgets();
+}
+
+void TrainingScheduler::abort(const std::string& reason) {
+	if (!done()) {
+		stop(ETrainingStopReason::Aborted, reason);
+	}
+}
+
+void TrainingScheduler::decide(TrainingDecision decision) {
+	decision.step = m_step;
+	decision.elapsed_seconds = m_elapsed_seconds;
+
+	m_batch_size = decision.batch_size;
+	m_density_grid_interval = decision.density_grid_interval;
+	m_stop_reason = decision.stop_reason;
+
+	std::string what;
+	switch (decision.type) {
+		case ETrainingDecision::ProbeBatchSize: what = fmt::format("probing batch size {}", decision.batch_size); break;
+		case ETrainingDecision::BatchSize: what = fmt::format("batch size {}", decision.batch_size); break;
+		case ETrainingDecision::DensityGridInterval:
+			what = decision.density_grid_interval > 0 ?
+				fmt::format("density grid update every {} steps", decision.density_grid_interval) :
+				std::string{"default density grid update cadence"};
+			break;
+		case ETrainingDecision::Stop: what = fmt::format("stop ({})", to_string(decision.stop_reason)); break;
+		default: throw std::runtime_error{"Invalid training decision."};
+	}
+
+	tlog::info() << fmt::format("Training schedule at step {} after {:.1f}s: {}{}", decision.step, decision.elapsed_seconds, what, decision.reason.empty() ? "" : fmt::format(" ({})", decision.reason));
+	m_decisions.emplace_back(std::move(decision));
+}
+
+void TrainingScheduler::stop(ETrainingStopReason reason, const std::string& why) {
+	decide({ETrainingDecision::Stop, 0, 0.0, m_batch_size, m_density_grid_interval, reason, why});
+}
+
+void TrainingScheduler::start_probe(size_t candidate) {
+	m_probe = candidate;
+	m_probing = true;
+	m_probe_warmup = m_config.n_probe_warmup_steps > 0;
+	m_probe_steps_left = m_probe_warmup ? m_config.n_probe_warmup_steps : m_config.n_probe_steps;
+	m_probe_seconds = 0.0;
+	m_probe_n_steps = 0;
+
+	decide({ETrainingDecision::ProbeBatchSize, 0, 0.0, m_candidates[candidate], m_density_grid_interval, ETrainingStopReason::None, ""});
+}
+
+void TrainingScheduler::finish_probing() {
+	m_probing = false;
+
+	float best = 0.0f;
+	for (const auto& t : m_throughput) {
+		best = std::max(best, t.second);
+	}
+
+	// Probed in ascending order, so the first one that is fast enough is the smallest
+	uint32_t batch_size = m_throughput.back().first;
+	for (const auto& t : m_throughput) {
+		if (t.second >= m_config.throughput_tolerance * best) {
+			batch_size = t.first;
+			break;
+		}
+	}
+
+	std::string reason;
+	for (const auto& t : m_throughput) {
+		reason += fmt::format("{}{}: {:.2f} Msamples/s", reason.empty() ? "" : ", ", t.first, t.second * 1e-6f);
+	}
+
+	decide({ETrainingDecision::BatchSize, 0, 0.0, batch_size, m_density_grid_interval, ETrainingStopReason::None, reason});
+}
+
+void TrainingScheduler::tune_density_grid_interval() {
+	// The density grid still forms during the first steps, which rely on frequent updates.
+	constexpr uint32_t N_WARMUP_STEPS = 256;
+
+	uint32_t interval = 0;
+	if (m_step >= N_WARMUP_STEPS && m_step_seconds > 0.0 && m_prep_seconds_per_update > 0.0) {
+		double needed = m_prep_seconds_per_update / (m_config.max_density_grid_overhead * m_step_seconds);
+		if (needed > default_density_grid_interval(m_step)) {
+			interval = 1;
+			while (interval < needed && interval < m_config.max_density_grid_interval) {
+				interval *= 2;
+			}
+
+			interval = std::min(interval, m_config.max_density_grid_interval);
+			if (interval <= default_density_grid_interval(m_step)) {
+				interval = 0;
+			}
+		}
+	}
+
+	if (interval != m_density_grid_interval) {
+		decide({ETrainingDecision::DensityGridInterval, 0, 0.0, m_batch_size, interval, ETrainingStopReason::None, fmt::format(
+			"{:.3f}ms per update, {:.3f}ms per step", m_prep_seconds_per_update * 1000.0, m_step_seconds * 1000.0
+		)});
+	}
+}
+
+void TrainingScheduler::apply_replay() {
+	while (m_replay_pos < m_replay.size() && m_replay[m_replay_pos].step <= m_step) {
+		const TrainingDecision& decision = m_replay[m_replay_pos++];
+		if (decision.step != m_step) {
+			throw std::runtime_error{fmt::format("Training schedule decision of step {} can not be replayed at step {}.", decision.step, m_step)};
+		}
+
+		m_batch_size = decision.batch_size;
+		m_density_grid_interval = decision.density_grid_interval;
+		m_stop_reason = decision.stop_reason;
+
+		tlog::info() << fmt::format("Replaying training schedule at step {}: {} (batch size {}, density grid interval {})", decision.step, to_string(decision.type), m_batch_size, m_density_grid_interval);
+		m_decisions.push_back(decision);
+	}
+}
+
+void TrainingScheduler::check_budgets() {
+	if (done()) {
+		return;
+	}
+
+	if (m_config.step_budget > 0 && n_steps_done() >= m_config.step_budget) {
+		stop(ETrainingStopReason::StepBudget, fmt::format("{} steps", n_steps_done()));
+	} else if (m_config.time_budget_seconds > 0.0 && m_elapsed_seconds >= m_config.time_budget_seconds) {
+		stop(ETrainingStopReason::TimeBudget, fmt::format("{:.1f}s", m_elapsed_seconds));
+	}
+}
+
+NGP_NAMESPACE_END
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   adaptive_sampling.cpp
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Host tests of the adaptive sampling tile scheduler.
+ */
+
+#include "test_common.h"
+
+#include <neural-graphics-primitives/adaptive_sampling.h>
+
+using namespace ngp;
+
+namespace {
+
+struct Pixels {
+	Pixels(const ivec2& res, float m, float m2, uint32_t count)
+	: resolution{res}, mean(compMul(res), m), second_moment(compMul(res), m2), n(compMul(res), count) {}
+
+	void set(int x, int y, float m, float m2, uint32_t count) {
+		size_t idx = x + (size_t)y * resolution.x;
+		mean[idx] = m;
+		second_moment[idx] = m2;
+		n[idx] = count;
+	}
+
+	uint32_t active_tiles(const AdaptiveSamplingSettings& settings, std::vector<uint8_t>& tile_active) const {
+		return compute_active_tiles(resolution, mean.data(), second_moment.data(), n.data(), settings, tile_active);
+	}
+
+	ivec2 resolution;
+	std::vector<float> mean;
+	std::vector<float> second_moment;
+	std::vector<uint32_t> n;
+};
+
+AdaptiveSamplingSettings test_settings(uint32_t tile_size) {
+	AdaptiveSamplingSettings settings;
+	settings.enabled = true;
+	settings.tile_size = tile_size;
+	settings.min_spp = 4;
+	settings.max_spp = 64;
+	settings.relative_variance_threshold = 1e-3f;
+	return settings;
+}
+
+}
+
+int main() {
+	// Partial tiles at the right and bottom borders count as tiles of their own.
+	NGP_CHECK(adaptive_tile_resolution({5, 3}, 2) == ivec2(3, 2));
+	NGP_CHECK(adaptive_tile_resolution({4, 4}, 2) == ivec2(2, 2));
+	NGP_CHECK(adaptive_tile_resolution({1, 1}, 16) == ivec2(1, 1));
+	NGP_CHECK_THROWS(adaptive_tile_resolution({4, 4}, 0));
+
+	std::vector<uint8_t> tile_active;
+
+	// Pixels at the maximum sample count are converged regardless of their variance.
+	{
+		Pixels pixels{{5, 3}, 0.5f, 1.0f, 64};
+		NGP_CHECK(pixels.active_tiles(test_settings(2), tile_active) == 0);
+		NGP_CHECK(tile_active.size() == 6);
+	}
+
+	// A single noisy pixel in the partial corner tile activates only that tile.
+	{
+		Pixels pixels{{5, 3}, 0.5f, 0.25f, 16};
+		pixels.set(4, 2, 0.5f, 1.0f, 16);
+		NGP_CHECK(pixels.active_tiles(test_settings(2), tile_active) == 1);
+		NGP_CHECK(tile_active == std::vector<uint8_t>({0, 0, 0, 0, 0, 1}));
+	}
+
+	// Pixels below the minimum sample count stay active even without variance.
+	{
+		Pixels pixels{{4, 4}, 0.5f, 0.25f, 16};
+		pixels.set(0, 3, 0.5f, 0.25f, 3);
+		pixels.set(1, 2, 0.5f, 0.25f, 2);
+		NGP_CHECK(pixels.active_tiles(test_settings(2), tile_active) == 1);
+		NGP_CHECK(tile_active == std::vector<uint8_t>({0, 0, 1, 0}));
+	}
+
+	// The threshold applies to the variance of the mean, which shrinks with the sample count.
+	{
+		// Variance 0.01 at luminance 0.5, such that the relative variance of the mean is about 0.04 / n.
+		Pixels pixels{{2, 1}, 0.5f, 0.26f, 16};
+		NGP_CHECK(pixels.active_tiles(test_settings(1), tile_active) == 2);
+
+		pixels.set(1, 0, 0.5f, 0.26f, 63);
+		NGP_CHECK(pixels.active_tiles(test_settings(1), tile_active) == 1);
+		NGP_CHECK(tile_active == std::vector<uint8_t>({1, 0}));
+	}
+
+	// Expanding the tiles yields the per-pixel mask of exactly the pixels in active tiles.
+	{
+		std::vector<uint8_t> pixel_mask;
+		expand_tile_mask({5, 3}, 2, {1, 0, 0, 0, 0, 1}, pixel_mask);
+		NGP_CHECK(pixel_mask == std::vector<uint8_t>({
+			1, 1, 0, 0, 0,
+			1, 1, 0, 0, 0,
+			0, 0, 0, 0, 1,
+		}));
+	}
+
+	return ngp_test_result();
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   test_common.h
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Minimal checks for the host tests. A failed check is logged and fails the test, but the remaining
+ *          checks still run.
+ */
+
+#pragma once
+
+#include <neural-graphics-primitives/common.h>
+
+#include <stdexcept>
+
+inline int& ngp_test_n_failures() {
+	static int n_failures = 0;
+	return n_failures;
+}
+
+inline int ngp_test_result() {
+	if (ngp_test_n_failures() > 0) {
+		tlog::error() << ngp_test_n_failures() << " check(s) failed.";
+		return 1;
+	}
+
+	tlog::success() << "All checks passed.";
+	return 0;
+}
+
+#define NGP_CHECK(x) \
+	do { \
+		if (!(x)) { \
+			tlog::error() << __FILE__ << ":" << __LINE__ << ": check failed: " #x; \
+			++ngp_test_n_failures(); \
+		} \
+	} while (0)
+
+#define NGP_CHECK_THROWS(x) \
+	do { \
+		bool threw = false; \
+		try { \
+			(void)(x); \
+		} catch (const std::runtime_error&) { \
+			threw = true; \
+		} \
+		NGP_CHECK(threw && "expected " #x " to throw"); \
+	} while (0)
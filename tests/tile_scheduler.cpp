@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2020-2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/** @file   tile_scheduler.cpp
+ *  @author Thomas Müller, NVIDIA
+ *  @brief  Host tests of the ordering and budget policy of the progressive tile scheduler.
+ */
+
+#include "test_common.h"
+
+#include <neural-graphics-primitives/tile_scheduler.h>
+
+using namespace ngp;
+
+using Tiles = std::vector<uint32_t>;
+
+int main() {
+	NGP_CHECK_THROWS(ProgressiveTileScheduler{}.reset({4, 4}, 0, {0.5f, 0.5f}, 1));
+
+	// Partial tiles at the borders only count their own pixels.
+	{
+		ProgressiveTileScheduler scheduler;
+		scheduler.reset({5, 3}, 2, {0.5f, 0.5f}, 1);
+		NGP_CHECK(scheduler.tile_resolution() == ivec2(3, 2));
+		NGP_CHECK(scheduler.n_tiles() == 6);
+		NGP_CHECK(scheduler.tile_n_pixels(0) == 4);
+		NGP_CHECK(scheduler.tile_n_pixels(2) == 2);
+		NGP_CHECK(scheduler.tile_n_pixels(5) == 1);
+	}
+
+	// Tiles are handed out from the fovea outwards; equidistant tiles in scanline order. Without a measurement, a
+	// frame renders a single tile, and every frame afterwards renders at most twice the pixels of the previous one.
+	{
+		ProgressiveTileScheduler scheduler;
+		scheduler.reset({6, 6}, 2, {0.5f, 0.5f}, 1);
+
+		NGP_CHECK(scheduler.next_tiles(16.0f) == Tiles({4}));
+		scheduler.report_frame_time(0.0f);
+		NGP_CHECK(scheduler.next_tiles(16.0f) == Tiles({1, 3}));
+		scheduler.report_frame_time(0.0f);
+		NGP_CHECK(scheduler.next_tiles(16.0f) == Tiles({5, 7, 0, 2}));
+		scheduler.report_frame_time(0.0f);
+		NGP_CHECK(scheduler.next_tiles(16.0f) == Tiles({6, 8}));
+		scheduler.report_frame_time(0.0f);
+
+		NGP_CHECK(scheduler.finished());
+		NGP_CHECK(scheduler.next_tiles(16.0f).empty());
+		NGP_CHECK(scheduler.tile_mask({1, 3}) == std::vector<uint8_t>({0, 1, 0, 1, 0, 0, 0, 0, 0}));
+	}
+
+	// The cost model limits the tiles to the frame budget, but a frame always renders at least one tile and never
+	// more than one pass, such that no tile gets a second sample before every tile got its first.
+	{
+		ProgressiveTileScheduler scheduler;
+		scheduler.reset({4, 4}, 2, {0.0f, 0.0f}, 2);
+
+		NGP_CHECK(scheduler.next_tiles(16.0f) == Tiles({0}));
+		scheduler.report_frame_time(1.0f);
+		NGP_CHECK(scheduler.ms_per_pixel() == 0.25f);
+
+		// Two more tiles would fit the pixel limit, but cost 2 ms.
+		NGP_CHECK(scheduler.next_tiles(1.5f) == Tiles({1}));
+		scheduler.report_frame_time(1.0f);
+		NGP_CHECK(scheduler.next_tiles(0.0f) == Tiles({2}));
+		scheduler.report_frame_time(1.0f);
+		NGP_CHECK(scheduler.next_tiles(100.0f) == Tiles({3, 0}));
+		scheduler.report_frame_time(2.0f);
+		NGP_CHECK(scheduler.next_tiles(100.0f) == Tiles({1, 2, 3}));
+
+		NGP_CHECK(scheduler.finished());
+		for (uint32_t i = 0; i < scheduler.n_tiles(); ++i) {
+			NGP_CHECK(scheduler.tile_spp(i) == 2);
+		}
+	}
+
+	// A reset cancels the scheduled tiles, but keeps the cost model. Frame times that arrive after it belong to the
+	// previous accumulation and are ignored.
+	{
+		ProgressiveTileScheduler scheduler;
+		scheduler.reset({4, 4}, 2, {0.0f, 0.0f}, 4);
+		uint64_t generation = scheduler.generation();
+
+		scheduler.next_tiles(16.0f);
+		scheduler.report_frame_time(1.0f);
+		scheduler.next_tiles(16.0f);
+
+		scheduler.reset({4, 4}, 2, {1.0f, 1.0f}, 4);
+		NGP_CHECK(scheduler.generation() == generation + 1);
+		NGP_CHECK(scheduler.tile_spp(0) == 0);
+
+		scheduler.report_frame_time(1000.0f);
+		NGP_CHECK(scheduler.ms_per_pixel() == 0.25f);
+		NGP_CHECK(scheduler.next_tiles(100.0f) == Tiles({3, 1}));
+	}
+
+	return ngp_test_result();
+}